@@ -1,4 +1,5 @@
 #cmake -S . -B build -DBUILD_TESTING=OFF #Отключение тестов
+#cmake -S . -B build -DPGW_BUILD_BENCHMARKS=ON #Сборка бенчмарков (pgw_server/bench)
 cmake -S . -B build
 cmake --build build
 
@@ -0,0 +1,44 @@
+#ifndef IO_UTILS_COARSE_CLOCK
+#define IO_UTILS_COARSE_CLOCK
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+
+namespace IO_Utils
+{
+    // Грубые часы для горячего пути: хранят последние прочитанные значения steady_clock и system_clock,
+    // чтобы не обращаться к системным часам на каждую операцию с сессией или строку CDR журнала.
+    // Значения обновляет тикер с выбранной точностью, дополнительно их может обновлять IO цикл раз в пачку событий.
+    // Пока не запущен ни один тикер, steady_now и system_now читают настоящие часы
+    class Coarse_Clock
+    {
+        static std::atomic<int64_t> steady_ns;
+        static std::atomic<int64_t> system_ns;
+        static std::atomic<size_t> active_tickers;
+
+    public:
+        // Перечитать настоящие часы и опубликовать новые значения
+        static void tick() noexcept;
+
+        static std::chrono::steady_clock::time_point steady_now() noexcept;
+        static std::chrono::system_clock::time_point system_now() noexcept;
+
+        // Поток, обновляющий часы раз в precision, пока существует объект
+        class Ticker
+        {
+            std::atomic<bool> stop{false};
+            std::thread thread;
+
+        public:
+            explicit Ticker(std::chrono::microseconds precision);
+            ~Ticker();
+
+            Ticker(const Ticker &) = delete;
+            Ticker &operator=(const Ticker &) = delete;
+        };
+    };
+}
+
+#endif // IO_UTILS_COARSE_CLOCK
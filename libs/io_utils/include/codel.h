@@ -0,0 +1,83 @@
+#ifndef IO_UTILS_CODEL
+#define IO_UTILS_CODEL
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+namespace IO_Utils
+{
+    // Защита от перегрузки входной очереди по времени ожидания в ней (CoDel в варианте для запросов).
+    // Перегрузка - постоянная очередь: очередь не опустошалась дольше interval. Без нее запрос может ждать
+    // до interval, при ней только до target, а более старые запросы потребитель не обрабатывает и отвечает
+    // коротким отказом, потому что клиент их скорее всего уже повторил.
+    // Чтобы отказ стоил меньше, при постоянной очереди производитель отказывает входящим сразу, если очередь
+    // длиннее, чем потребитель успевает разобрать за target (по среднему времени обработки запроса).
+    // Классический закон CoDel (частота отказов растет как sqrt(n)) рассчитан на TCP, который сам снижает
+    // скорость; UDP клиенты этого не делают, поэтому порог по длине очереди. Он держит ожидание около target
+    // без колебаний: очередь не опустошается, пока нагрузка выше пропускной способности, и выход из
+    // перегрузки происходит только когда она действительно закончилась.
+    // Методы потребителя и производителя вызываются каждый из своего единственного потока
+    class Codel_Controller
+    {
+    public:
+        struct Options
+        {
+            std::chrono::nanoseconds target = std::chrono::milliseconds(5);
+            std::chrono::nanoseconds interval = std::chrono::milliseconds(100);
+        };
+
+        Codel_Controller();
+        explicit Codel_Controller(Options options);
+
+        // Потребитель: очередь оказалась пустой
+        void queue_empty() noexcept
+        {
+            empty_seen = true;
+            if (standing.load(std::memory_order_relaxed))
+                standing.store(false, std::memory_order_relaxed);
+        }
+        // Потребитель: запрос ждал sojourn_ns, false - ответить отказом вместо обработки
+        bool admit(int64_t sojourn_ns, int64_t now_ns) noexcept;
+
+        // Производитель: true - отказать входящему запросу сразу. queued - текущая длина очереди
+        bool shed_incoming(size_t queued) const noexcept
+        {
+            return queued != 0 && standing.load(std::memory_order_relaxed) && queued >= queue_limit.load(std::memory_order_relaxed);
+        }
+
+        // Для метрик, из любого потока
+        int64_t last_sojourn_ns() const noexcept
+        {
+            return last_sojourn.load(std::memory_order_relaxed);
+        }
+        bool overloaded() const noexcept
+        {
+            return standing.load(std::memory_order_relaxed);
+        }
+        // Длина очереди, которую потребитель разбирает за target
+        size_t target_queue_length() const noexcept
+        {
+            return queue_limit.load(std::memory_order_relaxed);
+        }
+
+    private:
+        int64_t target_ns;
+        int64_t interval_ns;
+
+        // Состояние потребителя
+        bool empty_seen = true;
+        int64_t last_empty_ns = 0;
+        int64_t last_admit_ns = 0;
+        // Среднее время между запросами при непустой очереди, то есть время обработки, в 1/8 нс
+        int64_t service_ns_x8 = 0;
+
+        // Публикуется потребителем
+        std::atomic<bool> standing{false};
+        std::atomic<int64_t> last_sojourn{0};
+        std::atomic<size_t> queue_limit;
+    };
+}
+
+#endif // IO_UTILS_CODEL
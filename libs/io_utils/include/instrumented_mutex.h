@@ -0,0 +1,181 @@
+#ifndef IO_UTILS_INSTRUMENTED_MUTEX
+#define IO_UTILS_INSTRUMENTED_MUTEX
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <shared_mutex>
+#include <string>
+#include <vector>
+
+// Отладочная сборка (CMake опция IO_UTILS_LOCK_CALL_SITES=ON): при каждом ожидании блокировки
+// запоминается стек вызова, чтобы найти места, которые ждут дольше всего
+#ifndef IO_UTILS_LOCK_CALL_SITES
+#define IO_UTILS_LOCK_CALL_SITES 0
+#endif
+
+namespace IO_Utils
+{
+    // Снимок статистики одного мьютекса, время в нс
+    struct Lock_Stats
+    {
+        struct Mode
+        {
+            uint64_t acquisitions = 0;
+            // Сколько захватов не удалось сразу и пришлось ждать
+            uint64_t contended = 0;
+            uint64_t wait_ns = 0;
+            uint64_t max_wait_ns = 0;
+            // Время удержания замеряется только у каждого HOLD_SAMPLE_PERIOD захвата
+            uint64_t sampled_holds = 0;
+            uint64_t hold_ns = 0;
+            uint64_t max_hold_ns = 0;
+        };
+
+        Mode shared;
+        Mode exclusive;
+    };
+
+    // std::shared_mutex со статистикой, подходит для std::unique_lock и std::shared_lock.
+    // Сначала пробуется try_lock: если мьютекс свободен, ожидания нет и часы не читаются, поэтому счетчики
+    // ожиданий точные, а их замер не стоит ничего на быстром пути. Удержание замеряется выборочно.
+    // Счетчики монопольных захватов меняются только под монопольной блокировкой (одним потоком). Общие захваты
+    // считаются в ячейках по потокам (каждая в своей кэш-линии) и суммируются при чтении, поэтому читатели
+    // не пишут в одну линию; ожидания и удержания общих захватов редки и считаются атомарно в общих счетчиках
+    class Instrumented_Shared_Mutex
+    {
+    public:
+        static constexpr uint32_t HOLD_SAMPLE_PERIOD = 64;
+        // Ячейки счетчика общих захватов: потоки раскладываются по ним по кругу в порядке первого захвата
+        static constexpr size_t SHARED_SLOTS = 16;
+
+        void lock()
+        {
+            if (!mutex.try_lock())
+                lock_contended();
+
+            increment(exclusive_counters.acquisitions, 1);
+            if (sample_hold())
+                exclusive_hold_start = now_ns();
+        }
+
+        bool try_lock()
+        {
+            if (!mutex.try_lock())
+                return false;
+
+            increment(exclusive_counters.acquisitions, 1);
+            return true;
+        }
+
+        void unlock()
+        {
+            if (exclusive_hold_start != 0)
+                record_exclusive_hold();
+
+            mutex.unlock();
+        }
+
+        void lock_shared()
+        {
+            if (!mutex.try_lock_shared())
+                lock_shared_contended();
+
+            shared_slots[shared_slot].acquisitions.fetch_add(1, std::memory_order_relaxed);
+            if (shared_hold_owner == nullptr && sample_hold())
+            {
+                shared_hold_owner = this;
+                shared_hold_start = now_ns();
+            }
+        }
+
+        bool try_lock_shared()
+        {
+            if (!mutex.try_lock_shared())
+                return false;
+
+            shared_slots[shared_slot].acquisitions.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+
+        void unlock_shared()
+        {
+            if (shared_hold_owner == this)
+                record_shared_hold();
+
+            mutex.unlock_shared();
+        }
+
+        Lock_Stats stats() const;
+
+        struct Call_Site
+        {
+            // Адреса возврата, по одному в строке, с именами функций, если они есть в таблице символов (-rdynamic)
+            std::string frames;
+            uint64_t waits;
+            uint64_t wait_ns;
+        };
+
+        // Места, дольше всего ждавшие любой Instrumented_Shared_Mutex, по убыванию общего времени ожидания.
+        // Пусто, если сборка без IO_UTILS_LOCK_CALL_SITES
+        static std::vector<Call_Site> top_call_sites(size_t count);
+
+    private:
+        struct Mode_Counters
+        {
+            std::atomic<uint64_t> acquisitions{0};
+            std::atomic<uint64_t> contended{0};
+            std::atomic<uint64_t> wait_ns{0};
+            std::atomic<uint64_t> max_wait_ns{0};
+            std::atomic<uint64_t> sampled_holds{0};
+            std::atomic<uint64_t> hold_ns{0};
+            std::atomic<uint64_t> max_hold_ns{0};
+        };
+
+        // Ячейку пишет в основном один поток, fetch_add без соперников не гоняет линию между ядрами
+        struct alignas(64) Shared_Slot
+        {
+            std::atomic<uint64_t> acquisitions{0};
+        };
+
+        std::shared_mutex mutex;
+        Mode_Counters exclusive_counters;
+        // acquisitions общих захватов не используется, они в shared_slots
+        Mode_Counters shared_counters;
+        Shared_Slot shared_slots[SHARED_SLOTS];
+        // Начало выбранного для замера монопольного удержания, пишет только владелец, 0 - не замеряется
+        int64_t exclusive_hold_start = 0;
+
+        // Выбор каждого HOLD_SAMPLE_PERIOD захвата потока и замеряемое общее удержание потока (одно за раз)
+        static inline thread_local uint32_t sample_tick = 0;
+        static inline thread_local const Instrumented_Shared_Mutex *shared_hold_owner = nullptr;
+        static inline thread_local int64_t shared_hold_start = 0;
+
+        static inline std::atomic<size_t> next_shared_slot{0};
+        static inline thread_local size_t shared_slot = next_shared_slot.fetch_add(1, std::memory_order_relaxed) % SHARED_SLOTS;
+
+        static bool sample_hold() noexcept
+        {
+            return ++sample_tick % HOLD_SAMPLE_PERIOD == 0;
+        }
+
+        static int64_t now_ns() noexcept
+        {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+        }
+
+        // Увеличение без lock-префикса, только для счетчиков, которые меняются под монопольной блокировкой
+        static void increment(std::atomic<uint64_t> &counter, uint64_t value) noexcept
+        {
+            counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+        }
+
+        void lock_contended();
+        void lock_shared_contended();
+        void record_exclusive_hold();
+        void record_shared_hold();
+    };
+}
+
+#endif // IO_UTILS_INSTRUMENTED_MUTEX
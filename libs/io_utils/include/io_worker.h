@@ -1,6 +1,8 @@
 #ifndef IO_UTILS_WORKER
 #define IO_UTILS_WORKER
 
+#include "codel.h"
+#include "log_throttle.h"
 #include "registrar.h"
 #include "network_io.h"
 #include "queue.h"
@@ -24,11 +26,80 @@ namespace IO_Utils
         std::unordered_map<int, std::unique_ptr<Connection>> connections;
         std::unordered_map<int, std::shared_ptr<Socket>> client_sockets;
 
+        // HTTP ответ, который не ушел за один раз (большое тело или файл). Он досылается по EPOLLOUT,
+        // а следующий ответ тому же клиенту ждет, пока этот не уйдет целиком
+        struct Pending_Send
+        {
+            std::unique_ptr<Packet> packet;
+            size_t sent;
+        };
+        std::unordered_map<int, Pending_Send> pending_sends;
+
+        // HTTP запросы, пришедшие не целиком (длинное тело), дочитываются по следующим EPOLLIN
+        std::unordered_map<int, std::unique_ptr<Packet>> partial_requests;
+
+        // Предупреждения, которые при перегрузке повторялись бы на каждый пакет или подключение
+        Log_Throttle udp_in_full_log{"UDP in_queue is FULL"};
+        Log_Throttle http_in_full_log{"HTTP in_queue is FULL"};
+        Log_Throttle udp_error_log{"Trouble with UDP packets"};
+        Log_Throttle accept_error_log{"Client accept or register wrong"};
+
+        // Защита udp_in_queue от перегрузки и короткий ответ на отклоненный запрос
+        Codel_Controller *overload_control = nullptr;
+        std::vector<uint8_t> busy_reply;
+
+        // Чтение UDP сокета приостанавливается, когда в udp_in_queue high_watermark пакетов, и возобновляется
+        // на low_watermark: всплеск копится в приемном буфере ядра, а не читается, чтобы тут же быть отброшенным.
+        // 0 - чтение не приостанавливается
+        size_t udp_high_watermark = 0, udp_low_watermark = 0;
+        std::atomic<bool> udp_paused{false};
+        // Последнее значение счетчика отброшенных ядром датаграмм, в метрику идет прирост
+        uint32_t udp_kernel_drops_seen = 0;
+
+        void update_udp_flow_control(size_t queued);
+
+        // Отвечает busy_reply вместо постановки в очередь, если так решил overload_control (queued - длина очереди)
+        bool shed_udp(Packet &packet, size_t queued);
+
+        // Нужно ли ждать продолжения запроса: тело короче Content-Length или заголовки не закончились,
+        // а последнее чтение заполнило буфер целиком (buffer_filled)
+        bool http_request_incomplete(const Packet &packet, bool buffer_filled) const;
+
+        // Отправляет очередную часть ответа, 1 - осталось что досылать, 0 - отправлен, -1 - ошибка
+        int send_http(int fd, Pending_Send &pending);
+
     public:
+        // Сколько байт отправляется одному клиенту за одно событие, чтобы большая загрузка не задерживала остальных клиентов
+        static constexpr size_t MAX_SEND_CHUNK = 256 * 1024;
+        // Сколько байт продолжения запроса читается за одно событие и до какого размера запрос дочитывается
+        static constexpr size_t MAX_RECV_CHUNK = 64 * 1024;
+        static constexpr size_t MAX_HTTP_REQUEST_SIZE = 2 * 1024 * 1024;
+
+        // Пустой http_ip - только UDP (дополнительный конвейер), пустой udp_ip - только HTTP (режим thread_per_core).
+        // udp_reuse_port - UDP сокет в группе SO_REUSEPORT
         IO_Worker(
             std::string udp_ip, uint16_t udp_port,
             std::string http_ip, uint16_t http_port,
-            quill::Logger *logger);
+            quill::Logger *logger,
+            bool udp_reuse_port = false);
+
+        // Включает отказы входящим UDP запросам при перегрузке, вызывается до run.
+        // Потребитель udp_in_queue должен сообщать controller время ожидания запросов
+        void set_overload_control(Codel_Controller *controller, std::vector<uint8_t> busy_reply);
+
+        // Включает приостановку чтения UDP по заполнению udp_in_queue (low_watermark < high_watermark), вызывается до run
+        void set_udp_flow_control(size_t high_watermark, size_t low_watermark);
+        // Размер приемного буфера UDP сокета, возвращает фактический размер или -1
+        int set_udp_receive_buffer(int bytes);
+        // Фильтр UDP датаграмм в ядре (Socket::attach_filter), 0 или -1
+        int set_udp_socket_filter(const std::vector<sock_filter> &program);
+        // Выбор сокета для всей группы SO_REUSEPORT этого UDP сокета (Socket::attach_reuseport_filter), 0 или -1
+        int set_udp_steering_filter(const std::vector<sock_filter> &program);
+        // Для метрик, из любого потока
+        bool udp_reading_paused() const noexcept
+        {
+            return udp_paused.load(std::memory_order_relaxed);
+        }
 
         void run(
             std::atomic<bool> &stop,
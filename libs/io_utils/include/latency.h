@@ -0,0 +1,114 @@
+#ifndef IO_UTILS_LATENCY
+#define IO_UTILS_LATENCY
+
+#include "metrics.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Замеры задержек по этапам обработки пакета. Выключаются при сборке (CMake опция IO_UTILS_LATENCY_TRACKING=OFF),
+// тогда отметки времени и запись в гистограммы компилируются в пустые функции
+#ifndef IO_UTILS_LATENCY_TRACKING
+#define IO_UTILS_LATENCY_TRACKING 1
+#endif
+
+namespace IO_Utils
+{
+    // Моменты прохождения пакетом этапов обработки в нс steady_clock, 0 - этап не отмечен
+    struct Packet_Timestamps
+    {
+        // Сколько пакет пролежал в сокете после приема ядром (SO_TIMESTAMPNS), -1 если неизвестно
+        int64_t kernel_wait_ns = -1;
+        // Первое чтение (для HTTP запроса из нескольких частей - первой части)
+        int64_t received_ns = 0;
+        int64_t enqueued_ns = 0;
+        int64_t dequeued_ns = 0;
+        int64_t handled_ns = 0;
+    };
+
+    // Лог-линейная гистограмма (как HDR): 8 интервалов на каждую степень двойки, то есть ошибка не больше 12.5%
+    // во всем диапазоне от наносекунд до минут. Пишет один поток, читать можно из любого в любой момент
+    class Latency_Histogram
+    {
+    public:
+        static constexpr size_t SUB_BUCKET_BITS = 3;
+        static constexpr size_t SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+        static constexpr size_t BUCKETS = (64 - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+        static size_t bucket_index(uint64_t value) noexcept;
+        // Наибольшее значение, попадающее в интервал
+        static uint64_t bucket_upper_bound(size_t index) noexcept;
+
+        void record(int64_t value) noexcept;
+
+        uint64_t count() const noexcept;
+        uint64_t sum() const noexcept;
+        // Верхняя граница интервала, в который попадает квантиль q (0..1), 0 если значений нет
+        uint64_t quantile(double q) const noexcept;
+
+    private:
+        std::atomic<uint64_t> buckets[BUCKETS]{};
+        std::atomic<uint64_t> total{0};
+        std::atomic<uint64_t> total_sum{0};
+    };
+
+    // Гистограммы задержек по этапам, заполняются только IO потоком в момент отправки ответа
+    class Packet_Latency
+    {
+    public:
+        enum Protocol : size_t
+        {
+            udp,
+            http,
+            PROTOCOLS
+        };
+
+        enum Stage : size_t
+        {
+            // Ожидание в сокете до чтения (только UDP, по времени ядра)
+            socket,
+            // От первого чтения до постановки в очередь (для HTTP - ожидание всех частей запроса)
+            receive,
+            in_queue,
+            handler,
+            // От конца обработки до завершения отправки ответа
+            out_queue,
+            // От первого чтения до завершения отправки ответа
+            total,
+            STAGES
+        };
+
+        static int64_t now_ns() noexcept
+        {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+        }
+
+        static void stamp(int64_t &field) noexcept
+        {
+#if IO_UTILS_LATENCY_TRACKING
+            field = now_ns();
+#else
+            (void)field;
+#endif
+        }
+
+        // Записывает этапы отправленного пакета в гистограммы
+        static void record_sent(const Packet_Timestamps &timestamps, Protocol protocol) noexcept;
+
+        static const Latency_Histogram &histogram(Protocol protocol, Stage stage) noexcept;
+
+        static const char *protocol_name(Protocol protocol) noexcept;
+        static const char *stage_name(Stage stage) noexcept;
+
+        // Значения для Metrics::Collector типа summary: квантили, _sum и _count в секундах по каждому этапу
+        static void collect(Metrics::Samples &samples);
+
+        // Строка для периодической записи в лог: число пакетов, p50, p99 и p99.9 по этапам
+        static std::string summary();
+    };
+}
+
+#endif // IO_UTILS_LATENCY
@@ -0,0 +1,66 @@
+#ifndef IO_UTILS_LOG_THROTTLE
+#define IO_UTILS_LOG_THROTTLE
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+namespace IO_Utils
+{
+    // Ограничитель частоты сообщений одного места в коде (переполненная очередь, ошибка на каждый пакет).
+    // За окно window пропускается не больше burst сообщений, остальные только считаются. Первое пропущенное
+    // сообщение следующего окна сообщает, сколько было подавлено, поэтому при непрерывном потоке сводка
+    // выходит раз в окно. Можно вызывать из нескольких потоков, время берется из Coarse_Clock
+    class Log_Throttle
+    {
+        const char *site_name;
+        int64_t window_ns;
+        uint64_t burst;
+
+        std::atomic<int64_t> window_start_ns;
+        std::atomic<uint64_t> window_count{0};
+        std::atomic<uint64_t> suppressed{0};
+        // Последний пропущенный ключ и время, с которого его повторы подавляются
+        std::atomic<uint64_t> last_key{0};
+        std::atomic<int64_t> last_key_ns;
+
+        bool allow_at(int64_t now, uint64_t &suppressed_before) noexcept;
+
+    public:
+        static constexpr std::chrono::milliseconds DEFAULT_WINDOW{1000};
+        static constexpr uint64_t DEFAULT_BURST = 10;
+
+        // site - строковый литерал, которым подписывается сводка
+        explicit Log_Throttle(const char *site, std::chrono::milliseconds window = DEFAULT_WINDOW, uint64_t burst = DEFAULT_BURST);
+
+        Log_Throttle(const Log_Throttle &) = delete;
+        Log_Throttle &operator=(const Log_Throttle &) = delete;
+
+        // true, если сообщение нужно писать, suppressed_before - сколько подавлено с прошлого пропущенного
+        bool allow(uint64_t &suppressed_before) noexcept;
+        // То же, но повтор ключа предыдущего пропущенного сообщения в пределах окна подавляется сразу
+        // (например, один и тот же IMSI раз за разом)
+        bool allow(uint64_t key, uint64_t &suppressed_before) noexcept;
+
+        const char *site() const noexcept
+        {
+            return site_name;
+        }
+    };
+}
+
+// Обертка над макросом логгера: аргументы сообщения вычисляются, только если оно пропущено,
+// перед ним тем же уровнем пишется сводка о подавленных
+#define IO_UTILS_LOG_THROTTLED(throttle, LOG_MACRO, logger, fmt, ...)                                                \
+    do                                                                                                               \
+    {                                                                                                                \
+        uint64_t io_utils_suppressed = 0;                                                                            \
+        if ((throttle).allow(io_utils_suppressed))                                                                   \
+        {                                                                                                            \
+            if (io_utils_suppressed != 0)                                                                            \
+                LOG_MACRO(logger, "{} similar messages suppressed: {}", io_utils_suppressed, (throttle).site());     \
+            LOG_MACRO(logger, fmt __VA_OPT__(, ) __VA_ARGS__);                                                       \
+        }                                                                                                            \
+    } while (0)
+
+#endif // IO_UTILS_LOG_THROTTLE
@@ -0,0 +1,81 @@
+#ifndef IO_UTILS_METRICS
+#define IO_UTILS_METRICS
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace IO_Utils
+{
+    // Метрики процесса в текстовом формате Prometheus.
+    // Счетчики горячего пути (counter/add) у каждого потока свои, в отдельном выровненном по кэш-линии блоке:
+    // поток увеличивает только свое значение обычными load/store без lock-префикса, а сумма по потокам
+    // считается только при запросе метрик. Значения завершившихся потоков переносятся в общий итог.
+    // Все остальное (глубина очередей, число сессий, статистика журнала) снимается в момент запроса через Collector
+    class Metrics
+    {
+    public:
+        using Id = size_t;
+        // Одно значение: метки ("queue=\"udp_in\"", пустая строка - без меток), само значение
+        // и окончание имени для составных типов (_sum и _count у summary)
+        struct Sample
+        {
+            std::string labels;
+            double value;
+            std::string suffix;
+
+            Sample(std::string labels, double value, std::string suffix = "")
+                : labels(std::move(labels)), value(value), suffix(std::move(suffix)) {}
+        };
+        using Samples = std::vector<Sample>;
+
+        static constexpr size_t MAX_COUNTERS = 64;
+
+        struct alignas(64) Thread_Counters
+        {
+            std::atomic<uint64_t> values[MAX_COUNTERS]{};
+        };
+
+        // Регистрирует счетчик name{labels}, повторная регистрация с теми же именем и метками вернет тот же Id.
+        // Счетчики регистрируются при старте (обычно статическими переменными), std::length_error если их больше MAX_COUNTERS
+        static Id counter(const std::string &name, const std::string &help, const std::string &labels = "");
+
+        static void add(Id id, uint64_t value = 1) noexcept
+        {
+            Thread_Counters *counters = current != nullptr ? current : register_thread();
+            std::atomic<uint64_t> &counter = counters->values[id];
+            counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+        }
+
+        // Сумма счетчика по всем потокам
+        static uint64_t value(Id id);
+
+        // Значения, которые снимаются при запросе метрик, пока существует объект
+        class Collector
+        {
+            size_t id;
+
+        public:
+            // type - "counter", "gauge" или "summary", collect дописывает значения в Samples
+            Collector(const std::string &name, const std::string &help, const std::string &type, std::function<void(Samples &)> collect);
+            ~Collector();
+
+            Collector(const Collector &) = delete;
+            Collector &operator=(const Collector &) = delete;
+        };
+
+        // Дописывает в out все метрики, по HELP и TYPE на каждое имя
+        static void render(std::string &out);
+
+    private:
+        static inline thread_local Thread_Counters *current = nullptr;
+
+        static Thread_Counters *register_thread();
+    };
+}
+
+#endif // IO_UTILS_METRICS
@@ -0,0 +1,121 @@
+#ifndef IO_UTILS_MPSC_RING
+#define IO_UTILS_MPSC_RING
+
+#include <atomic>
+#include <memory>
+#include <cstdint>
+#include <type_traits>
+
+namespace IO_Utils
+{
+    // Кольцевой буфер фиксированного размера для многих писателей и одного читателя.
+    // В отличие от Queue хранит элементы по значению, поэтому подходит для небольших записей фиксированного размера.
+    // У каждой ячейки свой счетчик последовательности: писатель резервирует позицию через CAS на tail,
+    // копирует элемент и публикует ячейку, читатель забирает ячейки строго по порядку
+    template <typename T>
+    class MPSC_Ring
+    {
+        static_assert(std::is_trivially_copyable_v<T>, "T должен копироваться побайтово");
+
+        struct Cell
+        {
+            std::atomic<size_t> sequence;
+            T data;
+        };
+
+        size_t capacity;
+        size_t mask;
+        std::unique_ptr<Cell[]> cells;
+
+        alignas(64) std::atomic<size_t> tail{0};
+        // Используется только читателем
+        alignas(64) size_t head = 0;
+
+        static size_t round_up_to_power_of_two(size_t size)
+        {
+            size_t result = 1;
+            while (result < size)
+                result <<= 1;
+            return result;
+        }
+
+    public:
+        // Размер округляется вверх до степени двойки
+        explicit MPSC_Ring(size_t size) : capacity(round_up_to_power_of_two(size < 2 ? 2 : size)),
+                                          mask(capacity - 1),
+                                          cells(new Cell[capacity])
+        {
+            for (size_t i = 0; i < capacity; ++i)
+            {
+                cells[i].sequence.store(i, std::memory_order_relaxed);
+            }
+        }
+
+        // Если буфер заполнен, возвращает false и ничего не записывает
+        bool try_push(const T &elem) noexcept
+        {
+            size_t pos = tail.load(std::memory_order_relaxed);
+            Cell *cell;
+
+            while (true)
+            {
+                cell = &cells[pos & mask];
+                size_t sequence = cell->sequence.load(std::memory_order_acquire);
+                intptr_t diff = (intptr_t)sequence - (intptr_t)pos;
+
+                if (diff == 0)
+                {
+                    if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                        break;
+                }
+                else if (diff < 0)
+                {
+                    // Ячейку еще не освободил читатель, значит буфер заполнен
+                    return false;
+                }
+                else
+                {
+                    pos = tail.load(std::memory_order_relaxed);
+                }
+            }
+
+            cell->data = elem;
+            cell->sequence.store(pos + 1, std::memory_order_release);
+
+            return true;
+        }
+
+        // Должен вызываться только одним потоком. Если буфер пуст, возвращает false
+        bool try_pop(T &elem) noexcept
+        {
+            Cell &cell = cells[head & mask];
+            size_t sequence = cell.sequence.load(std::memory_order_acquire);
+
+            // Ячейка пуста или писатель еще не закончил ее заполнять
+            if ((intptr_t)sequence - (intptr_t)(head + 1) < 0)
+                return false;
+
+            elem = cell.data;
+            cell.sequence.store(head + capacity, std::memory_order_release);
+            ++head;
+
+            return true;
+        }
+
+        // Число позиций, зарезервированных писателями за все время
+        size_t pushed() const noexcept
+        {
+            return tail.load(std::memory_order_acquire);
+        }
+
+        size_t get_capacity() const noexcept
+        {
+            return capacity;
+        }
+
+        MPSC_Ring(const MPSC_Ring &) = delete;
+        MPSC_Ring &operator=(const MPSC_Ring &) = delete;
+    };
+}
+
+#endif // IO_UTILS_MPSC_RING
@@ -1,7 +1,12 @@
 #ifndef IO_UTILS_NETWORK_IO
 #define IO_UTILS_NETWORK_IO
 
+#include "latency.h"
+#include "trace.h"
+
 #include <cstdint>
+#include <linux/filter.h>
+#include <sys/types.h>
 #include <vector>
 #include <string>
 #include <memory>
@@ -25,14 +30,27 @@ namespace IO_Utils{
         virtual ~Socket() = default;
 
         static int make_ip_address(std::string IP, uint32_t& ip);
+        //Размер приемного буфера сокета в байтах, возвращает фактический размер (ядро удваивает запрошенный
+        //и ограничивает net.core.rmem_max, если нет CAP_NET_ADMIN) или -1
+        static int set_receive_buffer(int fd, int bytes);
+        //Классический BPF фильтр (SO_ATTACH_FILTER): датаграммы, которые он отвергает, ядро отбрасывает
+        //до постановки в приемный буфер. Пустая программа снимает фильтр
+        static int attach_filter(int fd, const std::vector<sock_filter>& program);
+        //Классический BPF выбора сокета в группе SO_REUSEPORT (SO_ATTACH_REUSEPORT_CBPF): программа возвращает
+        //номер сокета в порядке привязки к адресу, номер вне группы - выбор ядром по хешу адресов
+        static int attach_reuseport_filter(int fd, const std::vector<sock_filter>& program);
     };
 
     class UDP_Socket : public Socket{
     public:
         UDP_Socket() : Socket(){}
         UDP_Socket(uint32_t ip, uint16_t port) : Socket(ip, port){}
+        UDP_Socket(uint32_t ip, uint16_t port, bool reuse_port) : Socket(ip, port), reuse_port(reuse_port){}
 
         int listen_or_bind() override;
+
+        //Несколько сокетов на одном адресе (SO_REUSEPORT), ядро распределяет датаграммы между ними
+        bool reuse_port = false;
     };
 
     class TCP_Socket : public Socket{
@@ -73,6 +91,10 @@ namespace IO_Utils{
 
         int send_packet(const Packet& packet) override;
         int recv_packet(Packet& packet) override;
+
+        //Датаграммы, отброшенные ядром из-за переполнения приемного буфера сокета или фильтром сокета (SO_RXQ_OVFL).
+        //Счетчик ядра накопительный с момента создания сокета, обновляется с каждой принятой датаграммой
+        uint32_t kernel_drops = 0;
     };
 
     class TCP_Connection : public Connection{
@@ -81,6 +103,14 @@ namespace IO_Utils{
 
         int send_packet(const Packet& packet) override;
         int recv_packet(Packet& packet) override;
+
+        //Продолжает отправку пакета с байта sent (сначала data, затем file_body) на неблокирующий сокет,
+        //отправляя не больше max_bytes за вызов. sent увеличивается на отправленное.
+        //1 - отправлено не все (буфер сокета заполнен или исчерпан max_bytes), 0 - пакет отправлен целиком, -1 - ошибка
+        int send_partial(const Packet& packet, size_t& sent, size_t max_bytes);
+
+        //Дописывает в конец data пакета не больше max_bytes, возвращает число прочитанных байт (0 - соединение закрыто) или -1
+        int recv_append(Packet& packet, size_t max_bytes);
     };
 
     class HTTP_Connection : public TCP_Connection{
@@ -93,6 +123,27 @@ namespace IO_Utils{
         int recv_packet(Packet& packet) override{
             return TCP_Connection::recv_packet(packet);
         }
+
+        static constexpr size_t HEADERS_INCOMPLETE = SIZE_MAX;
+
+        //Сколько байт запроса в data еще не пришло: 0 - запрос целиком (или Content-Length не понят, тогда решает обработчик),
+        //HEADERS_INCOMPLETE - заголовки еще не закончились, иначе недостающая часть тела по Content-Length
+        static size_t missing_bytes(const std::vector<uint8_t>& data);
+    };
+
+    //Тело ответа из файла, которое отправляется после data через sendfile, минуя память процесса.
+    //Владеет дескриптором и закрывает его, поэтому пакеты с ним можно копировать
+    class File_Body{
+    public:
+        File_Body(int fd, off_t offset, size_t length) : fd(fd), offset(offset), length(length){}
+        ~File_Body();
+
+        File_Body(const File_Body&) = delete;
+        File_Body& operator=(const File_Body&) = delete;
+
+        int fd;
+        off_t offset;
+        size_t length;
     };
 
     class Packet{
@@ -105,6 +156,12 @@ namespace IO_Utils{
         virtual void set_socket(std::shared_ptr<Socket> socket) {this->socket = socket;}
 
         std::vector<uint8_t> data;
+        //Необязательное продолжение data из файла, только для TCP
+        std::shared_ptr<File_Body> file_body;
+        //Отметки времени этапов обработки для гистограмм задержек, ответ наследует их от запроса
+        Packet_Timestamps timestamps;
+        //Номер запроса в выборке трассировки, ответ тоже наследует его
+        Trace_Context trace;
     };
 
     class UDP_Packet : public Packet{
@@ -0,0 +1,58 @@
+#ifndef IO_UTILS_PERF_PROFILER
+#define IO_UTILS_PERF_PROFILER
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+
+namespace IO_Utils
+{
+    // Самопрофилирование через perf_event_open, без внешнего perf.
+    // Потоки конвейера регистрируются при старте (запоминается только tid и имя, без накладных расходов),
+    // счетчики открываются на время окна записи для каждого зарегистрированного потока отдельно.
+    // Аппаратные счетчики (циклы, инструкции, обращения и промахи кэша) есть не везде, например в виртуальных машинах,
+    // программные (процессорное время потока и переключения контекста) открываются всегда
+    class Perf_Profiler
+    {
+    public:
+        // Регистрирует вызвавший поток на время жизни объекта
+        class Thread_Registration
+        {
+            pid_t tid;
+
+        public:
+            explicit Thread_Registration(const std::string &name);
+            ~Thread_Registration();
+
+            Thread_Registration(const Thread_Registration &) = delete;
+            Thread_Registration &operator=(const Thread_Registration &) = delete;
+        };
+
+        // Значения за окно записи, приведенные к полному окну, если ядро делило счетчики по времени
+        struct Thread_Result
+        {
+            std::string name;
+            pid_t tid;
+            // Открылись ли аппаратные счетчики, иначе cycles, instructions и cache_* равны 0
+            bool hardware = false;
+            uint64_t task_clock_ns = 0;
+            uint64_t context_switches = 0;
+            uint64_t cycles = 0;
+            uint64_t instructions = 0;
+            uint64_t cache_references = 0;
+            uint64_t cache_misses = 0;
+        };
+
+        // Открывает счетчики всех зарегистрированных потоков. false, если окно уже открыто (error = EBUSY),
+        // нет зарегистрированных потоков (ESRCH) или не открылся ни один счетчик (errno последней ошибки perf_event_open)
+        static bool start(int &error);
+
+        static bool running();
+
+        // Закрывает окно, false если оно не было открыто
+        static bool stop(std::vector<Thread_Result> &results);
+    };
+}
+
+#endif // IO_UTILS_PERF_PROFILER
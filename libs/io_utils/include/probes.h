@@ -0,0 +1,35 @@
+#ifndef IO_UTILS_PROBES
+#define IO_UTILS_PROBES
+
+// Статические точки трассировки USDT (провайдер pgw) для bpftrace, perf и SystemTap.
+// Точка - одна инструкция nop и запись в секции .note.stapsdt, пока к процессу не подключен трассировщик,
+// ничего кроме вычисления аргументов не происходит, поэтому аргументы должны быть дешевыми: числа и указатели.
+// Выключаются опцией CMake IO_UTILS_USDT=OFF, без sys/sdt.h (пакет systemtap-sdt-dev) тоже не собираются
+
+#ifndef IO_UTILS_USDT
+#define IO_UTILS_USDT 1
+#endif
+
+#if IO_UTILS_USDT && __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+
+#define IO_UTILS_PROBES_ENABLED 1
+#define IO_UTILS_PROBE(name, ...) STAP_PROBEV(pgw, name __VA_OPT__(, ) __VA_ARGS__)
+#else
+#define IO_UTILS_PROBES_ENABLED 0
+// Аргументы не вычисляются
+#define IO_UTILS_PROBE(name, ...) ((void)0)
+#endif
+
+namespace IO_Utils
+{
+    // Первый аргумент точек packet_received и packet_sent. У queue_full первый аргумент - имя очереди
+    // ("udp_in", "http_in", "udp_out", "http_out"), затем IP и порт
+    enum Probe_Protocol : int
+    {
+        probe_udp = 0,
+        probe_http = 1
+    };
+}
+
+#endif // IO_UTILS_PROBES
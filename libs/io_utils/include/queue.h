@@ -48,6 +48,15 @@ namespace IO_Utils{
             return elem;
         }
 
+        //Примерное число элементов в очереди, можно читать из любого потока (для метрик)
+        size_t size() const noexcept {
+            //acquire: head сдвигается только после того, как потребитель увидел tail дальше него, поэтому tail здесь не меньше head
+            const size_t current_head = head.load(std::memory_order_acquire);
+            const size_t current_tail = tail.load(std::memory_order_relaxed);
+
+            return current_tail - current_head;
+        }
+
         ~Queue() {
             static_assert(sizeof(T) > 0, "T должен быть полным типом");
         }
@@ -15,6 +15,8 @@ namespace IO_Utils
 
         virtual int register_socket(int fd, uint32_t events) = 0;
         virtual int deregister_socket(int fd) = 0;
+        // Замена отслеживаемых событий уже зарегистрированного сокета
+        virtual int modify_socket(int fd, uint32_t events) = 0;
 
         virtual int get_epoll_fd() = 0;
     };
@@ -28,6 +30,7 @@ namespace IO_Utils
 
         int register_socket(int fd, uint32_t events) override;
         int deregister_socket(int fd) override;
+        int modify_socket(int fd, uint32_t events) override;
 
         int get_epoll_fd() override;
 
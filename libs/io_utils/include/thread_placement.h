@@ -0,0 +1,67 @@
+#ifndef IO_UTILS_THREAD_PLACEMENT
+#define IO_UTILS_THREAD_PLACEMENT
+
+#include <string>
+#include <vector>
+
+namespace IO_Utils
+{
+    // Размещение потоков: имена для top, ps -L и perf, закрепление за CPU и узел NUMA для новой памяти.
+    // Топология читается из /sys/devices/system/cpu, без libnuma
+    class Thread_Placement
+    {
+    public:
+        // -1 - неизвестно
+        struct CPU_Info
+        {
+            int core = -1;
+            int package = -1;
+            int node = -1;
+        };
+
+        // Имя вызывающего потока, обрезается до 15 символов (предел ядра). 0 или код ошибки pthread
+        static int set_name(const std::string &name);
+
+        // Закрепляет вызывающий поток за cpus, пустой список ничего не меняет. 0 или -1 (errno)
+        static int pin(const std::vector<int> &cpus);
+        // CPU, на которых может выполняться вызывающий поток
+        static std::vector<int> affinity();
+        // CPU потока index роли, у которой список cpus: потоки раскладываются по списку по кругу, пустой - без закрепления
+        static std::vector<int> pick(const std::vector<int> &cpus, size_t index);
+
+        static CPU_Info cpu_info(int cpu);
+        // Логические CPU того же физического ядра (гиперпотоки), включая cpu
+        static std::vector<int> siblings(int cpu);
+
+        // Новые страницы памяти вызывающего потока выделяются предпочтительно на узле node (MPOL_PREFERRED),
+        // -1 - политика по умолчанию: узел, на котором поток выполняется. 0 или -1 (errno)
+        static int prefer_node(int node);
+
+        // На время жизни закрепляет поток за cpus и при numa_local выделяет новую память на узле первого из них,
+        // затем возвращает прежнее закрепление и политику по умолчанию. Так очереди и таблицы, которые создает
+        // главный поток, оказываются на узле потоков, которые будут с ними работать. Страницы, уже полученные
+        // кучей процесса раньше, не переносятся. Неудачное закрепление не исключение: Scope продолжает работу
+        // без него, а вызывающий код сообщает об ошибке по pin_error()
+        class Scope
+        {
+            std::vector<int> previous;
+            bool preferred = false;
+            int error = 0;
+
+        public:
+            Scope(const std::vector<int> &cpus, bool numa_local);
+            ~Scope();
+
+            // 0 или errno неудавшегося закрепления
+            int pin_error() const noexcept
+            {
+                return error;
+            }
+
+            Scope(const Scope &) = delete;
+            Scope &operator=(const Scope &) = delete;
+        };
+    };
+}
+
+#endif // IO_UTILS_THREAD_PLACEMENT
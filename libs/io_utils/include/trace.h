@@ -0,0 +1,133 @@
+#ifndef IO_UTILS_TRACE
+#define IO_UTILS_TRACE
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace IO_Utils
+{
+    // Выборочная трассировка запросов в формате Chrome Trace Event (chrome://tracing, ui.perfetto.dev).
+    // Во время записи каждый sample_every-й запрос получает номер и несет его в пакете, а участки его обработки
+    // (прием, ожидание в очередях, обработчик, хранилище, ожидание блокировок, CDR журнал, отправка) пишутся
+    // в буфер своего потока без блокировок. Отдельный поток раз в FLUSH_INTERVAL переносит буферы в JSON файл.
+    // Вне записи цена - одна проверка флага на принятый пакет и проверка номера в потоке на участке
+    class Tracer
+    {
+    public:
+        // Участок в буфере потока, name - строковый литерал
+        struct Event
+        {
+            const char *name;
+            uint64_t id;
+            int64_t begin_ns;
+            int64_t duration_ns;
+            // 0 - поток, записавший участок, иначе одна из очередей (ожидание пакета в ней показывается отдельной дорожкой)
+            uint32_t track;
+        };
+
+        // Дорожки очередей
+        enum Track : uint32_t
+        {
+            thread_track = 0,
+            udp_in_queue,
+            http_in_queue,
+            udp_out_queue,
+            http_out_queue,
+            TRACKS
+        };
+
+        static constexpr size_t BUFFER_EVENTS = 8192;
+        static constexpr std::chrono::milliseconds FLUSH_INTERVAL{20};
+
+        static int64_t now_ns() noexcept
+        {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+        }
+
+        // Начинает запись в path на duration, false если запись уже идет (error = EBUSY)
+        // или файл не открылся (error - errno fopen)
+        static bool start(const std::string &path, size_t sample_every, std::chrono::milliseconds duration, int &error);
+        // Завершает запись досрочно и дописывает файл, false если записи не было
+        static bool stop();
+        static bool running() noexcept
+        {
+            return active.load(std::memory_order_relaxed);
+        }
+        // Сколько участков записано в файл и сколько потеряно из-за переполнения буферов за последнюю запись
+        static uint64_t written_events();
+        static uint64_t dropped_events();
+
+        // Номер для нового запроса: 0, если запись не идет или запрос не попал в выборку. Вызывается одним (IO) потоком
+        static uint64_t sample() noexcept
+        {
+            if (!active.load(std::memory_order_relaxed))
+                return 0;
+
+            return sample_next();
+        }
+
+        static void record(const char *name, uint64_t id, int64_t begin_ns, int64_t end_ns, Track track = thread_track) noexcept;
+
+        // Номер запроса, который сейчас обрабатывает поток, для участков глубже обработчика (хранилище, журнал)
+        static uint64_t current() noexcept
+        {
+            return current_id;
+        }
+
+        // Делает id текущим номером потока на время жизни объекта
+        class Scope
+        {
+            uint64_t previous;
+
+        public:
+            explicit Scope(uint64_t id) noexcept : previous(current_id)
+            {
+                current_id = id;
+            }
+            ~Scope()
+            {
+                current_id = previous;
+            }
+
+            Scope(const Scope &) = delete;
+            Scope &operator=(const Scope &) = delete;
+        };
+
+        // Участок от создания до уничтожения объекта, если поток обрабатывает запрос из выборки
+        class Span
+        {
+            const char *name;
+            uint64_t id;
+            int64_t begin_ns;
+
+        public:
+            explicit Span(const char *name) noexcept : name(name), id(current_id), begin_ns(id != 0 ? now_ns() : 0) {}
+            ~Span()
+            {
+                if (id != 0)
+                    record(name, id, begin_ns, now_ns());
+            }
+
+            Span(const Span &) = delete;
+            Span &operator=(const Span &) = delete;
+        };
+
+    private:
+        static inline std::atomic<bool> active{false};
+        static inline thread_local uint64_t current_id = 0;
+
+        static uint64_t sample_next() noexcept;
+    };
+
+    // Номер запроса в выборке трассировки и время его последнего перехода между потоками
+    struct Trace_Context
+    {
+        uint64_t id = 0;
+        int64_t handoff_ns = 0;
+    };
+}
+
+#endif // IO_UTILS_TRACE
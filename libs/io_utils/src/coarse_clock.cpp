@@ -0,0 +1,68 @@
+#include "coarse_clock.h"
+#include "thread_placement.h"
+
+namespace IO_Utils
+{
+    std::atomic<int64_t> Coarse_Clock::steady_ns{0};
+    std::atomic<int64_t> Coarse_Clock::system_ns{0};
+    std::atomic<size_t> Coarse_Clock::active_tickers{0};
+
+    void Coarse_Clock::tick() noexcept
+    {
+        int64_t steady = std::chrono::steady_clock::now().time_since_epoch().count();
+        int64_t system = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                             std::chrono::system_clock::now().time_since_epoch())
+                             .count();
+
+        // Часы могут обновлять несколько потоков сразу (тикер и IO цикл),
+        // монотонные часы не должны откатываться назад из-за того, что более старое значение записали позже
+        int64_t current = steady_ns.load(std::memory_order_relaxed);
+        while (current < steady && !steady_ns.compare_exchange_weak(current, steady, std::memory_order_relaxed))
+        {
+        }
+
+        system_ns.store(system, std::memory_order_relaxed);
+    }
+
+    std::chrono::steady_clock::time_point Coarse_Clock::steady_now() noexcept
+    {
+        if (active_tickers.load(std::memory_order_relaxed) == 0)
+            return std::chrono::steady_clock::now();
+
+        return std::chrono::steady_clock::time_point{std::chrono::steady_clock::duration{steady_ns.load(std::memory_order_relaxed)}};
+    }
+
+    std::chrono::system_clock::time_point Coarse_Clock::system_now() noexcept
+    {
+        if (active_tickers.load(std::memory_order_relaxed) == 0)
+            return std::chrono::system_clock::now();
+
+        return std::chrono::system_clock::time_point{
+            std::chrono::duration_cast<std::chrono::system_clock::duration>(std::chrono::nanoseconds{system_ns.load(std::memory_order_relaxed)})};
+    }
+
+    Coarse_Clock::Ticker::Ticker(std::chrono::microseconds precision)
+    {
+        // Значения должны быть актуальными до того, как ими начнут пользоваться вместо настоящих часов
+        tick();
+        active_tickers.fetch_add(1);
+
+        thread = std::thread{[this, precision]()
+                             {
+                                 Thread_Placement::set_name("pgw-clock");
+                                 while (!stop.load(std::memory_order_relaxed))
+                                 {
+                                     std::this_thread::sleep_for(precision);
+                                     tick();
+                                 }
+                             }};
+    }
+
+    Coarse_Clock::Ticker::~Ticker()
+    {
+        stop.store(true);
+        thread.join();
+
+        active_tickers.fetch_sub(1);
+    }
+}
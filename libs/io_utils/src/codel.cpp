@@ -0,0 +1,42 @@
+#include "codel.h"
+
+#include <limits>
+
+namespace IO_Utils
+{
+    Codel_Controller::Codel_Controller() : Codel_Controller(Options{}) {}
+
+    Codel_Controller::Codel_Controller(Options options)
+        : target_ns(options.target.count()),
+          interval_ns(options.interval.count()),
+          queue_limit(std::numeric_limits<size_t>::max())
+    {
+    }
+
+    bool Codel_Controller::admit(int64_t sojourn_ns, int64_t now_ns) noexcept
+    {
+        if (empty_seen)
+        {
+            // Точное время опустошения не нужно, достаточно знать, что оно было незадолго до этого запроса
+            last_empty_ns = now_ns;
+            empty_seen = false;
+        }
+        else
+        {
+            // Очередь не пустела с прошлого запроса: разница - время его обработки
+            int64_t service = now_ns - last_admit_ns;
+            service_ns_x8 = service_ns_x8 == 0 ? service * 8 : service_ns_x8 - service_ns_x8 / 8 + service;
+            if (service_ns_x8 >= 8)
+                queue_limit.store((size_t)(target_ns * 8 / service_ns_x8), std::memory_order_relaxed);
+        }
+        last_admit_ns = now_ns;
+
+        last_sojourn.store(sojourn_ns, std::memory_order_relaxed);
+
+        bool standing_queue = now_ns - last_empty_ns > interval_ns;
+        if (standing_queue != standing.load(std::memory_order_relaxed))
+            standing.store(standing_queue, std::memory_order_relaxed);
+
+        return sojourn_ns <= (standing_queue ? target_ns : interval_ns);
+    }
+}
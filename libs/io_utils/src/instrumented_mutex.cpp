@@ -0,0 +1,196 @@
+#include "instrumented_mutex.h"
+#include "trace.h"
+
+#include <algorithm>
+
+#if IO_UTILS_LOCK_CALL_SITES
+#include <array>
+#include <cstdlib>
+#include <map>
+#include <mutex>
+
+#include <execinfo.h>
+#endif
+
+namespace IO_Utils
+{
+    namespace
+    {
+        // Максимум для счетчиков, которые меняют несколько потоков одновременно
+        void update_max(std::atomic<uint64_t> &max, uint64_t value) noexcept
+        {
+            uint64_t current = max.load(std::memory_order_relaxed);
+            while (value > current && !max.compare_exchange_weak(current, value, std::memory_order_relaxed))
+            {
+            }
+        }
+
+#if IO_UTILS_LOCK_CALL_SITES
+        // Стек ожидавшего вызова без самого мьютекса, сравнивается целиком
+        constexpr size_t CALL_SITE_DEPTH = 8;
+        using Call_Stack = std::array<void *, CALL_SITE_DEPTH>;
+
+        struct Call_Site_Stats
+        {
+            uint64_t waits = 0;
+            uint64_t wait_ns = 0;
+        };
+
+        struct Call_Sites
+        {
+            std::mutex mutex;
+            std::map<Call_Stack, Call_Site_Stats> sites;
+        };
+
+        Call_Sites &call_sites()
+        {
+            static Call_Sites instance;
+            return instance;
+        }
+
+        void record_call_site(uint64_t wait_ns)
+        {
+            // Первый кадр - сама функция записи ожидания
+            void *frames[CALL_SITE_DEPTH + 1]{};
+            int depth = backtrace(frames, CALL_SITE_DEPTH + 1);
+
+            Call_Stack stack{};
+            for (int i = 1; i < depth; ++i)
+            {
+                stack[i - 1] = frames[i];
+            }
+
+            Call_Sites &current = call_sites();
+            std::lock_guard lock(current.mutex);
+
+            Call_Site_Stats &site = current.sites[stack];
+            site.waits++;
+            site.wait_ns += wait_ns;
+        }
+#endif
+    }
+
+    void Instrumented_Shared_Mutex::lock_contended()
+    {
+        int64_t begin = now_ns();
+        mutex.lock();
+        uint64_t wait = now_ns() - begin;
+
+        // Ожидание видно на дорожке потока внутри участка запроса из выборки трассировки
+        if (Tracer::current() != 0)
+            Tracer::record("lock_wait_exclusive", Tracer::current(), begin, begin + (int64_t)wait);
+
+        // Уже под монопольной блокировкой
+        increment(exclusive_counters.contended, 1);
+        increment(exclusive_counters.wait_ns, wait);
+        if (wait > exclusive_counters.max_wait_ns.load(std::memory_order_relaxed))
+            exclusive_counters.max_wait_ns.store(wait, std::memory_order_relaxed);
+
+#if IO_UTILS_LOCK_CALL_SITES
+        record_call_site(wait);
+#endif
+    }
+
+    void Instrumented_Shared_Mutex::lock_shared_contended()
+    {
+        int64_t begin = now_ns();
+        mutex.lock_shared();
+        uint64_t wait = now_ns() - begin;
+
+        if (Tracer::current() != 0)
+            Tracer::record("lock_wait_shared", Tracer::current(), begin, begin + (int64_t)wait);
+
+        shared_counters.contended.fetch_add(1, std::memory_order_relaxed);
+        shared_counters.wait_ns.fetch_add(wait, std::memory_order_relaxed);
+        update_max(shared_counters.max_wait_ns, wait);
+
+#if IO_UTILS_LOCK_CALL_SITES
+        record_call_site(wait);
+#endif
+    }
+
+    void Instrumented_Shared_Mutex::record_exclusive_hold()
+    {
+        uint64_t hold = now_ns() - exclusive_hold_start;
+        exclusive_hold_start = 0;
+
+        increment(exclusive_counters.sampled_holds, 1);
+        increment(exclusive_counters.hold_ns, hold);
+        if (hold > exclusive_counters.max_hold_ns.load(std::memory_order_relaxed))
+            exclusive_counters.max_hold_ns.store(hold, std::memory_order_relaxed);
+    }
+
+    void Instrumented_Shared_Mutex::record_shared_hold()
+    {
+        uint64_t hold = now_ns() - shared_hold_start;
+        shared_hold_owner = nullptr;
+
+        shared_counters.sampled_holds.fetch_add(1, std::memory_order_relaxed);
+        shared_counters.hold_ns.fetch_add(hold, std::memory_order_relaxed);
+        update_max(shared_counters.max_hold_ns, hold);
+    }
+
+    Lock_Stats Instrumented_Shared_Mutex::stats() const
+    {
+        auto snapshot = [](const Mode_Counters &counters)
+        {
+            Lock_Stats::Mode mode;
+            mode.acquisitions = counters.acquisitions.load(std::memory_order_relaxed);
+            mode.contended = counters.contended.load(std::memory_order_relaxed);
+            mode.wait_ns = counters.wait_ns.load(std::memory_order_relaxed);
+            mode.max_wait_ns = counters.max_wait_ns.load(std::memory_order_relaxed);
+            mode.sampled_holds = counters.sampled_holds.load(std::memory_order_relaxed);
+            mode.hold_ns = counters.hold_ns.load(std::memory_order_relaxed);
+            mode.max_hold_ns = counters.max_hold_ns.load(std::memory_order_relaxed);
+            return mode;
+        };
+
+        Lock_Stats result;
+        result.exclusive = snapshot(exclusive_counters);
+        result.shared = snapshot(shared_counters);
+        for (const Shared_Slot &slot : shared_slots)
+        {
+            result.shared.acquisitions += slot.acquisitions.load(std::memory_order_relaxed);
+        }
+        return result;
+    }
+
+    std::vector<Instrumented_Shared_Mutex::Call_Site> Instrumented_Shared_Mutex::top_call_sites(size_t count)
+    {
+        std::vector<Call_Site> result;
+
+#if IO_UTILS_LOCK_CALL_SITES
+        std::vector<std::pair<Call_Stack, Call_Site_Stats>> sites;
+        {
+            Call_Sites &current = call_sites();
+            std::lock_guard lock(current.mutex);
+            sites.assign(current.sites.begin(), current.sites.end());
+        }
+
+        std::sort(sites.begin(), sites.end(), [](const auto &a, const auto &b)
+                  { return a.second.wait_ns > b.second.wait_ns; });
+        if (sites.size() > count)
+            sites.resize(count);
+
+        for (const auto &[stack, site] : sites)
+        {
+            size_t depth = std::find(stack.begin(), stack.end(), nullptr) - stack.begin();
+
+            std::string frames;
+            char **symbols = backtrace_symbols(stack.data(), depth);
+            for (size_t i = 0; i < depth; ++i)
+            {
+                frames += symbols != nullptr ? symbols[i] : "?";
+                frames += '\n';
+            }
+            std::free(symbols);
+
+            result.push_back({std::move(frames), site.waits, site.wait_ns});
+        }
+#else
+        (void)count;
+#endif
+
+        return result;
+    }
+}
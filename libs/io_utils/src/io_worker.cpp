@@ -1,5 +1,11 @@
 #include "io_worker.h"
 
+#include "coarse_clock.h"
+#include "metrics.h"
+#include "perf_profiler.h"
+#include "probes.h"
+#include "trace.h"
+
 #include <quill/LogMacros.h>
 
 #include <sys/epoll.h>
@@ -8,10 +14,23 @@
 
 namespace IO_Utils
 {
+    static const Metrics::Id udp_received = Metrics::counter("pgw_packets_received_total", "UDP packets and complete HTTP requests received", "protocol=\"udp\"");
+    static const Metrics::Id http_received = Metrics::counter("pgw_packets_received_total", "UDP packets and complete HTTP requests received", "protocol=\"http\"");
+    static const Metrics::Id udp_sent = Metrics::counter("pgw_packets_sent_total", "UDP packets and HTTP responses sent completely", "protocol=\"udp\"");
+    static const Metrics::Id http_sent = Metrics::counter("pgw_packets_sent_total", "UDP packets and HTTP responses sent completely", "protocol=\"http\"");
+    static const Metrics::Id udp_in_drops = Metrics::counter("pgw_queue_drops_total", "Packets dropped because the queue was full", "queue=\"udp_in\"");
+    static const Metrics::Id http_in_drops = Metrics::counter("pgw_queue_drops_total", "Packets dropped because the queue was full", "queue=\"http_in\"");
+    static const Metrics::Id udp_errors = Metrics::counter("pgw_socket_errors_total", "Failed socket receive and send calls", "protocol=\"udp\"");
+    static const Metrics::Id http_errors = Metrics::counter("pgw_socket_errors_total", "Failed socket receive and send calls", "protocol=\"http\"");
+    static const Metrics::Id udp_kernel_drops = Metrics::counter("pgw_udp_kernel_drops_total", "UDP datagrams dropped by the kernel: receive buffer overflow or rejected by the socket filter");
+    static const Metrics::Id udp_pauses = Metrics::counter("pgw_udp_receive_pauses_total", "Times UDP socket reading was paused because udp_in reached the high watermark");
+    static const Metrics::Id udp_shed_incoming = Metrics::counter("pgw_overload_shed_total", "UDP requests answered busy because of udp_in queue delay", "stage=\"incoming\"");
+
     IO_Worker::IO_Worker(
         std::string udp_ip, uint16_t udp_port,
         std::string http_ip, uint16_t http_port,
-        quill::Logger *logger) : logger(logger)
+        quill::Logger *logger,
+        bool udp_reuse_port) : http_server_fd(-1), udp_server_fd(-1), logger(logger)
     {
         uint32_t _http_ip, _udp_ip;
 
@@ -23,56 +42,188 @@ namespace IO_Utils
             throw std::runtime_error("Can't create registrar correctly");
         }
 
-        int res = Socket::make_ip_address(http_ip, _http_ip);
-        if (res == -1)
+        int res;
+        if (!http_ip.empty())
         {
-            LOG_ERROR(logger, "HTTP ip wrong");
-            throw std::invalid_argument("Wrong http ip");
+            res = Socket::make_ip_address(http_ip, _http_ip);
+            if (res == -1)
+            {
+                LOG_ERROR(logger, "HTTP ip wrong");
+                throw std::invalid_argument("Wrong http ip");
+            }
+
+            http_server = std::make_shared<HTTP_Socket>(_http_ip, http_port);
+
+            errno = 0;
+            http_server_fd = http_server->listen_or_bind();
+            if (http_server_fd <= 0)
+            {
+                LOG_ERROR(logger, "Failure while binding http server fd, fd = {}, errno = {}", http_server_fd, errno);
+                throw std::runtime_error("Listen http server failure");
+            }
         }
 
-        res = Socket::make_ip_address(udp_ip, _udp_ip);
-        if (res == -1)
+        if (!udp_ip.empty())
         {
-            LOG_ERROR(logger, "UDP ip wrong");
-            throw std::invalid_argument("Wrong udp ip");
+            res = Socket::make_ip_address(udp_ip, _udp_ip);
+            if (res == -1)
+            {
+                LOG_ERROR(logger, "UDP ip wrong");
+                throw std::invalid_argument("Wrong udp ip");
+            }
+
+            udp_server = std::make_shared<UDP_Socket>(_udp_ip, udp_port, udp_reuse_port);
+
+            errno = 0;
+            udp_server_fd = udp_server->listen_or_bind();
+            if (udp_server_fd <= 0)
+            {
+                LOG_ERROR(logger, "Failure while binding udp server fd, fd = {}, errno = {}", udp_server_fd, errno);
+                throw std::runtime_error("Bind udp server failure");
+            }
+
+            udp_server_connection = std::make_unique<UDP_Connection>(udp_server_fd);
         }
 
-        http_server = std::make_shared<HTTP_Socket>(_http_ip, http_port);
-        udp_server = std::make_shared<UDP_Socket>(_udp_ip, udp_port);
+        if (http_server_fd > 0)
+        {
+            errno = 0;
+            res = registrar->register_socket(http_server_fd, EPOLLIN);
+            if (res < 0)
+            {
+                LOG_ERROR(logger, "HTTP server register wrong, epoll_fd = {}, server_fd = {}, errno = {}", registrar->get_epoll_fd(), http_server_fd, errno);
+                throw std::runtime_error("Can't register http server");
+            }
+        }
 
-        errno = 0;
-        http_server_fd = http_server->listen_or_bind();
-        if (http_server_fd <= 0)
+        if (udp_server_fd > 0)
         {
-            LOG_ERROR(logger, "Failure while binding http server fd, fd = {}, errno = {}", http_server_fd, errno);
-            throw std::runtime_error("Listen http server failure");
+            errno = 0;
+            res = registrar->register_socket(udp_server_fd, EPOLLIN | EPOLLOUT);
+            if (res < 0)
+            {
+                LOG_ERROR(logger, "UDP server register wrong, epoll_fd = {}, server_fd = {}, errno = {}", registrar->get_epoll_fd(), udp_server_fd, errno);
+                throw std::runtime_error("Can't register udp server");
+            }
         }
+    }
 
+    int IO_Worker::send_http(int fd, Pending_Send &pending)
+    {
         errno = 0;
-        udp_server_fd = udp_server->listen_or_bind();
-        if (udp_server_fd <= 0)
+        // В connections для клиентских дескрипторов лежат только HTTP_Connection
+        int res = static_cast<TCP_Connection &>(*connections.at(fd)).send_partial(*pending.packet, pending.sent, MAX_SEND_CHUNK);
+        if (res < 0)
         {
-            LOG_ERROR(logger, "Failure while binding udp server fd, fd = {}, errno = {}", udp_server_fd, errno);
-            throw std::runtime_error("Bind udp server failure");
+            Metrics::add(http_errors);
+            LOG_WARNING(logger, "Trouble with sending HTTP packets to {}, client_fd = {}, errno = {}", client_sockets.at(fd)->socket_to_str(), fd, errno);
         }
+        else if (res == 0)
+        {
+            IO_UTILS_PROBE(packet_sent, probe_http, client_sockets.at(fd)->ip, client_sockets.at(fd)->port,
+                           pending.packet->data.size() + (pending.packet->file_body != nullptr ? pending.packet->file_body->length : 0));
+
+            Metrics::add(http_sent);
+            Packet_Latency::record_sent(pending.packet->timestamps, Packet_Latency::http);
+            // От извлечения из очереди до последнего куска ответа, вместе с ожиданием готовности клиента
+            if (pending.packet->trace.id != 0)
+                Tracer::record("IO_Worker::send_http", pending.packet->trace.id, pending.packet->trace.handoff_ns, Tracer::now_ns());
+        }
+
+        return res;
+    }
 
-        udp_server_connection = std::make_unique<UDP_Connection>(udp_server_fd);
+    void IO_Worker::set_overload_control(Codel_Controller *controller, std::vector<uint8_t> busy_reply)
+    {
+        overload_control = controller;
+        this->busy_reply = std::move(busy_reply);
+    }
+
+    void IO_Worker::set_udp_flow_control(size_t high_watermark, size_t low_watermark)
+    {
+        if (high_watermark != 0 && low_watermark >= high_watermark)
+            throw std::invalid_argument("UDP low watermark must be less than high watermark");
+
+        udp_high_watermark = high_watermark;
+        udp_low_watermark = low_watermark;
+    }
+
+    int IO_Worker::set_udp_receive_buffer(int bytes)
+    {
+        return Socket::set_receive_buffer(udp_server_fd, bytes);
+    }
+
+    int IO_Worker::set_udp_socket_filter(const std::vector<sock_filter> &program)
+    {
+        return Socket::attach_filter(udp_server_fd, program);
+    }
+
+    int IO_Worker::set_udp_steering_filter(const std::vector<sock_filter> &program)
+    {
+        return Socket::attach_reuseport_filter(udp_server_fd, program);
+    }
+
+    void IO_Worker::update_udp_flow_control(size_t queued)
+    {
+        bool paused = udp_paused.load(std::memory_order_relaxed);
+        if (paused ? queued > udp_low_watermark : queued < udp_high_watermark)
+            return;
 
+        // EPOLLOUT остается: ответы продолжают уходить, пока чтение стоит
         errno = 0;
-        res = registrar->register_socket(http_server_fd, EPOLLIN);
-        if (res < 0)
+        if (registrar->modify_socket(udp_server_fd, paused ? EPOLLIN | EPOLLOUT : EPOLLOUT) < 0)
         {
-            LOG_ERROR(logger, "HTTP server register wrong, epoll_fd = {}, server_fd = {}, errno = {}", registrar->get_epoll_fd(), http_server_fd, errno);
-            throw std::runtime_error("Can't register http server");
+            LOG_ERROR(logger, "UDP server modify wrong, epoll_fd = {}, server_fd = {}, errno = {}", registrar->get_epoll_fd(), udp_server_fd, errno);
+            return;
         }
 
+        udp_paused.store(!paused, std::memory_order_relaxed);
+        if (!paused)
+        {
+            Metrics::add(udp_pauses);
+            LOG_DEBUG(logger, "UDP reading paused, udp_in_queue size = {}", queued);
+        }
+        else
+        {
+            LOG_DEBUG(logger, "UDP reading resumed, udp_in_queue size = {}", queued);
+        }
+    }
+
+    bool IO_Worker::shed_udp(Packet &packet, size_t queued)
+    {
+        if (!overload_control->shed_incoming(queued))
+            return false;
+
+        Metrics::add(udp_received);
+        Metrics::add(udp_shed_incoming);
+
+        // Ответ пишется в буфер запроса, он больше не нужен
+        packet.data = busy_reply;
         errno = 0;
-        res = registrar->register_socket(udp_server_fd, EPOLLIN | EPOLLOUT);
-        if (res < 0)
+        if (udp_server_connection->send_packet(packet) < 0)
+        {
+            Metrics::add(udp_errors);
+            IO_UTILS_LOG_THROTTLED(udp_error_log, LOG_WARNING, logger, "Trouble with sending UDP packets, server_fd = {}, errno = {}", udp_server_fd, errno);
+        }
+        else
         {
-            LOG_ERROR(logger, "UDP server register wrong, epoll_fd = {}, server_fd = {}, errno = {}", registrar->get_epoll_fd(), udp_server_fd, errno);
-            throw std::runtime_error("Can't register udp server");
+            Metrics::add(udp_sent);
         }
+
+        return true;
+    }
+
+    bool IO_Worker::http_request_incomplete(const Packet &packet, bool buffer_filled) const
+    {
+        // Слишком длинный запрос отдается обработчику как есть, он ответит ошибкой
+        if (packet.data.size() >= MAX_HTTP_REQUEST_SIZE)
+            return false;
+
+        size_t missing = HTTP_Connection::missing_bytes(packet.data);
+        if (missing == HTTP_Connection::HEADERS_INCOMPLETE)
+            return buffer_filled;
+
+        return missing > 0;
     }
 
     void IO_Worker::run(
@@ -80,6 +231,8 @@ namespace IO_Utils
         Queue<Packet> &http_in_queue, Queue<Packet> &udp_in_queue,
         Queue<Packet> &http_out_queue, Queue<Packet> &udp_out_queue)
     {
+        Perf_Profiler::Thread_Registration profiler_registration{"io_worker"};
+
         int res;
         epoll_event events[MAX_EVENTS];
         std::unique_ptr<Packet> http_packet_to_send = nullptr;
@@ -90,13 +243,21 @@ namespace IO_Utils
             if (stop.load())
                 ctr++;
 
+            if (udp_high_watermark != 0)
+                update_udp_flow_control(udp_in_queue.size());
+
             errno = 0;
-            int nfds = epoll_wait(registrar->get_epoll_fd(), events, MAX_EVENTS, TIMEOUT);
+            // Пока чтение приостановлено, очередь проверяется часто, даже если событий нет
+            int nfds = epoll_wait(registrar->get_epoll_fd(), events, MAX_EVENTS, udp_paused.load(std::memory_order_relaxed) ? 1 : TIMEOUT);
             if (nfds < 0)
             {
                 LOG_ERROR(logger, "Epoll_wait error, epoll_fd = {}, errno = {}", registrar->get_epoll_fd(), errno);
             }
 
+            // Раз в пачку событий обновляем грубые часы, чтобы их значения не отставали от времени прихода пакетов
+            if (nfds > 0)
+                Coarse_Clock::tick();
+
             for (int i = 0; i < nfds; ++i)
             {
                 int fd = events[i].data.fd;
@@ -109,7 +270,7 @@ namespace IO_Utils
                     int client_fd = client_socket->accept_socket(fd);
                     if (client_fd < 0)
                     {
-                        LOG_WARNING(logger, "Client accept wrong, epoll_fd = {}, client_fd = {}, server_fd = {}, errno = {}", registrar->get_epoll_fd(), client_fd, fd, errno);
+                        IO_UTILS_LOG_THROTTLED(accept_error_log, LOG_WARNING, logger, "Client accept wrong, epoll_fd = {}, client_fd = {}, server_fd = {}, errno = {}", registrar->get_epoll_fd(), client_fd, fd, errno);
 
                         continue;
                     }
@@ -118,7 +279,7 @@ namespace IO_Utils
                     res = registrar->register_socket(client_fd, EPOLLIN | EPOLLOUT);
                     if (res == -1)
                     {
-                        LOG_WARNING(logger, "Client register wrong, epoll_fd = {}, client_fd = {}, server_fd = {}, errno = {}", registrar->get_epoll_fd(), client_fd, fd, errno);
+                        IO_UTILS_LOG_THROTTLED(accept_error_log, LOG_WARNING, logger, "Client register wrong, epoll_fd = {}, client_fd = {}, server_fd = {}, errno = {}", registrar->get_epoll_fd(), client_fd, fd, errno);
 
                         continue;
                     }
@@ -132,22 +293,52 @@ namespace IO_Utils
                     {
                         UDP_Packet packet(nullptr);
 
+                        int64_t recv_begin = Tracer::running() ? Tracer::now_ns() : 0;
                         errno = 0;
                         res = udp_server_connection->recv_packet(packet);
+                        if (udp_server_connection->kernel_drops != udp_kernel_drops_seen)
+                        {
+                            // Счетчик ядра 32-битный и переполняется, беззнаковая разность это учитывает
+                            Metrics::add(udp_kernel_drops, (uint32_t)(udp_server_connection->kernel_drops - udp_kernel_drops_seen));
+                            udp_kernel_drops_seen = udp_server_connection->kernel_drops;
+                        }
+
                         if (res < 0)
                         {
-                            LOG_WARNING(logger, "Trouble with receiving UDP packets, server_fd = {}, errno = {}", udp_server_fd, errno);
+                            Metrics::add(udp_errors);
+                            IO_UTILS_LOG_THROTTLED(udp_error_log, LOG_WARNING, logger, "Trouble with receiving UDP packets, server_fd = {}, errno = {}", udp_server_fd, errno);
                         }
                         else if (packet.data.size() == 0)
                         {
                         }
+                        else if (overload_control != nullptr && shed_udp(packet, udp_in_queue.size()))
+                        {
+                        }
                         else
                         {
-                            std::unique_ptr<UDP_Packet> temp_packet = std::make_unique<UDP_Packet>(packet);
-                            res = udp_in_queue.push(std::move(temp_packet));
-                            if (res == -1)
+                            // Перемещение сохраняет буфер пакета, обработчик пишет ответ в ту же память
+                            Metrics::add(udp_received);
+                            Packet_Latency::stamp(packet.timestamps.received_ns);
+
+                            std::shared_ptr<Socket> socket = packet.get_socket();
+                            IO_UTILS_PROBE(packet_received, probe_udp, socket->ip, socket->port, packet.data.size());
+                            std::unique_ptr<UDP_Packet> temp_packet = std::make_unique<UDP_Packet>(std::move(packet));
+                            // Время ожидания в очереди нужно защите от перегрузки и без гистограмм задержек
+                            if (overload_control != nullptr)
+                                temp_packet->timestamps.enqueued_ns = Packet_Latency::now_ns();
+                            else
+                                Packet_Latency::stamp(temp_packet->timestamps.enqueued_ns);
+                            temp_packet->trace.id = recv_begin != 0 ? Tracer::sample() : 0;
+                            if (temp_packet->trace.id != 0)
+                            {
+                                temp_packet->trace.handoff_ns = Tracer::now_ns();
+                                Tracer::record("IO_Worker::recv_udp", temp_packet->trace.id, recv_begin, temp_packet->trace.handoff_ns);
+                            }
+                            if (!udp_in_queue.push(std::move(temp_packet)))
                             {
-                                LOG_WARNING(logger, "UDP in_queue is FULL, drop the packet from {}", packet.get_socket()->socket_to_str());
+                                Metrics::add(udp_in_drops);
+                                IO_UTILS_PROBE(queue_full, "udp_in", socket->ip, socket->port);
+                                IO_UTILS_LOG_THROTTLED(udp_in_full_log, LOG_WARNING, logger, "UDP in_queue is FULL, drop the packet from {}", socket->socket_to_str());
                             }
                             else
                             {
@@ -160,11 +351,27 @@ namespace IO_Utils
 
                         if (packet != nullptr)
                         {
+                            int64_t send_begin = 0;
+                            if (packet->trace.id != 0)
+                            {
+                                send_begin = Tracer::now_ns();
+                                Tracer::record("udp_out_queue", packet->trace.id, packet->trace.handoff_ns, send_begin, Tracer::udp_out_queue);
+                            }
+
                             errno = 0;
-                            res = udp_server_connection->send_packet(*packet.release());
+                            res = udp_server_connection->send_packet(*packet);
                             if (res < 0)
                             {
-                                LOG_WARNING(logger, "Trouble with sending UDP packets, server_fd = {}, errno = {}", udp_server_fd, errno);
+                                Metrics::add(udp_errors);
+                                IO_UTILS_LOG_THROTTLED(udp_error_log, LOG_WARNING, logger, "Trouble with sending UDP packets, server_fd = {}, errno = {}", udp_server_fd, errno);
+                            }
+                            else
+                            {
+                                Metrics::add(udp_sent);
+                                IO_UTILS_PROBE(packet_sent, probe_udp, packet->get_socket()->ip, packet->get_socket()->port, packet->data.size());
+                                Packet_Latency::record_sent(packet->timestamps, Packet_Latency::udp);
+                                if (packet->trace.id != 0)
+                                    Tracer::record("IO_Worker::send_udp", packet->trace.id, send_begin, Tracer::now_ns());
                             }
                         }
                         else
@@ -183,30 +390,75 @@ namespace IO_Utils
                             continue;
                         }
 
-                        HTTP_Packet packet{nullptr};
-                        packet.set_socket(client_sockets.at(fd));
+                        std::unique_ptr<Packet> request = nullptr;
+                        int64_t recv_begin = Tracer::running() ? Tracer::now_ns() : 0;
 
-                        errno = 0;
-                        res = connections.at(fd)->recv_packet(packet);
-                        if (res < 0)
-                        {
-                            LOG_WARNING(logger, "Trouble with receiving HTTP packet from {}, server_fd = {}, client_fd = {}, errno = {}", packet.get_socket()->socket_to_str(), http_server_fd, fd, errno);
-                        }
-                        else if (packet.data.size() == 0)
+                        auto partial = partial_requests.find(fd);
+                        if (partial != partial_requests.end())
                         {
+                            // Продолжение запроса, который не пришел за одно чтение, дочитывается в тот же пакет
+                            errno = 0;
+                            res = static_cast<TCP_Connection &>(*connections.at(fd)).recv_append(*partial->second, MAX_RECV_CHUNK);
+                            if (res < 0)
+                            {
+                                Metrics::add(http_errors);
+                                LOG_WARNING(logger, "Trouble with receiving HTTP packet from {}, server_fd = {}, client_fd = {}, errno = {}", client_sockets.at(fd)->socket_to_str(), http_server_fd, fd, errno);
+                            }
+                            else if (res > 0 && !http_request_incomplete(*partial->second, (size_t)res == MAX_RECV_CHUNK))
+                            {
+                                request = std::move(partial->second);
+                                partial_requests.erase(partial);
+                            }
                         }
                         else
                         {
-                            std::unique_ptr<Packet> temp_packet = std::make_unique<HTTP_Packet>(packet);
-                            res = http_in_queue.push(std::move(temp_packet));
-                            if (res == -1)
+                            HTTP_Packet packet{nullptr};
+                            packet.set_socket(client_sockets.at(fd));
+
+                            errno = 0;
+                            res = connections.at(fd)->recv_packet(packet);
+                            // Для запроса из нескольких частей время приема - время первой части
+                            Packet_Latency::stamp(packet.timestamps.received_ns);
+                            if (res < 0)
+                            {
+                                Metrics::add(http_errors);
+                                LOG_WARNING(logger, "Trouble with receiving HTTP packet from {}, server_fd = {}, client_fd = {}, errno = {}", packet.get_socket()->socket_to_str(), http_server_fd, fd, errno);
+                            }
+                            else if (packet.data.size() == 0)
+                            {
+                            }
+                            else if (http_request_incomplete(packet, packet.data.size() == BUFF_SIZE))
                             {
-                                LOG_WARNING(logger, "HTTP in_queue is FULL, drop the packet from {}", packet.get_socket()->socket_to_str());
+                                LOG_DEBUG(logger, "HTTP request from {} is incomplete, waiting for the rest", client_sockets.at(fd)->socket_to_str());
+                                partial_requests.emplace(fd, std::make_unique<HTTP_Packet>(std::move(packet)));
                             }
                             else
                             {
+                                request = std::make_unique<HTTP_Packet>(std::move(packet));
+                            }
+                        }
+
+                        if (request != nullptr)
+                        {
+                            IO_UTILS_PROBE(packet_received, probe_http, client_sockets.at(fd)->ip, client_sockets.at(fd)->port, request->data.size());
+
+                            Metrics::add(http_received);
+                            Packet_Latency::stamp(request->timestamps.enqueued_ns);
+                            // Для запроса из нескольких частей участок приема - только последнее чтение
+                            request->trace.id = recv_begin != 0 ? Tracer::sample() : 0;
+                            if (request->trace.id != 0)
+                            {
+                                request->trace.handoff_ns = Tracer::now_ns();
+                                Tracer::record("IO_Worker::recv_http", request->trace.id, recv_begin, request->trace.handoff_ns);
                             }
                         }
+
+                        if (request != nullptr && !http_in_queue.push(std::move(request)))
+                        {
+                            Metrics::add(http_in_drops);
+                            IO_UTILS_PROBE(queue_full, "http_in", client_sockets.at(fd)->ip, client_sockets.at(fd)->port);
+                            IO_UTILS_LOG_THROTTLED(http_in_full_log, LOG_WARNING, logger, "HTTP in_queue is FULL, drop the packet from {}", client_sockets.at(fd)->socket_to_str());
+                        }
                     }
                     if (events[i].events & EPOLLOUT)
                     {
@@ -217,22 +469,38 @@ namespace IO_Utils
                             continue;
                         }
 
-                        if (http_packet_to_send == nullptr)
-                            http_packet_to_send = http_out_queue.pop();
-
-                        if (http_packet_to_send == nullptr)
+                        auto pending = pending_sends.find(fd);
+                        if (pending != pending_sends.end())
                         {
+                            // Продолжение большого ответа, не больше MAX_SEND_CHUNK за событие
+                            if (send_http(fd, pending->second) != 1)
+                                pending_sends.erase(pending);
                         }
-                        else if (client_sockets.at(fd) == http_packet_to_send->get_socket())
+                        else
                         {
+                            if (http_packet_to_send == nullptr)
+                            {
+                                http_packet_to_send = http_out_queue.pop();
+                                if (http_packet_to_send != nullptr && http_packet_to_send->trace.id != 0)
+                                {
+                                    int64_t now = Tracer::now_ns();
+                                    Tracer::record("http_out_queue", http_packet_to_send->trace.id, http_packet_to_send->trace.handoff_ns, now, Tracer::http_out_queue);
+                                    http_packet_to_send->trace.handoff_ns = now;
+                                }
+                            }
 
-                            LOG_DEBUG(logger, "Sending HTTP response to client {}", client_sockets.at(fd)->socket_to_str());
-
-                            errno = 0;
-                            res = connections.at(fd)->send_packet(*http_packet_to_send.release());
-                            if (res < 0)
+                            if (http_packet_to_send == nullptr)
                             {
-                                LOG_WARNING(logger, "Trouble with sending HTTP packets to {}, client_fd = {}, server_fd = {}, errno = {}", client_sockets.at(fd)->socket_to_str(), fd, udp_server_fd, errno);
+                            }
+                            else if (client_sockets.at(fd) == http_packet_to_send->get_socket())
+                            {
+
+                                LOG_DEBUG(logger, "Sending HTTP response to client {}", client_sockets.at(fd)->socket_to_str());
+
+                                // Ответ сразу освобождает общую очередь, а то, что не ушло за раз, досылается отдельно
+                                Pending_Send send{std::move(http_packet_to_send), 0};
+                                if (send_http(fd, send) == 1)
+                                    pending_sends.emplace(fd, std::move(send));
                             }
                         }
                     }
@@ -256,6 +524,12 @@ namespace IO_Utils
                             continue;
                         }
 
+                        // Ответ отключившемуся клиенту больше некому отправлять, он не должен держать очередь
+                        if (http_packet_to_send != nullptr && http_packet_to_send->get_socket() == client_sockets.at(fd))
+                            http_packet_to_send = nullptr;
+
+                        pending_sends.erase(fd);
+                        partial_requests.erase(fd);
                         client_sockets.erase(fd);
                         connections.erase(fd);
                     }
@@ -276,18 +550,24 @@ namespace IO_Utils
 
     IO_Worker::~IO_Worker()
     {
-        errno = 0;
-        registrar->deregister_socket(udp_server_fd);
-        if (errno != 0)
+        if (udp_server_fd > 0)
         {
-            LOG_INFO(logger, "Can't deregister socket {} with fd = {}", udp_server->socket_to_str(), udp_server_fd);
+            errno = 0;
+            registrar->deregister_socket(udp_server_fd);
+            if (errno != 0)
+            {
+                LOG_INFO(logger, "Can't deregister socket {} with fd = {}", udp_server->socket_to_str(), udp_server_fd);
+            }
         }
 
-        errno = 0;
-        registrar->deregister_socket(http_server_fd);
-        if (errno != 0)
+        if (http_server_fd > 0)
         {
-            LOG_INFO(logger, "Can't deregister socket {} with fd = {}", http_server->socket_to_str(), http_server_fd);
+            errno = 0;
+            registrar->deregister_socket(http_server_fd);
+            if (errno != 0)
+            {
+                LOG_INFO(logger, "Can't deregister socket {} with fd = {}", http_server->socket_to_str(), http_server_fd);
+            }
         }
     }
 }
\ No newline at end of file
@@ -0,0 +1,167 @@
+#include "latency.h"
+
+#include <bit>
+#include <cstdio>
+
+namespace IO_Utils
+{
+    static Latency_Histogram histograms[Packet_Latency::PROTOCOLS][Packet_Latency::STAGES];
+
+    size_t Latency_Histogram::bucket_index(uint64_t value) noexcept
+    {
+        // Значения меньше SUB_BUCKETS идут по одному в интервал, дальше по SUB_BUCKETS интервалов на степень двойки
+        if (value < SUB_BUCKETS)
+            return value;
+
+        size_t shift = std::bit_width(value) - 1 - SUB_BUCKET_BITS;
+        return (shift + 1) * SUB_BUCKETS + ((value >> shift) - SUB_BUCKETS);
+    }
+
+    uint64_t Latency_Histogram::bucket_upper_bound(size_t index) noexcept
+    {
+        if (index < SUB_BUCKETS)
+            return index;
+
+        size_t shift = index / SUB_BUCKETS - 1;
+        uint64_t sub_bucket = index % SUB_BUCKETS + SUB_BUCKETS;
+        return ((sub_bucket + 1) << shift) - 1;
+    }
+
+    void Latency_Histogram::record(int64_t value) noexcept
+    {
+        uint64_t positive = value > 0 ? value : 0;
+
+        // Писатель один, поэтому обычные load/store без lock-префикса, как у счетчиков Metrics
+        std::atomic<uint64_t> &bucket = buckets[bucket_index(positive)];
+        bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        total.store(total.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        total_sum.store(total_sum.load(std::memory_order_relaxed) + positive, std::memory_order_relaxed);
+    }
+
+    uint64_t Latency_Histogram::count() const noexcept
+    {
+        return total.load(std::memory_order_relaxed);
+    }
+
+    uint64_t Latency_Histogram::sum() const noexcept
+    {
+        return total_sum.load(std::memory_order_relaxed);
+    }
+
+    uint64_t Latency_Histogram::quantile(double q) const noexcept
+    {
+        uint64_t current_total = count();
+        if (current_total == 0)
+            return 0;
+
+        // Номер значения, на котором набирается доля q, не меньше первого
+        uint64_t rank = q * current_total;
+        rank = rank < current_total ? rank + 1 : current_total;
+
+        uint64_t seen = 0;
+        for (size_t i = 0; i < BUCKETS; ++i)
+        {
+            seen += buckets[i].load(std::memory_order_relaxed);
+            if (seen >= rank)
+                return bucket_upper_bound(i);
+        }
+
+        // Счетчики интервалов и total обновляются не вместе, при одновременной записи total может убежать вперед
+        for (size_t i = BUCKETS; i > 0; --i)
+        {
+            if (buckets[i - 1].load(std::memory_order_relaxed) != 0)
+                return bucket_upper_bound(i - 1);
+        }
+
+        return 0;
+    }
+
+    void Packet_Latency::record_sent(const Packet_Timestamps &timestamps, Protocol protocol) noexcept
+    {
+#if IO_UTILS_LATENCY_TRACKING
+        // Если какой-то этап не отмечен (пакет создан не IO потоком), учитываются только известные
+        if (timestamps.received_ns == 0 || timestamps.handled_ns == 0)
+            return;
+
+        int64_t sent_ns = now_ns();
+        Latency_Histogram *current = histograms[protocol];
+
+        if (timestamps.kernel_wait_ns >= 0)
+            current[socket].record(timestamps.kernel_wait_ns);
+        if (timestamps.enqueued_ns != 0)
+            current[receive].record(timestamps.enqueued_ns - timestamps.received_ns);
+        if (timestamps.enqueued_ns != 0 && timestamps.dequeued_ns != 0)
+            current[in_queue].record(timestamps.dequeued_ns - timestamps.enqueued_ns);
+        if (timestamps.dequeued_ns != 0)
+            current[handler].record(timestamps.handled_ns - timestamps.dequeued_ns);
+        current[out_queue].record(sent_ns - timestamps.handled_ns);
+        current[total].record(sent_ns - timestamps.received_ns);
+#else
+        (void)timestamps;
+        (void)protocol;
+#endif
+    }
+
+    const Latency_Histogram &Packet_Latency::histogram(Protocol protocol, Stage stage) noexcept
+    {
+        return histograms[protocol][stage];
+    }
+
+    const char *Packet_Latency::protocol_name(Protocol protocol) noexcept
+    {
+        static const char *names[PROTOCOLS] = {"udp", "http"};
+        return names[protocol];
+    }
+
+    const char *Packet_Latency::stage_name(Stage stage) noexcept
+    {
+        static const char *names[STAGES] = {"socket", "receive", "in_queue", "handler", "out_queue", "total"};
+        return names[stage];
+    }
+
+    void Packet_Latency::collect(Metrics::Samples &samples)
+    {
+        static const double quantiles[] = {0.5, 0.9, 0.99, 0.999};
+        static const char *quantile_labels[] = {"0.5", "0.9", "0.99", "0.999"};
+
+        for (size_t p = 0; p < PROTOCOLS; ++p)
+        {
+            for (size_t s = 0; s < STAGES; ++s)
+            {
+                const Latency_Histogram &current = histograms[p][s];
+                std::string labels = std::string("protocol=\"") + protocol_name((Protocol)p) + "\",stage=\"" + stage_name((Stage)s) + "\"";
+
+                for (size_t q = 0; q < std::size(quantiles); ++q)
+                {
+                    samples.emplace_back(labels + ",quantile=\"" + quantile_labels[q] + "\"", current.quantile(quantiles[q]) / 1e9);
+                }
+                samples.emplace_back(labels, current.sum() / 1e9, "_sum");
+                samples.emplace_back(labels, current.count(), "_count");
+            }
+        }
+    }
+
+    std::string Packet_Latency::summary()
+    {
+        std::string result;
+        char buffer[128];
+
+        for (size_t p = 0; p < PROTOCOLS; ++p)
+        {
+            for (size_t s = 0; s < STAGES; ++s)
+            {
+                const Latency_Histogram &current = histograms[p][s];
+                if (current.count() == 0)
+                    continue;
+
+                std::snprintf(buffer, sizeof(buffer), "%s%s/%s n=%llu p50=%.1fus p99=%.1fus p99.9=%.1fus",
+                              result.empty() ? "" : "; ", protocol_name((Protocol)p), stage_name((Stage)s),
+                              (unsigned long long)current.count(), current.quantile(0.5) / 1e3,
+                              current.quantile(0.99) / 1e3, current.quantile(0.999) / 1e3);
+                result += buffer;
+            }
+        }
+
+        return result;
+    }
+}
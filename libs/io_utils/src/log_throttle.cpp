@@ -0,0 +1,67 @@
+#include "log_throttle.h"
+
+#include "coarse_clock.h"
+
+#include <limits>
+
+namespace IO_Utils
+{
+    namespace
+    {
+        int64_t now_ns() noexcept
+        {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(Coarse_Clock::steady_now().time_since_epoch()).count();
+        }
+
+        // Окно, которое уже закончилось при любом текущем времени
+        constexpr int64_t NEVER = std::numeric_limits<int64_t>::min() / 2;
+    }
+
+    Log_Throttle::Log_Throttle(const char *site, std::chrono::milliseconds window, uint64_t burst)
+        : site_name(site),
+          window_ns(std::chrono::duration_cast<std::chrono::nanoseconds>(window).count()),
+          burst(burst),
+          window_start_ns(NEVER),
+          last_key_ns(NEVER)
+    {
+    }
+
+    bool Log_Throttle::allow_at(int64_t now, uint64_t &suppressed_before) noexcept
+    {
+        int64_t start = window_start_ns.load(std::memory_order_relaxed);
+        // Новое окно открывает один поток, счет остальных за это время приблизителен
+        if (now - start >= window_ns && window_start_ns.compare_exchange_strong(start, now, std::memory_order_relaxed))
+            window_count.store(0, std::memory_order_relaxed);
+
+        if (window_count.fetch_add(1, std::memory_order_relaxed) >= burst)
+        {
+            suppressed.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        suppressed_before = suppressed.exchange(0, std::memory_order_relaxed);
+        return true;
+    }
+
+    bool Log_Throttle::allow(uint64_t &suppressed_before) noexcept
+    {
+        return allow_at(now_ns(), suppressed_before);
+    }
+
+    bool Log_Throttle::allow(uint64_t key, uint64_t &suppressed_before) noexcept
+    {
+        int64_t now = now_ns();
+        if (last_key.load(std::memory_order_relaxed) == key && now - last_key_ns.load(std::memory_order_relaxed) < window_ns)
+        {
+            suppressed.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        if (!allow_at(now, suppressed_before))
+            return false;
+
+        last_key.store(key, std::memory_order_relaxed);
+        last_key_ns.store(now, std::memory_order_relaxed);
+        return true;
+    }
+}
@@ -0,0 +1,227 @@
+#include "metrics.h"
+
+#include <algorithm>
+#include <charconv>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+
+namespace IO_Utils
+{
+    namespace
+    {
+        // Метрики с одним именем: счетчики с разными метками и (или) Collector
+        struct Family
+        {
+            std::string name;
+            std::string help;
+            std::string type;
+            std::vector<Metrics::Id> counters;
+            std::vector<size_t> collectors;
+        };
+
+        struct Registered_Collector
+        {
+            size_t family;
+            std::function<void(Metrics::Samples &)> collect;
+        };
+
+        struct Registry
+        {
+            std::mutex mutex;
+            std::vector<Family> families;
+            std::vector<std::string> counter_labels;
+            std::vector<Metrics::Thread_Counters *> threads;
+            // Сумма по завершившимся потокам
+            uint64_t retired[Metrics::MAX_COUNTERS]{};
+            std::map<size_t, Registered_Collector> collectors;
+            size_t next_collector = 0;
+        };
+
+        // Создается при первом обращении, поэтому счетчики можно регистрировать статическими переменными других файлов
+        Registry &registry()
+        {
+            static Registry instance;
+            return instance;
+        }
+
+        size_t find_family(Registry &registry, const std::string &name, const std::string &help, const std::string &type)
+        {
+            for (size_t i = 0; i < registry.families.size(); ++i)
+            {
+                if (registry.families[i].name == name)
+                    return i;
+            }
+
+            registry.families.push_back({name, help, type, {}, {}});
+            return registry.families.size() - 1;
+        }
+
+        // Переносит значения потока в общий итог при его завершении
+        struct Thread_Guard
+        {
+            Metrics::Thread_Counters *counters = nullptr;
+            // Metrics::current этого потока, обнуляется до освобождения счетчиков
+            Metrics::Thread_Counters **current_counters = nullptr;
+
+            ~Thread_Guard()
+            {
+                if (counters == nullptr)
+                    return;
+
+                *current_counters = nullptr;
+
+                Registry &current = registry();
+                std::lock_guard lock(current.mutex);
+
+                for (size_t i = 0; i < Metrics::MAX_COUNTERS; ++i)
+                {
+                    current.retired[i] += counters->values[i].load(std::memory_order_relaxed);
+                }
+                current.threads.erase(std::find(current.threads.begin(), current.threads.end(), counters));
+
+                delete counters;
+                counters = nullptr;
+            }
+        };
+
+        thread_local Thread_Guard thread_guard;
+
+        void append_value(std::string &out, uint64_t value)
+        {
+            char buffer[24];
+            out.append(buffer, std::to_chars(buffer, buffer + sizeof(buffer), value).ptr);
+        }
+
+        void append_value(std::string &out, double value)
+        {
+            char buffer[32];
+            out.append(buffer, std::to_chars(buffer, buffer + sizeof(buffer), value).ptr);
+        }
+
+        void append_name(std::string &out, const std::string &name, const std::string &labels)
+        {
+            out += name;
+            if (!labels.empty())
+            {
+                out += '{';
+                out += labels;
+                out += '}';
+            }
+            out += ' ';
+        }
+    }
+
+    Metrics::Id Metrics::counter(const std::string &name, const std::string &help, const std::string &labels)
+    {
+        Registry &current = registry();
+        std::lock_guard lock(current.mutex);
+
+        size_t family = find_family(current, name, help, "counter");
+        for (Id id : current.families[family].counters)
+        {
+            if (current.counter_labels[id] == labels)
+                return id;
+        }
+
+        if (current.counter_labels.size() >= MAX_COUNTERS)
+            throw std::length_error("Too many metrics counters");
+
+        Id id = current.counter_labels.size();
+        current.counter_labels.push_back(labels);
+        current.families[family].counters.push_back(id);
+
+        return id;
+    }
+
+    Metrics::Thread_Counters *Metrics::register_thread()
+    {
+        Registry &current_registry = registry();
+        std::lock_guard lock(current_registry.mutex);
+
+        current = new Thread_Counters;
+        thread_guard.counters = current;
+        thread_guard.current_counters = &current;
+        current_registry.threads.push_back(current);
+
+        return current;
+    }
+
+    uint64_t Metrics::value(Id id)
+    {
+        Registry &current = registry();
+        std::lock_guard lock(current.mutex);
+
+        uint64_t sum = current.retired[id];
+        for (Thread_Counters *counters : current.threads)
+        {
+            sum += counters->values[id].load(std::memory_order_relaxed);
+        }
+
+        return sum;
+    }
+
+    Metrics::Collector::Collector(const std::string &name, const std::string &help, const std::string &type,
+                                  std::function<void(Samples &)> collect)
+    {
+        Registry &current = registry();
+        std::lock_guard lock(current.mutex);
+
+        size_t family = find_family(current, name, help, type);
+        id = current.next_collector++;
+        current.collectors[id] = {family, std::move(collect)};
+        current.families[family].collectors.push_back(id);
+    }
+
+    Metrics::Collector::~Collector()
+    {
+        Registry &current = registry();
+        std::lock_guard lock(current.mutex);
+
+        std::vector<size_t> &collectors = current.families[current.collectors.at(id).family].collectors;
+        collectors.erase(std::find(collectors.begin(), collectors.end(), id));
+        current.collectors.erase(id);
+    }
+
+    void Metrics::render(std::string &out)
+    {
+        Registry &current = registry();
+        std::lock_guard lock(current.mutex);
+
+        Samples samples;
+        for (const Family &family : current.families)
+        {
+            if (family.counters.empty() && family.collectors.empty())
+                continue;
+
+            out += "# HELP " + family.name + " " + family.help + "\n";
+            out += "# TYPE " + family.name + " " + family.type + "\n";
+
+            for (Id id : family.counters)
+            {
+                uint64_t sum = current.retired[id];
+                for (Thread_Counters *counters : current.threads)
+                {
+                    sum += counters->values[id].load(std::memory_order_relaxed);
+                }
+
+                append_name(out, family.name, current.counter_labels[id]);
+                append_value(out, sum);
+                out += '\n';
+            }
+
+            for (size_t id : family.collectors)
+            {
+                samples.clear();
+                current.collectors.at(id).collect(samples);
+
+                for (const Sample &sample : samples)
+                {
+                    append_name(out, family.name + sample.suffix, sample.labels);
+                    append_value(out, sample.value);
+                    out += '\n';
+                }
+            }
+        }
+    }
+}
@@ -1,10 +1,19 @@
 #include "network_io.h"
 
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <charconv>
 #include <cstring>
+#include <ctime>
+#include <string_view>
 #include <fcntl.h>
 #include <unistd.h>
 #include <arpa/inet.h>
 #include <netinet/in.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
 
 namespace IO_Utils{
     bool Socket::operator==(const Socket& other){
@@ -30,6 +39,46 @@ namespace IO_Utils{
         return 0;
     }
 
+    int Socket::set_receive_buffer(int fd, int bytes){
+        //SO_RCVBUFFORCE обходит rmem_max, но требует CAP_NET_ADMIN
+        if(setsockopt(fd, SOL_SOCKET, SO_RCVBUFFORCE, &bytes, sizeof(bytes)) == -1 &&
+           setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &bytes, sizeof(bytes)) == -1){
+            return -1;
+        }
+
+        int actual = 0;
+        socklen_t length = sizeof(actual);
+        if(getsockopt(fd, SOL_SOCKET, SO_RCVBUF, &actual, &length) == -1){
+            return -1;
+        }
+        return actual;
+    }
+
+    int Socket::attach_filter(int fd, const std::vector<sock_filter>& program){
+        if(program.empty()){
+            int unused = 0;
+            return setsockopt(fd, SOL_SOCKET, SO_DETACH_FILTER, &unused, sizeof(unused)) == -1 && errno != ENOENT ? -1 : 0;
+        }
+
+        sock_fprog fprog;
+        fprog.len = (unsigned short)program.size();
+        fprog.filter = const_cast<sock_filter*>(program.data());
+        if(setsockopt(fd, SOL_SOCKET, SO_ATTACH_FILTER, &fprog, sizeof(fprog)) == -1){
+            return -1;
+        }
+        return 0;
+    }
+
+    int Socket::attach_reuseport_filter(int fd, const std::vector<sock_filter>& program){
+        sock_fprog fprog;
+        fprog.len = (unsigned short)program.size();
+        fprog.filter = const_cast<sock_filter*>(program.data());
+        if(setsockopt(fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &fprog, sizeof(fprog)) == -1){
+            return -1;
+        }
+        return 0;
+    }
+
     static int set_nonblocking(int fd){
         int flags = fcntl(fd, F_GETFL, 0);
         if(flags == -1) return -1;
@@ -100,22 +149,52 @@ namespace IO_Utils{
     int UDP_Connection::recv_packet(Packet& packet){
         sockaddr_in address;
         memset(&address, 0, sizeof(address));
-        socklen_t addrlen = sizeof(address);
 
-        char buffer[BUFF_SIZE];
+        packet.data.resize(BUFF_SIZE);
 
-        int recv_bytes = recvfrom(fd, buffer, BUFF_SIZE, 0, (sockaddr*)&address, &addrlen);
+        iovec iov{packet.data.data(), BUFF_SIZE};
+        //Место под время приема ядром (SO_TIMESTAMPNS) и счетчик отброшенных ядром датаграмм (SO_RXQ_OVFL)
+        alignas(cmsghdr) char control[CMSG_SPACE(sizeof(timespec)) + CMSG_SPACE(sizeof(uint32_t))];
 
-        if(recv_bytes >= 0){
-            packet.data.clear();
+        msghdr message;
+        memset(&message, 0, sizeof(message));
+        message.msg_name = &address;
+        message.msg_namelen = sizeof(address);
+        message.msg_iov = &iov;
+        message.msg_iovlen = 1;
+        message.msg_control = control;
+        message.msg_controllen = sizeof(control);
 
-            for(size_t i = 0; i < (size_t)recv_bytes; ++i){
-                packet.data.push_back(buffer[i]);
-            }
+        int recv_bytes = recvmsg(fd, &message, 0);
+
+        if(recv_bytes >= 0){
+            packet.data.resize(recv_bytes);
 
             UDP_Socket socket{address.sin_addr.s_addr, ntohs(address.sin_port)};
             packet.set_socket(std::make_shared<UDP_Socket>(socket));
+
+            packet.timestamps.kernel_wait_ns = -1;
+            for(cmsghdr* cmsg = CMSG_FIRSTHDR(&message); cmsg != nullptr; cmsg = CMSG_NXTHDR(&message, cmsg)){
+                if(cmsg->cmsg_level != SOL_SOCKET) continue;
+
+                if(cmsg->cmsg_type == SO_RXQ_OVFL){
+                    memcpy(&kernel_drops, CMSG_DATA(cmsg), sizeof(kernel_drops));
+                }
+#if IO_UTILS_LATENCY_TRACKING
+                //Время ядра идет по CLOCK_REALTIME, поэтому сравнивается с ним же
+                else if(cmsg->cmsg_type == SCM_TIMESTAMPNS){
+                    timespec kernel_time, now;
+                    memcpy(&kernel_time, CMSG_DATA(cmsg), sizeof(kernel_time));
+                    clock_gettime(CLOCK_REALTIME, &now);
+
+                    int64_t wait_ns = (now.tv_sec - kernel_time.tv_sec) * 1'000'000'000LL + (now.tv_nsec - kernel_time.tv_nsec);
+                    packet.timestamps.kernel_wait_ns = wait_ns > 0 ? wait_ns : 0;
+                }
+#endif
+            }
         }else{
+            packet.data.clear();
+
             return -1;
         }
 
@@ -136,24 +215,111 @@ namespace IO_Utils{
         return 0;
     }    
 
+    int TCP_Connection::send_partial(const Packet& packet, size_t& sent, size_t max_bytes){
+        size_t file_length = packet.file_body != nullptr ? packet.file_body->length : 0;
+        size_t total = packet.data.size() + file_length;
+        size_t limit = sent + max_bytes;
+
+        while(sent < total && sent < limit){
+            ssize_t res;
+            if(sent < packet.data.size()){
+                size_t length = packet.data.size() - sent;
+                if(length > limit - sent) length = limit - sent;
+
+                //MSG_MORE склеивает заголовки с началом файла в одни сегменты
+                res = send(fd, packet.data.data() + sent, length, MSG_NOSIGNAL | (file_length > 0 ? MSG_MORE : 0));
+            }else{
+                size_t file_sent = sent - packet.data.size();
+                size_t length = file_length - file_sent;
+                if(length > limit - sent) length = limit - sent;
+
+                off_t offset = packet.file_body->offset + file_sent;
+                //Просим ядро заранее дочитать следующий кусок, чтобы sendfile реже ждал диск в потоке ввода-вывода
+                posix_fadvise(packet.file_body->fd, offset + length, length, POSIX_FADV_WILLNEED);
+                res = sendfile(fd, packet.file_body->fd, &offset, length);
+                //Файл оказался короче заявленного, дослать нечего
+                if(res == 0) return -1;
+            }
+
+            if(res < 0){
+                if(errno == EINTR) continue;
+                if(errno == EAGAIN || errno == EWOULDBLOCK) return 1;
+                return -1;
+            }
+
+            sent += res;
+        }
+
+        return sent < total ? 1 : 0;
+    }
+
+    File_Body::~File_Body(){
+        if(fd >= 0) close(fd);
+    }
+
     int TCP_Connection::recv_packet(Packet& packet){
-        char buffer[BUFF_SIZE];
+        //Чтение сразу в буфер пакета, его емкость потом используется под ответ
+        packet.data.resize(BUFF_SIZE);
 
-        int recv_bytes = recv(fd, buffer, BUFF_SIZE, 0);
+        int recv_bytes = recv(fd, packet.data.data(), BUFF_SIZE, 0);
 
         if(recv_bytes >= 0){
-            packet.data.clear();
-
-            for(size_t i = 0; i < (size_t)recv_bytes; ++i){
-                packet.data.push_back(buffer[i]);
-            }
+            packet.data.resize(recv_bytes);
 
             return 0;
         }else{
+            packet.data.clear();
+
             return -1;
         }
     }
 
+    int TCP_Connection::recv_append(Packet& packet, size_t max_bytes){
+        size_t size = packet.data.size();
+        packet.data.resize(size + max_bytes);
+
+        int recv_bytes = recv(fd, packet.data.data() + size, max_bytes, 0);
+
+        packet.data.resize(size + (recv_bytes > 0 ? recv_bytes : 0));
+
+        return recv_bytes;
+    }
+
+    size_t HTTP_Connection::missing_bytes(const std::vector<uint8_t>& data){
+        static constexpr std::string_view end_of_headers = "\r\n\r\n";
+        static constexpr std::string_view content_length = "content-length:";
+
+        std::string_view request{(const char*)data.data(), data.size()};
+        size_t headers_end = request.find(end_of_headers);
+        if(headers_end == std::string_view::npos){
+            return HEADERS_INCOMPLETE;
+        }
+
+        size_t received = request.size() - headers_end - end_of_headers.size();
+
+        //Строки заголовков после строки запроса, имя сравнивается без учета регистра
+        std::string_view headers = request.substr(0, headers_end);
+        for(size_t line = headers.find('\n'); line != std::string_view::npos; line = headers.find('\n', line + 1)){
+            std::string_view name = headers.substr(line + 1, content_length.size());
+            if(!std::equal(name.begin(), name.end(), content_length.begin(), content_length.end(),
+                           [](char a, char b){ return std::tolower((unsigned char)a) == b; })){
+                continue;
+            }
+
+            size_t value = headers.find_first_not_of(" \t", line + 1 + content_length.size());
+            size_t length = 0;
+            if(value == std::string_view::npos ||
+               std::from_chars(headers.data() + value, headers.data() + headers.size(), length).ec != std::errc{} ||
+               length <= received){
+                return 0;
+            }
+
+            return length - received;
+        }
+
+        return 0;
+    }
+
     int UDP_Socket::listen_or_bind(){
         int fd = socket(AF_INET, SOCK_DGRAM, 0);
         if(fd == -1){
@@ -166,6 +332,19 @@ namespace IO_Utils{
             close(fd);
             return -2;
         }
+        if (reuse_port && setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &reuse, sizeof(reuse))) {
+            close(fd);
+            return -2;
+        }
+
+#if IO_UTILS_LATENCY_TRACKING
+        //Время приема датаграммы ядром для замера ожидания в сокете, без него замер просто пропускается
+        int timestamps = 1;
+        setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPNS, &timestamps, sizeof(timestamps));
+#endif
+        //Число датаграмм, отброшенных ядром при переполнении буфера, приходит с каждой принятой датаграммой
+        int overflow = 1;
+        setsockopt(fd, SOL_SOCKET, SO_RXQ_OVFL, &overflow, sizeof(overflow));
 
         sockaddr_in address;
         memset(&address, 0, sizeof(address));
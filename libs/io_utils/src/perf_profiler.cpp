@@ -0,0 +1,210 @@
+#include "perf_profiler.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <mutex>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace IO_Utils
+{
+    namespace
+    {
+        enum Event : size_t
+        {
+            task_clock,
+            context_switches,
+            cycles,
+            instructions,
+            cache_references,
+            cache_misses,
+            EVENTS
+        };
+
+        struct Event_Config
+        {
+            uint32_t type;
+            uint64_t config;
+        };
+
+        constexpr Event_Config event_configs[EVENTS] = {
+            {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK},
+            {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES},
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_REFERENCES},
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES}};
+
+        struct Registered_Thread
+        {
+            pid_t tid;
+            std::string name;
+        };
+
+        struct Capture
+        {
+            Registered_Thread thread;
+            int fds[EVENTS];
+        };
+
+        struct Profiler_State
+        {
+            std::mutex mutex;
+            std::vector<Registered_Thread> threads;
+            bool running = false;
+            std::vector<Capture> captures;
+        };
+
+        Profiler_State &state()
+        {
+            static Profiler_State instance;
+            return instance;
+        }
+
+        int open_event(const Event_Config &event, pid_t tid)
+        {
+            perf_event_attr attr;
+            std::memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = event.type;
+            attr.config = event.config;
+            attr.disabled = 1;
+            attr.exclude_hv = 1;
+            // Доля времени, когда счетчик действительно работал, если ядро делит аппаратные счетчики между событиями
+            attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+            int fd = syscall(SYS_perf_event_open, &attr, tid, -1, -1, PERF_FLAG_FD_CLOEXEC);
+            if (fd < 0 && (errno == EACCES || errno == EPERM))
+            {
+                // При perf_event_paranoid >= 2 непривилегированному процессу доступно только время в user space
+                attr.exclude_kernel = 1;
+                fd = syscall(SYS_perf_event_open, &attr, tid, -1, -1, PERF_FLAG_FD_CLOEXEC);
+            }
+
+            return fd;
+        }
+
+        uint64_t read_scaled(int fd)
+        {
+            uint64_t values[3]{};
+            if (fd < 0 || read(fd, values, sizeof(values)) != sizeof(values) || values[2] == 0)
+                return 0;
+
+            if (values[2] == values[1])
+                return values[0];
+
+            return (uint64_t)((double)values[0] * values[1] / values[2]);
+        }
+    }
+
+    Perf_Profiler::Thread_Registration::Thread_Registration(const std::string &name) : tid((pid_t)syscall(SYS_gettid))
+    {
+        Profiler_State &current = state();
+        std::lock_guard lock(current.mutex);
+
+        current.threads.push_back({tid, name});
+    }
+
+    Perf_Profiler::Thread_Registration::~Thread_Registration()
+    {
+        Profiler_State &current = state();
+        std::lock_guard lock(current.mutex);
+
+        // Номер потока может достаться новому потоку, поэтому он убирается сразу
+        auto it = std::find_if(current.threads.begin(), current.threads.end(), [this](const Registered_Thread &thread)
+                               { return thread.tid == tid; });
+        if (it != current.threads.end())
+            current.threads.erase(it);
+    }
+
+    bool Perf_Profiler::start(int &error)
+    {
+        Profiler_State &current = state();
+        std::lock_guard lock(current.mutex);
+
+        error = EBUSY;
+        if (current.running)
+            return false;
+
+        error = current.threads.empty() ? ESRCH : 0;
+        current.captures.clear();
+        for (const Registered_Thread &thread : current.threads)
+        {
+            Capture capture{thread, {}};
+            bool opened = false;
+            for (size_t e = 0; e < EVENTS; ++e)
+            {
+                capture.fds[e] = open_event(event_configs[e], thread.tid);
+                if (capture.fds[e] < 0)
+                    error = errno;
+                else
+                    opened = true;
+            }
+
+            if (opened)
+                current.captures.push_back(capture);
+        }
+
+        if (current.captures.empty())
+            return false;
+
+        for (Capture &capture : current.captures)
+        {
+            for (int fd : capture.fds)
+            {
+                if (fd >= 0)
+                    ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+            }
+        }
+
+        current.running = true;
+        return true;
+    }
+
+    bool Perf_Profiler::running()
+    {
+        Profiler_State &current = state();
+        std::lock_guard lock(current.mutex);
+
+        return current.running;
+    }
+
+    bool Perf_Profiler::stop(std::vector<Thread_Result> &results)
+    {
+        Profiler_State &current = state();
+        std::lock_guard lock(current.mutex);
+
+        results.clear();
+        if (!current.running)
+            return false;
+
+        for (Capture &capture : current.captures)
+        {
+            Thread_Result result;
+            result.name = capture.thread.name;
+            result.tid = capture.thread.tid;
+            result.hardware = capture.fds[cycles] >= 0;
+            result.task_clock_ns = read_scaled(capture.fds[task_clock]);
+            result.context_switches = read_scaled(capture.fds[context_switches]);
+            result.cycles = read_scaled(capture.fds[cycles]);
+            result.instructions = read_scaled(capture.fds[instructions]);
+            result.cache_references = read_scaled(capture.fds[cache_references]);
+            result.cache_misses = read_scaled(capture.fds[cache_misses]);
+            results.push_back(result);
+
+            for (int fd : capture.fds)
+            {
+                if (fd >= 0)
+                    close(fd);
+            }
+        }
+
+        current.captures.clear();
+        current.running = false;
+        return true;
+    }
+}
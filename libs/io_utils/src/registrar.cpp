@@ -48,6 +48,15 @@ namespace IO_Utils
         return 0;
     }
 
+    int Registrar::modify_socket(int fd, uint32_t events)
+    {
+        epoll_event _events;
+        _events.events = events;
+        _events.data.fd = fd;
+
+        return epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &_events);
+    }
+
     int Registrar::get_epoll_fd()
     {
         return epoll_fd;
@@ -0,0 +1,177 @@
+#include "thread_placement.h"
+
+#include <linux/mempolicy.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <charconv>
+#include <filesystem>
+#include <fstream>
+
+namespace IO_Utils
+{
+    // Число из файла /sys, -1 если файла нет
+    static int read_sys_number(const std::string &path)
+    {
+        std::ifstream file(path);
+        int value = -1;
+        if (!(file >> value))
+            return -1;
+        return value;
+    }
+
+    // Список CPU в формате /sys: "0-3,8,10-11"
+    static std::vector<int> parse_cpu_list(const std::string &list)
+    {
+        std::vector<int> cpus;
+        size_t begin = 0;
+        while (begin < list.size())
+        {
+            size_t end = list.find(',', begin);
+            if (end == std::string::npos)
+                end = list.size();
+
+            int first = -1, last = -1;
+            const char *range = list.data() + begin;
+            auto [dash, error] = std::from_chars(range, list.data() + end, first);
+            if (error != std::errc{})
+                break;
+            last = first;
+            if (dash < list.data() + end && *dash == '-')
+                std::from_chars(dash + 1, list.data() + end, last);
+
+            for (int cpu = first; cpu <= last; ++cpu)
+            {
+                cpus.push_back(cpu);
+            }
+            begin = end + 1;
+        }
+
+        return cpus;
+    }
+
+    int Thread_Placement::set_name(const std::string &name)
+    {
+        return pthread_setname_np(pthread_self(), name.substr(0, 15).c_str());
+    }
+
+    int Thread_Placement::pin(const std::vector<int> &cpus)
+    {
+        if (cpus.empty())
+            return 0;
+
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int cpu : cpus)
+        {
+            if (cpu < 0 || cpu >= CPU_SETSIZE)
+            {
+                errno = EINVAL;
+                return -1;
+            }
+            CPU_SET(cpu, &set);
+        }
+
+        return sched_setaffinity(0, sizeof(set), &set);
+    }
+
+    std::vector<int> Thread_Placement::affinity()
+    {
+        std::vector<int> cpus;
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        if (sched_getaffinity(0, sizeof(set), &set) != 0)
+            return cpus;
+
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+        {
+            if (CPU_ISSET(cpu, &set))
+                cpus.push_back(cpu);
+        }
+
+        return cpus;
+    }
+
+    std::vector<int> Thread_Placement::pick(const std::vector<int> &cpus, size_t index)
+    {
+        if (cpus.empty())
+            return {};
+        return {cpus[index % cpus.size()]};
+    }
+
+    Thread_Placement::CPU_Info Thread_Placement::cpu_info(int cpu)
+    {
+        CPU_Info info;
+        std::string dir = "/sys/devices/system/cpu/cpu" + std::to_string(cpu);
+        info.core = read_sys_number(dir + "/topology/core_id");
+        info.package = read_sys_number(dir + "/topology/physical_package_id");
+
+        // Узел виден как ссылка nodeN в каталоге CPU
+        std::error_code error;
+        for (const auto &entry : std::filesystem::directory_iterator(dir, error))
+        {
+            std::string name = entry.path().filename().string();
+            int node;
+            if (name.size() > 4 && name.compare(0, 4, "node") == 0 &&
+                std::from_chars(name.data() + 4, name.data() + name.size(), node).ec == std::errc{})
+            {
+                info.node = node;
+                break;
+            }
+        }
+
+        return info;
+    }
+
+    std::vector<int> Thread_Placement::siblings(int cpu)
+    {
+        std::ifstream file("/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/topology/thread_siblings_list");
+        std::string list;
+        if (!std::getline(file, list))
+            return {cpu};
+        return parse_cpu_list(list);
+    }
+
+    int Thread_Placement::prefer_node(int node)
+    {
+        if (node < 0)
+            return (int)syscall(SYS_set_mempolicy, MPOL_DEFAULT, nullptr, 0);
+
+        unsigned long mask = 0;
+        if ((size_t)node >= sizeof(mask) * 8)
+        {
+            errno = EINVAL;
+            return -1;
+        }
+        mask = 1UL << node;
+        // Ядро считает maxnode на единицу больше числа бит маски
+        return (int)syscall(SYS_set_mempolicy, MPOL_PREFERRED, &mask, sizeof(mask) * 8 + 1);
+    }
+
+    Thread_Placement::Scope::Scope(const std::vector<int> &cpus, bool numa_local)
+    {
+        if (cpus.empty())
+            return;
+
+        previous = affinity();
+        if (pin(cpus) != 0)
+            error = errno;
+
+        if (numa_local)
+        {
+            int node = cpu_info(cpus[0]).node;
+            preferred = node >= 0 && prefer_node(node) == 0;
+        }
+    }
+
+    Thread_Placement::Scope::~Scope()
+    {
+        if (preferred)
+            prefer_node(-1);
+        if (!previous.empty())
+            pin(previous);
+    }
+}
@@ -0,0 +1,292 @@
+#include "trace.h"
+
+#include <cerrno>
+#include <condition_variable>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace IO_Utils
+{
+    namespace
+    {
+        // Дорожки очередей показываются как отдельные потоки с этими номерами
+        constexpr int64_t TRACK_TID_BASE = 1000000000;
+        constexpr const char *track_names[Tracer::TRACKS] = {"", "udp_in_queue", "http_in_queue", "udp_out_queue", "http_out_queue"};
+
+        // Кольцо одного писателя (свой поток) и одного читателя (поток записи файла)
+        struct Thread_Buffer
+        {
+            Tracer::Event events[Tracer::BUFFER_EVENTS];
+            std::atomic<uint64_t> head{0};
+            std::atomic<uint64_t> tail{0};
+            pid_t tid;
+            std::string name;
+        };
+
+        struct Trace_State
+        {
+            // Регистрация буферов, запуск и остановка записи
+            std::mutex mutex;
+            std::vector<std::shared_ptr<Thread_Buffer>> buffers;
+
+            std::thread flusher;
+            std::condition_variable stop_condition;
+            bool stop_requested = false;
+
+            std::FILE *file = nullptr;
+            bool first_event = true;
+            std::vector<bool> used_tracks;
+
+            std::atomic<uint64_t> sample_every{1};
+            std::atomic<uint64_t> sample_counter{0};
+            std::atomic<uint64_t> next_id{0};
+            std::atomic<uint64_t> written{0};
+            std::atomic<uint64_t> dropped{0};
+
+            // Запись, не остановленная до выхода из программы, дописывается
+            ~Trace_State()
+            {
+                if (!flusher.joinable())
+                    return;
+
+                {
+                    std::lock_guard lock(mutex);
+                    stop_requested = true;
+                }
+                stop_condition.notify_all();
+                flusher.join();
+            }
+        };
+
+        Trace_State &state()
+        {
+            static Trace_State instance;
+            return instance;
+        }
+
+        thread_local std::shared_ptr<Thread_Buffer> local_buffer;
+
+        Thread_Buffer *thread_buffer()
+        {
+            if (local_buffer)
+                return local_buffer.get();
+
+            // Первый участок потока, буфер остается в списке и после завершения потока, чтобы дописать его участки
+            auto buffer = std::make_shared<Thread_Buffer>();
+            buffer->tid = (pid_t)syscall(SYS_gettid);
+            char name[16]{};
+            pthread_getname_np(pthread_self(), name, sizeof(name));
+            buffer->name = name;
+
+            Trace_State &current = state();
+            {
+                std::lock_guard lock(current.mutex);
+                current.buffers.push_back(buffer);
+            }
+
+            local_buffer = std::move(buffer);
+            return local_buffer.get();
+        }
+
+        void write_event(Trace_State &current, const Thread_Buffer &buffer, const Tracer::Event &event)
+        {
+            int64_t tid = buffer.tid;
+            if (event.track != Tracer::thread_track && event.track < Tracer::TRACKS)
+            {
+                tid = TRACK_TID_BASE + event.track;
+                current.used_tracks[event.track] = true;
+            }
+
+            // Время в микросекундах
+            std::fprintf(current.file, "%s\n{\"name\":\"%s\",\"cat\":\"pgw\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%lld,\"args\":{\"id\":%llu}}",
+                         current.first_event ? "" : ",", event.name, event.begin_ns / 1000.0, event.duration_ns / 1000.0,
+                         (long long)tid, (unsigned long long)event.id);
+            current.first_event = false;
+            current.written.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        void write_thread_name(Trace_State &current, int64_t tid, const std::string &name)
+        {
+            std::fprintf(current.file, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%lld,\"args\":{\"name\":\"%s\"}}",
+                         current.first_event ? "" : ",", (long long)tid, name.c_str());
+            current.first_event = false;
+        }
+
+        // Переносит все накопленные участки в файл, вызывается только потоком записи
+        void drain(Trace_State &current, const std::vector<std::shared_ptr<Thread_Buffer>> &buffers)
+        {
+            for (const auto &buffer : buffers)
+            {
+                uint64_t tail = buffer->tail.load(std::memory_order_relaxed);
+                uint64_t head = buffer->head.load(std::memory_order_acquire);
+                for (; tail != head; ++tail)
+                {
+                    write_event(current, *buffer, buffer->events[tail % Tracer::BUFFER_EVENTS]);
+                }
+
+                buffer->tail.store(tail, std::memory_order_release);
+            }
+        }
+
+        std::vector<std::shared_ptr<Thread_Buffer>> registered_buffers(Trace_State &current)
+        {
+            std::lock_guard lock(current.mutex);
+            return current.buffers;
+        }
+
+        void flush_loop(Trace_State &current, std::chrono::steady_clock::time_point deadline, std::atomic<bool> &active)
+        {
+            {
+                std::unique_lock lock(current.mutex);
+                while (!current.stop_requested && std::chrono::steady_clock::now() < deadline)
+                {
+                    lock.unlock();
+                    drain(current, registered_buffers(current));
+                    lock.lock();
+
+                    current.stop_condition.wait_for(lock, Tracer::FLUSH_INTERVAL, [&current]
+                                                    { return current.stop_requested; });
+                }
+            }
+
+            active.store(false, std::memory_order_relaxed);
+
+            // Участки запросов, получивших номер до остановки, но завершившихся позже, теряются
+            auto buffers = registered_buffers(current);
+            drain(current, buffers);
+
+            for (const auto &buffer : buffers)
+            {
+                write_thread_name(current, buffer->tid, buffer->name);
+            }
+            for (uint32_t track = 1; track < Tracer::TRACKS; ++track)
+            {
+                if (current.used_tracks[track])
+                    write_thread_name(current, TRACK_TID_BASE + track, track_names[track]);
+            }
+
+            std::fputs("\n]}\n", current.file);
+            std::fclose(current.file);
+            current.file = nullptr;
+        }
+    }
+
+    bool Tracer::start(const std::string &path, size_t sample_every, std::chrono::milliseconds duration, int &error)
+    {
+        Trace_State &current = state();
+        std::unique_lock lock(current.mutex);
+
+        error = EBUSY;
+        if (active.load(std::memory_order_relaxed))
+            return false;
+
+        // Предыдущая запись завершилась по времени
+        if (current.flusher.joinable())
+        {
+            lock.unlock();
+            current.flusher.join();
+            lock.lock();
+            if (active.load(std::memory_order_relaxed) || current.flusher.joinable())
+                return false;
+        }
+
+        std::FILE *file = std::fopen(path.c_str(), "w");
+        if (file == nullptr)
+        {
+            error = errno;
+            return false;
+        }
+        error = 0;
+
+        std::fputs("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[", file);
+
+        // Участки, записанные после конца прошлой записи, отбрасываются. Поток записи не работает, поэтому
+        // двигать tail здесь безопасно
+        for (const auto &buffer : current.buffers)
+        {
+            buffer->tail.store(buffer->head.load(std::memory_order_acquire), std::memory_order_release);
+        }
+
+        current.file = file;
+        current.first_event = true;
+        current.used_tracks.assign(TRACKS, false);
+        current.stop_requested = false;
+        current.sample_every.store(sample_every == 0 ? 1 : sample_every, std::memory_order_relaxed);
+        current.sample_counter.store(0, std::memory_order_relaxed);
+        current.written.store(0, std::memory_order_relaxed);
+        current.dropped.store(0, std::memory_order_relaxed);
+
+        active.store(true, std::memory_order_relaxed);
+        current.flusher = std::thread(flush_loop, std::ref(current), std::chrono::steady_clock::now() + duration, std::ref(active));
+        return true;
+    }
+
+    bool Tracer::stop()
+    {
+        Trace_State &current = state();
+        std::unique_lock lock(current.mutex);
+
+        if (!active.load(std::memory_order_relaxed) || !current.flusher.joinable())
+            return false;
+
+        current.stop_requested = true;
+        current.stop_condition.notify_all();
+        lock.unlock();
+
+        current.flusher.join();
+        return true;
+    }
+
+    uint64_t Tracer::written_events()
+    {
+        return state().written.load(std::memory_order_relaxed);
+    }
+
+    uint64_t Tracer::dropped_events()
+    {
+        return state().dropped.load(std::memory_order_relaxed);
+    }
+
+    uint64_t Tracer::sample_next() noexcept
+    {
+        Trace_State &current = state();
+        if (current.sample_counter.fetch_add(1, std::memory_order_relaxed) % current.sample_every.load(std::memory_order_relaxed) != 0)
+            return 0;
+
+        return current.next_id.fetch_add(1, std::memory_order_relaxed) + 1;
+    }
+
+    void Tracer::record(const char *name, uint64_t id, int64_t begin_ns, int64_t end_ns, Track track) noexcept
+    {
+        if (!active.load(std::memory_order_relaxed))
+            return;
+
+        Thread_Buffer *buffer;
+        try
+        {
+            buffer = thread_buffer();
+        }
+        catch (...)
+        {
+            state().dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        uint64_t head = buffer->head.load(std::memory_order_relaxed);
+        if (head - buffer->tail.load(std::memory_order_acquire) >= BUFFER_EVENTS)
+        {
+            state().dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        buffer->events[head % BUFFER_EVENTS] = {name, id, begin_ns, end_ns - begin_ns, track};
+        buffer->head.store(head + 1, std::memory_order_release);
+    }
+}
@@ -0,0 +1,59 @@
+#include "coarse_clock.h"
+
+#include <gtest/gtest.h>
+
+#include <thread>
+#include <chrono>
+
+using namespace IO_Utils;
+using namespace std::chrono_literals;
+
+TEST(CoarseClockTest, FallsBackToRealClockWithoutTicker)
+{
+    auto before = std::chrono::steady_clock::now();
+    std::this_thread::sleep_for(1ms);
+    auto coarse = Coarse_Clock::steady_now();
+
+    // Без тикера часы не должны возвращать устаревшее значение
+    EXPECT_GT(coarse, before);
+}
+
+TEST(CoarseClockTest, TickerKeepsClockFresh)
+{
+    Coarse_Clock::Ticker ticker{1ms};
+
+    auto first = Coarse_Clock::steady_now();
+    std::this_thread::sleep_for(50ms);
+    auto second = Coarse_Clock::steady_now();
+
+    EXPECT_GE(second - first, 20ms);
+    // Отставание от настоящих часов ограничено точностью тикера (с запасом на планировщик)
+    EXPECT_LT(std::chrono::steady_clock::now() - second, 50ms);
+
+    auto system_diff = std::chrono::system_clock::now() - Coarse_Clock::system_now();
+    EXPECT_LT(std::chrono::abs(system_diff), std::chrono::milliseconds(50));
+}
+
+TEST(CoarseClockTest, ValueIsCachedBetweenTicks)
+{
+    Coarse_Clock::Ticker ticker{1s};
+
+    // Тикер с большой точностью не успеет обновить значение между двумя чтениями
+    auto first = Coarse_Clock::steady_now();
+    std::this_thread::sleep_for(5ms);
+    auto second = Coarse_Clock::steady_now();
+
+    EXPECT_EQ(first, second);
+}
+
+TEST(CoarseClockTest, ManualTickNeverGoesBackwards)
+{
+    Coarse_Clock::Ticker ticker{1s};
+
+    auto first = Coarse_Clock::steady_now();
+    std::this_thread::sleep_for(2ms);
+    Coarse_Clock::tick();
+    auto second = Coarse_Clock::steady_now();
+
+    EXPECT_GT(second, first);
+}
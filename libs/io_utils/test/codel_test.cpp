@@ -0,0 +1,67 @@
+#include "codel.h"
+
+#include <gtest/gtest.h>
+
+using namespace IO_Utils;
+
+namespace
+{
+    constexpr int64_t MS = 1'000'000;
+    constexpr int64_t US = 1'000;
+}
+
+TEST(CodelTest, AdmitsShortQueueDelay)
+{
+    Codel_Controller controller{{std::chrono::milliseconds(5), std::chrono::milliseconds(100)}};
+
+    // Очередь регулярно опустошается
+    for (int64_t now = 0; now < 1000 * MS; now += MS)
+    {
+        ASSERT_TRUE(controller.admit(MS, now));
+        controller.queue_empty();
+        ASSERT_FALSE(controller.shed_incoming(10));
+    }
+    EXPECT_FALSE(controller.overloaded());
+    EXPECT_EQ(controller.last_sojourn_ns(), MS);
+}
+
+TEST(CodelTest, LimitsDelayOfStandingQueue)
+{
+    Codel_Controller controller{{std::chrono::milliseconds(5), std::chrono::milliseconds(100)}};
+
+    // Без постоянной очереди допускается ожидание до interval
+    ASSERT_TRUE(controller.admit(50 * MS, 0));
+    ASSERT_FALSE(controller.admit(150 * MS, MS));
+
+    // Очередь не опустошалась дольше interval: допускается только target
+    ASSERT_TRUE(controller.admit(4 * MS, 50 * MS));
+    ASSERT_FALSE(controller.admit(20 * MS, 150 * MS));
+    EXPECT_TRUE(controller.overloaded());
+
+    // После опустошения снова долгий предел
+    controller.queue_empty();
+    EXPECT_FALSE(controller.overloaded());
+    ASSERT_TRUE(controller.admit(20 * MS, 200 * MS));
+}
+
+TEST(CodelTest, ShedsIncomingAboveTargetQueueLength)
+{
+    Codel_Controller controller{{std::chrono::milliseconds(5), std::chrono::milliseconds(100)}};
+
+    // Обработка по 10 мкс без опустошения очереди: за target разбирается 500 запросов
+    int64_t now = 0;
+    for (; now <= 200 * MS; now += 10 * US)
+    {
+        controller.admit(2 * MS, now);
+    }
+    ASSERT_TRUE(controller.overloaded());
+    EXPECT_EQ(controller.target_queue_length(), 500u);
+
+    EXPECT_FALSE(controller.shed_incoming(0));
+    EXPECT_FALSE(controller.shed_incoming(499));
+    EXPECT_TRUE(controller.shed_incoming(500));
+
+    // Очередь опустела - перегрузки нет при любой длине
+    controller.queue_empty();
+    EXPECT_FALSE(controller.shed_incoming(10000));
+}
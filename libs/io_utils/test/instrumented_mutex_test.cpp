@@ -0,0 +1,116 @@
+#include "instrumented_mutex.h"
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include <vector>
+
+using namespace IO_Utils;
+
+TEST(InstrumentedMutexTest, CountsAcquisitions)
+{
+    Instrumented_Shared_Mutex mutex;
+
+    for (size_t i = 0; i < 3; ++i)
+    {
+        std::unique_lock lock(mutex);
+    }
+    for (size_t i = 0; i < 5; ++i)
+    {
+        std::shared_lock lock(mutex);
+    }
+    {
+        std::unique_lock lock(mutex, std::try_to_lock);
+        ASSERT_TRUE(lock.owns_lock());
+    }
+
+    Lock_Stats stats = mutex.stats();
+    EXPECT_EQ(stats.exclusive.acquisitions, 4u);
+    EXPECT_EQ(stats.shared.acquisitions, 5u);
+    // Без соперников ожиданий нет
+    EXPECT_EQ(stats.exclusive.contended, 0u);
+    EXPECT_EQ(stats.shared.contended, 0u);
+    EXPECT_EQ(stats.exclusive.wait_ns, 0u);
+}
+
+// Общие захваты из многих потоков считаются по ячейкам потоков, сумма при чтении точная
+TEST(InstrumentedMutexTest, SumsSharedAcquisitionsAcrossThreads)
+{
+    Instrumented_Shared_Mutex mutex;
+    constexpr size_t threads_count = Instrumented_Shared_Mutex::SHARED_SLOTS + 4, per_thread = 1000;
+
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < threads_count; ++t)
+    {
+        threads.emplace_back([&mutex]()
+                             {
+            for (size_t i = 0; i < per_thread; ++i)
+            {
+                std::shared_lock lock(mutex);
+            } });
+    }
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+
+    EXPECT_EQ(mutex.stats().shared.acquisitions, threads_count * per_thread);
+}
+
+TEST(InstrumentedMutexTest, SamplesHoldTime)
+{
+    Instrumented_Shared_Mutex mutex;
+
+    // Замеряется каждый HOLD_SAMPLE_PERIOD захват потока, независимо от мьютекса
+    for (size_t i = 0; i < 2 * Instrumented_Shared_Mutex::HOLD_SAMPLE_PERIOD; ++i)
+    {
+        std::unique_lock lock(mutex);
+    }
+    for (size_t i = 0; i < 2 * Instrumented_Shared_Mutex::HOLD_SAMPLE_PERIOD; ++i)
+    {
+        std::shared_lock lock(mutex);
+    }
+
+    Lock_Stats stats = mutex.stats();
+    EXPECT_EQ(stats.exclusive.sampled_holds, 2u);
+    EXPECT_EQ(stats.shared.sampled_holds, 2u);
+    EXPECT_GE(stats.exclusive.max_hold_ns * stats.exclusive.sampled_holds, stats.exclusive.hold_ns);
+}
+
+TEST(InstrumentedMutexTest, RecordsWaits)
+{
+    Instrumented_Shared_Mutex mutex;
+    std::atomic<bool> locked{false};
+
+    std::thread holder([&]()
+                       {
+                           std::unique_lock lock(mutex);
+                           locked.store(true);
+                           std::this_thread::sleep_for(std::chrono::milliseconds(30)); });
+
+    while (!locked.load())
+    {
+        std::this_thread::yield();
+    }
+
+    {
+        std::shared_lock lock(mutex);
+    }
+    holder.join();
+
+    Lock_Stats stats = mutex.stats();
+    EXPECT_EQ(stats.shared.contended, 1u);
+    EXPECT_GE(stats.shared.wait_ns, 10'000'000u);
+    EXPECT_EQ(stats.shared.max_wait_ns, stats.shared.wait_ns);
+    EXPECT_EQ(stats.exclusive.contended, 0u);
+
+    if (IO_UTILS_LOCK_CALL_SITES)
+    {
+        EXPECT_FALSE(Instrumented_Shared_Mutex::top_call_sites(10).empty());
+    }
+    else
+        EXPECT_TRUE(Instrumented_Shared_Mutex::top_call_sites(10).empty());
+}
@@ -0,0 +1,94 @@
+#include "latency.h"
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <initializer_list>
+#include <limits>
+
+using namespace IO_Utils;
+
+TEST(LatencyTest, BucketBounds)
+{
+    // Малые значения точные, дальше каждое значение попадает в интервал с верхней границей не меньше него
+    // и не больше чем на 12.5% выше
+    for (uint64_t value = 0; value < Latency_Histogram::SUB_BUCKETS; ++value)
+    {
+        EXPECT_EQ(Latency_Histogram::bucket_upper_bound(Latency_Histogram::bucket_index(value)), value);
+    }
+
+    for (uint64_t value : std::initializer_list<uint64_t>{8, 9, 15, 16, 17, 1000, 123456789, 1ull << 40, std::numeric_limits<uint64_t>::max()})
+    {
+        size_t index = Latency_Histogram::bucket_index(value);
+        ASSERT_LT(index, Latency_Histogram::BUCKETS);
+
+        uint64_t upper = Latency_Histogram::bucket_upper_bound(index);
+        EXPECT_GE(upper, value);
+        EXPECT_LE(upper - value, value / 8);
+        // Следующее значение после границы уже в следующем интервале
+        if (upper != std::numeric_limits<uint64_t>::max())
+        {
+            EXPECT_EQ(Latency_Histogram::bucket_index(upper + 1), index + 1);
+        }
+    }
+}
+
+TEST(LatencyTest, Quantiles)
+{
+    Latency_Histogram histogram;
+    EXPECT_EQ(histogram.quantile(0.5), 0u);
+
+    // 90 значений по 1 мкс и 10 по 1 мс
+    for (size_t i = 0; i < 90; ++i)
+    {
+        histogram.record(1000);
+    }
+    for (size_t i = 0; i < 10; ++i)
+    {
+        histogram.record(1'000'000);
+    }
+    // Отрицательная разница (часы разных этапов) считается нулем
+    histogram.record(-5);
+
+    EXPECT_EQ(histogram.count(), 101u);
+    EXPECT_EQ(histogram.sum(), 90u * 1000 + 10u * 1'000'000);
+
+    EXPECT_EQ(histogram.quantile(0.0), 0u);
+    EXPECT_EQ(histogram.quantile(0.5), Latency_Histogram::bucket_upper_bound(Latency_Histogram::bucket_index(1000)));
+    EXPECT_EQ(histogram.quantile(0.99), Latency_Histogram::bucket_upper_bound(Latency_Histogram::bucket_index(1'000'000)));
+    EXPECT_EQ(histogram.quantile(1.0), Latency_Histogram::bucket_upper_bound(Latency_Histogram::bucket_index(1'000'000)));
+}
+
+TEST(LatencyTest, RecordSentStages)
+{
+    const Latency_Histogram &total = Packet_Latency::histogram(Packet_Latency::udp, Packet_Latency::total);
+    const Latency_Histogram &socket = Packet_Latency::histogram(Packet_Latency::udp, Packet_Latency::socket);
+    uint64_t total_before = total.count();
+    uint64_t socket_before = socket.count();
+
+    Packet_Timestamps timestamps;
+    int64_t now = Packet_Latency::now_ns();
+    timestamps.received_ns = now - 4000;
+    timestamps.enqueued_ns = now - 3000;
+    timestamps.dequeued_ns = now - 2000;
+    timestamps.handled_ns = now - 1000;
+
+    Packet_Latency::record_sent(timestamps, Packet_Latency::udp);
+
+    if (IO_UTILS_LATENCY_TRACKING)
+    {
+        EXPECT_EQ(total.count() - total_before, 1u);
+        // Время ядра неизвестно, этап пропускается
+        EXPECT_EQ(socket.count(), socket_before);
+        EXPECT_NE(Packet_Latency::summary().find("udp/in_queue"), std::string::npos);
+    }
+    else
+    {
+        EXPECT_EQ(total.count(), total_before);
+    }
+
+    // Пакет без отметок (создан не IO потоком) не учитывается
+    total_before = total.count();
+    Packet_Latency::record_sent(Packet_Timestamps{}, Packet_Latency::udp);
+    EXPECT_EQ(total.count(), total_before);
+}
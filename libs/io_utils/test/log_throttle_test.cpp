@@ -0,0 +1,73 @@
+#include "log_throttle.h"
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace IO_Utils;
+
+TEST(LogThrottleTest, AllowsBurstPerWindow)
+{
+    Log_Throttle throttle{"test", std::chrono::milliseconds(50), 3};
+
+    uint64_t suppressed = 100;
+    for (int i = 0; i < 3; ++i)
+    {
+        ASSERT_TRUE(throttle.allow(suppressed));
+        EXPECT_EQ(suppressed, 0u);
+    }
+    for (int i = 0; i < 5; ++i)
+    {
+        ASSERT_FALSE(throttle.allow(suppressed));
+    }
+
+    // Первое сообщение следующего окна несет число подавленных
+    std::this_thread::sleep_for(std::chrono::milliseconds(60));
+    ASSERT_TRUE(throttle.allow(suppressed));
+    EXPECT_EQ(suppressed, 5u);
+    ASSERT_TRUE(throttle.allow(suppressed));
+    EXPECT_EQ(suppressed, 0u);
+    EXPECT_STREQ(throttle.site(), "test");
+}
+
+TEST(LogThrottleTest, SuppressesRepeatedKey)
+{
+    Log_Throttle throttle{"test", std::chrono::milliseconds(50), 10};
+
+    uint64_t suppressed = 0;
+    ASSERT_TRUE(throttle.allow(1, suppressed));
+    ASSERT_FALSE(throttle.allow(1, suppressed));
+    ASSERT_FALSE(throttle.allow(1, suppressed));
+    ASSERT_TRUE(throttle.allow(2, suppressed));
+    EXPECT_EQ(suppressed, 2u);
+    ASSERT_TRUE(throttle.allow(1, suppressed));
+
+    // Повтор после окна снова пишется
+    std::this_thread::sleep_for(std::chrono::milliseconds(60));
+    ASSERT_TRUE(throttle.allow(1, suppressed));
+    EXPECT_EQ(suppressed, 0u);
+}
+
+TEST(LogThrottleTest, MacroEvaluatesArgumentsOnlyWhenAllowed)
+{
+    Log_Throttle throttle{"test", std::chrono::seconds(10), 2};
+
+    int evaluated = 0;
+    std::vector<std::string> logged;
+    auto argument = [&evaluated]
+    { return ++evaluated; };
+    auto record = [&logged](void *, const char *fmt, auto &&...)
+    { logged.push_back(fmt); };
+#define TEST_LOG(logger, fmt, ...) record(logger, fmt __VA_OPT__(, ) __VA_ARGS__)
+    for (int i = 0; i < 10; ++i)
+    {
+        IO_UTILS_LOG_THROTTLED(throttle, TEST_LOG, nullptr, "message {}", argument());
+    }
+#undef TEST_LOG
+
+    ASSERT_EQ(logged.size(), 2u);
+    EXPECT_EQ(logged[0], "message {}");
+    EXPECT_EQ(evaluated, 2);
+}
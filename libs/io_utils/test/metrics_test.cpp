@@ -0,0 +1,68 @@
+#include "metrics.h"
+
+#include <gtest/gtest.h>
+
+#include <thread>
+#include <vector>
+
+using namespace IO_Utils;
+
+TEST(MetricsTest, CountersSumOverThreads)
+{
+    Metrics::Id id = Metrics::counter("test_sum_total", "Test counter", "kind=\"a\"");
+    ASSERT_EQ(Metrics::counter("test_sum_total", "Test counter", "kind=\"a\""), id);
+
+    uint64_t before = Metrics::value(id);
+
+    // Значения завершившихся потоков не должны теряться
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < 4; ++t)
+    {
+        threads.emplace_back([id]()
+                             {
+                                 for (size_t i = 0; i < 10000; ++i)
+                                 {
+                                     Metrics::add(id);
+                                 } });
+    }
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+    Metrics::add(id, 5);
+
+    EXPECT_EQ(Metrics::value(id) - before, 40005u);
+}
+
+TEST(MetricsTest, RenderPrometheusText)
+{
+    Metrics::Id a = Metrics::counter("test_render_total", "Render test", "kind=\"a\"");
+    Metrics::Id b = Metrics::counter("test_render_total", "Render test", "kind=\"b\"");
+    Metrics::add(a, 3);
+    Metrics::add(b, 7);
+
+    std::string out;
+    {
+        Metrics::Collector collector{"test_render_gauge", "Gauge test", "gauge", [](Metrics::Samples &samples)
+                                     {
+                                         samples.emplace_back("", 1.5);
+                                         samples.emplace_back("shard=\"1\"", 2);
+                                     }};
+        Metrics::render(out);
+    }
+
+    EXPECT_NE(out.find("# HELP test_render_total Render test\n"
+                       "# TYPE test_render_total counter\n"
+                       "test_render_total{kind=\"a\"} 3\n"
+                       "test_render_total{kind=\"b\"} 7\n"),
+              std::string::npos);
+    EXPECT_NE(out.find("# TYPE test_render_gauge gauge\n"
+                       "test_render_gauge 1.5\n"
+                       "test_render_gauge{shard=\"1\"} 2\n"),
+              std::string::npos);
+
+    // После удаления Collector его значения больше не выводятся
+    out.clear();
+    Metrics::render(out);
+    EXPECT_EQ(out.find("test_render_gauge"), std::string::npos);
+}
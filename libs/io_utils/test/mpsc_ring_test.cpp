@@ -0,0 +1,106 @@
+#include "mpsc_ring.h"
+
+#include <gtest/gtest.h>
+
+#include <thread>
+#include <atomic>
+#include <vector>
+
+using namespace IO_Utils;
+
+struct Record
+{
+    uint32_t producer;
+    uint32_t value;
+};
+
+TEST(MPSCRingTest, PushPopSingleElement)
+{
+    MPSC_Ring<Record> ring(4);
+    ASSERT_TRUE(ring.try_push({1, 42}));
+
+    Record record;
+    ASSERT_TRUE(ring.try_pop(record));
+    EXPECT_EQ(record.producer, 1);
+    EXPECT_EQ(record.value, 42);
+    EXPECT_FALSE(ring.try_pop(record));
+}
+
+TEST(MPSCRingTest, CapacityRoundedToPowerOfTwo)
+{
+    MPSC_Ring<Record> ring(5);
+    EXPECT_EQ(ring.get_capacity(), 8);
+}
+
+TEST(MPSCRingTest, PushUntilFull)
+{
+    MPSC_Ring<Record> ring(4);
+    for (uint32_t i = 0; i < 4; ++i)
+    {
+        EXPECT_TRUE(ring.try_push({0, i}));
+    }
+    EXPECT_FALSE(ring.try_push({0, 100}));
+    EXPECT_EQ(ring.pushed(), 4);
+
+    // После освобождения ячейки запись снова возможна
+    Record record;
+    ASSERT_TRUE(ring.try_pop(record));
+    EXPECT_EQ(record.value, 0);
+    EXPECT_TRUE(ring.try_push({0, 4}));
+}
+
+TEST(MPSCRingTest, WrapAroundKeepsOrder)
+{
+    MPSC_Ring<Record> ring(4);
+    Record record;
+
+    for (uint32_t i = 0; i < 100; ++i)
+    {
+        ASSERT_TRUE(ring.try_push({0, i}));
+        ASSERT_TRUE(ring.try_pop(record));
+        EXPECT_EQ(record.value, i);
+    }
+}
+
+TEST(MPSCRingTest, MultipleProducersSingleConsumer)
+{
+    constexpr uint32_t producers = 4;
+    constexpr uint32_t per_producer = 100000;
+
+    MPSC_Ring<Record> ring(1024);
+    std::vector<std::thread> threads;
+
+    for (uint32_t p = 0; p < producers; ++p)
+    {
+        threads.emplace_back([&ring, p]()
+                             {
+                                 for (uint32_t i = 0; i < per_producer; ++i)
+                                 {
+                                     while (!ring.try_push({p, i}))
+                                     {
+                                         std::this_thread::yield();
+                                     }
+                                 } });
+    }
+
+    // От каждого писателя элементы должны приходить по порядку и без потерь
+    std::vector<uint32_t> expected(producers, 0);
+    size_t received = 0;
+    Record record;
+    while (received < producers * per_producer)
+    {
+        if (ring.try_pop(record))
+        {
+            ASSERT_EQ(record.value, expected[record.producer]);
+            expected[record.producer]++;
+            received++;
+        }
+    }
+
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+
+    EXPECT_FALSE(ring.try_pop(record));
+}
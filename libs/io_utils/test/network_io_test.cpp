@@ -4,6 +4,12 @@
 #include <gmock/gmock.h>
 
 #include <netinet/in.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <thread>
 
 using namespace IO_Utils;
 
@@ -83,6 +89,103 @@ TEST(NetworkIOTest, UDPConnectionSendReceive)
     close(receiver_fd);
 }
 
+TEST(NetworkIOTest, UDPKernelDropsReported)
+{
+    UDP_Socket sender(INADDR_ANY, 0);
+    int sender_fd = sender.listen_or_bind();
+    ASSERT_GT(sender_fd, 0);
+
+    UDP_Socket receiver(0x100007F, 0);
+    int receiver_fd = receiver.listen_or_bind();
+    ASSERT_GT(receiver_fd, 0);
+    // Ядро поднимает слишком маленький размер до своего минимума
+    EXPECT_GT(Socket::set_receive_buffer(receiver_fd, 1), 0);
+
+    sockaddr_in receiver_addr;
+    socklen_t len = sizeof(receiver_addr);
+    getsockname(receiver_fd, (sockaddr *)&receiver_addr, &len);
+
+    UDP_Connection sender_conn(sender_fd);
+    UDP_Connection receiver_conn(receiver_fd);
+
+    Packet send_packet(std::make_shared<UDP_Socket>(receiver_addr.sin_addr.s_addr, ntohs(receiver_addr.sin_port)));
+    send_packet.data.assign(512, 1);
+    for (int i = 0; i < 100; ++i)
+    {
+        sender_conn.send_packet(send_packet);
+    }
+
+    // Буфер переполнен, часть датаграмм отброшена
+    Packet recv_packet(nullptr);
+    int received = 0;
+    while (receiver_conn.recv_packet(recv_packet) == 0)
+    {
+        received++;
+    }
+    EXPECT_GT(received, 0);
+    EXPECT_LT(received, 100);
+
+    // Счетчик ядра запоминается при постановке датаграммы в буфер, поэтому отброшенные видны со следующей
+    sender_conn.send_packet(send_packet);
+    ASSERT_EQ(receiver_conn.recv_packet(recv_packet), 0);
+    EXPECT_EQ(receiver_conn.kernel_drops, 100u - received);
+
+    close(sender_fd);
+    close(receiver_fd);
+}
+
+TEST(NetworkIOTest, UDPSocketFilter)
+{
+    UDP_Socket sender(INADDR_ANY, 0);
+    int sender_fd = sender.listen_or_bind();
+    ASSERT_GT(sender_fd, 0);
+
+    UDP_Socket receiver(0x100007F, 0);
+    int receiver_fd = receiver.listen_or_bind();
+    ASSERT_GT(receiver_fd, 0);
+
+    sockaddr_in receiver_addr;
+    socklen_t len = sizeof(receiver_addr);
+    getsockname(receiver_fd, (sockaddr *)&receiver_addr, &len);
+
+    UDP_Connection sender_conn(sender_fd);
+    UDP_Connection receiver_conn(receiver_fd);
+
+    // Пропускает только датаграммы, в UDP заголовке которых длина 8 + 2
+    std::vector<sock_filter> program = {
+        BPF_STMT(BPF_LD | BPF_H | BPF_ABS, 4),
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 10, 0, 1),
+        BPF_STMT(BPF_RET | BPF_K, 0xFFFFFFFF),
+        BPF_STMT(BPF_RET | BPF_K, 0),
+    };
+    ASSERT_EQ(Socket::attach_filter(receiver_fd, program), 0);
+
+    Packet send_packet(std::make_shared<UDP_Socket>(receiver_addr.sin_addr.s_addr, ntohs(receiver_addr.sin_port)));
+    send_packet.data = {1, 2, 3};
+    EXPECT_EQ(sender_conn.send_packet(send_packet), 0);
+    send_packet.data = {1, 2};
+    EXPECT_EQ(sender_conn.send_packet(send_packet), 0);
+
+    Packet recv_packet(nullptr);
+    EXPECT_EQ(receiver_conn.recv_packet(recv_packet), 0);
+    EXPECT_EQ(recv_packet.data, std::vector<uint8_t>({1, 2}));
+    // Отброшенные фильтром ядро считает вместе с потерями от переполнения буфера (SO_RXQ_OVFL)
+    EXPECT_EQ(receiver_conn.kernel_drops, 1u);
+    EXPECT_EQ(receiver_conn.recv_packet(recv_packet), -1);
+
+    // Без фильтра проходит все
+    ASSERT_EQ(Socket::attach_filter(receiver_fd, {}), 0);
+    send_packet.data = {1, 2, 3};
+    EXPECT_EQ(sender_conn.send_packet(send_packet), 0);
+    EXPECT_EQ(receiver_conn.recv_packet(recv_packet), 0);
+    EXPECT_EQ(recv_packet.data, std::vector<uint8_t>({1, 2, 3}));
+
+    EXPECT_EQ(Socket::attach_filter(-1, program), -1);
+
+    close(sender_fd);
+    close(receiver_fd);
+}
+
 TEST(NetworkIOTest, TCPSocketConnectAccept)
 {
     TCP_Socket server(INADDR_ANY, 0);
@@ -167,4 +270,71 @@ TEST(NetworkIOTest, TCPConnectionSendReceive)
     server_thread.join();
     close(server_fd);
     close(client_fd);
-}
\ No newline at end of file
+}
+TEST(NetworkIOTest, TCPSendPartialWithFileBody)
+{
+    int sockets[2];
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, sockets), 0);
+    fcntl(sockets[0], F_SETFL, fcntl(sockets[0], F_GETFL, 0) | O_NONBLOCK);
+
+    // Файл больше буфера сокета, чтобы отправка шла в несколько вызовов
+    std::vector<uint8_t> file_data(1024 * 1024);
+    for (size_t i = 0; i < file_data.size(); ++i)
+    {
+        file_data[i] = (uint8_t)(i * 7);
+    }
+    char path[] = "/tmp/network_io_test_XXXXXX";
+    int file_fd = mkstemp(path);
+    ASSERT_GE(file_fd, 0);
+    unlink(path);
+    ASSERT_EQ(write(file_fd, file_data.data(), file_data.size()), (ssize_t)file_data.size());
+
+    Packet packet(nullptr);
+    packet.data = {'h', 'e', 'a', 'd'};
+    // Отправляется файл без первых 100 байт
+    packet.file_body = std::make_shared<File_Body>(file_fd, 100, file_data.size() - 100);
+
+    std::vector<uint8_t> received;
+    std::thread reader([&]
+                       {
+        uint8_t buffer[65536];
+        ssize_t res;
+        while ((res = recv(sockets[1], buffer, sizeof(buffer), 0)) > 0)
+            received.insert(received.end(), buffer, buffer + res); });
+
+    TCP_Connection conn(sockets[0]);
+    size_t sent = 0;
+    size_t calls = 0;
+    int res;
+    while ((res = conn.send_partial(packet, sent, 64 * 1024)) == 1)
+    {
+        calls++;
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+    EXPECT_EQ(res, 0);
+    EXPECT_EQ(sent, 4 + file_data.size() - 100);
+    EXPECT_GT(calls, 0u);
+
+    close(sockets[0]);
+    reader.join();
+    close(sockets[1]);
+
+    ASSERT_EQ(received.size(), 4 + file_data.size() - 100);
+    EXPECT_EQ(std::vector<uint8_t>(received.begin(), received.begin() + 4), packet.data);
+    EXPECT_TRUE(std::equal(received.begin() + 4, received.end(), file_data.begin() + 100));
+}
+
+TEST(NetworkIOTest, HTTPMissingBytes)
+{
+    auto missing = [](const std::string &request)
+    {
+        return HTTP_Connection::missing_bytes(std::vector<uint8_t>(request.begin(), request.end()));
+    };
+
+    EXPECT_EQ(missing("GET /stop HTTP/1.1\r\nHost: x"), HTTP_Connection::HEADERS_INCOMPLETE);
+    EXPECT_EQ(missing("GET /stop HTTP/1.1\r\nHost: x\r\n\r\n"), 0u);
+    EXPECT_EQ(missing("POST /check_subscribers HTTP/1.1\r\ncontent-length: 10\r\n\r\n1234"), 6u);
+    EXPECT_EQ(missing("POST /check_subscribers HTTP/1.1\r\nContent-Length:4\r\n\r\n1234"), 0u);
+    // Непонятную длину проверяет обработчик
+    EXPECT_EQ(missing("POST /check_subscribers HTTP/1.1\r\nContent-Length: x\r\n\r\n1234"), 0u);
+}
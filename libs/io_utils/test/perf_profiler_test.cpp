@@ -0,0 +1,46 @@
+#include "perf_profiler.h"
+
+#include <gtest/gtest.h>
+
+#include <cerrno>
+#include <chrono>
+
+using namespace IO_Utils;
+
+TEST(PerfProfilerTest, CapturesRegisteredThread)
+{
+    std::vector<Perf_Profiler::Thread_Result> results;
+    ASSERT_FALSE(Perf_Profiler::stop(results));
+
+    Perf_Profiler::Thread_Registration registration{"test"};
+
+    int error = 0;
+    if (!Perf_Profiler::start(error))
+        GTEST_SKIP() << "perf_event_open is not available, errno = " << error;
+
+    // Второе окно не открывается, пока не закрыто первое
+    int second_error = 0;
+    EXPECT_FALSE(Perf_Profiler::start(second_error));
+    EXPECT_TRUE(Perf_Profiler::running());
+
+    // Немного процессорного времени для счетчиков
+    volatile uint64_t sum = 0;
+    auto end = std::chrono::steady_clock::now() + std::chrono::milliseconds(20);
+    while (std::chrono::steady_clock::now() < end)
+    {
+        sum = sum + 1;
+    }
+
+    ASSERT_TRUE(Perf_Profiler::stop(results));
+    EXPECT_FALSE(Perf_Profiler::running());
+
+    ASSERT_EQ(results.size(), 1u);
+    EXPECT_EQ(results[0].name, "test");
+    EXPECT_GT(results[0].task_clock_ns, 5'000'000u);
+    if (results[0].hardware)
+    {
+        EXPECT_GT(results[0].instructions, 0u);
+    }
+    else
+        EXPECT_EQ(results[0].cycles, 0u);
+}
@@ -67,4 +67,26 @@ TEST(RegistrarTest, EpollWait)
     registrar.deregister_socket(pipe_fds[0]);
     close(pipe_fds[0]);
     close(pipe_fds[1]);
-}
\ No newline at end of file
+}
+TEST(RegistrarTest, ModifyEvents)
+{
+    Registrar registrar;
+    int pipe_fds[2];
+    ASSERT_EQ(pipe(pipe_fds), 0);
+
+    ASSERT_EQ(registrar.register_socket(pipe_fds[0], EPOLLIN), 0);
+    write(pipe_fds[1], "test", 4);
+
+    // Без EPOLLIN готовые данные не будят epoll_wait
+    ASSERT_EQ(registrar.modify_socket(pipe_fds[0], 0), 0);
+    epoll_event events[1];
+    EXPECT_EQ(epoll_wait(registrar.get_epoll_fd(), events, 1, 50), 0);
+
+    ASSERT_EQ(registrar.modify_socket(pipe_fds[0], EPOLLIN), 0);
+    EXPECT_EQ(epoll_wait(registrar.get_epoll_fd(), events, 1, 50), 1);
+
+    EXPECT_LT(registrar.modify_socket(pipe_fds[1], EPOLLIN), 0);
+
+    registrar.deregister_socket(pipe_fds[0]);
+    close(pipe_fds[1]);
+}
@@ -0,0 +1,120 @@
+#include "thread_placement.h"
+
+#include <gtest/gtest.h>
+
+#include <pthread.h>
+#include <sched.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <thread>
+
+using namespace IO_Utils;
+
+TEST(ThreadPlacementTest, NameIsTruncatedToKernelLimit)
+{
+    std::string name;
+    std::thread thread([&name]()
+                       {
+        EXPECT_EQ(Thread_Placement::set_name("pgw-process-with-long-name"), 0);
+        char buffer[32]{};
+        pthread_getname_np(pthread_self(), buffer, sizeof(buffer));
+        name = buffer; });
+    thread.join();
+
+    EXPECT_EQ(name, "pgw-process-wit");
+}
+
+TEST(ThreadPlacementTest, PinsToAllowedCpu)
+{
+    std::vector<int> allowed = Thread_Placement::affinity();
+    ASSERT_FALSE(allowed.empty());
+
+    std::thread thread([&allowed]()
+                       {
+        int cpu = allowed.back();
+        ASSERT_EQ(Thread_Placement::pin({cpu}), 0);
+        EXPECT_EQ(Thread_Placement::affinity(), std::vector<int>{cpu});
+        EXPECT_EQ(sched_getcpu(), cpu); });
+    thread.join();
+}
+
+TEST(ThreadPlacementTest, RejectsInvalidCpu)
+{
+    std::vector<int> before = Thread_Placement::affinity();
+
+    EXPECT_EQ(Thread_Placement::pin({-1}), -1);
+    EXPECT_EQ(errno, EINVAL);
+    EXPECT_EQ(Thread_Placement::pin({CPU_SETSIZE}), -1);
+    // Пустой список не закрепляет поток
+    EXPECT_EQ(Thread_Placement::pin({}), 0);
+
+    EXPECT_EQ(Thread_Placement::affinity(), before);
+}
+
+TEST(ThreadPlacementTest, ScopeRestoresAffinity)
+{
+    std::vector<int> before = Thread_Placement::affinity();
+    ASSERT_FALSE(before.empty());
+
+    {
+        Thread_Placement::Scope scope({before.front()}, true);
+        EXPECT_EQ(Thread_Placement::affinity(), std::vector<int>{before.front()});
+    }
+    EXPECT_EQ(Thread_Placement::affinity(), before);
+
+    // Без CPU Scope ничего не меняет
+    {
+        Thread_Placement::Scope scope({}, true);
+        EXPECT_EQ(Thread_Placement::affinity(), before);
+    }
+}
+
+TEST(ThreadPlacementTest, ScopeReportsPinError)
+{
+    std::vector<int> before = Thread_Placement::affinity();
+
+    {
+        Thread_Placement::Scope scope({-1}, false);
+        EXPECT_EQ(scope.pin_error(), EINVAL);
+    }
+    EXPECT_EQ(Thread_Placement::affinity(), before);
+
+    Thread_Placement::Scope scope({before.front()}, false);
+    EXPECT_EQ(scope.pin_error(), 0);
+}
+
+TEST(ThreadPlacementTest, PickCyclesThroughList)
+{
+    std::vector<int> cpus{2, 5, 7};
+
+    EXPECT_EQ(Thread_Placement::pick(cpus, 0), std::vector<int>{2});
+    EXPECT_EQ(Thread_Placement::pick(cpus, 2), std::vector<int>{7});
+    EXPECT_EQ(Thread_Placement::pick(cpus, 4), std::vector<int>{5});
+    EXPECT_TRUE(Thread_Placement::pick({}, 3).empty());
+}
+
+TEST(ThreadPlacementTest, ReadsTopology)
+{
+    int cpu = Thread_Placement::affinity().front();
+
+    Thread_Placement::CPU_Info info = Thread_Placement::cpu_info(cpu);
+    // В контейнере /sys может быть недоступен, тогда поля остаются -1
+    EXPECT_GE(info.core, -1);
+    EXPECT_GE(info.package, -1);
+    EXPECT_GE(info.node, -1);
+
+    std::vector<int> siblings = Thread_Placement::siblings(cpu);
+    EXPECT_NE(std::find(siblings.begin(), siblings.end(), cpu), siblings.end());
+}
+
+TEST(ThreadPlacementTest, PrefersNodeAndRestoresDefault)
+{
+    int node = Thread_Placement::cpu_info(Thread_Placement::affinity().front()).node;
+    if (node >= 0)
+    {
+        EXPECT_EQ(Thread_Placement::prefer_node(node), 0);
+    }
+    EXPECT_EQ(Thread_Placement::prefer_node(-1), 0);
+    EXPECT_EQ(Thread_Placement::prefer_node(4096), -1);
+}
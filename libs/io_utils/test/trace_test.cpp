@@ -0,0 +1,143 @@
+#include "trace.h"
+
+#include <gtest/gtest.h>
+
+#include <cerrno>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+using namespace IO_Utils;
+
+namespace
+{
+    std::string trace_path()
+    {
+        return (std::filesystem::temp_directory_path() / "io_utils_trace_test.json").string();
+    }
+
+    std::string read_file(const std::string &path)
+    {
+        std::ifstream file(path);
+        std::stringstream content;
+        content << file.rdbuf();
+        return content.str();
+    }
+}
+
+TEST(TracerTest, RecordsSampledSpans)
+{
+    std::string path = trace_path();
+    int error = 0;
+    ASSERT_FALSE(Tracer::stop());
+    EXPECT_EQ(Tracer::sample(), 0u);
+
+    ASSERT_TRUE(Tracer::start(path, 1, std::chrono::seconds(10), error));
+    EXPECT_TRUE(Tracer::running());
+    EXPECT_FALSE(Tracer::start(path, 1, std::chrono::seconds(10), error));
+    EXPECT_EQ(error, EBUSY);
+
+    uint64_t id = Tracer::sample();
+    ASSERT_NE(id, 0u);
+    {
+        // Участок без номера в потоке не пишется
+        Tracer::Span ignored{"ignored"};
+    }
+    {
+        Tracer::Scope scope{id};
+        EXPECT_EQ(Tracer::current(), id);
+        Tracer::Span span{"handler"};
+    }
+    EXPECT_EQ(Tracer::current(), 0u);
+
+    int64_t now = Tracer::now_ns();
+    Tracer::record("queue", id, now - 1000, now, Tracer::udp_in_queue);
+    std::thread([id]
+                { Tracer::Scope scope{id}; Tracer::Span span{"other_thread"}; })
+        .join();
+
+    ASSERT_TRUE(Tracer::stop());
+    EXPECT_FALSE(Tracer::running());
+    EXPECT_EQ(Tracer::written_events(), 3u);
+    EXPECT_EQ(Tracer::dropped_events(), 0u);
+
+    // После остановки участки не пишутся
+    Tracer::record("late", id, now, now);
+
+    std::string content = read_file(path);
+    EXPECT_EQ(content.rfind("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[", 0), 0u);
+    EXPECT_NE(content.find("\"name\":\"handler\",\"cat\":\"pgw\",\"ph\":\"X\""), std::string::npos);
+    EXPECT_NE(content.find("\"name\":\"other_thread\""), std::string::npos);
+    EXPECT_NE(content.find("\"args\":{\"id\":" + std::to_string(id) + "}"), std::string::npos);
+    EXPECT_NE(content.find("\"args\":{\"name\":\"udp_in_queue\"}"), std::string::npos);
+    EXPECT_EQ(content.find("ignored"), std::string::npos);
+    EXPECT_EQ(content.find("late"), std::string::npos);
+    EXPECT_EQ(content.substr(content.size() - 4), "\n]}\n");
+
+    std::filesystem::remove(path);
+}
+
+TEST(TracerTest, SamplesEveryNthRequest)
+{
+    std::string path = trace_path();
+    int error = 0;
+    ASSERT_TRUE(Tracer::start(path, 3, std::chrono::seconds(10), error));
+
+    size_t sampled = 0;
+    for (int i = 0; i < 9; ++i)
+    {
+        if (Tracer::sample() != 0)
+            sampled++;
+    }
+    EXPECT_EQ(sampled, 3u);
+
+    ASSERT_TRUE(Tracer::stop());
+    std::filesystem::remove(path);
+}
+
+TEST(TracerTest, StopsAfterDuration)
+{
+    std::string path = trace_path();
+    int error = 0;
+    ASSERT_TRUE(Tracer::start(path, 1, std::chrono::milliseconds(10), error));
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (Tracer::running() && std::chrono::steady_clock::now() < deadline)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    EXPECT_FALSE(Tracer::running());
+    EXPECT_FALSE(Tracer::stop());
+
+    // Следующая запись начинается после завершившейся по времени
+    ASSERT_TRUE(Tracer::start(path, 1, std::chrono::seconds(10), error));
+    ASSERT_TRUE(Tracer::stop());
+    std::filesystem::remove(path);
+}
+
+TEST(TracerTest, DropsWhenBufferIsFull)
+{
+    std::string path = trace_path();
+    int error = 0;
+    ASSERT_TRUE(Tracer::start(path, 1, std::chrono::seconds(10), error));
+
+    // Поток записи не успевает переносить буфер, пока в него пишут без пауз
+    int64_t now = Tracer::now_ns();
+    for (size_t i = 0; i < Tracer::BUFFER_EVENTS * 4; ++i)
+    {
+        Tracer::record("burst", 1, now, now);
+    }
+
+    ASSERT_TRUE(Tracer::stop());
+    EXPECT_EQ(Tracer::written_events() + Tracer::dropped_events(), Tracer::BUFFER_EVENTS * 4);
+    std::filesystem::remove(path);
+}
+
+TEST(TracerTest, ReportsOpenError)
+{
+    int error = 0;
+    EXPECT_FALSE(Tracer::start("/nonexistent_dir/trace.json", 1, std::chrono::seconds(10), error));
+    EXPECT_EQ(error, ENOENT);
+    EXPECT_FALSE(Tracer::running());
+}
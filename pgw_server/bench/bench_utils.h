@@ -0,0 +1,65 @@
+#ifndef PGW_BENCH_UTILS
+#define PGW_BENCH_UTILS
+
+#include <quill/Backend.h>
+#include <quill/Frontend.h>
+#include <quill/Logger.h>
+#include <quill/sinks/FileSink.h>
+
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <string>
+
+namespace PGW_Bench
+{
+    // Логгер бенчмарков пишет только ошибки, чтобы логирование не влияло на замеры
+    inline quill::Logger *make_logger(const std::string &name)
+    {
+        quill::Backend::start();
+
+        auto file_sink = quill::Frontend::create_or_get_sink<quill::FileSink>(
+            (std::filesystem::temp_directory_path() / (name + ".log")).string(),
+            []()
+            {
+                quill::FileSinkConfig cfg;
+                cfg.set_open_mode('w');
+                return cfg;
+            }(),
+            quill::FileEventNotifier{});
+
+        quill::Logger *logger = quill::Frontend::create_or_get_logger("root", std::move(file_sink));
+        logger->set_log_level(quill::LogLevel::Error);
+
+        return logger;
+    }
+
+    // Временная директория под файлы бенчмарка, очищается при создании
+    inline std::string make_dir(const std::string &name)
+    {
+        std::filesystem::path dir = std::filesystem::temp_directory_path() / name;
+        std::filesystem::remove_all(dir);
+        std::filesystem::create_directories(dir);
+
+        return dir.string();
+    }
+
+    // Выполняет fn(i) iterations раз и печатает время на операцию и число операций в секунду
+    template <typename F>
+    double measure(const char *name, size_t iterations, F &&fn)
+    {
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < iterations; ++i)
+        {
+            fn(i);
+        }
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+        double ops_per_sec = iterations / elapsed.count();
+        std::printf("%-48s %10.1f ns/op %14.0f ops/sec\n", name, elapsed.count() * 1e9 / iterations, ops_per_sec);
+
+        return ops_per_sec;
+    }
+}
+
+#endif // PGW_BENCH_UTILS
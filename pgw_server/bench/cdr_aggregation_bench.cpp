@@ -0,0 +1,102 @@
+#include "bench_utils.h"
+
+#include "cdr_journal.h"
+#include "session_storage.h"
+
+#include <ctime>
+#include <thread>
+#include <vector>
+
+// Объем CDR и процессорное время в режимах per_event и aggregated на одной и той же нагрузке через Session_Storage:
+// sessions сессий создаются, rounds раз обновляются (не чаще раза в 0.5 секунды, как требует хранилище) и удаляются.
+// Процессорное время считается по всему процессу, то есть вместе с потоком записи журнала
+static double process_cpu_seconds()
+{
+    timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main()
+{
+    constexpr size_t sessions = 100'000;
+    constexpr size_t rounds = 4;
+
+    quill::Logger *logger = PGW_Bench::make_logger("cdr_aggregation_bench");
+
+    std::vector<PGW::IMSI> imsis(sessions);
+    for (size_t i = 0; i < sessions; ++i)
+    {
+        imsis[i].set_IMSI_from_str(std::to_string(250010000000000ul + i));
+    }
+
+    std::atomic<size_t> timeout{3600};
+    std::atomic<size_t> rate{1000};
+
+    std::printf("%zu sessions, %zu updates each\n", sessions, rounds);
+    std::printf("%-10s %12s %14s %16s\n", "mode", "CDR lines", "CDR bytes", "CPU ms");
+
+    for (PGW::CDR_Mode mode : {PGW::CDR_Mode::per_event, PGW::CDR_Mode::aggregated})
+    {
+        std::string dir = PGW_Bench::make_dir("cdr_aggregation_bench");
+
+        PGW::CDR_Journal_Options options;
+        options.mode = mode;
+        options.queue_size = 1 << 20;
+
+        double cpu_begin = process_cpu_seconds();
+        {
+            PGW::CDR_Journal journal{dir + "/cdr.csv", 1'000'000'000, logger, options};
+            std::atomic<bool> stop{false};
+
+            {
+                PGW::Session_Storage storage{timeout, rate, journal, {}, logger, stop};
+
+                for (const auto &imsi : imsis)
+                {
+                    storage._create(imsi, PGW::Session{imsi, std::chrono::steady_clock::now()});
+                }
+
+                for (size_t round = 0; round < rounds; ++round)
+                {
+                    // Сон не расходует процессорное время и не попадает в замер
+                    std::this_thread::sleep_for(std::chrono::milliseconds(510));
+                    for (const auto &imsi : imsis)
+                    {
+                        storage._update(imsi, PGW::Session{imsi});
+                    }
+                }
+
+                for (const auto &imsi : imsis)
+                {
+                    storage._delete(imsi);
+                }
+
+                stop.store(true);
+            }
+
+            journal.flush();
+        }
+        double cpu = process_cpu_seconds() - cpu_begin;
+
+        size_t bytes = 0;
+        size_t lines = 0;
+        for (const auto &entry : std::filesystem::directory_iterator(dir))
+        {
+            bytes += entry.file_size();
+
+            std::FILE *file = std::fopen(entry.path().c_str(), "r");
+            for (int c = std::fgetc(file); c != EOF; c = std::fgetc(file))
+            {
+                if (c == '\n')
+                    lines++;
+            }
+            std::fclose(file);
+        }
+
+        std::printf("%-10s %12zu %14zu %16.1f\n", mode == PGW::CDR_Mode::per_event ? "per_event" : "aggregated",
+                    lines, bytes, cpu * 1000);
+    }
+
+    return 0;
+}
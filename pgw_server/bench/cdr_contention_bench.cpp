@@ -0,0 +1,66 @@
+#include "bench_utils.h"
+
+#include "cdr_journal.h"
+#include "imsi.h"
+
+#include <thread>
+#include <vector>
+
+// Конкуренция потоков обработки за CDR журнал: несколько потоков одновременно вызывают write
+// с одной общей очередью и с отдельной очередью на каждый шард хранилища (cdr_streams = 16).
+// Очередь достаточно большая, чтобы поток записи не тормозил писателей, замеряется только сам write
+int main()
+{
+    constexpr size_t per_thread = 250'000;
+    constexpr size_t imsi_pool = 1024;
+
+    quill::Logger *logger = PGW_Bench::make_logger("cdr_contention_bench");
+
+    std::vector<PGW::IMSI> imsis(imsi_pool);
+    for (size_t i = 0; i < imsi_pool; ++i)
+    {
+        imsis[i].set_IMSI_from_str(std::to_string(100000000000000ul + i * 7919));
+    }
+
+    std::printf("%-8s %-8s %14s %12s %10s\n", "threads", "streams", "writes/sec", "ns/write", "blocked");
+
+    for (size_t threads : {1, 2, 4, 8})
+    {
+        for (size_t streams : {1, 16})
+        {
+            std::string dir = PGW_Bench::make_dir("cdr_contention_bench");
+
+            PGW::CDR_Journal_Options options;
+            options.streams = streams;
+            options.format = PGW::CDR_Format::binary;
+            options.queue_size = threads * per_thread * 2;
+
+            PGW::CDR_Journal journal{dir + "/cdr.csv", 1'000'000'000, logger, options};
+
+            auto begin = std::chrono::steady_clock::now();
+            std::vector<std::thread> workers;
+            for (size_t t = 0; t < threads; ++t)
+            {
+                workers.emplace_back([&journal, &imsis, t]()
+                                     {
+                                         for (size_t i = 0; i < per_thread; ++i)
+                                         {
+                                             journal.write(imsis[(i * 31 + t * 17) % imsi_pool], PGW::CDR_Action::updated);
+                                         } });
+            }
+            for (auto &worker : workers)
+            {
+                worker.join();
+            }
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+
+            journal.flush();
+
+            size_t total = threads * per_thread;
+            std::printf("%-8zu %-8zu %14.0f %12.1f %10zu\n", threads, streams,
+                        total / elapsed.count(), elapsed.count() * 1e9 * threads / total, journal.blocked_writes());
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,75 @@
+#include "bench_utils.h"
+
+#include "cdr_journal.h"
+#include "imsi.h"
+
+// Скорость записи CDR и наихудшее окно потерь (сколько запись провела без fdatasync) для каждого режима durability.
+// Нагрузка ограничена по скорости, чтобы окно потерь было видно на реалистичном потоке, а не на одном большом всплеске
+int main(int argc, char *argv[])
+{
+    // Путь к директории на нужном диске можно передать аргументом, по умолчанию временная директория
+    std::string dir = argc > 1 ? argv[1] : PGW_Bench::make_dir("cdr_durability_bench");
+
+    constexpr size_t records = 200'000;
+    constexpr size_t rate_per_ms = 100;
+
+    quill::Logger *logger = PGW_Bench::make_logger("cdr_durability_bench");
+
+    PGW::IMSI imsi;
+    imsi.set_IMSI_from_str("123456789012345");
+
+    struct Mode
+    {
+        const char *name;
+        PGW::CDR_Durability durability;
+    };
+
+    for (Mode mode : {Mode{"none", PGW::CDR_Durability::none},
+                      Mode{"periodic (1000 ms)", PGW::CDR_Durability::periodic},
+                      Mode{"group_commit (50 ms)", PGW::CDR_Durability::group_commit}})
+    {
+        PGW::CDR_Journal_Options options;
+        options.durability = mode.durability;
+        options.sync_interval = std::chrono::milliseconds(1000);
+        options.max_commit_latency = std::chrono::milliseconds(50);
+
+        PGW::CDR_Journal journal{dir + "/cdr.csv", 100'000, logger, options};
+
+        // Запись с ограничением скорости: rate_per_ms записей в миллисекунду
+        auto begin = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < records; ++i)
+        {
+            journal.write(imsi, PGW::CDR_Action::updated);
+
+            if (i % rate_per_ms == rate_per_ms - 1)
+                std::this_thread::sleep_until(begin + std::chrono::milliseconds(i / rate_per_ms + 1));
+        }
+        journal.flush();
+        std::chrono::duration<double> paced = std::chrono::steady_clock::now() - begin;
+
+        // Запись без ограничения, сколько режим выдерживает в пике
+        begin = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < records; ++i)
+        {
+            journal.write(imsi, PGW::CDR_Action::updated);
+        }
+        journal.flush();
+        std::chrono::duration<double> burst = std::chrono::steady_clock::now() - begin;
+
+        // Ждем, пока в синхронизирующих режимах все записи окажутся на диске
+        while (mode.durability != PGW::CDR_Durability::none && journal.durable_records() < 2 * records)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+
+        std::printf("%-22s paced %10.0f rec/s  burst %10.0f rec/s  fdatasync calls %6zu  worst loss window ",
+                    mode.name, records / paced.count(), records / burst.count(), journal.sync_count());
+
+        if (mode.durability == PGW::CDR_Durability::none)
+            std::printf("unbounded (kernel writeback)\n");
+        else
+            std::printf("%.1f ms\n", std::chrono::duration<double, std::milli>(journal.max_loss_window()).count());
+    }
+
+    return 0;
+}
@@ -0,0 +1,65 @@
+#include "bench_utils.h"
+
+#include "cdr_history.h"
+#include "cdr_journal.h"
+#include "imsi.h"
+
+#include <vector>
+
+// Поиск истории одного абонента по 100 закрытым при ротации файлам журнала:
+// с индексом (читаются только блоки, где фильтр Блума допускает IMSI) и полным чтением всех файлов.
+// Файлы к моменту замера уже в page cache, поэтому разница по времени - это разбор, а не диск, объем чтения печатается отдельно
+int main()
+{
+    constexpr size_t files = 100;
+    constexpr size_t lines_per_file = 10'000;
+    constexpr size_t imsi_pool = 100'000;
+    constexpr size_t lookups = 50;
+
+    quill::Logger *logger = PGW_Bench::make_logger("cdr_history_bench");
+
+    std::vector<PGW::IMSI> imsis(imsi_pool);
+    for (size_t i = 0; i < imsi_pool; ++i)
+    {
+        imsis[i].set_IMSI_from_str(std::to_string(250010000000000ul + i * 7919));
+    }
+
+    for (PGW::CDR_Format format : {PGW::CDR_Format::csv, PGW::CDR_Format::binary})
+    {
+        std::string dir = PGW_Bench::make_dir("cdr_history_bench");
+
+        PGW::CDR_Journal_Options options;
+        options.format = format;
+        options.queue_size = 1 << 20;
+        {
+            PGW::CDR_Journal journal{dir + "/cdr.csv", lines_per_file, logger, options};
+            for (size_t i = 0; i < files * lines_per_file; ++i)
+            {
+                journal.write(imsis[(i * 31) % imsi_pool], PGW::CDR_Action::updated);
+            }
+            journal.flush();
+        }
+
+        PGW::CDR_History history{dir + "/cdr.csv", format};
+        std::printf("-- %s, %zu files, %zu records --\n", format == PGW::CDR_Format::csv ? "csv" : "binary",
+                    history.list_files().size(), files * lines_per_file);
+
+        for (bool use_index : {true, false})
+        {
+            PGW::CDR_Lookup_Stats stats;
+            size_t found = 0;
+
+            PGW_Bench::measure(use_index ? "lookup with index" : "lookup with full scan", lookups, [&](size_t i)
+                               {
+                                   std::string imsi = imsis[(i * 997) % imsi_pool].get_IMSI_to_str();
+                                   found += history.lookup(imsi, 0, 1000, &stats, use_index).size(); });
+
+            std::printf("    %zu records found, %.1f KiB read per lookup, %zu of %zu blocks read\n",
+                        found, stats.bytes_read / 1024.0 / lookups, stats.blocks_read, stats.blocks);
+        }
+
+        std::filesystem::remove_all(dir);
+    }
+
+    return 0;
+}
@@ -0,0 +1,132 @@
+#include "bench_utils.h"
+
+#include "cdr_journal.h"
+#include "cdr_time_formatter.h"
+#include "imsi.h"
+
+#include <cstring>
+#include <ctime>
+
+// Пропускная способность CDR журнала в строках в секунду:
+// отдельно форматирование метки времени (старый вариант через std::to_string и кешированный форматтер)
+// и запись в журнал целиком, от write до попадания строк в файл, а также задержка ротации файлов
+int main()
+{
+    constexpr size_t iterations = 2'000'000;
+    volatile size_t sink = 0;
+
+    quill::Logger *logger = PGW_Bench::make_logger("cdr_journal_bench");
+    std::string dir = PGW_Bench::make_dir("cdr_journal_bench");
+
+    std::time_t start = std::time(nullptr);
+
+    std::printf("-- timestamp + line formatting --\n");
+    PGW_Bench::measure("localtime_r + std::to_string (old)", iterations, [&](size_t i)
+                       {
+                           std::time_t timestamp = start + i / 100000;
+                           std::tm time_info;
+                           localtime_r(&timestamp, &time_info);
+
+                           std::string str = "\"";
+                           str += std::to_string(time_info.tm_year + 1900);
+                           str += "-";
+                           str += std::to_string(time_info.tm_mon);
+                           str += "-";
+                           str += std::to_string(time_info.tm_mday);
+                           str += " ";
+                           str += std::to_string(time_info.tm_hour);
+                           str += ":";
+                           str += std::to_string(time_info.tm_min);
+                           str += ":";
+                           str += std::to_string(time_info.tm_sec);
+                           str += "\",\"123456789012345\",\"updated\"\r\n";
+                           sink = sink + str.size(); });
+
+    PGW::CDR_Time_Formatter formatter;
+    PGW_Bench::measure("CDR_Time_Formatter (cached per second)", iterations, [&](size_t i)
+                       {
+                           char line[128];
+                           line[0] = '"';
+                           std::memcpy(line + 1, formatter.format(start + i / 100000), PGW::CDR_Time_Formatter::DATE_TIME_SIZE);
+                           std::memcpy(line + 20, "\",\"123456789012345\",\"updated\"\r\n", 31);
+                           sink = sink + line[5]; });
+
+    std::printf("-- CDR_Journal end to end --\n");
+    PGW::IMSI imsi;
+    imsi.set_IMSI_from_str("123456789012345");
+
+    for (size_t max_lines : {1'000'000'000ul, 100'000ul})
+    {
+        PGW::CDR_Journal journal{dir + "/cdr.csv", max_lines, logger};
+
+        auto begin = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < iterations; ++i)
+        {
+            journal.write(imsi, PGW::CDR_Action::updated);
+        }
+        journal.flush();
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+
+        std::printf("CDR_Journal write + flush, rotation every %zu lines: %.0f lines/sec\n",
+                    max_lines, iterations / elapsed.count());
+    }
+
+    // Двоичный формат против CSV: размер записи на диске и скорость записи
+    std::printf("-- CSV vs binary --\n");
+    for (PGW::CDR_Format format : {PGW::CDR_Format::csv, PGW::CDR_Format::binary})
+    {
+        std::string format_dir = PGW_Bench::make_dir(format == PGW::CDR_Format::csv ? "cdr_journal_bench_csv" : "cdr_journal_bench_binary");
+
+        PGW::CDR_Journal_Options options;
+        options.format = format;
+
+        auto begin = std::chrono::steady_clock::now();
+        {
+            PGW::CDR_Journal journal{format_dir + "/cdr.csv", 1'000'000'000, logger, options};
+            for (size_t i = 0; i < iterations; ++i)
+            {
+                journal.write(imsi, PGW::CDR_Action::updated);
+            }
+            journal.flush();
+        }
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+
+        size_t bytes = 0;
+        for (const auto &entry : std::filesystem::directory_iterator(format_dir))
+        {
+            bytes += entry.file_size();
+        }
+
+        std::printf("%-8s %6.1f bytes/record %14.0f records/sec\n",
+                    format == PGW::CDR_Format::csv ? "csv" : "binary",
+                    (double)bytes / iterations, iterations / elapsed.count());
+    }
+
+    // Остановка потока записи на ротацию: файл создается на месте или подменяется заранее открытым
+    std::printf("-- rotation stall (periodic durability, rotation every 100000 lines) --\n");
+    for (bool background : {false, true})
+    {
+        std::string rotation_dir = PGW_Bench::make_dir(background ? "cdr_journal_bench_rotation_bg" : "cdr_journal_bench_rotation_inline");
+
+        PGW::CDR_Journal_Options options;
+        options.durability = PGW::CDR_Durability::periodic;
+        options.background_rotation = background;
+
+        PGW::CDR_Journal journal{rotation_dir + "/cdr.csv", 100'000, logger, options};
+
+        auto begin = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < iterations; ++i)
+        {
+            journal.write(imsi, PGW::CDR_Action::updated);
+        }
+        journal.flush();
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+
+        std::printf("%-10s %14.0f lines/sec, %zu rotations (%zu inline), worst rotation stall %.1f us\n",
+                    background ? "background" : "inline",
+                    iterations / elapsed.count(), journal.rotation_count(), journal.inline_rotation_count(),
+                    std::chrono::duration<double, std::micro>(journal.max_rotation_time()).count());
+    }
+
+    return 0;
+}
@@ -0,0 +1,79 @@
+#include "bench_utils.h"
+
+#include "cdr_journal.h"
+#include "imsi.h"
+#include "session_storage.h"
+
+#include <coarse_clock.h>
+
+#include <ctime>
+#include <unordered_set>
+
+// Сравнение чтения настоящих часов с грубыми часами на горячем пути хранилища сессий и CDR журнала
+int main()
+{
+    constexpr size_t iterations = 2'000'000;
+    volatile int64_t sink = 0;
+
+    quill::Logger *logger = PGW_Bench::make_logger("coarse_clock_bench");
+    std::string dir = PGW_Bench::make_dir("coarse_clock_bench");
+
+    std::printf("-- clock reads --\n");
+    PGW_Bench::measure("steady_clock::now", iterations, [&](size_t)
+                       { sink = sink + std::chrono::steady_clock::now().time_since_epoch().count(); });
+    PGW_Bench::measure("system_clock::now + localtime_r", iterations, [&](size_t)
+                       {
+                           std::time_t timestamp = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
+                           std::tm time_info;
+                           localtime_r(&timestamp, &time_info);
+                           sink = sink + time_info.tm_sec; });
+
+    {
+        IO_Utils::Coarse_Clock::Ticker ticker{std::chrono::milliseconds(10)};
+
+        PGW_Bench::measure("Coarse_Clock::steady_now", iterations, [&](size_t)
+                           { sink = sink + IO_Utils::Coarse_Clock::steady_now().time_since_epoch().count(); });
+        PGW_Bench::measure("Coarse_Clock::system_now", iterations, [&](size_t)
+                           { sink = sink + IO_Utils::Coarse_Clock::system_now().time_since_epoch().count(); });
+    }
+
+    // Одни и те же операции хранилища с настоящими часами и с тикером
+    std::vector<PGW::IMSI> imsis(10000);
+    for (size_t i = 0; i < imsis.size(); ++i)
+    {
+        imsis[i].set_IMSI_from_str(std::to_string(100000000 + i));
+    }
+
+    for (bool coarse : {false, true})
+    {
+        std::unique_ptr<IO_Utils::Coarse_Clock::Ticker> ticker;
+        if (coarse)
+            ticker = std::make_unique<IO_Utils::Coarse_Clock::Ticker>(std::chrono::milliseconds(10));
+
+        std::printf("-- %s --\n", coarse ? "coarse clock (10 ms ticker)" : "real clock");
+
+        std::atomic<size_t> timeout{30};
+        std::atomic<size_t> rate{1000000};
+        std::atomic<bool> stop{false};
+        PGW::CDR_Journal cdr_log{dir + "/cdr.csv", 10'000'000, logger};
+
+        {
+            PGW::Session_Storage storage{timeout, rate, cdr_log, {}, logger, stop};
+
+            PGW_Bench::measure("Session_Storage::_create", imsis.size(), [&](size_t i)
+                               { storage._create(imsis[i], {imsis[i], IO_Utils::Coarse_Clock::steady_now()}); });
+            // Обновления отклоняются из-за ограничения в 0.5 секунды, но время читается на каждую операцию
+            PGW_Bench::measure("Session_Storage::_update", iterations / 4, [&](size_t i)
+                               { storage._update(imsis[i % imsis.size()], {}); });
+
+            stop.store(true);
+        }
+
+        PGW::IMSI imsi;
+        imsi.set_IMSI_from_str("123456789012345");
+        PGW_Bench::measure("CDR_Journal::write", iterations / 4, [&](size_t)
+                           { cdr_log.write(imsi, PGW::CDR_Action::updated); });
+    }
+
+    return 0;
+}
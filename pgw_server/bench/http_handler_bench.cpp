@@ -0,0 +1,127 @@
+#include "bench_utils.h"
+
+#include "cdr_journal.h"
+#include "handler.h"
+#include "imsi.h"
+#include "session_storage.h"
+
+#include <network_io.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+// Выделения памяти считаются глобальным operator new, чтобы было видно, сколько их приходится на один запрос
+static std::atomic<size_t> allocations{0};
+
+void *operator new(size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void *ptr = std::malloc(size == 0 ? 1 : size))
+        return ptr;
+
+    throw std::bad_alloc{};
+}
+
+void operator delete(void *ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept
+{
+    std::free(ptr);
+}
+
+// Обработка GET /check_subscriber в HTTP_Handler::handle_packet в одном потоке, без сети:
+// разбор запроса, поиск сессии в хранилище и формирование ответа. Пакет переиспользуется между запросами,
+// как буфер соединения в IO потоке, поэтому в замер попадают только выделения самого обработчика.
+// Для сравнения та же проверка пачкой через POST /check_subscribers
+int main()
+{
+    constexpr size_t sessions = 10'000;
+    constexpr size_t requests = 1'000'000;
+
+    quill::Logger *logger = PGW_Bench::make_logger("http_handler_bench");
+    std::string dir = PGW_Bench::make_dir("http_handler_bench");
+
+    std::atomic<bool> stop{false};
+    std::atomic<size_t> session_timeout{3600};
+    std::atomic<size_t> graceful_shutdown_rate{1'000'000};
+
+    {
+        PGW::CDR_Journal journal{dir + "/cdr.csv", 1'000'000, logger};
+        auto storage = std::make_shared<PGW::Session_Storage>(session_timeout, graceful_shutdown_rate, journal,
+                                                              std::unordered_set<PGW::IMSI>{}, logger, stop);
+
+        std::vector<std::string> active(sessions);
+        std::vector<std::string> not_active(sessions);
+        for (size_t i = 0; i < sessions; ++i)
+        {
+            active[i] = std::to_string(250010000000000ul + i * 7919);
+            not_active[i] = std::to_string(250020000000000ul + i * 7919);
+
+            PGW::Session session;
+            session.imsi.set_IMSI_from_str(active[i]);
+            session.last_activity = std::chrono::steady_clock::now();
+            storage->_create(session.imsi, session);
+        }
+
+        PGW::HTTP_Handler handler{storage, stop, logger};
+        auto socket = std::make_shared<IO_Utils::HTTP_Socket>(0, 0);
+
+        for (bool is_active : {true, false})
+        {
+            std::vector<std::string> &pool = is_active ? active : not_active;
+            std::vector<std::string> prepared(sessions);
+            for (size_t i = 0; i < sessions; ++i)
+            {
+                prepared[i] = "GET /check_subscriber HTTP/1.1\r\n"
+                              "Host: 127.0.0.1:65000\r\n"
+                              "User-Agent: curl/8.5.0\r\n"
+                              "Accept: */*\r\n"
+                              "IMSI: " + pool[i] + "\r\n"
+                              "\r\n";
+            }
+
+            std::unique_ptr<IO_Utils::Packet> packet = std::make_unique<IO_Utils::HTTP_Packet>(socket);
+            packet->data.reserve(IO_Utils::BUFF_SIZE);
+            size_t bytes = 0;
+
+            size_t allocations_before = allocations.load();
+            PGW_Bench::measure(is_active ? "check_subscriber, active" : "check_subscriber, not active", requests, [&](size_t i)
+                               {
+                                   const std::string &request = prepared[(i * 31) % sessions];
+                                   packet->data.assign(request.begin(), request.end());
+                                   packet = handler.handle_packet(std::move(packet));
+                                   bytes += packet->data.size(); });
+
+            std::printf("    %.2f allocations per request, %.1f response bytes\n",
+                        (double)(allocations.load() - allocations_before) / requests, (double)bytes / requests);
+        }
+
+        // POST /check_subscribers: те же IMSI пачками по batch в теле, половина с сессиями, одно обращение к хранилищу на пачку
+        constexpr size_t batch = 1000;
+        constexpr size_t batch_requests = 2000;
+        std::string body;
+        for (size_t i = 0; i < batch; ++i)
+        {
+            body += (i % 2 == 0 ? active : not_active)[(i * 31) % sessions] + "\n";
+        }
+        std::string bulk_request = "POST /check_subscribers HTTP/1.1\r\nContent-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+
+        std::unique_ptr<IO_Utils::Packet> packet = std::make_unique<IO_Utils::HTTP_Packet>(socket);
+        double requests_per_sec = PGW_Bench::measure("check_subscribers, 1000 IMSI per request", batch_requests, [&](size_t)
+                                                     {
+                                                         packet->data.assign(bulk_request.begin(), bulk_request.end());
+                                                         packet = handler.handle_packet(std::move(packet)); });
+        std::printf("    %.0f IMSI/sec\n", requests_per_sec * batch);
+
+        stop.store(true);
+    }
+
+    std::filesystem::remove_all(dir);
+
+    return 0;
+}
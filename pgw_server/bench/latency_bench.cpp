@@ -0,0 +1,42 @@
+#include "bench_utils.h"
+
+#include <latency.h>
+
+// Цена замеров задержек на один пакет: четыре отметки времени по пути пакета и запись шести этапов
+// в гистограммы при отправке. При сборке с IO_UTILS_LATENCY_TRACKING=OFF обе операции пустые
+int main()
+{
+    constexpr size_t packets = 10'000'000;
+
+    std::printf("IO_UTILS_LATENCY_TRACKING = %d\n", IO_UTILS_LATENCY_TRACKING);
+    std::printf("%-28s %12s\n", "operation", "ns/packet");
+
+    // Отдельно стоимость одного чтения часов, из которой в основном и складывается цена отметок
+    int64_t checksum = 0;
+    auto begin = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < packets; ++i)
+    {
+        checksum += IO_Utils::Packet_Latency::now_ns();
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+    std::printf("%-28s %12.2f\n", "steady_clock::now", elapsed.count() * 1e9 / packets);
+
+    begin = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < packets; ++i)
+    {
+        IO_Utils::Packet_Timestamps timestamps;
+        timestamps.kernel_wait_ns = i & 1023;
+        IO_Utils::Packet_Latency::stamp(timestamps.received_ns);
+        IO_Utils::Packet_Latency::stamp(timestamps.enqueued_ns);
+        IO_Utils::Packet_Latency::stamp(timestamps.dequeued_ns);
+        IO_Utils::Packet_Latency::stamp(timestamps.handled_ns);
+        IO_Utils::Packet_Latency::record_sent(timestamps, IO_Utils::Packet_Latency::udp);
+        checksum += timestamps.handled_ns;
+    }
+    elapsed = std::chrono::steady_clock::now() - begin;
+    std::printf("%-28s %12.2f\n", "stamps + record_sent", elapsed.count() * 1e9 / packets);
+
+    std::printf("checksum %lld\n%s\n", (long long)checksum, IO_Utils::Packet_Latency::summary().c_str());
+
+    return 0;
+}
@@ -0,0 +1,67 @@
+#include "bench_utils.h"
+
+#include <instrumented_mutex.h>
+
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include <vector>
+
+// Цена статистики блокировок: захват и освобождение std::shared_mutex против Instrumented_Shared_Mutex,
+// монопольно и на чтение, одним потоком и несколькими на 16 мьютексах (как шарды хранилища).
+// Время - общее время, деленное на число всех захватов
+template <typename Mutex>
+static double measure(size_t threads, bool exclusive)
+{
+    constexpr size_t per_thread = 5'000'000;
+    constexpr size_t shards = 16;
+
+    std::vector<Mutex> mutexes(shards);
+    uint64_t counters[shards]{};
+
+    auto begin = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < threads; ++t)
+    {
+        workers.emplace_back([&, t]()
+                             {
+                                 for (size_t i = 0; i < per_thread; ++i)
+                                 {
+                                     size_t shard = (i * 7 + t) % shards;
+                                     if (exclusive)
+                                     {
+                                         std::unique_lock lock(mutexes[shard]);
+                                         counters[shard]++;
+                                     }
+                                     else
+                                     {
+                                         std::shared_lock lock(mutexes[shard]);
+                                         asm volatile("" : : "r"(counters[shard]));
+                                     }
+                                 } });
+    }
+    for (auto &worker : workers)
+    {
+        worker.join();
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+
+    return elapsed.count() * 1e9 / (per_thread * threads);
+}
+
+int main()
+{
+    std::printf("%-8s %-10s %18s %18s\n", "threads", "mode", "shared_mutex ns", "instrumented ns");
+
+    for (size_t threads : {1, 4})
+    {
+        for (bool exclusive : {true, false})
+        {
+            std::printf("%-8zu %-10s %18.2f %18.2f\n", threads, exclusive ? "exclusive" : "shared",
+                        measure<std::shared_mutex>(threads, exclusive),
+                        measure<IO_Utils::Instrumented_Shared_Mutex>(threads, exclusive));
+        }
+    }
+
+    return 0;
+}
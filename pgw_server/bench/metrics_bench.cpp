@@ -0,0 +1,52 @@
+#include "bench_utils.h"
+
+#include <metrics.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+// Цена счетчика на горячем пути: Metrics::add (свой блок у каждого потока) против одного общего
+// std::atomic с fetch_add, за который соревнуются все потоки. Время - общее время, деленное на число всех увеличений
+int main()
+{
+    constexpr size_t per_thread = 20'000'000;
+
+    IO_Utils::Metrics::Id id = IO_Utils::Metrics::counter("bench_counter_total", "Benchmark counter");
+    alignas(64) std::atomic<uint64_t> shared{0};
+
+    std::printf("%-8s %-24s %12s\n", "threads", "counter", "ns/add");
+
+    for (size_t threads : {1, 2, 4, 8})
+    {
+        for (bool per_thread_counter : {true, false})
+        {
+            auto begin = std::chrono::steady_clock::now();
+            std::vector<std::thread> workers;
+            for (size_t t = 0; t < threads; ++t)
+            {
+                workers.emplace_back([&]()
+                                     {
+                                         for (size_t i = 0; i < per_thread; ++i)
+                                         {
+                                             if (per_thread_counter)
+                                                 IO_Utils::Metrics::add(id);
+                                             else
+                                                 shared.fetch_add(1, std::memory_order_relaxed);
+                                         } });
+            }
+            for (auto &worker : workers)
+            {
+                worker.join();
+            }
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+
+            std::printf("%-8zu %-24s %12.2f\n", threads, per_thread_counter ? "Metrics::add" : "shared atomic fetch_add",
+                        elapsed.count() * 1e9 / (per_thread * threads));
+        }
+    }
+
+    std::printf("total %llu + %llu\n", (unsigned long long)IO_Utils::Metrics::value(id), (unsigned long long)shared.load());
+
+    return 0;
+}
@@ -0,0 +1,126 @@
+#include "bench_utils.h"
+
+#include <codel.h>
+
+#include <deque>
+
+// Полезная пропускная способность за точкой насыщения с защитой от перегрузки и без нее.
+// Моделирование в виртуальном времени на настоящем Codel_Controller: IO поток кладет запросы в очередь
+// на 10000 мест с заданной нагрузкой, поток обработки тратит SERVICE на запрос и BUSY на отказ без обработки.
+// Полезный ответ - обработанный запрос, ответ на который ушел раньше, чем клиент повторил запрос (TIMEOUT).
+// В конце - цена вызовов контроллера на пакет в реальном времени
+namespace
+{
+    constexpr int64_t US = 1'000;
+    constexpr int64_t MS = 1'000'000;
+
+    constexpr size_t QUEUE_CAPACITY = 10000;
+    constexpr int64_t SERVICE = 10 * US;
+    constexpr int64_t BUSY = 1 * US;
+    constexpr int64_t TIMEOUT = 50 * MS;
+    constexpr int64_t DURATION = 5000 * MS;
+    // Первая секунда не считается: очередь еще заполняется
+    constexpr int64_t WARMUP = 1000 * MS;
+
+    struct Result
+    {
+        size_t offered = 0;
+        size_t good = 0;
+        size_t late = 0;
+        size_t shed_incoming = 0;
+        size_t shed_stale = 0;
+        size_t tail_drops = 0;
+    };
+
+    Result simulate(double load, bool control)
+    {
+        IO_Utils::Codel_Controller controller;
+        std::deque<int64_t> queue;
+        Result result;
+
+        int64_t gap = (int64_t)(SERVICE / load);
+        int64_t next_arrival = 0;
+        int64_t consumer_free = 0;
+
+        while (next_arrival < DURATION || !queue.empty())
+        {
+            bool counted = next_arrival >= WARMUP;
+
+            // Следующее событие - приход запроса или освобождение потока обработки
+            if (next_arrival < DURATION && (queue.empty() || next_arrival <= consumer_free))
+            {
+                int64_t now = next_arrival;
+                next_arrival += gap;
+                result.offered += counted;
+
+                if (control && controller.shed_incoming(queue.size()))
+                    result.shed_incoming += counted;
+                else if (queue.size() >= QUEUE_CAPACITY)
+                    result.tail_drops += counted;
+                else
+                    queue.push_back(now);
+
+                continue;
+            }
+
+            if (queue.empty())
+                break;
+
+            int64_t now = std::max(consumer_free, queue.front());
+            int64_t sojourn = now - queue.front();
+            queue.pop_front();
+            counted = now >= WARMUP;
+
+            if (control && !controller.admit(sojourn, now))
+            {
+                result.shed_stale += counted;
+                consumer_free = now + BUSY;
+            }
+            else
+            {
+                consumer_free = now + SERVICE;
+                if (sojourn + SERVICE <= TIMEOUT)
+                    result.good += counted;
+                else
+                    result.late += counted;
+            }
+
+            if (queue.empty())
+                controller.queue_empty();
+        }
+
+        return result;
+    }
+}
+
+int main()
+{
+    constexpr double seconds = (DURATION - WARMUP) / 1e9;
+
+    std::printf("capacity %.0f req/s, queue %zu, client timeout %lld ms\n", 1e9 / SERVICE, QUEUE_CAPACITY, (long long)(TIMEOUT / MS));
+    std::printf("%-6s %-8s %12s %10s %10s %10s %10s\n", "load", "control", "goodput/s", "late %", "incoming %", "stale %", "drops %");
+
+    for (double load : {0.5, 0.9, 1.0, 1.2, 1.5, 2.0, 3.0, 5.0})
+    {
+        for (bool control : {false, true})
+        {
+            Result r = simulate(load, control);
+            double offered = r.offered != 0 ? r.offered : 1;
+            std::printf("%-6.1f %-8s %12.0f %10.1f %10.1f %10.1f %10.1f\n", load, control ? "codel" : "none",
+                        r.good / seconds, r.late * 100 / offered, r.shed_incoming * 100 / offered,
+                        r.shed_stale * 100 / offered, r.tail_drops * 100 / offered);
+        }
+    }
+
+    std::printf("\n");
+    IO_Utils::Codel_Controller controller;
+    size_t shed = 0;
+    PGW_Bench::measure("admit + shed_incoming", 10'000'000, [&](size_t i)
+                       {
+                           int64_t now = (int64_t)i * US;
+                           shed += controller.shed_incoming(100);
+                           shed += !controller.admit((int64_t)(i % 20) * MS, now); });
+    std::printf("shed %zu\n", shed);
+
+    return 0;
+}
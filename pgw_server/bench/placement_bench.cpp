@@ -0,0 +1,164 @@
+#include "bench_utils.h"
+
+#include <network_io.h>
+#include <queue.h>
+#include <thread_placement.h>
+
+#include <algorithm>
+#include <atomic>
+#include <optional>
+#include <thread>
+#include <vector>
+
+// Передача пакетов между IO потоком и потоком обработки через Queue<Packet> в зависимости от того, где они
+// выполняются: на одном CPU, на гиперпотоках одного ядра, на разных ядрах одного процессора и на разных
+// процессорах (узлах NUMA). Очереди создаются под Scope с CPU потока обработки, как в main.
+// Поток передачи: IO поток заполняет очередь, обработка забирает. Пинг-понг: пакет уходит по udp_in и
+// возвращается по udp_out, как запрос и ответ, время - полный круг. Недоступные на машине пары - n/a
+namespace
+{
+    using IO_Utils::Thread_Placement;
+
+    constexpr size_t PACKETS = 2'000'000;
+    constexpr size_t ROUND_TRIPS = 200'000;
+    constexpr size_t QUEUE_SIZE = 10000;
+
+    struct Pair
+    {
+        const char *name;
+        int io = -1;
+        int process = -1;
+    };
+
+    // Пустая очередь уступает процессор: на одном CPU ожидающий поток иначе занимал бы его до конца кванта
+    std::unique_ptr<IO_Utils::Packet> wait_pop(IO_Utils::Queue<IO_Utils::Packet> &queue)
+    {
+        std::unique_ptr<IO_Utils::Packet> packet;
+        while ((packet = queue.pop()) == nullptr)
+        {
+            std::this_thread::yield();
+        }
+        return packet;
+    }
+
+    double handoff(const Pair &pair)
+    {
+        std::optional<Thread_Placement::Scope> scope;
+        scope.emplace(std::vector<int>{pair.process}, true);
+        IO_Utils::Queue<IO_Utils::Packet> udp_in_queue{QUEUE_SIZE};
+        scope.reset();
+
+        auto begin = std::chrono::steady_clock::now();
+        std::thread process([&]()
+                            {
+            Thread_Placement::pin({pair.process});
+            for (size_t i = 0; i < PACKETS; ++i)
+            {
+                wait_pop(udp_in_queue);
+            } });
+
+        Thread_Placement::Scope io{{pair.io}, false};
+        for (size_t i = 0; i < PACKETS; ++i)
+        {
+            // Обработка - единственный читатель, поэтому после ожидания места push не отбросит пакет
+            while (udp_in_queue.size() >= QUEUE_SIZE)
+            {
+                std::this_thread::yield();
+            }
+            auto packet = std::make_unique<IO_Utils::Packet>(nullptr);
+            packet->data.assign(12, (uint8_t)i);
+            udp_in_queue.push(std::move(packet));
+        }
+        process.join();
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+
+        return PACKETS / elapsed.count();
+    }
+
+    double ping_pong(const Pair &pair)
+    {
+        std::optional<Thread_Placement::Scope> scope;
+        scope.emplace(std::vector<int>{pair.process}, true);
+        IO_Utils::Queue<IO_Utils::Packet> udp_in_queue{QUEUE_SIZE}, udp_out_queue{QUEUE_SIZE};
+        scope.reset();
+
+        std::thread process([&]()
+                            {
+            Thread_Placement::pin({pair.process});
+            for (size_t i = 0; i < ROUND_TRIPS; ++i)
+            {
+                udp_out_queue.push(wait_pop(udp_in_queue));
+            } });
+
+        Thread_Placement::Scope io{{pair.io}, false};
+        auto begin = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < ROUND_TRIPS; ++i)
+        {
+            udp_in_queue.push(std::make_unique<IO_Utils::Packet>(nullptr));
+            wait_pop(udp_out_queue);
+        }
+        std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - begin;
+        process.join();
+
+        return elapsed.count() / ROUND_TRIPS;
+    }
+
+    // Пары CPU по топологии из /sys среди CPU, на которых разрешено выполняться бенчмарку
+    std::vector<Pair> make_pairs(const std::vector<int> &cpus)
+    {
+        int first = cpus.front();
+        Thread_Placement::CPU_Info first_info = Thread_Placement::cpu_info(first);
+
+        std::vector<Pair> pairs{{"same cpu", first, first}, {"sibling threads"}, {"same package"}, {"across packages"}};
+        std::vector<int> siblings = Thread_Placement::siblings(first);
+        for (int cpu : cpus)
+        {
+            if (cpu == first)
+                continue;
+
+            Thread_Placement::CPU_Info info = Thread_Placement::cpu_info(cpu);
+            bool sibling = std::find(siblings.begin(), siblings.end(), cpu) != siblings.end();
+            Pair *pair = nullptr;
+            if (sibling)
+                pair = &pairs[1];
+            else if (info.package == first_info.package && info.node == first_info.node)
+                pair = &pairs[2];
+            else
+                pair = &pairs[3];
+
+            if (pair->io < 0)
+            {
+                pair->io = first;
+                pair->process = cpu;
+            }
+        }
+
+        return pairs;
+    }
+}
+
+int main()
+{
+    std::vector<int> cpus = Thread_Placement::affinity();
+    std::vector<Pair> pairs = make_pairs(cpus);
+
+    std::printf("%zu packets handed off, %zu round trips, %zu allowed CPUs\n", PACKETS, ROUND_TRIPS, cpus.size());
+    std::printf("%-16s %-12s %14s %16s\n", "placement", "io/process", "packets/s", "round trip ns");
+    for (const Pair &pair : pairs)
+    {
+        if (pair.io < 0)
+        {
+            std::printf("%-16s %-12s %14s %16s\n", pair.name, "n/a", "n/a", "n/a");
+            continue;
+        }
+
+        Thread_Placement::CPU_Info io = Thread_Placement::cpu_info(pair.io), process = Thread_Placement::cpu_info(pair.process);
+        std::string placement = std::to_string(pair.io) + "/" + std::to_string(pair.process);
+        double packets_per_sec = handoff(pair);
+        double round_trip_ns = ping_pong(pair);
+        std::printf("%-16s %-12s %14.0f %16.0f   (node %d/%d)\n", pair.name, placement.c_str(), packets_per_sec, round_trip_ns,
+                    io.node, process.node);
+    }
+
+    return 0;
+}
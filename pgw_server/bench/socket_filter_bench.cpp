@@ -0,0 +1,120 @@
+#include "bench_utils.h"
+
+#include <imsi.h>
+#include <network_io.h>
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <random>
+
+// Цена приема смеси верных IE с IMSI и мусора с фильтром сокета в ядре и без него.
+// Отправитель и получатель в одном потоке на loopback: датаграммы уходят пачкой, потом получатель
+// вычитывает сокет и проверяет каждую датаграмму, как UDP_Handler. На loopback фильтр выполняется при
+// отправке, поэтому отдельно время получателя (recvmsg и проверка в пользовательском пространстве) и общее время
+namespace
+{
+    constexpr size_t PACKETS = 200'000;
+    constexpr size_t BATCH = 256;
+
+    std::vector<std::vector<uint8_t>> make_mix(double junk_share)
+    {
+        std::mt19937 random(42);
+        std::vector<std::vector<uint8_t>> mix(PACKETS);
+
+        for (auto &data : mix)
+        {
+            if (random() % 1000 >= junk_share * 1000)
+            {
+                PGW::IMSI imsi;
+                imsi.set_IMSI_from_str(std::to_string(100000000000000ULL + random() % 900000000000000ULL));
+                data = imsi.get_IMSI_to_IE();
+            }
+            else
+            {
+                // Мусор разного вида: случайные байты, чужой тип IE, неверное поле Length
+                data.resize(1 + random() % 64);
+                for (uint8_t &byte : data)
+                    byte = (uint8_t)random();
+                if (data.size() > 4 && random() % 2 == 0)
+                    data[0] = 1;
+            }
+        }
+
+        return mix;
+    }
+
+    struct Result
+    {
+        double total_ns = 0;
+        double receiver_ns = 0;
+        size_t received = 0;
+        size_t valid = 0;
+    };
+
+    Result run(const std::vector<std::vector<uint8_t>> &mix, bool filter)
+    {
+        IO_Utils::UDP_Socket receiver_socket(0x100007F, 0), sender_socket(0x100007F, 0);
+        int receiver_fd = receiver_socket.listen_or_bind();
+        int sender_fd = sender_socket.listen_or_bind();
+        IO_Utils::Socket::set_receive_buffer(receiver_fd, 4 * 1024 * 1024);
+        if (filter)
+            IO_Utils::Socket::attach_filter(receiver_fd, PGW::IMSI::socket_filter());
+
+        sockaddr_in address;
+        socklen_t length = sizeof(address);
+        getsockname(receiver_fd, (sockaddr *)&address, &length);
+
+        IO_Utils::UDP_Connection receiver(receiver_fd), sender(sender_fd);
+        IO_Utils::Packet outgoing(std::make_shared<IO_Utils::UDP_Socket>(address.sin_addr.s_addr, ntohs(address.sin_port)));
+        IO_Utils::Packet incoming(nullptr);
+
+        Result result;
+        std::chrono::nanoseconds receiver_time{0};
+        auto begin = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < mix.size(); i += BATCH)
+        {
+            for (size_t j = i; j < std::min(i + BATCH, mix.size()); ++j)
+            {
+                outgoing.data = mix[j];
+                sender.send_packet(outgoing);
+            }
+
+            auto receive_begin = std::chrono::steady_clock::now();
+            while (receiver.recv_packet(incoming) == 0)
+            {
+                result.received++;
+                PGW::IMSI imsi;
+                result.valid += imsi.set_IMSI_from_IE(incoming.data);
+            }
+            receiver_time += std::chrono::steady_clock::now() - receive_begin;
+        }
+        result.total_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - begin).count() / mix.size();
+        result.receiver_ns = receiver_time.count() / (double)mix.size();
+
+        close(receiver_fd);
+        close(sender_fd);
+
+        return result;
+    }
+}
+
+int main()
+{
+    std::printf("%zu packets, %zu BPF instructions\n", PACKETS, PGW::IMSI::socket_filter().size());
+    std::printf("%-8s %-8s %14s %14s %12s %10s\n", "junk %", "filter", "receiver ns", "total ns", "received", "valid");
+
+    for (double junk : {0.0, 0.5, 0.9, 0.99})
+    {
+        std::vector<std::vector<uint8_t>> mix = make_mix(junk);
+        for (bool filter : {false, true})
+        {
+            Result r = run(mix, filter);
+            std::printf("%-8.0f %-8s %14.1f %14.1f %12zu %10zu\n", junk * 100, filter ? "bpf" : "none",
+                        r.receiver_ns, r.total_ns, r.received, r.valid);
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,122 @@
+#include "bench_utils.h"
+
+#include "cdr_journal.h"
+#include "session_storage.h"
+
+#include <random>
+#include <thread>
+#include <vector>
+
+// Конкуренция за блокировки шардов хранилища между UDP конвейерами с распределением запросов по IMSI
+// (IMSI::reuseport_filter) и без него (ядро раскладывает по хешу адресов, то есть любой IMSI у любого конвейера).
+// Каждый поток - конвейер, обрабатывающий запросы как UDP_Handler: _read, затем _update или _create.
+// При распределении поток получает только IMSI шардов s, для которых s % threads == номер потока
+namespace
+{
+    constexpr size_t SUBSCRIBERS = 100'000;
+    constexpr size_t REQUESTS_PER_THREAD = 1'000'000;
+
+    struct Result
+    {
+        double requests_per_sec = 0;
+        uint64_t contended = 0;
+        double wait_ms = 0;
+    };
+
+    Result run(PGW::Session_Storage &storage, const std::vector<PGW::IMSI> &imsis, size_t threads, bool steering)
+    {
+        // Запросы каждого конвейера заранее, чтобы выбор IMSI не попадал в замер
+        std::vector<std::vector<const PGW::IMSI *>> requests(threads);
+        std::mt19937 random(7);
+        for (auto &stream : requests)
+        {
+            stream.reserve(REQUESTS_PER_THREAD);
+        }
+        for (size_t t = 0; t < threads; ++t)
+        {
+            while (requests[t].size() < REQUESTS_PER_THREAD)
+            {
+                const PGW::IMSI &imsi = imsis[random() % imsis.size()];
+                if (!steering || imsi.shard_key() % PGW::Session_Storage::amount_of_shards % threads == t)
+                    requests[t].push_back(&imsi);
+            }
+        }
+
+        std::vector<IO_Utils::Lock_Stats> before = storage.lock_stats();
+
+        auto begin = std::chrono::steady_clock::now();
+        std::vector<std::thread> workers;
+        for (size_t t = 0; t < threads; ++t)
+        {
+            workers.emplace_back([&storage, &stream = requests[t]]()
+                                 {
+                                     PGW::Session session;
+                                     for (const PGW::IMSI *imsi : stream)
+                                     {
+                                         if (storage._read(*imsi, session))
+                                             storage._update(*imsi, session);
+                                         else
+                                             storage._create(*imsi, PGW::Session{*imsi, std::chrono::steady_clock::now()});
+                                     } });
+        }
+        for (auto &worker : workers)
+        {
+            worker.join();
+        }
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+
+        Result result;
+        result.requests_per_sec = threads * REQUESTS_PER_THREAD / elapsed.count();
+        std::vector<IO_Utils::Lock_Stats> after = storage.lock_stats();
+        for (size_t i = 0; i < after.size(); ++i)
+        {
+            result.contended += after[i].shared.contended - before[i].shared.contended +
+                                after[i].exclusive.contended - before[i].exclusive.contended;
+            result.wait_ms += (after[i].shared.wait_ns - before[i].shared.wait_ns +
+                               after[i].exclusive.wait_ns - before[i].exclusive.wait_ns) / 1e6;
+        }
+
+        return result;
+    }
+}
+
+int main()
+{
+    quill::Logger *logger = PGW_Bench::make_logger("steering_bench");
+    std::string dir = PGW_Bench::make_dir("steering_bench");
+
+    std::vector<PGW::IMSI> imsis(SUBSCRIBERS);
+    for (size_t i = 0; i < SUBSCRIBERS; ++i)
+    {
+        imsis[i].set_IMSI_from_str(std::to_string(250010000000000ul + i));
+    }
+
+    std::atomic<size_t> timeout{3600};
+    // Выгрузка сессий при удалении хранилища без пауз
+    std::atomic<size_t> rate{1'000'000};
+    PGW::CDR_Journal_Options options;
+    options.overflow_policy = PGW::CDR_Overflow_Policy::drop;
+    PGW::CDR_Journal journal{dir + "/cdr.csv", 1'000'000'000, logger, options};
+
+    std::printf("%zu subscribers, %zu requests per thread, %u hardware threads\n", SUBSCRIBERS, REQUESTS_PER_THREAD, std::thread::hardware_concurrency());
+    std::printf("%-8s %-10s %14s %14s %12s\n", "threads", "steering", "requests/s", "contended", "wait ms");
+
+    for (size_t threads : {1, 2, 4, 8})
+    {
+        for (bool steering : {false, true})
+        {
+            Result r;
+            {
+                std::atomic<bool> stop{false};
+                PGW::Session_Storage storage{timeout, rate, journal, {}, logger, stop};
+                r = run(storage, imsis, threads, steering);
+                // Поток очистки хранилища завершается по stop
+                stop.store(true);
+            }
+            std::printf("%-8zu %-10s %14.0f %14llu %12.1f\n", threads, steering ? "imsi" : "none",
+                        r.requests_per_sec, (unsigned long long)r.contended, r.wait_ms);
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,221 @@
+#include "bench_utils.h"
+
+#include "cdr_journal.h"
+#include "core_worker.h"
+#include "session_storage.h"
+
+#include <io_worker.h>
+
+#include <netinet/in.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include <random>
+#include <thread>
+#include <vector>
+
+// Пропускная способность и задержка UDP запросов в режиме thread_per_core (Core_Worker: прием, обработка
+// и ответ в одном потоке) и в конвейерах (IO_Worker и поток обработки с очередями между ними, как в main)
+// при 1-16 ядрах/конвейерах, в обоих случаях с распределением по IMSI. Клиент на loopback держит в полете
+// WINDOW запросов, датаграммы без ответа за LOSS_TIMEOUT считаются потерянными
+namespace
+{
+    constexpr size_t SUBSCRIBERS = 100'000;
+    constexpr size_t REQUESTS = 100'000;
+    constexpr size_t WINDOW = 128;
+    constexpr int LOSS_TIMEOUT_MS = 20;
+
+    struct Result
+    {
+        double requests_per_sec = 0;
+        double mean_us = 0;
+        size_t lost = 0;
+    };
+
+    // Поток обработки конвейера: как process в main, но пустая очередь уступает процессор,
+    // иначе на машине с меньшим числом ядер простаивающие конвейеры отнимали бы его у занятых
+    void process(std::atomic<bool> &stop, IO_Utils::Queue<IO_Utils::Packet> &udp_in_queue, IO_Utils::Queue<IO_Utils::Packet> &udp_out_queue,
+                 std::shared_ptr<PGW::ISession_Storage> storage, quill::Logger *logger)
+    {
+        PGW::UDP_Handler udp_handler{{}, storage, logger};
+        while (!stop.load())
+        {
+            std::unique_ptr<IO_Utils::Packet> packet = udp_in_queue.pop();
+            if (packet == nullptr)
+            {
+                std::this_thread::yield();
+                continue;
+            }
+            udp_out_queue.push(udp_handler.handle_packet(std::move(packet)));
+        }
+    }
+
+    Result load(uint16_t port, const std::vector<std::vector<uint8_t>> &requests)
+    {
+        IO_Utils::UDP_Socket client_socket(0x100007F, 0);
+        int client_fd = client_socket.listen_or_bind();
+        IO_Utils::Socket::set_receive_buffer(client_fd, 4 * 1024 * 1024);
+        IO_Utils::UDP_Connection client(client_fd);
+        IO_Utils::Packet outgoing(std::make_shared<IO_Utils::UDP_Socket>(0x100007F, port));
+        IO_Utils::Packet incoming(nullptr);
+
+        Result result;
+        size_t sent = 0, answered = 0;
+        double latency_sum_us = 0;
+        auto begin = std::chrono::steady_clock::now();
+        while (sent < requests.size())
+        {
+            // Запросы окна отправляются разом, задержка каждого ответа считается от начала окна
+            auto window_begin = std::chrono::steady_clock::now();
+            size_t window = std::min(WINDOW, requests.size() - sent);
+            for (size_t i = 0; i < window; ++i)
+            {
+                outgoing.data = requests[sent + i];
+                client.send_packet(outgoing);
+            }
+            sent += window;
+
+            size_t replies = 0;
+            while (replies < window)
+            {
+                pollfd descriptor{client_fd, POLLIN, 0};
+                if (poll(&descriptor, 1, LOSS_TIMEOUT_MS) != 1)
+                    break;
+                while (replies < window && client.recv_packet(incoming) == 0)
+                {
+                    replies++;
+                    latency_sum_us += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - window_begin).count();
+                }
+            }
+            answered += replies;
+            result.lost += window - replies;
+        }
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+
+        result.requests_per_sec = answered / elapsed.count();
+        result.mean_us = answered != 0 ? latency_sum_us / answered : 0;
+        close(client_fd);
+
+        return result;
+    }
+
+    Result run_pipelines(size_t workers, uint16_t port, const std::vector<std::vector<uint8_t>> &requests,
+                         PGW::CDR_Journal &journal, quill::Logger *logger)
+    {
+        std::atomic<size_t> timeout{3600};
+        std::atomic<size_t> rate{1'000'000};
+        std::atomic<bool> stop{false};
+        Result result;
+        {
+            std::shared_ptr<PGW::ISession_Storage> storage = std::make_shared<PGW::Session_Storage>(timeout, rate, journal, std::unordered_set<PGW::IMSI>{}, logger, stop);
+
+            struct Pipeline
+            {
+                IO_Utils::Queue<IO_Utils::Packet> http_in_queue{1}, udp_in_queue{10000}, http_out_queue{1}, udp_out_queue{10000};
+                std::unique_ptr<IO_Utils::IO_Worker> io_worker;
+            };
+            std::vector<std::unique_ptr<Pipeline>> pipelines;
+            for (size_t i = 0; i < workers; ++i)
+            {
+                pipelines.push_back(std::make_unique<Pipeline>());
+                pipelines.back()->io_worker = std::make_unique<IO_Utils::IO_Worker>("127.0.0.1", port, "", 0, logger, workers > 1);
+                pipelines.back()->io_worker->set_udp_receive_buffer(4 * 1024 * 1024);
+            }
+            if (workers > 1)
+                pipelines[0]->io_worker->set_udp_steering_filter(PGW::IMSI::reuseport_filter((uint32_t)workers, PGW::Session_Storage::amount_of_shards));
+
+            std::vector<std::thread> threads;
+            for (auto &pipeline : pipelines)
+            {
+                threads.emplace_back(&IO_Utils::IO_Worker::run, pipeline->io_worker.get(), std::ref(stop),
+                                     std::ref(pipeline->http_in_queue), std::ref(pipeline->udp_in_queue),
+                                     std::ref(pipeline->http_out_queue), std::ref(pipeline->udp_out_queue));
+                threads.emplace_back(process, std::ref(stop), std::ref(pipeline->udp_in_queue), std::ref(pipeline->udp_out_queue), storage, logger);
+            }
+
+            result = load(port, requests);
+
+            stop.store(true);
+            for (auto &thread : threads)
+            {
+                thread.join();
+            }
+        }
+
+        return result;
+    }
+
+    Result run_cores(size_t cores, uint16_t port, const std::vector<std::vector<uint8_t>> &requests,
+                     PGW::CDR_Journal &journal, quill::Logger *logger)
+    {
+        std::atomic<size_t> timeout{3600};
+        std::atomic<size_t> rate{1'000'000};
+        std::atomic<bool> stop{false};
+        Result result;
+        {
+            std::shared_ptr<PGW::Session_Storage> storage = std::make_shared<PGW::Session_Storage>(timeout, rate, journal, std::unordered_set<PGW::IMSI>{}, logger, stop, false);
+
+            std::vector<std::unique_ptr<PGW::Core_Worker>> workers;
+            for (size_t i = 0; i < cores; ++i)
+            {
+                workers.push_back(std::make_unique<PGW::Core_Worker>("127.0.0.1", port, i, cores, std::unordered_set<PGW::IMSI>{}, storage, logger));
+                workers.back()->set_udp_receive_buffer(4 * 1024 * 1024);
+            }
+            if (cores > 1)
+                workers[0]->set_udp_steering_filter(PGW::IMSI::reuseport_filter((uint32_t)cores, PGW::Session_Storage::amount_of_shards));
+
+            std::vector<std::thread> threads;
+            for (auto &worker : workers)
+            {
+                threads.emplace_back(&PGW::Core_Worker::run, worker.get(), std::ref(stop));
+            }
+
+            result = load(port, requests);
+
+            stop.store(true);
+            for (auto &thread : threads)
+            {
+                thread.join();
+            }
+        }
+
+        return result;
+    }
+}
+
+int main()
+{
+    quill::Logger *logger = PGW_Bench::make_logger("thread_per_core_bench");
+    std::string dir = PGW_Bench::make_dir("thread_per_core_bench");
+
+    PGW::CDR_Journal_Options options;
+    options.overflow_policy = PGW::CDR_Overflow_Policy::drop;
+    PGW::CDR_Journal journal{dir + "/cdr.csv", 1'000'000'000, logger, options};
+
+    std::vector<std::vector<uint8_t>> requests(REQUESTS);
+    std::mt19937 random(11);
+    for (auto &request : requests)
+    {
+        PGW::IMSI imsi;
+        imsi.set_IMSI_from_str(std::to_string(250010000000000ul + random() % SUBSCRIBERS));
+        request = imsi.get_IMSI_to_IE();
+    }
+
+    std::printf("%zu requests, window %zu, %u hardware threads\n", REQUESTS, WINDOW, std::thread::hardware_concurrency());
+    std::printf("%-6s %-16s %14s %12s %10s\n", "cores", "mode", "requests/s", "mean us", "lost");
+
+    // IO_Worker не закрывает свой сокет, поэтому у каждого замера свой порт
+    uint16_t port = 65200;
+    for (size_t cores : {1, 2, 4, 8, 16})
+    {
+        for (bool thread_per_core : {false, true})
+        {
+            Result r = thread_per_core ? run_cores(cores, port++, requests, journal, logger)
+                                       : run_pipelines(cores, port++, requests, journal, logger);
+            std::printf("%-6zu %-16s %14.0f %12.1f %10zu\n", cores, thread_per_core ? "thread_per_core" : "pipeline",
+                        r.requests_per_sec, r.mean_us, r.lost);
+        }
+    }
+
+    return 0;
+}
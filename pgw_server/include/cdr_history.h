@@ -0,0 +1,66 @@
+#ifndef PGW_CDR_HISTORY
+#define PGW_CDR_HISTORY
+
+#include "cdr_record.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace PGW
+{
+    // Сколько работы потребовал поиск, по этим числам видно, насколько помог индекс
+    struct CDR_Lookup_Stats
+    {
+        size_t files = 0;
+        // Файлы, пропущенные целиком по времени изменения
+        size_t skipped_files = 0;
+        size_t indexed_files = 0;
+        // Файлы без индекса (текущий файл журнала или старые), прочитанные полностью
+        size_t scanned_files = 0;
+        size_t blocks = 0;
+        size_t blocks_read = 0;
+        size_t bytes_read = 0;
+        // Поиск остановлен по пределу прочитанных байт, дальше по файлам могут быть еще записи
+        bool truncated = false;
+    };
+
+    // Поиск записей одного абонента в файлах CDR журнала, в том числе уже закрытых при ротации.
+    // Только читает файлы, поэтому может работать в любом потоке параллельно с записью журнала.
+    // У текущего файла журнала индекса еще нет, он всегда читается целиком
+    class CDR_History
+    {
+        std::string directory;
+        // Начало имени файлов журнала (имя из конфигурации и "_") и их расширение
+        std::string prefix;
+        std::string extension;
+        CDR_Format format;
+
+        // Проверяет и добавляет в result записи из буфера с целыми строками или двоичными записями
+        void collect(const char *data, size_t size, const std::string &imsi, int64_t since_ns, size_t limit,
+                     std::vector<CDR_Record> &result) const;
+        void scan_file(const std::string &path, const std::string &imsi, int64_t since_ns, size_t limit, size_t max_bytes,
+                       std::vector<CDR_Record> &result, CDR_Lookup_Stats &stats) const;
+
+    public:
+        // filename и format те же, что у CDR_Journal
+        CDR_History(const std::string &filename, CDR_Format format);
+
+        // Файлы журнала от старых к новым
+        std::vector<std::string> list_files() const;
+
+        // Путь к файлу журнала с именем name (без директории), пустая строка, если такого файла журнала нет.
+        // Имя сверяется со списком файлов, поэтому выйти за пределы директории журнала через него нельзя
+        std::string find_file(const std::string &name) const;
+
+        // Не больше limit записей IMSI imsi (цифры) с временем не раньше since_ns, от старых к новым.
+        // use_index = false читает все файлы полностью, для сравнения. Чтение останавливается, когда прочитано
+        // max_bytes (с точностью до блока или куска файла), тогда в stats выставляется truncated
+        std::vector<CDR_Record> lookup(const std::string &imsi, int64_t since_ns, size_t limit,
+                                       CDR_Lookup_Stats *stats = nullptr, bool use_index = true,
+                                       size_t max_bytes = SIZE_MAX) const;
+    };
+}
+
+#endif // PGW_CDR_HISTORY
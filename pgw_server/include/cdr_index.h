@@ -0,0 +1,77 @@
+#ifndef PGW_CDR_INDEX
+#define PGW_CDR_INDEX
+
+#include "cdr_record.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace PGW
+{
+    // Разреженный индекс файла CDR журнала: файл делится на блоки по CDR_INDEX_BLOCK_RECORDS записей,
+    // для каждого блока хранятся смещение, размер, диапазон времени и фильтр Блума по IMSI.
+    // Индекс пишется рядом с файлом (<файл>.idx) при его закрытии, поиск читает только блоки, где IMSI может быть
+    constexpr char CDR_INDEX_MAGIC[8] = {'P', 'G', 'W', 'C', 'D', 'R', 'I', 'X'};
+    constexpr uint16_t CDR_INDEX_VERSION = 1;
+    constexpr size_t CDR_INDEX_BLOCK_RECORDS = 512;
+    // 8 бит фильтра на запись и 4 хэша дают около 2.5% ложных срабатываний, даже если все IMSI в блоке разные
+    constexpr size_t CDR_INDEX_BLOOM_BYTES = 512;
+    constexpr size_t CDR_INDEX_BLOOM_HASHES = 4;
+
+#pragma pack(push, 1)
+    struct CDR_Index_Header
+    {
+        char magic[8];
+        uint16_t version;
+        uint16_t bloom_bytes;
+        uint32_t block_records;
+        uint64_t blocks;
+    };
+
+    struct CDR_Index_Block
+    {
+        // Смещение и размер блока в файле журнала в байтах
+        uint64_t offset;
+        uint64_t size;
+        uint32_t records;
+        uint32_t reserved;
+        int64_t min_timestamp_ns;
+        int64_t max_timestamp_ns;
+        uint8_t bloom[CDR_INDEX_BLOOM_BYTES];
+    };
+#pragma pack(pop)
+
+    static_assert(sizeof(CDR_Index_Header) == 24);
+
+    // Собирает индекс по мере записи файла, используется только потоком записи журнала
+    class CDR_Index_Builder
+    {
+        std::vector<CDR_Index_Block> blocks;
+        uint64_t offset = 0;
+
+    public:
+        // Новый файл, start_offset - размер заголовка перед первой записью
+        void reset(uint64_t start_offset);
+
+        // Учитывает запись, занявшую size байт сразу за предыдущей
+        void add(const CDR_Record &record, size_t size);
+
+        // Забирает собранные блоки, после этого нужен reset
+        std::vector<CDR_Index_Block> take_blocks();
+    };
+
+    // false, если IMSI в блоке точно нет
+    bool cdr_index_may_contain(const CDR_Index_Block &block, const char *imsi, size_t imsi_length);
+
+    std::string cdr_index_path(const std::string &journal_path);
+
+    // Запись через временный файл и rename, чтобы читатель не увидел недописанный индекс
+    bool write_cdr_index(const std::string &journal_path, const std::vector<CDR_Index_Block> &blocks);
+
+    // false, если индекса нет или он поврежден
+    bool read_cdr_index(const std::string &journal_path, std::vector<CDR_Index_Block> &blocks);
+}
+
+#endif // PGW_CDR_INDEX
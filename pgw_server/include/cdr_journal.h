@@ -1,39 +1,270 @@
 #ifndef PGW_CDR_JOURNAL
 #define PGW_CDR_JOURNAL
 
-#include <fstream>
+#include "cdr_index.h"
+#include "cdr_record.h"
+#include "cdr_time_formatter.h"
+
+#include <mpsc_ring.h>
+
+#include <memory>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
 #include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
 
 #include <quill/Logger.h>
 
 namespace PGW
 {
     class IMSI;
-    
+
+    // Что делать с записью, если очередь потока записи заполнена
+    enum class CDR_Overflow_Policy
+    {
+        // Ждать освобождения места, записи не теряются, но задержка диска доходит до вызывающего потока
+        block,
+        // Отбросить запись и увеличить счетчик потерь
+        drop
+    };
+
+    // Когда записанные строки принудительно сбрасываются на диск через fdatasync
+    enum class CDR_Durability
+    {
+        // Только в page cache, на диск их отправит ядро когда посчитает нужным
+        none,
+        // fdatasync раз в sync_interval, если с прошлого раза что-то записывалось
+        periodic,
+        // Записи копятся в группу, на всю группу один fdatasync, но ни одна запись не ждет его начала дольше max_commit_latency
+        // (само время fdatasync в эту границу не входит, его видно в max_loss_window)
+        group_commit
+    };
+
+    // Обработка закрытых файлов журнала в фоновом потоке
+    enum class CDR_Post_Process
+    {
+        none,
+        // Рядом с файлом пишется <файл>.crc32 в формате "crc32  имя_файла"
+        checksum
+    };
+
+    // Какие события сессий попадают в журнал
+    enum class CDR_Mode
+    {
+        // Запись на каждое создание, обновление и удаление
+        per_event,
+        // Одна итоговая запись на сессию при ее удалении (время появления, последней активности и число обновлений),
+        // отказы в создании пишутся как раньше
+        aggregated
+    };
+
+    struct CDR_Journal_Options
+    {
+        // Размер очереди в записях, округляется вверх до степени двойки (при нескольких потоках делится между ними)
+        size_t queue_size = 65536;
+        // Число независимых очередей (потоков записей). Поток выбирается по хэшу IMSI, как и шард хранилища,
+        // поэтому при 16 потоках у каждого шарда своя очередь и шарды не соревнуются за одну
+        size_t streams = 1;
+        CDR_Overflow_Policy overflow_policy = CDR_Overflow_Policy::block;
+        // Как часто поток записи забирает накопившиеся записи из очереди
+        std::chrono::milliseconds flush_interval{10};
+        CDR_Format format = CDR_Format::csv;
+        CDR_Mode mode = CDR_Mode::per_event;
+
+        CDR_Durability durability = CDR_Durability::none;
+        std::chrono::milliseconds sync_interval{1000};
+        std::chrono::milliseconds max_commit_latency{50};
+        // Резервировать место под весь файл (fallocate) при его создании
+        bool preallocate = true;
+
+        // Следующий файл заранее открывается фоновым потоком, при ротации поток записи только подменяет дескриптор,
+        // а синхронизация и закрытие старого файла тоже уходят в фоновый поток
+        bool background_rotation = true;
+        CDR_Post_Process post_process = CDR_Post_Process::none;
+        // При закрытии файла рядом пишется разреженный индекс <файл>.idx для поиска истории по IMSI (см. cdr_index.h)
+        bool index = true;
+    };
+
     class CDR_Journal
     {
+        // Максимальное число строк, которые поток записи передает одним writev
+        static constexpr size_t BATCH_SIZE = 256;
+        static constexpr size_t LINE_SIZE = CDR_CSV_LINE_SIZE;
+        static_assert(sizeof(CDR_Binary_Record) <= LINE_SIZE);
+        // Средняя длина строки CSV, по ней оценивается размер файла для fallocate
+        static constexpr size_t EXPECTED_CSV_LINE_SIZE = 56;
+        // Больше этого место заранее не резервируется, иначе огромный cdr_max_length_lines занимает весь диск
+        static constexpr size_t MAX_PREALLOCATE_SIZE = 256 * 1024 * 1024;
+        // Сколько записей достаточно для закрытия группы в режиме group_commit, не дожидаясь задержки
+        static constexpr size_t GROUP_COMMIT_RECORDS = BATCH_SIZE * 16;
+
         std::string filename;
-        std::ofstream file;
-        std::mutex m;
+        // Файлом владеет поток записи, остальным доступен только признак открытости
+        int fd = -1;
+        std::string current_path;
+        std::atomic<bool> file_open{false};
+        // Имя последнего файла без расширения и число файлов, созданных в ту же секунду
+        std::string last_file_base;
+        size_t same_second_files = 0;
+
+        // Закрытый поток записи файл, который фоновый поток должен синхронизировать, закрыть и обработать
+        struct Retired_File
+        {
+            int fd;
+            std::string path;
+            size_t unsynced_records;
+            int64_t oldest_unsynced_ns;
+            std::vector<CDR_Index_Block> index;
+        };
+
+        // Состояние фоновых потоков ротации и обработки закрытых файлов, защищено rotation_mutex.
+        // Это два отдельных потока: долгий fdatasync закрытого файла не должен задерживать открытие следующего
+        std::mutex rotation_mutex;
+        std::condition_variable prepare_cv;
+        std::condition_variable retired_cv;
+        std::deque<Retired_File> retired_files;
+        // Заранее открытый файл под временным именем, -1 если еще не готов
+        int prepared_fd = -1;
+        bool prepare_requested = false;
+        bool stop_rotation = false;
+        std::thread prepare_thread;
+        std::thread post_process_thread;
+
+        std::atomic<size_t> rotations{0};
+        // Ротации, при которых заранее открытого файла не оказалось и его пришлось создавать в потоке записи
+        std::atomic<size_t> inline_rotations{0};
+        std::atomic<int64_t> max_rotation_ns{0};
 
         quill::Logger* logger;
 
-        // Счетчик чтобы раз в некоторое число строк сбрасывать буфер в файл, конкретно каждые 50 строк
-        size_t ctr = 0;
         // Максимальный размер CDR журнала в строках, после исчерпания создается новый файл
         size_t cdr_max_length_lines;
+        size_t lines_in_file = 0;
+
+        CDR_Journal_Options options;
+
+        // Очереди потоков записей, каждая в отдельном выделении памяти, чтобы не делить кэш-линии
+        std::vector<std::unique_ptr<IO_Utils::MPSC_Ring<CDR_Record>>> rings;
+        // С какой очереди поток записи начинает следующую пачку, чтобы ни одна не ждала дольше других
+        size_t next_ring = 0;
+        // Следующий сквозной номер записи. Единственная общая для всех потоков запись на пути write, но это один
+        // fetch_add без повторов, в отличие от CAS и записи ячейки в общей очереди
+        alignas(64) std::atomic<uint64_t> next_sequence{1};
+        std::atomic<size_t> dropped{0};
+        std::atomic<size_t> blocked{0};
+        // Сколько записей поток записи забрал из очереди и записал в файл
+        std::atomic<size_t> written{0};
+        // Сколько забранных из очереди записей не попало в файл из-за ошибок создания файла или записи
+        std::atomic<size_t> lost{0};
+
+        // Состояние синхронизации, меняется только потоком записи
+        size_t unsynced_records = 0;
+        int64_t oldest_unsynced_ns = 0;
+        std::chrono::steady_clock::time_point last_sync;
+        // Сколько записей гарантированно на диске и наибольший возраст записи на момент окончания fdatasync
+        std::atomic<size_t> durable{0};
+        std::atomic<size_t> sync_calls{0};
+        std::atomic<int64_t> max_loss_window_ns{0};
+
+        // Буферы потока записи под отформатированные строки (или двоичные записи) одной пачки и исходные записи
+        char lines[BATCH_SIZE][LINE_SIZE];
+        size_t line_lengths[BATCH_SIZE];
+        CDR_Record batch_records[BATCH_SIZE];
+
+        // Индекс текущего файла, используется только потоком записи
+        CDR_Index_Builder index_builder;
+
+        // Используется только потоком записи (и конструктором до его запуска)
+        CDR_Time_Formatter time_formatter;
+
+        std::atomic<bool> stop_writer{false};
+        std::thread writer_thread;
+
+        // Имя следующего файла: имя из конфигурации с временной меткой, для двоичного формата с расширением .cdr
+        std::string make_file_name();
+        // Имя, под которым фоновый поток держит заранее открытый файл
+        std::string prepared_file_name() const;
+        // Открывает файл, резервирует под него место и пишет заголовок, -1 при ошибке
+        int open_file(const std::string &path);
 
         //Создает CDR журнал с указанным именем и временной меткой добавленной к в нему
         bool create_file();
+        // Переход на новый файл при заполнении текущего, по возможности на заранее открытый
+        bool rotate_file();
+        // Отдает текущий файл потоку обработки (или синхронизирует и закрывает сам, если его нет)
+        void retire_file();
+
+        // Цикл потока, заранее открывающего следующий файл
+        void prepare_loop();
+        // Цикл низкоприоритетного потока, который синхронизирует, закрывает и обрабатывает закрытые файлы
+        void post_process_loop();
+        void finish_file(const Retired_File &file);
+        void write_checksum(const std::string &path);
+        // Учет выполненного fdatasync, вызывается из потока записи и фонового потока
+        void record_sync(size_t records, int64_t oldest_unsynced_ns);
+
+        // Цикл потока записи: раз в flush_interval забирает все записи из очереди и пишет их пачками
+        void writer_loop();
+        // Забирает записи из очереди, пока она не опустеет, возвращает число обработанных записей
+        size_t drain();
+        // Заполняет общие поля записи и ставит ее в очередь
+        void push(const IMSI &imsi, CDR_Action action, CDR_Record &record);
+        // Переводит запись в формат журнала, возвращает число байт, записанных в line
+        size_t format_record(const CDR_Record &record, char *line);
+        // Пишет первые count строк из lines, при необходимости переходя на новый файл.
+        // Возвращает число записей, целиком попавших в файл, при ошибке остальные не пишутся
+        size_t write_lines(size_t count);
+
+        // fdatasync текущего файла, если в нем есть несинхронизированные записи
+        void sync_file();
+        // Решает, пора ли синхронизировать файл в соответствии с режимом durability
+        void maybe_sync();
+        // Сколько спать потоку записи, когда очередь пуста
+        std::chrono::milliseconds idle_interval() const;
+
     public:
-        CDR_Journal(const std::string filename, size_t cdr_max_length_lines, quill::Logger* logger);
+        CDR_Journal(const std::string filename, size_t cdr_max_length_lines, quill::Logger* logger, CDR_Journal_Options options = {});
+
+        //Записи в журнале определенного формата Timestamp, IMSI, Action (строкой CSV или двоичной записью, см. cdr_record.h)
+        //Timestamp и сквозной номер определяются в момент вызова, сама строка пишется в файл отдельным потоком.
+        //При нескольких потоках записей порядок строк в файле может отличаться от порядка вызовов, его восстанавливает
+        //номер (в CSV добавляется четвертым полем, двоичные файлы упорядочивает cdr_tool merge)
+        virtual void write(IMSI imsi, CDR_Action action);
 
-        //Записи в журнале определенного формата Timestamp, IMSI, Action
-        //Timestamp определяется в момент записи самой строки в журнал
-        virtual void write(IMSI imsi, std::string action);
+        // Итоговая запись о сессии для режима aggregated, action - причина удаления
+        virtual void write_summary(IMSI imsi, CDR_Action action, std::chrono::system_clock::time_point first_seen,
+                                   std::chrono::system_clock::time_point last_seen, uint32_t update_count);
+
+        CDR_Mode get_mode() const;
+
+        // Дожидается, пока все поставленные до вызова записи окажутся в файле
+        void flush();
 
         bool is_open();
 
+        size_t dropped_records() const;
+        // Записи, потерянные из-за ошибок файла (не создался или не записался)
+        size_t lost_records() const;
+        size_t blocked_writes() const;
+        // Сколько записей поток записи забрал из очереди и записал в файл
+        size_t written_records() const;
+
+        // Число записей, для которых уже выполнен fdatasync (в режиме none всегда 0)
+        size_t durable_records() const;
+        size_t sync_count() const;
+        // Наибольшее время, которое запись провела без fdatasync, то есть окно потерь при падении
+        std::chrono::nanoseconds max_loss_window() const;
+
+        size_t rotation_count() const;
+        size_t inline_rotation_count() const;
+        // Наибольшее время, на которое ротация останавливала поток записи
+        std::chrono::nanoseconds max_rotation_time() const;
+
         ~CDR_Journal();
 
         CDR_Journal(const CDR_Journal& other) = delete;
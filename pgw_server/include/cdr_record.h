@@ -0,0 +1,177 @@
+#ifndef PGW_CDR_RECORD
+#define PGW_CDR_RECORD
+
+#include "cdr_time_formatter.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+namespace PGW
+{
+    // Действия, которые попадают в CDR журнал
+    enum class CDR_Action : uint8_t
+    {
+        created,
+        updated,
+        rejected_blacklisted,
+        rejected_error,
+        delete_on_timeout,
+        delete_on_offload,
+        delete_manually
+    };
+
+    constexpr size_t CDR_ACTIONS_COUNT = 7;
+
+    // Текстовое представление действия в том виде, в каком оно пишется в журнал
+    const char *cdr_action_to_str(CDR_Action action);
+
+    // Обратное преобразование, false если такого действия нет
+    bool cdr_action_from_str(const char *str, size_t length, CDR_Action &action);
+
+    // Запись CDR фиксированного размера, в таком виде она передается потоку записи
+    struct CDR_Record
+    {
+        // Время system_clock в наносекундах, определяется в момент вызова write
+        int64_t timestamp_ns;
+        // Сквозной номер записи среди всех потоков журнала, по нему восстанавливается общий порядок (0 - нет номера)
+        uint64_t sequence;
+        // Итог сессии в режиме агрегации: когда сессия появилась, когда обновлялась последний раз и сколько раз.
+        // Для обычных записей нули
+        int64_t first_seen_ns;
+        int64_t last_seen_ns;
+        uint32_t update_count;
+        char imsi[15];
+        uint8_t imsi_length;
+        CDR_Action action;
+    };
+
+    enum class CDR_Format
+    {
+        // Строки "Timestamp","IMSI","Action"
+        csv,
+        // Заголовок файла и записи фиксированного размера CDR_Binary_Record
+        binary
+    };
+
+    // Имя из конфигурации без расширения и расширение файлов журнала (для двоичного формата всегда .cdr)
+    void split_cdr_file_name(const std::string &filename, CDR_Format format, std::string &base, std::string &extension);
+
+    // Максимальная длина строки CSV, которую может дать одна запись
+    constexpr size_t CDR_CSV_LINE_SIZE = 192;
+
+    // Пишет строку "YYYY-MM-DD HH:MM:SS","IMSI","Action"\r\n в line (не меньше CDR_CSV_LINE_SIZE байт), возвращает ее длину.
+    // С with_summary добавляются поля ,"First seen","Last seen","Update count" (для записей без итога сессии пустые и 0),
+    // с with_sequence последним полем добавляется ,"Sequence"
+    size_t format_csv_line(const CDR_Record &record, CDR_Time_Formatter &formatter, char *line, bool with_sequence = false, bool with_summary = false);
+
+    // Разбирает "YYYY-MM-DD HH:MM:SS" в местном времени, как его пишет CDR_Time_Formatter, в секунды от эпохи
+    bool parse_cdr_date_time(const char *str, size_t length, int64_t &seconds);
+
+    // Обратное к format_csv_line преобразование строки (с \r\n или без), число полей определяет, есть ли итог сессии
+    // и номер. Время в CSV хранится с точностью до секунды. false, если строка не похожа на запись журнала
+    bool parse_csv_line(const char *line, size_t length, CDR_Record &record);
+
+    // Двоичный формат журнала. Все поля little-endian, структуры без выравнивания
+    constexpr char CDR_BINARY_MAGIC[8] = {'P', 'G', 'W', 'C', 'D', 'R', '\0', '\0'};
+    // Версия 2 добавила номер последовательности, версия 3 итог сессии. Файлы прошлых версий по-прежнему читаются
+    constexpr uint16_t CDR_BINARY_VERSION = 3;
+    constexpr char CDR_BINARY_SCHEMA[] = "timestamp_ns:i64,sequence:u64,first_seen_ns:i64,last_seen_ns:i64,imsi:bcd8,imsi_len:u8,action:u8,pad:2,upd:u32";
+
+#pragma pack(push, 1)
+    struct CDR_File_Header
+    {
+        char magic[8];
+        uint16_t version;
+        uint16_t header_size;
+        uint16_t record_size;
+        uint16_t reserved;
+        // Текстовое описание полей записи, чтобы файл можно было разобрать без исходников
+        char schema[112];
+    };
+
+    struct CDR_Binary_Record
+    {
+        int64_t timestamp_ns;
+        uint64_t sequence;
+        int64_t first_seen_ns;
+        int64_t last_seen_ns;
+        // Цифры IMSI в BCD, как в IE: младший полубайт - первая цифра, незанятые полубайты 0xF
+        uint8_t imsi_bcd[8];
+        uint8_t imsi_length;
+        uint8_t action;
+        uint8_t reserved[2];
+        uint32_t update_count;
+    };
+
+    // Запись версии 2, без итога сессии
+    struct CDR_Binary_Record_V2
+    {
+        int64_t timestamp_ns;
+        uint64_t sequence;
+        uint8_t imsi_bcd[8];
+        uint8_t imsi_length;
+        uint8_t action;
+        uint8_t reserved[6];
+    };
+
+    // Запись версии 1, без номера последовательности
+    struct CDR_Binary_Record_V1
+    {
+        int64_t timestamp_ns;
+        uint8_t imsi_bcd[8];
+        uint8_t imsi_length;
+        uint8_t action;
+        uint8_t reserved[6];
+    };
+#pragma pack(pop)
+
+    static_assert(sizeof(CDR_File_Header) == 128);
+    static_assert(sizeof(CDR_Binary_Record) == 48);
+    static_assert(sizeof(CDR_Binary_Record_V2) == 32);
+    static_assert(sizeof(CDR_Binary_Record_V1) == 24);
+    static_assert(sizeof(CDR_BINARY_SCHEMA) <= sizeof(CDR_File_Header::schema));
+
+    CDR_File_Header make_cdr_file_header();
+
+    // Проверяет сигнатуру, версию (текущую или одну из прошлых) и размеры из заголовка
+    bool check_cdr_file_header(const CDR_File_Header &header);
+
+    void encode_binary_record(const CDR_Record &record, CDR_Binary_Record &binary);
+
+    // false, если запись повреждена (неизвестное действие или недопустимые цифры IMSI)
+    bool decode_binary_record(const CDR_Binary_Record &binary, CDR_Record &record);
+    bool decode_binary_record(const CDR_Binary_Record_V2 &binary, CDR_Record &record);
+    bool decode_binary_record(const CDR_Binary_Record_V1 &binary, CDR_Record &record);
+
+    // CRC-32 (IEEE 802.3, как у zlib и cksum -a crc32b), для продолжения подсчета передается прошлое значение
+    uint32_t cdr_crc32(const void *data, size_t length, uint32_t crc = 0);
+
+    // Последовательное чтение двоичного CDR журнала
+    class CDR_Binary_Reader
+    {
+        std::FILE *file = nullptr;
+        bool header_valid = false;
+        uint16_t version = 0;
+        // Число поврежденных записей, пропущенных при чтении
+        size_t skipped = 0;
+
+    public:
+        explicit CDR_Binary_Reader(const std::string &path);
+        ~CDR_Binary_Reader();
+
+        // Файл открыт и заголовок совпадает с одной из поддерживаемых версий формата
+        bool is_valid() const;
+
+        // Читает следующую запись, false в конце файла
+        bool next(CDR_Record &record);
+
+        size_t skipped_records() const;
+
+        CDR_Binary_Reader(const CDR_Binary_Reader &) = delete;
+        CDR_Binary_Reader &operator=(const CDR_Binary_Reader &) = delete;
+    };
+}
+
+#endif // PGW_CDR_RECORD
@@ -0,0 +1,43 @@
+#ifndef PGW_CDR_TIME_FORMATTER
+#define PGW_CDR_TIME_FORMATTER
+
+#include <ctime>
+#include <cstddef>
+
+namespace PGW
+{
+    // Форматирование временных меток CDR журнала в виде "YYYY-MM-DD HH:MM:SS" с ведущими нулями.
+    // Отформатированная строка кешируется на текущую секунду, localtime_r вызывается только при ее смене,
+    // память не выделяется. Объект не потокобезопасен, им должен пользоваться один поток (поток записи журнала).
+    // Кешей несколько (slot): разные поля одной строки CDR (время записи, начало и конец сессии) не вытесняют
+    // друг друга, и каждое форматируется заново только при смене своей секунды
+    class CDR_Time_Formatter
+    {
+    public:
+        static constexpr size_t DATE_TIME_SIZE = 19;
+        static constexpr size_t SLOTS = 3;
+
+    private:
+        struct Slot
+        {
+            std::time_t cached_timestamp = -1;
+            char date_time[DATE_TIME_SIZE + 1];
+        };
+
+        Slot slots[SLOTS];
+
+        static void update(Slot &slot, std::time_t timestamp);
+
+    public:
+        CDR_Time_Formatter();
+
+        // Возвращает DATE_TIME_SIZE символов без завершающего нуля, указатель действителен до следующего вызова
+        // с тем же slot (меньше SLOTS)
+        const char *format(std::time_t timestamp, size_t slot = 0);
+
+        // То же самое, но в виде для имени файла "YYYY-MM-DD_HH:MM:SS", в out пишется DATE_TIME_SIZE символов
+        void format_for_filename(std::time_t timestamp, char *out);
+    };
+}
+
+#endif // PGW_CDR_TIME_FORMATTER
@@ -0,0 +1,153 @@
+#ifndef PGW_CORE_WORKER
+#define PGW_CORE_WORKER
+
+#include "handler.h"
+#include "session_storage.h"
+
+#include <mpsc_ring.h>
+#include <network_io.h>
+#include <registrar.h>
+
+#include <quill/Logger.h>
+
+#include <future>
+
+namespace PGW
+{
+    // Результат поиска сессий в шардах ядра: active[i] - есть ли сессия у imsis[i],
+    // session - найденная сессия для поиска с want_session
+    struct Session_Lookup_Result
+    {
+        std::vector<bool> active;
+        Session session;
+    };
+
+    // Запрос к ядру-владельцу шардов. После передачи в Core_Worker::post_lookup принадлежит ядру,
+    // ответ приходит через future от result
+    struct Session_Lookup
+    {
+        std::vector<IMSI> imsis;
+        // _read одного IMSI вместе с сессией, иначе _read_batch
+        bool want_session = false;
+        std::promise<Session_Lookup_Result> result;
+    };
+
+    // Ядро режима thread_per_core: один поток принимает UDP запросы из своего сокета группы SO_REUSEPORT,
+    // обрабатывает и отвечает без очередей между потоками. IMSI распределяются по ядрам программой
+    // IMSI::reuseport_filter, поэтому ядро k работает только с шардами s, для которых s % cores == k:
+    // само удаляет в них устаревшие сессии и отвечает на поиски из HTTP, пришедшие через канал lookups.
+    // Грубые часы ядро не обновляет (их держит Ticker), а очередь CDR журнала выбирается по шарду, так что
+    // при cdr_streams = 16 у каждой очереди один писатель. Общей записью на пути UDP остается сквозной номер
+    // CDR записи (один fetch_add на запись), без него не восстановить общий порядок журнала
+    class Core_Worker
+    {
+        size_t core, cores;
+        std::shared_ptr<Session_Storage> storage;
+        quill::Logger *logger;
+
+        UDP_Handler udp_handler;
+
+        std::shared_ptr<IO_Utils::UDP_Socket> udp_server;
+        int udp_server_fd;
+        std::unique_ptr<IO_Utils::UDP_Connection> udp_server_connection;
+        IO_Utils::Registrar registrar;
+
+        // Канал поисков от потока обработки HTTP, wakeup_fd (eventfd) будит цикл ядра при новом запросе
+        IO_Utils::MPSC_Ring<Session_Lookup *> lookups{256};
+        int wakeup_fd;
+
+        std::atomic<uint64_t> handled_requests{0}, handled_lookups{0};
+        // Последнее значение счетчика отброшенных ядром датаграмм, в метрику идет прирост
+        uint32_t udp_kernel_drops_seen = 0;
+
+        // Принимает и обрабатывает не больше MAX_BATCH датаграмм, чтобы поиски и очистка не ждали конца всплеска
+        void serve_udp();
+        void serve_lookups();
+        void expire_sessions();
+
+    public:
+        static constexpr size_t MAX_BATCH = 64;
+
+        // Ядро-владелец шарда хранилища
+        static size_t shard_owner(size_t shard, size_t cores) noexcept
+        {
+            return shard % cores;
+        }
+
+        // Ядро-владелец шардов IMSI, то же, что выбирает IMSI::reuseport_filter
+        static size_t owner(const IMSI &imsi, size_t cores) noexcept
+        {
+            return shard_owner(imsi.shard_key() % Session_Storage::amount_of_shards, cores);
+        }
+
+        // При cores > 1 сокет входит в группу SO_REUSEPORT, номер в группе - порядок создания ядер
+        Core_Worker(
+            std::string udp_ip, uint16_t udp_port,
+            size_t core, size_t cores,
+            std::unordered_set<IMSI> blacklist,
+            std::shared_ptr<Session_Storage> storage,
+            quill::Logger *logger);
+
+        // Размер приемного буфера сокета, возвращает фактический размер или -1
+        int set_udp_receive_buffer(int bytes);
+        // Фильтр датаграмм в ядре (Socket::attach_filter), 0 или -1
+        int set_udp_socket_filter(const std::vector<sock_filter> &program);
+        // Выбор сокета для всей группы (Socket::attach_reuseport_filter), 0 или -1
+        int set_udp_steering_filter(const std::vector<sock_filter> &program);
+
+        // Из любого потока. false - канал заполнен, lookup остается у вызывающего
+        bool post_lookup(std::unique_ptr<Session_Lookup> &lookup);
+
+        // Для метрик, из любого потока
+        uint64_t requests() const noexcept
+        {
+            return handled_requests.load(std::memory_order_relaxed);
+        }
+        uint64_t lookups_served() const noexcept
+        {
+            return handled_lookups.load(std::memory_order_relaxed);
+        }
+
+        void run(std::atomic<bool> &stop);
+
+        ~Core_Worker();
+
+        Core_Worker(const Core_Worker &) = delete;
+        Core_Worker &operator=(const Core_Worker &) = delete;
+    };
+
+    // Хранилище для HTTP_Handler в режиме thread_per_core: поиски передаются ядрам-владельцам шардов
+    // и ждут их ответа, так что HTTP не блокирует шарды ядер и не читает их память. Остальные операции
+    // (_create, _update, _delete, lock_stats) идут в хранилище напрямую из вызывающего потока под блокировкой шарда,
+    // HTTP их не делает, кроме /lock_stats. Поиск, на который ядро не ответило, бросает Session_Storage_Unavailable
+    class Core_Session_Storage : public ISession_Storage
+    {
+        std::shared_ptr<Session_Storage> storage;
+        std::vector<Core_Worker *> cores;
+        quill::Logger *logger;
+
+        // Общий срок ответа всех ядер на один поиск
+        static constexpr std::chrono::seconds LOOKUP_TIMEOUT{1};
+
+        // Невалидный future - канал ядра переполнен
+        std::future<Session_Lookup_Result> post(size_t core, std::vector<IMSI> imsis, bool want_session);
+        // Ответ ядра core до deadline или Session_Storage_Unavailable
+        Session_Lookup_Result wait(size_t core, std::future<Session_Lookup_Result> &result,
+                                   std::chrono::steady_clock::time_point deadline);
+
+    public:
+        Core_Session_Storage(std::shared_ptr<Session_Storage> storage, std::vector<Core_Worker *> cores, quill::Logger *logger);
+
+        bool _create(IMSI imsi, Session session) override;
+        bool _read(IMSI imsi, Session &session) override;
+        bool _update(IMSI imsi, Session session) override;
+        bool _delete(IMSI imsi) override;
+
+        // IMSI раскладываются по ядрам-владельцам, ядра ищут параллельно
+        size_t _read_batch(const std::vector<IMSI> &imsis, std::vector<bool> &active) override;
+
+        std::vector<IO_Utils::Lock_Stats> lock_stats() override;
+    };
+}
+
+#endif // PGW_CORE_WORKER
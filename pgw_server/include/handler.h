@@ -1,16 +1,21 @@
 #ifndef PGW_HANDLER
 #define PGW_HANDLER
 
+#include "cdr_history.h"
+#include "cdr_time_formatter.h"
 #include "imsi.h"
 #include "session_storage.h"
 
+#include <log_throttle.h>
 #include <network_io.h>
 
 #include <picohttpparser.h>
 #include <quill/Logger.h>
 
+#include <chrono>
 #include <vector>
 #include <string>
+#include <string_view>
 #include <cstdint>
 #include <memory>
 #include <unordered_set>
@@ -19,6 +24,9 @@ namespace PGW
 {
     std::string vec_to_str(std::vector<uint8_t> data);
 
+    // Сравнение ASCII строк без учета регистра (имена HTTP заголовков), без выделения памяти
+    bool equals_ignore_case(std::string_view a, std::string_view b);
+
     class Handler
     {
     protected:
@@ -37,6 +45,9 @@ namespace PGW
         std::shared_ptr<ISession_Storage> session_storage;
 
     public:
+        // Ответ на запрос, отклоненный защитой от перегрузки без обработки
+        static std::vector<uint8_t> busy_response();
+
         UDP_Handler(std::unordered_set<IMSI> blacklist, std::shared_ptr<ISession_Storage> session_storage, quill::Logger* logger);
 
         std::unique_ptr<IO_Utils::Packet> handle_packet(std::unique_ptr<IO_Utils::Packet> packet) override;
@@ -49,25 +60,107 @@ namespace PGW
 
     class HTTP_Handler : public TCP_Handler
     {
-        std::vector<uint8_t> create_error_response(int status_code, const std::string &message);
-
-        std::vector<uint8_t> process_request(
-            std::string method,
-            std::string path,
+        // Ответ на HTTP запрос. Строки указывают на литералы или буферы обработчика, но не в пакет запроса,
+        // поэтому ответ можно записать поверх запроса
+        struct Response
+        {
+            std::string_view status = "200 OK";
+            std::string_view content_type = "text/plain";
+            // Дополнительные заголовки, каждый со своим \r\n
+            std::string_view extra_headers;
+            std::string_view content;
+            // Тело из файла вместо content, отправляется через sendfile
+            std::shared_ptr<IO_Utils::File_Body> file_body;
+        };
+
+        // Записывает ответ в out, сохраняя выделенную под out память
+        static void render_response(const Response &response, std::vector<uint8_t> &out);
+
+        // method, path и body указывают в буфер пакета
+        void process_request(
+            std::string_view method,
+            std::string_view path,
             int http_version,
             phr_header *headers,
             size_t num_headers,
-            const char *body,
-            size_t body_size);
+            std::string_view body,
+            Response &response);
+
+        // Ответ 503 на поиск, на который хранилище не смогло ответить
+        void unavailable(const Session_Storage_Unavailable &error, Response &response);
+        IO_Utils::Log_Throttle unavailable_log{"Session lookup failed"};
+
+        // GET /check_subscriber с IMSI в заголовке IMSI, отвечает active или not active
+        void process_check_subscriber(phr_header *headers, size_t num_headers, Response &response);
+
+        // POST /check_subscribers с IMSI в теле: по одному в строке (ответ CSV "IMSI","статус")
+        // или JSON массив строк, в том числе в поле "imsis" объекта (ответ JSON массив {"imsi","status"}).
+        // Все IMSI проверяются одним обращением к хранилищу
+        void process_check_subscribers(std::string_view method, std::string_view body, Response &response);
+
+        // GET /cdr?imsi=...&since=...&limit=..., строки CSV в content
+        void process_cdr_request(std::string_view method, std::string_view query, Response &response);
+
+        // GET /cdr/files - список файлов журнала, GET /cdr/files/<имя> - сам файл (с поддержкой Range).
+        // Файл не читается в память: открытый дескриптор уходит в file_body, IO поток отправляет его через sendfile
+        void process_cdr_files_request(std::string_view name, phr_header *headers, size_t num_headers, Response &response);
+
+        // GET /lock_stats - статистика блокировок шардов хранилища строками CSV,
+        // в отладочной сборке (IO_UTILS_LOCK_CALL_SITES) после пустой строки - места, дольше всего ждавшие блокировок
+        void process_lock_stats_request(Response &response);
+
+        // GET /profile/start открывает окно записи счетчиков perf_event_open по потокам конвейера,
+        // GET /profile/stop закрывает его и отвечает CSV: окно и число пакетов, затем по строке на поток
+        // (IPC, доля промахов кэша, циклы и процессорное время на пакет). Только при profiling_enabled
+        void process_profile_request(std::string_view action, Response &response);
+
+        // GET /trace/start?sample=N&duration_ms=M начинает запись участков каждого N-го запроса в trace_file
+        // (Chrome Trace Event JSON) на M миллисекунд, GET /trace/stop завершает ее досрочно.
+        // Пустой trace_file запрещает запись
+        void process_trace_request(std::string_view action, std::string_view query, Response &response);
 
         std::shared_ptr<ISession_Storage> session_storage;
         std::atomic<bool> &stop;
         quill::Logger* logger;
+        // История CDR журнала для /cdr, без нее запрос отвечает 404
+        std::shared_ptr<CDR_History> cdr_history;
+        CDR_Time_Formatter time_formatter;
+        // Буферы для ответов, собираемых на лету (/cdr), переиспользуются между запросами
+        std::string content_buffer;
+        std::string headers_buffer;
+        // Разобранное тело /check_subscribers: строки из запроса, IMSI правильных из них и результаты проверки
+        std::vector<std::string> batch_keys;
+        std::vector<IMSI> batch_imsis;
+        std::vector<bool> batch_active;
+        // Самопрофилирование: разрешено ли оно, начало текущего окна и число принятых пакетов на тот момент
+        bool profiling_enabled;
+        std::chrono::steady_clock::time_point profile_start_time;
+        uint64_t profile_start_packets = 0;
+        // Файл для записи трассировки
+        std::string trace_file;
 
     public:
+        // Ограничения на заголовки и тело запроса
         static constexpr size_t MAX_HTTP_SIZE = 8192;
-
-        HTTP_Handler(std::shared_ptr<ISession_Storage> session_storage, std::atomic<bool> &stop, quill::Logger* logger);
+        static constexpr size_t MAX_HTTP_BODY_SIZE = 1024 * 1024;
+        // Сколько записей /cdr возвращает по умолчанию и сколько можно запросить параметром limit
+        static constexpr size_t DEFAULT_CDR_LIMIT = 1000;
+        static constexpr size_t MAX_CDR_LIMIT = 10000;
+        // Сколько байт файлов журнала /cdr читает за один запрос: поиск идет в потоке обработки вместе с UDP,
+        // поэтому он ограничен, а ответ помечается заголовком X-CDR-Truncated (дальше - запрос с since позже)
+        static constexpr size_t MAX_CDR_SCAN_BYTES = 16 * 1024 * 1024;
+        // Предел since в секундах, чтобы время в наносекундах помещалось в int64_t
+        static constexpr int64_t MAX_CDR_SINCE_SEC = INT64_MAX / 1'000'000'000;
+        // Сколько мест ожидания блокировок выдает /lock_stats
+        static constexpr size_t LOCK_CALL_SITES_LIMIT = 10;
+        // Параметры /trace/start по умолчанию и предел длительности записи
+        static constexpr size_t DEFAULT_TRACE_SAMPLE = 100;
+        static constexpr size_t DEFAULT_TRACE_DURATION_MS = 10000;
+        static constexpr size_t MAX_TRACE_DURATION_MS = 10 * 60 * 1000;
+
+        HTTP_Handler(std::shared_ptr<ISession_Storage> session_storage, std::atomic<bool> &stop, quill::Logger* logger,
+                     std::shared_ptr<CDR_History> cdr_history = nullptr, bool profiling_enabled = false,
+                     std::string trace_file = "");
 
         std::unique_ptr<IO_Utils::Packet> handle_packet(std::unique_ptr<IO_Utils::Packet> packet) override;
     };
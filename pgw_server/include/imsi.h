@@ -4,6 +4,7 @@
 #include <vector>
 #include <string>
 #include <cstdint>
+#include <linux/filter.h>
 
 namespace PGW
 {
@@ -21,8 +22,25 @@ namespace PGW
 
         std::string get_IMSI_to_str() const;
 
+        // Цифры IMSI без копирования, для аргументов USDT точек
+        const char *c_str() const noexcept { return imsi.c_str(); }
+
         std::vector<uint8_t> get_IMSI_to_IE() const;
 
+        // Программа классического BPF для SO_ATTACH_FILTER на UDP сокете: ядро пропускает только датаграммы,
+        // которые принимает set_IMSI_from_IE (тип IE, поле Length, от 1 до 15 цифр BCD), остальные отбрасывает
+        static std::vector<sock_filter> socket_filter();
+
+        // Ключ распределения по шардам хранилища, считается по байтам IE так же, как в reuseport_filter:
+        // FNV-1a и свертка key ^ (key >> 16). Множитель не сравним с ±1 по модулю 16, иначе младшие биты
+        // зависели бы только от младших полубайтов байтов и часть цифр не влияла бы на шард
+        static constexpr uint32_t SHARD_KEY_BASIS = 0x811C9DC5;
+        static constexpr uint32_t SHARD_KEY_PRIME = 0x01000193;
+        uint32_t shard_key() const noexcept;
+        // Программа для SO_ATTACH_REUSEPORT_CBPF: датаграмма с IMSI уходит сокету номер (shard_key % shards) % sockets,
+        // то есть каждый сокет группы получает IMSI только своих шардов. Остальные датаграммы распределяет ядро
+        static std::vector<sock_filter> reuseport_filter(uint32_t sockets, uint32_t shards);
+
         bool operator==(const IMSI &other) const;
     };
 }
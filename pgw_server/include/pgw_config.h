@@ -1,11 +1,29 @@
 #ifndef PGW_CONFIG
 #define PGW_CONFIG
 
+#include "cdr_journal.h"
+
 #include <nlohmann/json.hpp>
 #include <quill/core/LogLevel.h>
 
 namespace PGW
 {
+    // Раздел thread_placement: CPU для потоков каждой роли, пустой список - поток не закрепляется.
+    // Потоки IO, обработки и ядра k закрепляются за одним CPU cpus[k % размер], очистка хранилища
+    // и главный поток (перечитывание конфигурации) - за всем списком, поток логгера - за первым CPU списка
+    struct Thread_Placement_Config
+    {
+        std::vector<int> io;
+        std::vector<int> process;
+        std::vector<int> cleanup;
+        std::vector<int> logger;
+        std::vector<int> config_reload;
+        // Ядра режима thread_per_core
+        std::vector<int> cores;
+        // Очереди и хранилище создаются с памятью на узле NUMA потока обработки, который с ними работает
+        bool numa_local = true;
+    };
+
     class Config
     {
         std::string config_path;
@@ -26,12 +44,43 @@ namespace PGW
 
         std::string cdr_file;
         size_t cdr_file_max_lines;
+        // Параметры потока записи CDR журнала
+        CDR_Journal_Options cdr_options;
 
         std::string log_file;
         quill::LogLevel log_level;
 
         std::vector<std::string> blacklist;
 
+        // Точность грубых часов, которыми пользуются хранилище сессий и CDR журнал
+        size_t clock_precision_ms;
+        // Период записи сводки задержек по этапам в лог, 0 - не писать
+        size_t latency_log_interval_sec;
+        // Разрешены ли /profile/start и /profile/stop (счетчики perf_event_open по потокам)
+        bool profiling_enabled;
+        // Файл для записи трассировки запросов (/trace/start), пустая строка запрещает запись
+        std::string trace_file;
+        // Защита udp_in_queue от перегрузки (CoDel): допустимое ожидание в очереди при постоянной очереди
+        // и интервал, за который очередь должна опустошиться, чтобы перегрузки не было
+        bool overload_control;
+        size_t overload_target_ms;
+        size_t overload_interval_ms;
+        // Приемный буфер UDP сокета в байтах (0 - размер по умолчанию ядра) и заполнение udp_in_queue,
+        // на котором чтение сокета приостанавливается и возобновляется (0 - не приостанавливать)
+        size_t udp_receive_buffer_bytes;
+        size_t udp_high_watermark;
+        size_t udp_low_watermark;
+        // Отбрасывать датаграммы не в формате IE с IMSI фильтром в ядре (IMSI::socket_filter), без ответа клиенту
+        bool udp_socket_filter;
+        // Число UDP конвейеров (сокет в группе SO_REUSEPORT, IO поток и поток обработки) и распределение
+        // датаграмм между ними по IMSI (IMSI::reuseport_filter) вместо хеша адресов
+        size_t udp_workers;
+        bool udp_steering;
+        // Режим thread_per_core: вместо udp_workers конвейеров столько же ядер (Core_Worker), каждое само принимает,
+        // обрабатывает и отправляет UDP запросы своих шардов, распределение по IMSI включено всегда
+        bool thread_per_core;
+        Thread_Placement_Config thread_placement;
+
         Config(const std::string &config_path);
 
         // Горячая смена перезагружаемой части конфигурации
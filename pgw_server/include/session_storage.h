@@ -3,10 +3,18 @@
 
 #include "imsi.h"
 
+#include <instrumented_mutex.h>
+#include <log_throttle.h>
+
 #include <chrono>
+#include <fstream>
+#include <memory>
+#include <mutex>
 #include <unordered_map>
 #include <unordered_set>
+#include <vector>
 #include <shared_mutex>
+#include <stdexcept>
 #include <atomic>
 #include <thread>
 
@@ -18,6 +26,18 @@ namespace PGW
     {
         IMSI imsi;
         std::chrono::steady_clock::time_point last_activity;
+        // Для итоговой CDR записи (режим aggregated), заполняются хранилищем
+        std::chrono::system_clock::time_point first_seen{};
+        std::chrono::system_clock::time_point last_seen{};
+        uint32_t update_count = 0;
+    };
+
+    // Хранилище не смогло ответить на поиск (канал ядра-владельца переполнен, ядро не ответило вовремя
+    // или уже остановлено). Это не то же самое, что "сессии нет": HTTP отвечает на такой поиск 503
+    class Session_Storage_Unavailable : public std::runtime_error
+    {
+    public:
+        using std::runtime_error::runtime_error;
     };
 
     class ISession_Storage
@@ -28,10 +48,18 @@ namespace PGW
         virtual bool _update(IMSI, Session) = 0;
         virtual bool _delete(IMSI) = 0;
 
+        // Проверка сессий сразу для нескольких IMSI: active[i] - есть ли сессия у imsis[i].
+        // Возвращает число найденных. По умолчанию это _read для каждого IMSI
+        virtual size_t _read_batch(const std::vector<IMSI> &imsis, std::vector<bool> &active);
+
+        // Статистика блокировок по шардам для /lock_stats, пусто если хранилище ее не ведет
+        virtual std::vector<IO_Utils::Lock_Stats> lock_stats();
+
         virtual ~ISession_Storage() = default;
     };
 
     class CDR_Journal;
+    enum class CDR_Action : uint8_t;
 
     class Session_Storage : public ISession_Storage
     {
@@ -41,11 +69,12 @@ namespace PGW
         struct Shard
         {
             std::unordered_map<IMSI, Session> sessions;
-            std::shared_mutex mutex;
+            // Считает ожидания и удержания, чтобы было видно, какие шарды перегружены
+            IO_Utils::Instrumented_Shared_Mutex mutex;
         };
 
-        static constexpr size_t amount_of_shards = 16;
-        std::vector<Shard> shards{amount_of_shards};
+        // Каждый шард выделяется отдельно, чтобы его память можно было разместить на узле NUMA владельца
+        std::vector<std::unique_ptr<Shard>> shards;
 
         std::atomic<size_t> &session_timeout_in_seconds;
         std::atomic<size_t> &graceful_shutdown_rate;
@@ -55,19 +84,35 @@ namespace PGW
 
         quill::Logger* logger;
 
+        // Отказы IMSI из черного списка пишутся в CDR журнал всегда, ограничивается только лог
+        IO_Utils::Log_Throttle blacklisted_log{"Create session rejected: IMSI blacklisted"};
+        // Поиск отсутствующих сессий (/check_subscriber и повторные UDP запросы) пишется в лог с ограничением
+        IO_Utils::Log_Throttle not_found_log{"Can't find session"};
+
+        // Журнал в режиме aggregated: вместо записей на каждое событие одна итоговая при удалении сессии
+        bool aggregate_cdr;
+
         std::thread cleanup_thread;
+        // CPU, за которыми закрепляется поток очистки, пустой - не закрепляется
+        std::vector<int> cleanup_cpus;
 
-        // Хэш-функция для определения номера шарда
+        // Номер шарда по IMSI::shard_key, тот же, что у программы распределения пакетов по UDP сокетам
         size_t get_shard_index(const IMSI &imsi) const;
 
         // Функция осуществляющая периодическую очистку хранилища сессий от устаревших записей.
-        // Действует в отдельном потоке, создаваемом в конструкторе, итерация каждые 0.5 секунды
+        // Действует в отдельном потоке, создаваемом в конструкторе, итерация каждые 0.25 секунды
         void cleanup(std::atomic<bool> &stop);
 
         // Удаляет сессии со скоростью graceful_shutdown_rate сессий в секунду
         void delete_sessions_gracefully();
 
+        // CDR запись об удалении сессии: обычная или итоговая, в зависимости от режима журнала
+        void write_delete_cdr(const IMSI &imsi, const Session &session, CDR_Action action);
+
     public:
+        // При нескольких UDP конвейерах конвейер k обрабатывает IMSI шардов s, для которых s % конвейеров == k
+        static constexpr size_t amount_of_shards = 16;
+
         CDR_Journal &cdr_log;
         Session_Storage(
             std::atomic<size_t> &session_timeout_in_seconds,
@@ -75,7 +120,13 @@ namespace PGW
             CDR_Journal &cdr_log,
             std::unordered_set<IMSI> blacklist,
             quill::Logger* logger,
-            std::atomic<bool> &stop);
+            std::atomic<bool> &stop,
+            bool cleanup_thread_enabled = true,
+            std::vector<int> cleanup_cpus = {},
+            // CPU потока-владельца каждого шарда: шард создается под Thread_Placement::Scope с ними,
+            // пустой список (или нет элемента для шарда) - в текущем размещении
+            const std::vector<std::vector<int>> &shard_cpus = {},
+            bool numa_local = false);
 
         // Перезапишет сессию даже если она существует
         // Но если использовать в связке с предварительным _read и _update в случае нахождения, все нормально
@@ -88,6 +139,19 @@ namespace PGW
 
         bool _delete(IMSI imsi) override;
 
+        // IMSI группируются по шардам, каждый шард блокируется на чтение один раз на весь запрос
+        size_t _read_batch(const std::vector<IMSI> &imsis, std::vector<bool> &active) override;
+
+        // Удаляет устаревшие сессии одного шарда. Без потока очистки (cleanup_thread_enabled = false)
+        // это делают владельцы шардов, например ядра в режиме thread_per_core
+        void expire_shard(size_t shard_index);
+
+        // Число сессий в каждом шарде, для метрик
+        std::vector<size_t> shard_sizes();
+
+        // Статистика мьютекса каждого шарда
+        std::vector<IO_Utils::Lock_Stats> lock_stats() override;
+
         ~Session_Storage();
     };
 }
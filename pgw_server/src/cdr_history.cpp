@@ -0,0 +1,286 @@
+#include "cdr_history.h"
+
+#include "cdr_index.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <filesystem>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace PGW
+{
+    // Читает size байт с offset, false при ошибке или если файл оказался короче
+    static bool read_at(int fd, char *buffer, size_t size, uint64_t offset)
+    {
+        size_t done = 0;
+        while (done < size)
+        {
+            ssize_t res = pread(fd, buffer + done, size - done, offset + done);
+            if (res < 0 && errno == EINTR)
+                continue;
+            if (res <= 0)
+                return false;
+
+            done += res;
+        }
+
+        return true;
+    }
+
+    CDR_History::CDR_History(const std::string &filename, CDR_Format format) : format(format)
+    {
+        std::string base;
+        split_cdr_file_name(filename, format, base, extension);
+
+        std::filesystem::path base_path{base};
+        directory = base_path.has_parent_path() ? base_path.parent_path().string() : ".";
+        prefix = base_path.filename().string() + "_";
+    }
+
+    std::vector<std::string> CDR_History::list_files() const
+    {
+        // Имя файла: префикс, "YYYY-MM-DD_HH:MM:SS", для нескольких файлов в одну секунду "_N", расширение.
+        // Сортировка по строке поставила бы "_10" раньше "_2", поэтому номер сравнивается как число
+        struct Entry
+        {
+            std::string date_time;
+            size_t number;
+            std::string path;
+        };
+        std::vector<Entry> entries;
+
+        std::error_code ec;
+        for (const auto &entry : std::filesystem::directory_iterator(directory, ec))
+        {
+            std::string name = entry.path().filename().string();
+            if (name.size() < prefix.size() + CDR_Time_Formatter::DATE_TIME_SIZE + extension.size() ||
+                name.compare(0, prefix.size(), prefix) != 0 ||
+                name.compare(name.size() - extension.size(), extension.size(), extension) != 0)
+                continue;
+
+            std::string stem = name.substr(prefix.size(), name.size() - prefix.size() - extension.size());
+            size_t number = 0;
+            if (stem.size() > CDR_Time_Formatter::DATE_TIME_SIZE)
+            {
+                const char *begin = stem.data() + CDR_Time_Formatter::DATE_TIME_SIZE + 1;
+                const char *end = stem.data() + stem.size();
+                auto [ptr, res] = std::from_chars(begin, end, number);
+                if (stem[CDR_Time_Formatter::DATE_TIME_SIZE] != '_' || res != std::errc{} || ptr != end)
+                    continue;
+            }
+
+            entries.push_back({stem.substr(0, CDR_Time_Formatter::DATE_TIME_SIZE), number, entry.path().string()});
+        }
+
+        std::sort(entries.begin(), entries.end(), [](const Entry &a, const Entry &b)
+                  { return a.date_time != b.date_time ? a.date_time < b.date_time : a.number < b.number; });
+
+        std::vector<std::string> result;
+        result.reserve(entries.size());
+        for (auto &entry : entries)
+        {
+            result.push_back(std::move(entry.path));
+        }
+
+        return result;
+    }
+
+    std::string CDR_History::find_file(const std::string &name) const
+    {
+        for (const auto &path : list_files())
+        {
+            if (std::filesystem::path(path).filename() == name)
+                return path;
+        }
+
+        return "";
+    }
+
+    void CDR_History::collect(const char *data, size_t size, const std::string &imsi, int64_t since_ns, size_t limit,
+                              std::vector<CDR_Record> &result) const
+    {
+        CDR_Record record;
+
+        if (format == CDR_Format::binary)
+        {
+            for (size_t offset = 0; offset + sizeof(CDR_Binary_Record) <= size && result.size() < limit; offset += sizeof(CDR_Binary_Record))
+            {
+                CDR_Binary_Record binary;
+                std::memcpy(&binary, data + offset, sizeof(binary));
+
+                if (decode_binary_record(binary, record) && record.timestamp_ns >= since_ns &&
+                    record.imsi_length == imsi.size() && std::memcmp(record.imsi, imsi.data(), imsi.size()) == 0)
+                    result.push_back(record);
+            }
+
+            return;
+        }
+
+        // IMSI стоит после "YYYY-MM-DD HH:MM:SS"," и сравнивается до разбора строки, разбор времени дорогой
+        constexpr size_t imsi_offset = 1 + CDR_Time_Formatter::DATE_TIME_SIZE + 3;
+
+        const char *end = data + size;
+        for (const char *line = data; line < end && result.size() < limit;)
+        {
+            const char *line_end = (const char *)std::memchr(line, '\n', end - line);
+            line_end = line_end == nullptr ? end : line_end + 1;
+
+            size_t length = line_end - line;
+            if (length > imsi_offset + imsi.size() && std::memcmp(line + imsi_offset, imsi.data(), imsi.size()) == 0 &&
+                line[imsi_offset + imsi.size()] == '"' && parse_csv_line(line, length, record) && record.timestamp_ns >= since_ns)
+                result.push_back(record);
+
+            line = line_end;
+        }
+    }
+
+    void CDR_History::scan_file(const std::string &path, const std::string &imsi, int64_t since_ns, size_t limit, size_t max_bytes,
+                                std::vector<CDR_Record> &result, CDR_Lookup_Stats &stats) const
+    {
+        stats.scanned_files++;
+
+        if (format == CDR_Format::binary)
+        {
+            // Файлы прошлых версий формата разбирает CDR_Binary_Reader
+            CDR_Binary_Reader reader{path};
+            CDR_Record record;
+            while (result.size() < limit && reader.next(record))
+            {
+                if (stats.bytes_read >= max_bytes)
+                {
+                    stats.truncated = true;
+                    break;
+                }
+                stats.bytes_read += sizeof(CDR_Binary_Record);
+                if (record.timestamp_ns >= since_ns && record.imsi_length == imsi.size() &&
+                    std::memcmp(record.imsi, imsi.data(), imsi.size()) == 0)
+                    result.push_back(record);
+            }
+
+            return;
+        }
+
+        int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            return;
+
+        // Читается кусками, незаконченная строка в конце куска переносится в начало следующего.
+        // Недописанная строка в конце текущего файла просто не попадает в результат
+        std::vector<char> buffer(256 * 1024);
+        size_t filled = 0;
+        while (result.size() < limit)
+        {
+            if (stats.bytes_read >= max_bytes)
+            {
+                stats.truncated = true;
+                break;
+            }
+
+            ssize_t res = read(fd, buffer.data() + filled, buffer.size() - filled);
+            if (res < 0 && errno == EINTR)
+                continue;
+            if (res <= 0)
+                break;
+
+            stats.bytes_read += res;
+            filled += res;
+
+            const char *last_newline = (const char *)memrchr(buffer.data(), '\n', filled);
+            size_t complete = last_newline == nullptr ? 0 : last_newline - buffer.data() + 1;
+            if (complete == 0 && filled == buffer.size())
+            {
+                // Строк такой длины журнал не пишет, файл не похож на журнал
+                break;
+            }
+
+            collect(buffer.data(), complete, imsi, since_ns, limit, result);
+
+            std::memmove(buffer.data(), buffer.data() + complete, filled - complete);
+            filled -= complete;
+        }
+
+        close(fd);
+    }
+
+    std::vector<CDR_Record> CDR_History::lookup(const std::string &imsi, int64_t since_ns, size_t limit,
+                                                CDR_Lookup_Stats *stats, bool use_index, size_t max_bytes) const
+    {
+        CDR_Lookup_Stats local_stats;
+        CDR_Lookup_Stats &current = stats != nullptr ? *stats : local_stats;
+
+        std::vector<CDR_Record> result;
+        std::vector<CDR_Index_Block> blocks;
+        std::vector<char> buffer;
+
+        for (const auto &path : list_files())
+        {
+            if (result.size() >= limit || current.truncated)
+                break;
+            if (current.bytes_read >= max_bytes)
+            {
+                current.truncated = true;
+                break;
+            }
+
+            current.files++;
+
+            // Время записи не больше времени изменения файла, поэтому файлы, измененные до since, пропускаются целиком
+            struct stat file_stat;
+            if (stat(path.c_str(), &file_stat) != 0)
+                continue;
+            int64_t mtime_ns = (int64_t)file_stat.st_mtim.tv_sec * 1'000'000'000 + file_stat.st_mtim.tv_nsec;
+            if (mtime_ns < since_ns)
+            {
+                current.skipped_files++;
+                continue;
+            }
+
+            if (!use_index || !read_cdr_index(path, blocks))
+            {
+                scan_file(path, imsi, since_ns, limit, max_bytes, result, current);
+                continue;
+            }
+
+            current.indexed_files++;
+            current.blocks += blocks.size();
+
+            int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd < 0)
+                continue;
+
+            for (const auto &block : blocks)
+            {
+                if (result.size() >= limit)
+                    break;
+                if (current.bytes_read >= max_bytes)
+                {
+                    current.truncated = true;
+                    break;
+                }
+                if (block.max_timestamp_ns < since_ns || !cdr_index_may_contain(block, imsi.data(), imsi.size()))
+                    continue;
+
+                buffer.resize(block.size);
+                if (!read_at(fd, buffer.data(), block.size, block.offset))
+                    break;
+
+                current.blocks_read++;
+                current.bytes_read += block.size;
+
+                collect(buffer.data(), block.size, imsi, since_ns, limit, result);
+            }
+
+            close(fd);
+        }
+
+        // В одном файле записи разных потоков журнала могут идти не по порядку
+        std::stable_sort(result.begin(), result.end(), [](const CDR_Record &a, const CDR_Record &b)
+                         { return a.timestamp_ns != b.timestamp_ns ? a.timestamp_ns < b.timestamp_ns : a.sequence < b.sequence; });
+
+        return result;
+    }
+}
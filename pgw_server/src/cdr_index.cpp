@@ -0,0 +1,142 @@
+#include "cdr_index.h"
+
+#include <cstdio>
+#include <cstring>
+
+namespace PGW
+{
+    // FNV-1a от цифр IMSI, из двух половин получаются все CDR_INDEX_BLOOM_HASHES позиций (двойное хэширование)
+    static uint64_t imsi_hash(const char *imsi, size_t imsi_length)
+    {
+        uint64_t hash = 14695981039346656037ull;
+        for (size_t i = 0; i < imsi_length; ++i)
+        {
+            hash ^= (uint8_t)imsi[i];
+            hash *= 1099511628211ull;
+        }
+
+        return hash;
+    }
+
+    template <typename F>
+    static void for_each_bloom_bit(const char *imsi, size_t imsi_length, F &&fn)
+    {
+        uint64_t hash = imsi_hash(imsi, imsi_length);
+        uint32_t h1 = (uint32_t)hash;
+        uint32_t h2 = (uint32_t)(hash >> 32) | 1;
+
+        for (size_t i = 0; i < CDR_INDEX_BLOOM_HASHES; ++i)
+        {
+            fn((h1 + i * h2) % (CDR_INDEX_BLOOM_BYTES * 8));
+        }
+    }
+
+    void CDR_Index_Builder::reset(uint64_t start_offset)
+    {
+        blocks.clear();
+        offset = start_offset;
+    }
+
+    void CDR_Index_Builder::add(const CDR_Record &record, size_t size)
+    {
+        if (blocks.empty() || blocks.back().records >= CDR_INDEX_BLOCK_RECORDS)
+        {
+            CDR_Index_Block block;
+            std::memset(&block, 0, sizeof(block));
+            block.offset = offset;
+            block.min_timestamp_ns = record.timestamp_ns;
+            block.max_timestamp_ns = record.timestamp_ns;
+            blocks.push_back(block);
+        }
+
+        CDR_Index_Block &block = blocks.back();
+        block.size += size;
+        block.records++;
+        if (record.timestamp_ns < block.min_timestamp_ns)
+            block.min_timestamp_ns = record.timestamp_ns;
+        if (record.timestamp_ns > block.max_timestamp_ns)
+            block.max_timestamp_ns = record.timestamp_ns;
+
+        for_each_bloom_bit(record.imsi, record.imsi_length, [&block](size_t bit)
+                           { block.bloom[bit / 8] |= 1 << (bit % 8); });
+
+        offset += size;
+    }
+
+    std::vector<CDR_Index_Block> CDR_Index_Builder::take_blocks()
+    {
+        return std::move(blocks);
+    }
+
+    bool cdr_index_may_contain(const CDR_Index_Block &block, const char *imsi, size_t imsi_length)
+    {
+        bool result = true;
+        for_each_bloom_bit(imsi, imsi_length, [&](size_t bit)
+                           { result = result && (block.bloom[bit / 8] & (1 << (bit % 8))); });
+
+        return result;
+    }
+
+    std::string cdr_index_path(const std::string &journal_path)
+    {
+        return journal_path + ".idx";
+    }
+
+    bool write_cdr_index(const std::string &journal_path, const std::vector<CDR_Index_Block> &blocks)
+    {
+        std::string path = cdr_index_path(journal_path);
+        std::string temp_path = path + ".tmp";
+
+        std::FILE *file = std::fopen(temp_path.c_str(), "wb");
+        if (file == nullptr)
+            return false;
+
+        CDR_Index_Header header;
+        std::memset(&header, 0, sizeof(header));
+        std::memcpy(header.magic, CDR_INDEX_MAGIC, sizeof(header.magic));
+        header.version = CDR_INDEX_VERSION;
+        header.bloom_bytes = CDR_INDEX_BLOOM_BYTES;
+        header.block_records = CDR_INDEX_BLOCK_RECORDS;
+        header.blocks = blocks.size();
+
+        bool ok = std::fwrite(&header, sizeof(header), 1, file) == 1;
+        if (ok && !blocks.empty())
+            ok = std::fwrite(blocks.data(), sizeof(CDR_Index_Block), blocks.size(), file) == blocks.size();
+
+        ok = std::fclose(file) == 0 && ok;
+        if (!ok || std::rename(temp_path.c_str(), path.c_str()) != 0)
+        {
+            std::remove(temp_path.c_str());
+            return false;
+        }
+
+        return true;
+    }
+
+    bool read_cdr_index(const std::string &journal_path, std::vector<CDR_Index_Block> &blocks)
+    {
+        std::FILE *file = std::fopen(cdr_index_path(journal_path).c_str(), "rb");
+        if (file == nullptr)
+            return false;
+
+        CDR_Index_Header header;
+        bool ok = std::fread(&header, sizeof(header), 1, file) == 1 &&
+                  std::memcmp(header.magic, CDR_INDEX_MAGIC, sizeof(header.magic)) == 0 &&
+                  header.version == CDR_INDEX_VERSION &&
+                  header.bloom_bytes == CDR_INDEX_BLOOM_BYTES &&
+                  header.blocks < (1ull << 32);
+
+        if (ok)
+        {
+            blocks.resize(header.blocks);
+            ok = header.blocks == 0 || std::fread(blocks.data(), sizeof(CDR_Index_Block), header.blocks, file) == header.blocks;
+        }
+
+        std::fclose(file);
+
+        if (!ok)
+            blocks.clear();
+
+        return ok;
+    }
+}
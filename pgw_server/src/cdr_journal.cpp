@@ -2,141 +2,764 @@
 
 #include "imsi.h"
 
+#include <coarse_clock.h>
+#include <perf_profiler.h>
+#include <probes.h>
+#include <thread_placement.h>
+#include <trace.h>
+
 #include <quill/LogMacros.h>
 
+#include <cerrno>
+#include <cstring>
+#include <cstdio>
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
 namespace PGW
 {
-    CDR_Journal::CDR_Journal(std::string filename, size_t cdr_max_length_lines, quill::Logger *logger) : filename(filename), cdr_max_length_lines(cdr_max_length_lines), logger(logger)
+    static void update_max(std::atomic<int64_t> &max, int64_t value)
     {
+        int64_t current = max.load(std::memory_order_relaxed);
+        while (value > current && !max.compare_exchange_weak(current, value, std::memory_order_relaxed))
+        {
+        }
+    }
+
+    CDR_Journal::CDR_Journal(std::string filename, size_t cdr_max_length_lines, quill::Logger *logger, CDR_Journal_Options options) : filename(filename),
+                                                                                                                                     logger(logger),
+                                                                                                                                     cdr_max_length_lines(cdr_max_length_lines),
+                                                                                                                                     options(options)
+    {
+        if (this->options.streams == 0)
+            this->options.streams = 1;
+
+        size_t stream_queue_size = options.queue_size / this->options.streams;
+        if (stream_queue_size < 64)
+            stream_queue_size = 64;
+
+        for (size_t i = 0; i < this->options.streams; ++i)
+        {
+            rings.push_back(std::make_unique<IO_Utils::MPSC_Ring<CDR_Record>>(stream_queue_size));
+        }
+
+        last_sync = std::chrono::steady_clock::now();
+
+        if (options.background_rotation)
+            prepare_thread = std::thread{&CDR_Journal::prepare_loop, this};
+        if (options.background_rotation || options.post_process != CDR_Post_Process::none)
+            post_process_thread = std::thread{&CDR_Journal::post_process_loop, this};
+
         create_file();
+
+        writer_thread = std::thread{&CDR_Journal::writer_loop, this};
     };
 
+    std::string CDR_Journal::make_file_name()
+    {
+        std::string base, extension;
+        split_cdr_file_name(filename, options.format, base, extension);
+
+        std::time_t timestamp = std::chrono::system_clock::to_time_t(IO_Utils::Coarse_Clock::system_now());
+        char date_time[CDR_Time_Formatter::DATE_TIME_SIZE];
+        time_formatter.format_for_filename(timestamp, date_time);
+
+        base += "_";
+        base.append(date_time, CDR_Time_Formatter::DATE_TIME_SIZE);
+
+        // Несколько ротаций за одну секунду не должны перезаписывать друг друга
+        if (base == last_file_base)
+        {
+            same_second_files++;
+            return base + "_" + std::to_string(same_second_files) + extension;
+        }
+
+        last_file_base = base;
+        same_second_files = 0;
+
+        return base + extension;
+    }
+
+    std::string CDR_Journal::prepared_file_name() const
+    {
+        std::string base, extension;
+        split_cdr_file_name(filename, options.format, base, extension);
+
+        return base + ".next" + extension;
+    }
+
+    int CDR_Journal::open_file(const std::string &path)
+    {
+        int new_fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+
+        if (new_fd < 0)
+        {
+            // Даже если не ведется CDR журнал сессии все равно можно создавать, хранить и удалять, функции выполняются потому INFO
+            // Поставил бы ERROR но в примере с лекции все что выше INFO идет только в связи с потерей сервиса, а он вроде как предоставляется
+            LOG_ERROR(logger, "Can't create CDR Journal with name {}, errno = {}", path, errno);
+            return -1;
+        }
+
+        if (options.preallocate)
+        {
+            // Место под весь файл выделяется сразу, чтобы запись и fdatasync не упирались в выделение блоков.
+            // FALLOC_FL_KEEP_SIZE оставляет размер файла равным объему данных, поэтому читатели не видят хвост из нулей
+            size_t expected_size = cdr_max_length_lines * (options.format == CDR_Format::binary ? sizeof(CDR_Binary_Record) : EXPECTED_CSV_LINE_SIZE);
+            if (expected_size > MAX_PREALLOCATE_SIZE)
+                expected_size = MAX_PREALLOCATE_SIZE;
+            if (fallocate(new_fd, FALLOC_FL_KEEP_SIZE, 0, expected_size) != 0)
+            {
+                LOG_DEBUG(logger, "Can't preallocate CDR Journal {}, errno = {}", path, errno);
+            }
+        }
+
+        if (options.format == CDR_Format::binary)
+        {
+            CDR_File_Header header = make_cdr_file_header();
+            if (::write(new_fd, &header, sizeof(header)) != sizeof(header))
+            {
+                LOG_ERROR(logger, "Can't write header to CDR Journal with name {}, errno = {}", path, errno);
+                close(new_fd);
+                return -1;
+            }
+        }
+
+        return new_fd;
+    }
+
     bool CDR_Journal::create_file()
     {
-        if (file.is_open())
+        if (fd >= 0)
+            retire_file();
+
+        lines_in_file = 0;
+        current_path = make_file_name();
+        fd = open_file(current_path);
+
+        if (fd < 0)
+            return false;
+
+        file_open.store(true);
+        index_builder.reset(options.format == CDR_Format::binary ? sizeof(CDR_File_Header) : 0);
+
+        LOG_DEBUG(logger, "Created CDR Journal with name {}", current_path);
+
+        if (options.background_rotation)
         {
-            file << std::flush;
-            file.close();
+            {
+                std::lock_guard<std::mutex> lock(rotation_mutex);
+                prepare_requested = true;
+            }
+            prepare_cv.notify_one();
         }
 
-        std::string current_filename;
+        return true;
+    }
+
+    bool CDR_Journal::rotate_file()
+    {
+        auto begin = std::chrono::steady_clock::now();
 
-        size_t index = filename.find_last_of(".");
+        int next_fd = -1;
+        if (options.background_rotation)
+        {
+            std::lock_guard<std::mutex> lock(rotation_mutex);
+            next_fd = prepared_fd;
+            prepared_fd = -1;
+        }
 
-        if (index != std::string::npos)
+        std::string next_path;
+        if (next_fd >= 0)
         {
-            current_filename = filename.substr(0, index);
+            // Файл получает имя с временной меткой момента ротации, rename не трогает ни данные, ни открытый дескриптор
+            next_path = make_file_name();
+            if (rename(prepared_file_name().c_str(), next_path.c_str()) != 0)
+            {
+                LOG_ERROR(logger, "Can't rename prepared CDR Journal to {}, errno = {}", next_path, errno);
+                close(next_fd);
+                next_fd = -1;
+            }
+        }
+
+        bool result = true;
+        if (next_fd >= 0)
+        {
+            retire_file();
+
+            fd = next_fd;
+            current_path = next_path;
+            lines_in_file = 0;
+            file_open.store(true);
+            index_builder.reset(options.format == CDR_Format::binary ? sizeof(CDR_File_Header) : 0);
+
+            LOG_DEBUG(logger, "Switched to prepared CDR Journal with name {}", current_path);
+
+            {
+                std::lock_guard<std::mutex> lock(rotation_mutex);
+                prepare_requested = true;
+            }
+            prepare_cv.notify_one();
         }
         else
         {
-            current_filename = filename;
+            // Фоновый поток не успел (или выключен), файл создается здесь же, как раньше
+            inline_rotations.fetch_add(1, std::memory_order_relaxed);
+            result = create_file();
         }
 
-        std::time_t timestamp = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
-        std::tm time_info;
-        localtime_r(&timestamp, &time_info);
+        rotations.fetch_add(1, std::memory_order_relaxed);
+        update_max(max_rotation_ns, std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin).count());
+
+        return result;
+    }
+
+    void CDR_Journal::retire_file()
+    {
+        Retired_File file{fd, current_path, unsynced_records, oldest_unsynced_ns, {}};
+        if (options.index)
+            file.index = index_builder.take_blocks();
 
-        current_filename += "_";
-        current_filename += std::to_string(time_info.tm_year + 1900);
-        current_filename += "-";
-        current_filename += std::to_string(time_info.tm_mon);
-        current_filename += "-";
-        current_filename += std::to_string(time_info.tm_mday);
-        current_filename += "_";
-        current_filename += std::to_string(time_info.tm_hour);
-        current_filename += ":";
-        current_filename += std::to_string(time_info.tm_min);
-        current_filename += ":";
-        current_filename += std::to_string(time_info.tm_sec);
+        fd = -1;
+        unsynced_records = 0;
+        file_open.store(false);
 
-        if (index != std::string::npos)
+        if (post_process_thread.joinable())
         {
-            current_filename += filename.substr(index, filename.size() - index);
+            {
+                std::lock_guard<std::mutex> lock(rotation_mutex);
+                retired_files.push_back(std::move(file));
+            }
+            retired_cv.notify_one();
         }
         else
         {
-            current_filename += ".csv";
+            finish_file(file);
+        }
+    }
+
+    void CDR_Journal::finish_file(const Retired_File &file)
+    {
+        // Закрываемый файл должен оказаться на диске целиком, раз уж этого требует режим
+        if (options.durability != CDR_Durability::none && file.unsynced_records > 0)
+        {
+            if (fdatasync(file.fd) != 0)
+            {
+                LOG_ERROR(logger, "Can't sync CDR Journal {}, errno = {}", file.path, errno);
+            }
+            else
+            {
+                record_sync(file.unsynced_records, file.oldest_unsynced_ns);
+            }
         }
 
-        file.open(current_filename, std::ios::out);
+        close(file.fd);
 
-        if (!file.is_open())
+        if (options.index && !write_cdr_index(file.path, file.index))
         {
-            // Даже если не ведется CDR журнал сессии все равно можно создавать, хранить и удалять, функции выполняются потому INFO
-            // Поставил бы ERROR но в примере с лекции все что выше INFO идет только в связи с потерей сервиса, а он вроде как предоставляется
-            LOG_ERROR(logger, "Can't create CDR Journal with name {}", current_filename);
-            return false;
+            LOG_ERROR(logger, "Can't write index for CDR Journal {}, errno = {}", file.path, errno);
         }
 
-        LOG_DEBUG(logger, "Created CDR Journal with name {}", current_filename);
+        if (options.post_process == CDR_Post_Process::checksum)
+            write_checksum(file.path);
+    }
 
-        return true;
+    void CDR_Journal::write_checksum(const std::string &path)
+    {
+        int file_fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (file_fd < 0)
+        {
+            LOG_ERROR(logger, "Can't open CDR Journal {} for checksum, errno = {}", path, errno);
+            return;
+        }
+
+        char buffer[64 * 1024];
+        uint32_t crc = 0;
+        ssize_t res;
+        while ((res = read(file_fd, buffer, sizeof(buffer))) != 0)
+        {
+            if (res < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+
+                LOG_ERROR(logger, "Can't read CDR Journal {} for checksum, errno = {}", path, errno);
+                close(file_fd);
+                return;
+            }
+
+            crc = cdr_crc32(buffer, res, crc);
+        }
+        close(file_fd);
+
+        std::string checksum_path = path + ".crc32";
+        std::FILE *checksum_file = std::fopen(checksum_path.c_str(), "w");
+        if (checksum_file == nullptr)
+        {
+            LOG_ERROR(logger, "Can't create checksum file {}, errno = {}", checksum_path, errno);
+            return;
+        }
+
+        size_t slash = path.find_last_of('/');
+        std::fprintf(checksum_file, "%08x  %s\n", crc, path.c_str() + (slash == std::string::npos ? 0 : slash + 1));
+        std::fclose(checksum_file);
+
+        LOG_DEBUG(logger, "CDR Journal {} checksum {:08x}", path, crc);
+    }
+
+    void CDR_Journal::prepare_loop()
+    {
+        IO_Utils::Thread_Placement::set_name("pgw-cdr-prepare");
+        std::unique_lock<std::mutex> lock(rotation_mutex);
+        while (true)
+        {
+            prepare_cv.wait(lock, [this]()
+                            { return stop_rotation || (prepare_requested && prepared_fd < 0); });
+
+            if (stop_rotation)
+                break;
+
+            prepare_requested = false;
+            lock.unlock();
+            int next_fd = open_file(prepared_file_name());
+            lock.lock();
+            prepared_fd = next_fd;
+        }
+
+        if (prepared_fd >= 0)
+        {
+            close(prepared_fd);
+            unlink(prepared_file_name().c_str());
+            prepared_fd = -1;
+        }
+    }
+
+    void CDR_Journal::post_process_loop()
+    {
+        IO_Utils::Thread_Placement::set_name("pgw-cdr-post");
+        // Поток работает с низким приоритетом по CPU и диску, чтобы подсчет контрольных сумм не мешал обработке запросов.
+        // В Linux приоритет (nice) задается для потока, а не для процесса
+        pid_t tid = (pid_t)syscall(SYS_gettid);
+        if (setpriority(PRIO_PROCESS, tid, 19) != 0)
+        {
+            LOG_DEBUG(logger, "Can't lower CDR post processing thread priority, errno = {}", errno);
+        }
+        constexpr int ioprio_who_process = 1;
+        constexpr int ioprio_class_idle = 3;
+        constexpr int ioprio_class_shift = 13;
+        if (syscall(SYS_ioprio_set, ioprio_who_process, tid, ioprio_class_idle << ioprio_class_shift) != 0)
+        {
+            LOG_DEBUG(logger, "Can't lower CDR post processing thread IO priority, errno = {}", errno);
+        }
+
+        std::unique_lock<std::mutex> lock(rotation_mutex);
+        while (true)
+        {
+            retired_cv.wait(lock, [this]()
+                            { return stop_rotation || !retired_files.empty(); });
+
+            // Перед остановкой обрабатываются все уже закрытые файлы
+            if (retired_files.empty())
+                break;
+
+            Retired_File file = std::move(retired_files.front());
+            retired_files.pop_front();
+            lock.unlock();
+            finish_file(file);
+            lock.lock();
+        }
+    }
+
+    void CDR_Journal::write(IMSI imsi, CDR_Action action)
+    {
+        CDR_Record record;
+        record.first_seen_ns = 0;
+        record.last_seen_ns = 0;
+        record.update_count = 0;
+
+        push(imsi, action, record);
+    }
+
+    void CDR_Journal::write_summary(IMSI imsi, CDR_Action action, std::chrono::system_clock::time_point first_seen,
+                                    std::chrono::system_clock::time_point last_seen, uint32_t update_count)
+    {
+        CDR_Record record;
+        record.first_seen_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(first_seen.time_since_epoch()).count();
+        record.last_seen_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(last_seen.time_since_epoch()).count();
+        record.update_count = update_count;
+
+        push(imsi, action, record);
     }
 
-    void CDR_Journal::write(IMSI imsi, std::string action)
+    void CDR_Journal::push(const IMSI &imsi, CDR_Action action, CDR_Record &record)
     {
-        std::lock_guard<std::mutex> lock(m);
+        IO_Utils::Tracer::Span trace_span{"CDR_Journal::push"};
 
-        if (ctr >= cdr_max_length_lines || !file.is_open())
+        record.timestamp_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                  IO_Utils::Coarse_Clock::system_now().time_since_epoch())
+                                  .count();
+
+        std::string imsi_str = imsi.get_IMSI_to_str();
+        record.imsi_length = imsi_str.size() < sizeof(record.imsi) ? imsi_str.size() : sizeof(record.imsi);
+        std::memcpy(record.imsi, imsi_str.data(), record.imsi_length);
+        record.action = action;
+        record.sequence = next_sequence.fetch_add(1, std::memory_order_relaxed);
+        IO_UTILS_PROBE(cdr_write, imsi_str.c_str(), static_cast<int>(action), record.sequence);
+
+        // Очередь по шарду хранилища: записи шарда пишет его владелец (конвейер или ядро), и очередь не делится с другими
+        auto &ring = *rings[rings.size() == 1 ? 0 : imsi.shard_key() % rings.size()];
+
+        if (ring.try_push(record))
+            return;
+
+        if (options.overflow_policy == CDR_Overflow_Policy::drop)
         {
-            ctr = 0;
+            // Сообщение о потерях пишет поток записи, чтобы не засорять лог на каждую запись
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            IO_UTILS_PROBE(cdr_dropped, imsi_str.c_str(), static_cast<int>(action), record.sequence);
+            return;
+        }
 
-            if (!create_file())
+        blocked.fetch_add(1, std::memory_order_relaxed);
+        while (!ring.try_push(record))
+        {
+            std::this_thread::yield();
+        }
+    }
+
+    size_t CDR_Journal::format_record(const CDR_Record &record, char *line)
+    {
+        if (options.format == CDR_Format::binary)
+        {
+            CDR_Binary_Record binary;
+            encode_binary_record(record, binary);
+            std::memcpy(line, &binary, sizeof(binary));
+
+            return sizeof(binary);
+        }
+
+        return format_csv_line(record, time_formatter, line, rings.size() > 1, options.mode == CDR_Mode::aggregated);
+    }
+
+    size_t CDR_Journal::write_lines(size_t count)
+    {
+        iovec iov[BATCH_SIZE];
+
+        size_t i = 0;
+        while (i < count)
+        {
+            if (lines_in_file >= cdr_max_length_lines || fd < 0)
             {
-                return;
+                if (!(fd >= 0 ? rotate_file() : create_file()))
+                {
+                    // Без файла записи теряются, ошибку уже записал create_file
+                    return i;
+                }
+            }
+
+            // Пачка не должна выходить за границу текущего файла
+            size_t chunk = count - i;
+            if (chunk > cdr_max_length_lines - lines_in_file)
+                chunk = cdr_max_length_lines - lines_in_file;
+
+            size_t total = 0;
+            for (size_t j = 0; j < chunk; ++j)
+            {
+                iov[j].iov_base = lines[i + j];
+                iov[j].iov_len = line_lengths[i + j];
+                total += line_lengths[i + j];
+            }
+
+            iovec *current = iov;
+            size_t iov_count = chunk;
+            bool failed = false;
+            while (total > 0)
+            {
+                ssize_t res = writev(fd, current, iov_count);
+                if (res < 0)
+                {
+                    if (errno == EINTR)
+                        continue;
+
+                    LOG_ERROR(logger, "Can't write to CDR Journal, errno = {}", errno);
+                    failed = true;
+                    break;
+                }
+
+                // Частичная запись, пропускаем уже записанные строки
+                total -= res;
+                while (iov_count > 0 && (size_t)res >= current->iov_len)
+                {
+                    res -= current->iov_len;
+                    current++;
+                    iov_count--;
+                }
+                if (iov_count > 0)
+                {
+                    current->iov_base = (char *)current->iov_base + res;
+                    current->iov_len -= res;
+                }
+            }
+
+            // Учитываются только строки, записанные целиком: в iov остались недописанные
+            size_t done = chunk - iov_count;
+            if (done > 0 && unsynced_records == 0)
+                oldest_unsynced_ns = batch_records[i].timestamp_ns;
+            unsynced_records += done;
+
+            if (options.index)
+            {
+                for (size_t j = 0; j < done; ++j)
+                {
+                    index_builder.add(batch_records[i + j], line_lengths[i + j]);
+                }
+            }
+
+            lines_in_file += done;
+            i += done;
+
+            if (failed)
+            {
+                // Недописанная строка сдвинула бы смещения индекса для следующих, поэтому файл закрывается
+                // и следующая пачка начнет новый
+                lines_in_file = cdr_max_length_lines;
+                return i;
             }
         }
 
-        std::time_t timestamp = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
-        std::tm time_info;
-        localtime_r(&timestamp, &time_info);
+        return i;
+    }
 
-        std::string str = "\"";
+    void CDR_Journal::sync_file()
+    {
+        if (fd < 0 || unsynced_records == 0)
+            return;
 
-        str += std::to_string(time_info.tm_year + 1900);
-        str += "-";
-        str += std::to_string(time_info.tm_mon);
-        str += "-";
-        str += std::to_string(time_info.tm_mday);
-        str += " ";
-        str += std::to_string(time_info.tm_hour);
-        str += ":";
-        str += std::to_string(time_info.tm_min);
-        str += ":";
-        str += std::to_string(time_info.tm_sec);
+        if (fdatasync(fd) != 0)
+        {
+            LOG_ERROR(logger, "Can't sync CDR Journal, errno = {}", errno);
+            return;
+        }
 
-        str += "\",\"";
+        record_sync(unsynced_records, oldest_unsynced_ns);
+        unsynced_records = 0;
+        last_sync = std::chrono::steady_clock::now();
+    }
 
-        str += imsi.get_IMSI_to_str();
+    void CDR_Journal::record_sync(size_t records, int64_t oldest_unsynced_ns)
+    {
+        int64_t now_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                             std::chrono::system_clock::now().time_since_epoch())
+                             .count();
+        update_max(max_loss_window_ns, now_ns - oldest_unsynced_ns);
 
-        str += "\",\"";
+        durable.fetch_add(records, std::memory_order_release);
+        sync_calls.fetch_add(1, std::memory_order_relaxed);
+    }
 
-        str += action;
+    void CDR_Journal::maybe_sync()
+    {
+        if (unsynced_records == 0)
+            return;
 
-        str += "\"\r\n";
+        switch (options.durability)
+        {
+        case CDR_Durability::none:
+            break;
+        case CDR_Durability::periodic:
+            if (std::chrono::steady_clock::now() - last_sync >= options.sync_interval)
+                sync_file();
+            break;
+        case CDR_Durability::group_commit:
+        {
+            // Группа закрывается, когда набралось достаточно записей или самая старая из них
+            // прождала половину допустимой задержки: вторая половина остается на сон потока (не больше четверти),
+            // отставание грубых часов, которыми помечены записи, и сам fdatasync
+            int64_t now_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                 std::chrono::system_clock::now().time_since_epoch())
+                                 .count();
+            std::chrono::nanoseconds age{now_ns - oldest_unsynced_ns};
 
-        file << str;
+            if (unsynced_records >= GROUP_COMMIT_RECORDS || age >= options.max_commit_latency / 2)
+                sync_file();
+            break;
+        }
+        }
+    }
 
-        if (ctr % 50 == 0 && ctr != 0)
+    std::chrono::milliseconds CDR_Journal::idle_interval() const
+    {
+        if (options.durability == CDR_Durability::group_commit && unsynced_records > 0)
         {
-            file << std::flush;
+            std::chrono::milliseconds quarter_latency = options.max_commit_latency / 4;
+            if (quarter_latency < std::chrono::milliseconds(1))
+                quarter_latency = std::chrono::milliseconds(1);
+
+            return quarter_latency < options.flush_interval ? quarter_latency : options.flush_interval;
         }
 
-        ctr++;
+        return options.flush_interval;
+    }
+
+    size_t CDR_Journal::drain()
+    {
+        size_t total = 0;
+
+        while (true)
+        {
+            size_t count = 0;
+            for (size_t i = 0; i < rings.size() && count < BATCH_SIZE; ++i)
+            {
+                auto &ring = *rings[(next_ring + i) % rings.size()];
+                while (count < BATCH_SIZE && ring.try_pop(batch_records[count]))
+                {
+                    line_lengths[count] = format_record(batch_records[count], lines[count]);
+                    count++;
+                }
+            }
+            next_ring = (next_ring + 1) % rings.size();
+
+            if (count == 0)
+                break;
+
+            size_t stored = write_lines(count);
+
+            total += count;
+            lost.fetch_add(count - stored, std::memory_order_relaxed);
+            written.fetch_add(stored, std::memory_order_release);
+
+            // При постоянном потоке записей очередь может не опустеть долго, синхронизация не должна этого ждать
+            maybe_sync();
+        }
+
+        return total;
+    }
+
+    void CDR_Journal::writer_loop()
+    {
+        IO_Utils::Thread_Placement::set_name("pgw-cdr-writer");
+        IO_Utils::Perf_Profiler::Thread_Registration profiler_registration{"cdr_writer"};
+        size_t reported_drops = 0;
+
+        while (true)
+        {
+            // Признак остановки читается до опустошения очереди, чтобы не потерять записи, поставленные перед остановкой
+            bool stopping = stop_writer.load();
+
+            size_t processed = drain();
+            maybe_sync();
+
+            size_t current_drops = dropped.load(std::memory_order_relaxed);
+            if (current_drops != reported_drops)
+            {
+                LOG_WARNING(logger, "CDR Journal queue is FULL, {} records dropped", current_drops - reported_drops);
+                reported_drops = current_drops;
+            }
+
+            if (stopping && processed == 0)
+                break;
+
+            if (processed == 0)
+                std::this_thread::sleep_for(idle_interval());
+        }
+    }
+
+    void CDR_Journal::flush()
+    {
+        size_t target = 0;
+        for (const auto &ring : rings)
+        {
+            target += ring->pushed();
+        }
+
+        // Потерянные записи тоже обработаны, иначе flush ждал бы их вечно
+        while (written.load(std::memory_order_acquire) + lost.load(std::memory_order_relaxed) < target)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
     }
 
     bool CDR_Journal::is_open()
     {
-        std::lock_guard<std::mutex> lock(m);
+        return file_open.load();
+    }
+
+    size_t CDR_Journal::dropped_records() const
+    {
+        return dropped.load(std::memory_order_relaxed);
+    }
+
+    size_t CDR_Journal::lost_records() const
+    {
+        return lost.load(std::memory_order_relaxed);
+    }
+
+    size_t CDR_Journal::written_records() const
+    {
+        return written.load(std::memory_order_acquire);
+    }
+
+    size_t CDR_Journal::blocked_writes() const
+    {
+        return blocked.load(std::memory_order_relaxed);
+    }
+
+    size_t CDR_Journal::durable_records() const
+    {
+        return durable.load(std::memory_order_acquire);
+    }
+
+    size_t CDR_Journal::sync_count() const
+    {
+        return sync_calls.load(std::memory_order_relaxed);
+    }
 
-        return file.is_open();
+    std::chrono::nanoseconds CDR_Journal::max_loss_window() const
+    {
+        return std::chrono::nanoseconds{max_loss_window_ns.load(std::memory_order_relaxed)};
+    }
+
+    CDR_Mode CDR_Journal::get_mode() const
+    {
+        return options.mode;
+    }
+
+    size_t CDR_Journal::rotation_count() const
+    {
+        return rotations.load(std::memory_order_relaxed);
+    }
+
+    size_t CDR_Journal::inline_rotation_count() const
+    {
+        return inline_rotations.load(std::memory_order_relaxed);
+    }
+
+    std::chrono::nanoseconds CDR_Journal::max_rotation_time() const
+    {
+        return std::chrono::nanoseconds{max_rotation_ns.load(std::memory_order_relaxed)};
     }
 
     CDR_Journal::~CDR_Journal()
     {
-        if (file.is_open())
+        stop_writer.store(true);
+        writer_thread.join();
+
+        // Последний файл проходит тот же путь, что и закрытые при ротации: синхронизация, закрытие, обработка
+        if (fd >= 0)
+            retire_file();
+
         {
-            file << std::flush;
+            std::lock_guard<std::mutex> lock(rotation_mutex);
+            stop_rotation = true;
         }
+        prepare_cv.notify_one();
+        retired_cv.notify_one();
+
+        if (prepare_thread.joinable())
+            prepare_thread.join();
+        if (post_process_thread.joinable())
+            post_process_thread.join();
     }
 }
\ No newline at end of file
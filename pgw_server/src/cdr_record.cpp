@@ -0,0 +1,443 @@
+#include "cdr_record.h"
+
+#include <array>
+#include <charconv>
+#include <cstring>
+#include <ctime>
+
+namespace PGW
+{
+    const char *cdr_action_to_str(CDR_Action action)
+    {
+        switch (action)
+        {
+        case CDR_Action::created:
+            return "created";
+        case CDR_Action::updated:
+            return "updated";
+        case CDR_Action::rejected_blacklisted:
+            return "rejected, IMSI blacklisted";
+        case CDR_Action::rejected_error:
+            return "rejected, error while session creating";
+        case CDR_Action::delete_on_timeout:
+            return "delete_session_on_timeout";
+        case CDR_Action::delete_on_offload:
+            return "delete_session_on_offload";
+        case CDR_Action::delete_manually:
+            return "delete_session_manually";
+        }
+
+        return "unknown";
+    }
+
+    bool cdr_action_from_str(const char *str, size_t length, CDR_Action &action)
+    {
+        for (size_t i = 0; i < CDR_ACTIONS_COUNT; ++i)
+        {
+            const char *name = cdr_action_to_str((CDR_Action)i);
+            if (std::strlen(name) == length && std::memcmp(name, str, length) == 0)
+            {
+                action = (CDR_Action)i;
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    size_t format_csv_line(const CDR_Record &record, CDR_Time_Formatter &formatter, char *line, bool with_sequence, bool with_summary)
+    {
+        std::time_t timestamp = record.timestamp_ns / 1'000'000'000;
+        const char *action = cdr_action_to_str(record.action);
+        size_t action_length = std::strlen(action);
+
+        // "YYYY-MM-DD HH:MM:SS","IMSI","Action"\r\n, длина строки ограничена сверху размерами полей
+        constexpr size_t max_action_length = 48;
+        constexpr size_t max_sequence_length = 20;
+        constexpr size_t max_count_length = 10;
+        static_assert(1 + CDR_Time_Formatter::DATE_TIME_SIZE + 3 + sizeof(CDR_Record::imsi) + 3 + max_action_length +
+                          3 + CDR_Time_Formatter::DATE_TIME_SIZE + 3 + CDR_Time_Formatter::DATE_TIME_SIZE + 3 + max_count_length +
+                          3 + max_sequence_length + 3 <=
+                      CDR_CSV_LINE_SIZE);
+        if (action_length > max_action_length)
+            action_length = max_action_length;
+
+        char *out = line;
+        *out++ = '"';
+        std::memcpy(out, formatter.format(timestamp), CDR_Time_Formatter::DATE_TIME_SIZE);
+        out += CDR_Time_Formatter::DATE_TIME_SIZE;
+        std::memcpy(out, "\",\"", 3);
+        out += 3;
+        std::memcpy(out, record.imsi, record.imsi_length);
+        out += record.imsi_length;
+        std::memcpy(out, "\",\"", 3);
+        out += 3;
+        std::memcpy(out, action, action_length);
+        out += action_length;
+        if (with_summary)
+        {
+            // Начало и конец сессии форматируются в своих кешах, чтобы не сбивать кеш времени записи
+            int64_t seen_ns[2] = {record.first_seen_ns, record.last_seen_ns};
+            for (size_t i = 0; i < 2; ++i)
+            {
+                std::memcpy(out, "\",\"", 3);
+                out += 3;
+                if (seen_ns[i] != 0)
+                {
+                    std::memcpy(out, formatter.format(seen_ns[i] / 1'000'000'000, 1 + i), CDR_Time_Formatter::DATE_TIME_SIZE);
+                    out += CDR_Time_Formatter::DATE_TIME_SIZE;
+                }
+            }
+            std::memcpy(out, "\",\"", 3);
+            out += 3;
+            out = std::to_chars(out, out + max_count_length, record.update_count).ptr;
+        }
+        if (with_sequence)
+        {
+            std::memcpy(out, "\",\"", 3);
+            out += 3;
+            out = std::to_chars(out, out + max_sequence_length, record.sequence).ptr;
+        }
+        std::memcpy(out, "\"\r\n", 3);
+        out += 3;
+
+        return out - line;
+    }
+
+    void split_cdr_file_name(const std::string &filename, CDR_Format format, std::string &base, std::string &extension)
+    {
+        size_t index = filename.find_last_of(".");
+
+        if (index != std::string::npos)
+        {
+            base = filename.substr(0, index);
+        }
+        else
+        {
+            base = filename;
+        }
+
+        if (format == CDR_Format::binary)
+        {
+            // Двоичный журнал не должен выглядеть как CSV, расширение из конфигурации заменяется
+            extension = ".cdr";
+        }
+        else if (index != std::string::npos)
+        {
+            extension = filename.substr(index, filename.size() - index);
+        }
+        else
+        {
+            extension = ".csv";
+        }
+    }
+
+    // Число из ровно length цифр
+    static bool parse_digits(const char *str, size_t length, int &value)
+    {
+        auto [ptr, ec] = std::from_chars(str, str + length, value);
+        return ec == std::errc{} && ptr == str + length;
+    }
+
+    bool parse_cdr_date_time(const char *str, size_t length, int64_t &seconds)
+    {
+        if (length != CDR_Time_Formatter::DATE_TIME_SIZE || str[4] != '-' || str[7] != '-' || str[10] != ' ' ||
+            str[13] != ':' || str[16] != ':')
+            return false;
+
+        std::tm tm{};
+        if (!parse_digits(str, 4, tm.tm_year) || !parse_digits(str + 5, 2, tm.tm_mon) || !parse_digits(str + 8, 2, tm.tm_mday) ||
+            !parse_digits(str + 11, 2, tm.tm_hour) || !parse_digits(str + 14, 2, tm.tm_min) || !parse_digits(str + 17, 2, tm.tm_sec))
+            return false;
+
+        tm.tm_year -= 1900;
+        tm.tm_mon -= 1;
+        // Переход на летнее время определяет mktime
+        tm.tm_isdst = -1;
+
+        std::time_t result = std::mktime(&tm);
+        if (result == (std::time_t)-1)
+            return false;
+
+        seconds = result;
+        return true;
+    }
+
+    bool parse_csv_line(const char *line, size_t length, CDR_Record &record)
+    {
+        while (length > 0 && (line[length - 1] == '\n' || line[length - 1] == '\r'))
+            length--;
+
+        if (length < 2 || line[0] != '"' || line[length - 1] != '"')
+            return false;
+
+        // Поля разделяются последовательностью ",", запятая с пробелом внутри действия ее не образует
+        constexpr size_t max_fields = 7;
+        const char *fields[max_fields];
+        size_t lengths[max_fields];
+        size_t count = 0;
+
+        const char *begin = line + 1;
+        const char *end = line + length - 1;
+        while (true)
+        {
+            if (count == max_fields)
+                return false;
+
+            const char *separator = begin;
+            while (separator + 2 < end && std::memcmp(separator, "\",\"", 3) != 0)
+                separator++;
+            if (separator + 2 >= end)
+                separator = end;
+
+            fields[count] = begin;
+            lengths[count] = separator - begin;
+            count++;
+
+            if (separator == end)
+                break;
+            begin = separator + 3;
+        }
+
+        if (count != 3 && count != 4 && count != 6 && count != 7)
+            return false;
+
+        int64_t seconds;
+        if (!parse_cdr_date_time(fields[0], lengths[0], seconds))
+            return false;
+        record.timestamp_ns = seconds * 1'000'000'000;
+
+        if (lengths[1] == 0 || lengths[1] > sizeof(record.imsi))
+            return false;
+        for (size_t i = 0; i < lengths[1]; ++i)
+        {
+            if (fields[1][i] < '0' || fields[1][i] > '9')
+                return false;
+        }
+        std::memcpy(record.imsi, fields[1], lengths[1]);
+        record.imsi_length = lengths[1];
+
+        if (!cdr_action_from_str(fields[2], lengths[2], record.action))
+            return false;
+
+        record.first_seen_ns = 0;
+        record.last_seen_ns = 0;
+        record.update_count = 0;
+        record.sequence = 0;
+
+        if (count >= 6)
+        {
+            int64_t *seen[2] = {&record.first_seen_ns, &record.last_seen_ns};
+            for (size_t i = 0; i < 2; ++i)
+            {
+                if (lengths[3 + i] == 0)
+                    continue;
+                if (!parse_cdr_date_time(fields[3 + i], lengths[3 + i], seconds))
+                    return false;
+                *seen[i] = seconds * 1'000'000'000;
+            }
+
+            auto [ptr, ec] = std::from_chars(fields[5], fields[5] + lengths[5], record.update_count);
+            if (ec != std::errc{} || ptr != fields[5] + lengths[5])
+                return false;
+        }
+
+        if (count == 4 || count == 7)
+        {
+            auto [ptr, ec] = std::from_chars(fields[count - 1], fields[count - 1] + lengths[count - 1], record.sequence);
+            if (ec != std::errc{} || ptr != fields[count - 1] + lengths[count - 1])
+                return false;
+        }
+
+        return true;
+    }
+
+    CDR_File_Header make_cdr_file_header()
+    {
+        CDR_File_Header header;
+        std::memset(&header, 0, sizeof(header));
+
+        std::memcpy(header.magic, CDR_BINARY_MAGIC, sizeof(header.magic));
+        header.version = CDR_BINARY_VERSION;
+        header.header_size = sizeof(CDR_File_Header);
+        header.record_size = sizeof(CDR_Binary_Record);
+        std::memcpy(header.schema, CDR_BINARY_SCHEMA, sizeof(CDR_BINARY_SCHEMA));
+
+        return header;
+    }
+
+    bool check_cdr_file_header(const CDR_File_Header &header)
+    {
+        if (std::memcmp(header.magic, CDR_BINARY_MAGIC, sizeof(header.magic)) != 0)
+            return false;
+
+        if (header.header_size != sizeof(CDR_File_Header))
+            return false;
+
+        return (header.version == CDR_BINARY_VERSION && header.record_size == sizeof(CDR_Binary_Record)) ||
+               (header.version == 2 && header.record_size == sizeof(CDR_Binary_Record_V2)) ||
+               (header.version == 1 && header.record_size == sizeof(CDR_Binary_Record_V1));
+    }
+
+    void encode_binary_record(const CDR_Record &record, CDR_Binary_Record &binary)
+    {
+        std::memset(&binary, 0, sizeof(binary));
+        std::memset(binary.imsi_bcd, 0xFF, sizeof(binary.imsi_bcd));
+
+        binary.timestamp_ns = record.timestamp_ns;
+        binary.sequence = record.sequence;
+        binary.first_seen_ns = record.first_seen_ns;
+        binary.last_seen_ns = record.last_seen_ns;
+        binary.update_count = record.update_count;
+        binary.imsi_length = record.imsi_length;
+        binary.action = (uint8_t)record.action;
+
+        for (size_t i = 0; i < record.imsi_length && i < sizeof(record.imsi); ++i)
+        {
+            uint8_t digit = record.imsi[i] - '0';
+            uint8_t &byte = binary.imsi_bcd[i / 2];
+
+            if (i % 2 == 0)
+                byte = (byte & 0xF0) | digit;
+            else
+                byte = (byte & 0x0F) | (digit << 4);
+        }
+    }
+
+    // Общая часть разбора записей обеих версий
+    template <typename Binary>
+    static bool decode_common(const Binary &binary, CDR_Record &record)
+    {
+        if (binary.imsi_length > sizeof(record.imsi) || binary.action >= CDR_ACTIONS_COUNT)
+            return false;
+
+        record.timestamp_ns = binary.timestamp_ns;
+        record.imsi_length = binary.imsi_length;
+        record.action = (CDR_Action)binary.action;
+
+        for (size_t i = 0; i < binary.imsi_length; ++i)
+        {
+            uint8_t digit = (binary.imsi_bcd[i / 2] >> ((i % 2) * 4)) & 0xF;
+            if (digit > 9)
+                return false;
+
+            record.imsi[i] = '0' + digit;
+        }
+
+        return true;
+    }
+
+    bool decode_binary_record(const CDR_Binary_Record &binary, CDR_Record &record)
+    {
+        record.sequence = binary.sequence;
+        record.first_seen_ns = binary.first_seen_ns;
+        record.last_seen_ns = binary.last_seen_ns;
+        record.update_count = binary.update_count;
+        return decode_common(binary, record);
+    }
+
+    bool decode_binary_record(const CDR_Binary_Record_V2 &binary, CDR_Record &record)
+    {
+        record.sequence = binary.sequence;
+        record.first_seen_ns = 0;
+        record.last_seen_ns = 0;
+        record.update_count = 0;
+        return decode_common(binary, record);
+    }
+
+    bool decode_binary_record(const CDR_Binary_Record_V1 &binary, CDR_Record &record)
+    {
+        record.sequence = 0;
+        record.first_seen_ns = 0;
+        record.last_seen_ns = 0;
+        record.update_count = 0;
+        return decode_common(binary, record);
+    }
+
+    uint32_t cdr_crc32(const void *data, size_t length, uint32_t crc)
+    {
+        static const auto table = []()
+        {
+            std::array<uint32_t, 256> result{};
+            for (uint32_t i = 0; i < 256; ++i)
+            {
+                uint32_t value = i;
+                for (int bit = 0; bit < 8; ++bit)
+                {
+                    value = (value & 1) ? (value >> 1) ^ 0xEDB88320u : value >> 1;
+                }
+                result[i] = value;
+            }
+            return result;
+        }();
+
+        const uint8_t *bytes = (const uint8_t *)data;
+        crc = ~crc;
+        for (size_t i = 0; i < length; ++i)
+        {
+            crc = table[(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+        }
+
+        return ~crc;
+    }
+
+    // Читает записи версии, которой соответствует Binary, пропуская поврежденные
+    template <typename Binary>
+    static bool read_next(std::FILE *file, CDR_Record &record, size_t &skipped)
+    {
+        Binary binary;
+        while (std::fread(&binary, sizeof(binary), 1, file) == 1)
+        {
+            if (decode_binary_record(binary, record))
+                return true;
+
+            skipped++;
+        }
+
+        return false;
+    }
+
+    CDR_Binary_Reader::CDR_Binary_Reader(const std::string &path)
+    {
+        file = std::fopen(path.c_str(), "rb");
+        if (file == nullptr)
+            return;
+
+        CDR_File_Header header;
+        header_valid = std::fread(&header, sizeof(header), 1, file) == 1 && check_cdr_file_header(header);
+        if (header_valid)
+            version = header.version;
+    }
+
+    CDR_Binary_Reader::~CDR_Binary_Reader()
+    {
+        if (file != nullptr)
+            std::fclose(file);
+    }
+
+    bool CDR_Binary_Reader::is_valid() const
+    {
+        return file != nullptr && header_valid;
+    }
+
+    bool CDR_Binary_Reader::next(CDR_Record &record)
+    {
+        if (!is_valid())
+            return false;
+
+        switch (version)
+        {
+        case 1:
+            return read_next<CDR_Binary_Record_V1>(file, record, skipped);
+        case 2:
+            return read_next<CDR_Binary_Record_V2>(file, record, skipped);
+        default:
+            return read_next<CDR_Binary_Record>(file, record, skipped);
+        }
+    }
+
+    size_t CDR_Binary_Reader::skipped_records() const
+    {
+        return skipped;
+    }
+}
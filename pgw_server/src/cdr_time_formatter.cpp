@@ -0,0 +1,56 @@
+#include "cdr_time_formatter.h"
+
+#include <cstring>
+
+namespace PGW
+{
+    static void write_digits(char *out, int value, size_t width)
+    {
+        for (size_t i = width; i > 0; --i)
+        {
+            out[i - 1] = '0' + value % 10;
+            value /= 10;
+        }
+    }
+
+    CDR_Time_Formatter::CDR_Time_Formatter()
+    {
+        for (Slot &slot : slots)
+        {
+            std::memcpy(slot.date_time, "0000-00-00 00:00:00", DATE_TIME_SIZE + 1);
+        }
+    }
+
+    void CDR_Time_Formatter::update(Slot &slot, std::time_t timestamp)
+    {
+        std::tm time_info;
+        localtime_r(&timestamp, &time_info);
+
+        // Разделители уже на своих местах, переписываются только цифры
+        char *date_time = slot.date_time;
+        write_digits(date_time, time_info.tm_year + 1900, 4);
+        // tm_mon считается с нуля
+        write_digits(date_time + 5, time_info.tm_mon + 1, 2);
+        write_digits(date_time + 8, time_info.tm_mday, 2);
+        write_digits(date_time + 11, time_info.tm_hour, 2);
+        write_digits(date_time + 14, time_info.tm_min, 2);
+        write_digits(date_time + 17, time_info.tm_sec, 2);
+
+        slot.cached_timestamp = timestamp;
+    }
+
+    const char *CDR_Time_Formatter::format(std::time_t timestamp, size_t slot)
+    {
+        Slot &cached = slots[slot];
+        if (timestamp != cached.cached_timestamp)
+            update(cached, timestamp);
+
+        return cached.date_time;
+    }
+
+    void CDR_Time_Formatter::format_for_filename(std::time_t timestamp, char *out)
+    {
+        std::memcpy(out, format(timestamp), DATE_TIME_SIZE);
+        out[10] = '_';
+    }
+}
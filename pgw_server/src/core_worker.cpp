@@ -0,0 +1,357 @@
+#include "core_worker.h"
+
+#include <latency.h>
+#include <metrics.h>
+#include <perf_profiler.h>
+
+#include <quill/LogMacros.h>
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <stdexcept>
+
+namespace PGW
+{
+    using IO_Utils::Metrics;
+
+    static const Metrics::Id udp_received = Metrics::counter("pgw_packets_received_total", "UDP packets and complete HTTP requests received", "protocol=\"udp\"");
+    static const Metrics::Id udp_sent = Metrics::counter("pgw_packets_sent_total", "UDP packets and HTTP responses sent completely", "protocol=\"udp\"");
+    static const Metrics::Id udp_errors = Metrics::counter("pgw_socket_errors_total", "Failed socket receive and send calls", "protocol=\"udp\"");
+    static const Metrics::Id udp_kernel_drops = Metrics::counter("pgw_udp_kernel_drops_total", "UDP datagrams dropped by the kernel: receive buffer overflow or rejected by the socket filter");
+
+    // Раз в столько ядро удаляет устаревшие сессии своих шардов, как поток очистки хранилища
+    static constexpr std::chrono::milliseconds EXPIRE_INTERVAL{250};
+
+    Core_Worker::Core_Worker(
+        std::string udp_ip, uint16_t udp_port,
+        size_t core, size_t cores,
+        std::unordered_set<IMSI> blacklist,
+        std::shared_ptr<Session_Storage> storage,
+        quill::Logger *logger) : core(core), cores(cores),
+                                 storage(storage),
+                                 logger(logger),
+                                 udp_handler(std::move(blacklist), storage, logger),
+                                 udp_server_fd(-1),
+                                 wakeup_fd(-1)
+    {
+        if (registrar.get_epoll_fd() < 0)
+        {
+            LOG_ERROR(logger, "Registrar failure epoll_fd = {}", registrar.get_epoll_fd());
+            throw std::runtime_error("Can't create registrar correctly");
+        }
+
+        uint32_t _udp_ip;
+        int res = IO_Utils::Socket::make_ip_address(udp_ip, _udp_ip);
+        if (res == -1)
+        {
+            LOG_ERROR(logger, "UDP ip wrong");
+            throw std::invalid_argument("Wrong udp ip");
+        }
+
+        udp_server = std::make_shared<IO_Utils::UDP_Socket>(_udp_ip, udp_port, cores > 1);
+
+        errno = 0;
+        udp_server_fd = udp_server->listen_or_bind();
+        if (udp_server_fd <= 0)
+        {
+            LOG_ERROR(logger, "Failure while binding udp server fd of core {}, fd = {}, errno = {}", core, udp_server_fd, errno);
+            throw std::runtime_error("Bind udp server failure");
+        }
+
+        udp_server_connection = std::make_unique<IO_Utils::UDP_Connection>(udp_server_fd);
+
+        wakeup_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (wakeup_fd < 0)
+        {
+            LOG_ERROR(logger, "Can't create eventfd of core {}, errno = {}", core, errno);
+            throw std::runtime_error("Can't create eventfd");
+        }
+
+        errno = 0;
+        if (registrar.register_socket(udp_server_fd, EPOLLIN) < 0 || registrar.register_socket(wakeup_fd, EPOLLIN) < 0)
+        {
+            LOG_ERROR(logger, "Core {} register wrong, epoll_fd = {}, errno = {}", core, registrar.get_epoll_fd(), errno);
+            throw std::runtime_error("Can't register core sockets");
+        }
+    }
+
+    int Core_Worker::set_udp_receive_buffer(int bytes)
+    {
+        return IO_Utils::Socket::set_receive_buffer(udp_server_fd, bytes);
+    }
+
+    int Core_Worker::set_udp_socket_filter(const std::vector<sock_filter> &program)
+    {
+        return IO_Utils::Socket::attach_filter(udp_server_fd, program);
+    }
+
+    int Core_Worker::set_udp_steering_filter(const std::vector<sock_filter> &program)
+    {
+        return IO_Utils::Socket::attach_reuseport_filter(udp_server_fd, program);
+    }
+
+    bool Core_Worker::post_lookup(std::unique_ptr<Session_Lookup> &lookup)
+    {
+        if (!lookups.try_push(lookup.get()))
+            return false;
+        lookup.release();
+
+        // Счетчик eventfd только растет до чтения ядром, ошибка EAGAIN при переполнении не страшна
+        uint64_t one = 1;
+        if (write(wakeup_fd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+            LOG_WARNING(logger, "Can't wake up core {}, errno = {}", core, errno);
+
+        return true;
+    }
+
+    void Core_Worker::serve_udp()
+    {
+        std::unique_ptr<IO_Utils::Packet> packet = std::make_unique<IO_Utils::UDP_Packet>(nullptr);
+
+        for (size_t i = 0; i < MAX_BATCH; ++i)
+        {
+            int res = udp_server_connection->recv_packet(*packet);
+            if (udp_server_connection->kernel_drops != udp_kernel_drops_seen)
+            {
+                Metrics::add(udp_kernel_drops, (uint32_t)(udp_server_connection->kernel_drops - udp_kernel_drops_seen));
+                udp_kernel_drops_seen = udp_server_connection->kernel_drops;
+            }
+
+            // Пустая датаграмма принимается без ошибки, но остается без ответа, как в IO_Worker
+            if (res == 0 && packet->data.empty())
+                continue;
+            if (res < 0)
+            {
+                // Сокет вычитан
+                if (errno != EAGAIN && errno != EWOULDBLOCK)
+                {
+                    Metrics::add(udp_errors);
+                    LOG_WARNING(logger, "Trouble with receiving UDP packets on core {}, errno = {}", core, errno);
+                }
+                return;
+            }
+
+            Metrics::add(udp_received);
+            IO_Utils::Packet_Latency::stamp(packet->timestamps.received_ns);
+
+            // Ответ пишется в буфер запроса и отправляется тем же потоком
+            packet = udp_handler.handle_packet(std::move(packet));
+            IO_Utils::Packet_Latency::stamp(packet->timestamps.handled_ns);
+            handled_requests.store(handled_requests.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+
+            if (udp_server_connection->send_packet(*packet) < 0)
+            {
+                Metrics::add(udp_errors);
+                LOG_WARNING(logger, "Trouble with sending UDP packets on core {}, errno = {}", core, errno);
+            }
+            else
+            {
+                Metrics::add(udp_sent);
+                IO_Utils::Packet_Latency::record_sent(packet->timestamps, IO_Utils::Packet_Latency::udp);
+            }
+            packet->timestamps = {};
+        }
+    }
+
+    void Core_Worker::serve_lookups()
+    {
+        uint64_t counter;
+        while (read(wakeup_fd, &counter, sizeof(counter)) > 0)
+        {
+        }
+
+        Session_Lookup *raw_lookup;
+        while (lookups.try_pop(raw_lookup))
+        {
+            std::unique_ptr<Session_Lookup> lookup{raw_lookup};
+            Session_Lookup_Result result;
+
+            if (lookup->want_session)
+                result.active.push_back(storage->_read(lookup->imsis[0], result.session));
+            else
+                storage->_read_batch(lookup->imsis, result.active);
+
+            lookup->result.set_value(std::move(result));
+            handled_lookups.store(handled_lookups.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        }
+    }
+
+    void Core_Worker::expire_sessions()
+    {
+        for (size_t shard = core; shard < Session_Storage::amount_of_shards; shard += cores)
+        {
+            storage->expire_shard(shard);
+        }
+    }
+
+    void Core_Worker::run(std::atomic<bool> &stop)
+    {
+        IO_Utils::Perf_Profiler::Thread_Registration profiler_registration{"core"};
+        LOG_DEBUG(logger, "Core {} of {} started", core, cores);
+
+        epoll_event events[IO_Utils::MAX_EVENTS];
+        auto next_expire = std::chrono::steady_clock::now() + EXPIRE_INTERVAL;
+        while (!stop.load())
+        {
+            errno = 0;
+            int nfds = epoll_wait(registrar.get_epoll_fd(), events, IO_Utils::MAX_EVENTS, (int)EXPIRE_INTERVAL.count());
+            if (nfds < 0 && errno != EINTR)
+            {
+                LOG_ERROR(logger, "Epoll_wait error on core {}, epoll_fd = {}, errno = {}", core, registrar.get_epoll_fd(), errno);
+            }
+
+            for (int i = 0; i < nfds; ++i)
+            {
+                if (events[i].data.fd == udp_server_fd)
+                    serve_udp();
+                else if (events[i].data.fd == wakeup_fd)
+                    serve_lookups();
+            }
+
+            auto now = std::chrono::steady_clock::now();
+            if (now >= next_expire)
+            {
+                expire_sessions();
+                next_expire = now + EXPIRE_INTERVAL;
+            }
+        }
+
+        LOG_DEBUG(logger, "Core {} stopped", core);
+    }
+
+    Core_Worker::~Core_Worker()
+    {
+        // Поиски, на которые ядро уже не ответит: future получит broken_promise
+        Session_Lookup *raw_lookup;
+        while (lookups.try_pop(raw_lookup))
+        {
+            delete raw_lookup;
+        }
+
+        if (udp_server_fd > 0)
+        {
+            registrar.deregister_socket(udp_server_fd);
+            // Иначе сокет остался бы в группе SO_REUSEPORT и получал бы часть датаграмм следующих ядер на этом адресе
+            close(udp_server_fd);
+        }
+        if (wakeup_fd >= 0)
+        {
+            registrar.deregister_socket(wakeup_fd);
+            close(wakeup_fd);
+        }
+    }
+
+    Core_Session_Storage::Core_Session_Storage(std::shared_ptr<Session_Storage> storage, std::vector<Core_Worker *> cores, quill::Logger *logger)
+        : storage(storage), cores(std::move(cores)), logger(logger)
+    {
+    }
+
+    std::future<Session_Lookup_Result> Core_Session_Storage::post(size_t core, std::vector<IMSI> imsis, bool want_session)
+    {
+        std::unique_ptr<Session_Lookup> lookup = std::make_unique<Session_Lookup>();
+        lookup->imsis = std::move(imsis);
+        lookup->want_session = want_session;
+        std::future<Session_Lookup_Result> result = lookup->result.get_future();
+
+        if (!cores[core]->post_lookup(lookup))
+        {
+            LOG_WARNING(logger, "Lookup channel of core {} is FULL", core);
+            return {};
+        }
+
+        return result;
+    }
+
+    bool Core_Session_Storage::_create(IMSI imsi, Session session)
+    {
+        return storage->_create(imsi, session);
+    }
+
+    Session_Lookup_Result Core_Session_Storage::wait(size_t core, std::future<Session_Lookup_Result> &result,
+                                                      std::chrono::steady_clock::time_point deadline)
+    {
+        if (!result.valid())
+            throw Session_Storage_Unavailable("Lookup channel of core " + std::to_string(core) + " is full");
+        if (result.wait_until(deadline) != std::future_status::ready)
+            throw Session_Storage_Unavailable("Core " + std::to_string(core) + " did not answer the lookup in time");
+
+        try
+        {
+            return result.get();
+        }
+        catch (const std::future_error &)
+        {
+            // Ядро удалено, не ответив
+            throw Session_Storage_Unavailable("Core " + std::to_string(core) + " is stopped");
+        }
+    }
+
+    bool Core_Session_Storage::_read(IMSI imsi, Session &session)
+    {
+        size_t core = Core_Worker::owner(imsi, cores.size());
+        std::future<Session_Lookup_Result> result = post(core, {imsi}, true);
+
+        Session_Lookup_Result lookup = wait(core, result, std::chrono::steady_clock::now() + LOOKUP_TIMEOUT);
+        session = lookup.session;
+        return lookup.active[0];
+    }
+
+    bool Core_Session_Storage::_update(IMSI imsi, Session session)
+    {
+        return storage->_update(imsi, session);
+    }
+
+    bool Core_Session_Storage::_delete(IMSI imsi)
+    {
+        return storage->_delete(imsi);
+    }
+
+    size_t Core_Session_Storage::_read_batch(const std::vector<IMSI> &imsis, std::vector<bool> &active)
+    {
+        active.assign(imsis.size(), false);
+
+        // indices[k] - номера IMSI запроса, которыми владеет ядро k
+        std::vector<std::vector<IMSI>> owned(cores.size());
+        std::vector<std::vector<size_t>> indices(cores.size());
+        for (size_t i = 0; i < imsis.size(); ++i)
+        {
+            size_t core = Core_Worker::owner(imsis[i], cores.size());
+            owned[core].push_back(imsis[i]);
+            indices[core].push_back(i);
+        }
+
+        // Сначала запросы всем ядрам, потом ожидание: ядра ищут одновременно
+        std::vector<std::future<Session_Lookup_Result>> results(cores.size());
+        for (size_t core = 0; core < cores.size(); ++core)
+        {
+            if (!owned[core].empty())
+                results[core] = post(core, std::move(owned[core]), false);
+        }
+
+        // Срок общий: остановленное ядро задерживает поиск не больше чем на LOOKUP_TIMEOUT, а не на каждое ядро
+        auto deadline = std::chrono::steady_clock::now() + LOOKUP_TIMEOUT;
+        size_t found = 0;
+        for (size_t core = 0; core < cores.size(); ++core)
+        {
+            if (indices[core].empty())
+                continue;
+
+            Session_Lookup_Result lookup = wait(core, results[core], deadline);
+            for (size_t j = 0; j < indices[core].size(); ++j)
+            {
+                active[indices[core][j]] = lookup.active[j];
+                found += lookup.active[j];
+            }
+        }
+
+        return found;
+    }
+
+    std::vector<IO_Utils::Lock_Stats> Core_Session_Storage::lock_stats()
+    {
+        return storage->lock_stats();
+    }
+}
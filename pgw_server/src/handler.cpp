@@ -1,11 +1,46 @@
 #include "handler.h"
 
+#include <coarse_clock.h>
+#include <metrics.h>
+#include <perf_profiler.h>
+#include <probes.h>
+#include <trace.h>
+
+#include <nlohmann/json.hpp>
 #include <quill/LogMacros.h>
 
 #include <algorithm>
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 namespace PGW
 {
+    using IO_Utils::Metrics;
+
+    static const Metrics::Id udp_created = Metrics::counter("pgw_udp_requests_total", "UDP requests by result", "result=\"created\"");
+    static const Metrics::Id udp_updated = Metrics::counter("pgw_udp_requests_total", "UDP requests by result", "result=\"updated\"");
+    static const Metrics::Id udp_rejected_update = Metrics::counter("pgw_udp_requests_total", "UDP requests by result", "result=\"rejected_too_recent\"");
+    static const Metrics::Id udp_rejected_create = Metrics::counter("pgw_udp_requests_total", "UDP requests by result", "result=\"rejected_create\"");
+    static const Metrics::Id udp_invalid = Metrics::counter("pgw_udp_requests_total", "UDP requests by result", "result=\"invalid\"");
+
+    // Ответы HTTP по первой цифре статуса, http_responses[2] - 2xx
+    static const Metrics::Id http_responses[6] = {
+        Metrics::counter("pgw_http_responses_total", "HTTP responses by status class", "class=\"other\""),
+        Metrics::counter("pgw_http_responses_total", "HTTP responses by status class", "class=\"1xx\""),
+        Metrics::counter("pgw_http_responses_total", "HTTP responses by status class", "class=\"2xx\""),
+        Metrics::counter("pgw_http_responses_total", "HTTP responses by status class", "class=\"3xx\""),
+        Metrics::counter("pgw_http_responses_total", "HTTP responses by status class", "class=\"4xx\""),
+        Metrics::counter("pgw_http_responses_total", "HTTP responses by status class", "class=\"5xx\"")};
+
+    // Счетчики IO потока, по ним считается число пакетов за окно профилирования
+    static const Metrics::Id udp_packets_received = Metrics::counter("pgw_packets_received_total", "UDP packets and complete HTTP requests received", "protocol=\"udp\"");
+    static const Metrics::Id http_packets_received = Metrics::counter("pgw_packets_received_total", "UDP packets and complete HTTP requests received", "protocol=\"http\"");
+
     std::string vec_to_str(std::vector<uint8_t> data)
     {
         std::string str = "";
@@ -18,6 +53,76 @@ namespace PGW
         return str;
     }
 
+    // Декодирует %XX и '+' в значении параметра запроса, false при неверной последовательности
+    static bool url_decode(std::string_view value, std::string &result)
+    {
+        result.clear();
+        for (size_t i = 0; i < value.size(); ++i)
+        {
+            if (value[i] == '+')
+            {
+                result += ' ';
+            }
+            else if (value[i] == '%')
+            {
+                unsigned int code = 0;
+                if (i + 2 >= value.size())
+                    return false;
+                auto [ptr, ec] = std::from_chars(value.data() + i + 1, value.data() + i + 3, code, 16);
+                if (ec != std::errc{} || ptr != value.data() + i + 3)
+                    return false;
+
+                result += (char)code;
+                i += 2;
+            }
+            else
+            {
+                result += value[i];
+            }
+        }
+
+        return true;
+    }
+
+    bool equals_ignore_case(std::string_view a, std::string_view b)
+    {
+        if (a.size() != b.size())
+            return false;
+
+        for (size_t i = 0; i < a.size(); ++i)
+        {
+            // Перевод в нижний регистр только для латинских букв, без учета локали
+            char x = a[i] >= 'A' && a[i] <= 'Z' ? a[i] + ('a' - 'A') : a[i];
+            char y = b[i] >= 'A' && b[i] <= 'Z' ? b[i] + ('a' - 'A') : b[i];
+            if (x != y)
+                return false;
+        }
+
+        return true;
+    }
+
+    static std::string_view header_name(const phr_header &header)
+    {
+        return {header.name, header.name_len};
+    }
+
+    static std::string_view header_value(const phr_header &header)
+    {
+        return {header.value, header.value_len};
+    }
+
+    // Значение первого заголовка с именем name (без учета регистра), пустое, если заголовка нет
+    static std::string_view find_header(const phr_header *headers, size_t num_headers, std::string_view name)
+    {
+        for (size_t i = 0; i < num_headers; ++i)
+        {
+            if (equals_ignore_case(header_name(headers[i]), name))
+                return header_value(headers[i]);
+        }
+
+        return {};
+    }
+
     std::vector<uint8_t> Handler::create_response(std::string message)
     {
         return {message.begin(), message.end()};
@@ -31,12 +136,22 @@ namespace PGW
 
     UDP_Handler::UDP_Handler(std::unordered_set<IMSI> blacklist, std::shared_ptr<ISession_Storage> session_storage, quill::Logger *logger) : blacklist(blacklist), session_storage(session_storage), logger(logger) {}
 
+    std::vector<uint8_t> UDP_Handler::busy_response()
+    {
+        std::string_view message = "rejected, server busy";
+        return {message.begin(), message.end()};
+    }
+
     std::unique_ptr<IO_Utils::Packet> UDP_Handler::handle_packet(std::unique_ptr<IO_Utils::Packet> packet)
     {
+        IO_Utils::Tracer::Span trace_span{"UDP_Handler::handle_packet"};
+
         IMSI imsi;
 
         if (!imsi.set_IMSI_from_IE(packet->data))
         {
+            Metrics::add(udp_invalid);
+            IO_UTILS_PROBE(udp_result, "", "invalid");
             packet->data = create_response("rejected, not IMSI IE");
 
             LOG_DEBUG(logger, "Received message without IMSI IE\n{}", vec_to_str(packet->data));
@@ -49,24 +164,32 @@ namespace PGW
         {
             if (session_storage->_update(imsi, session))
             {
+                Metrics::add(udp_updated);
+                IO_UTILS_PROBE(udp_result, imsi.c_str(), "updated");
                 packet->data = create_response("updated");
             }
             else
             {
+                Metrics::add(udp_rejected_update);
+                IO_UTILS_PROBE(udp_result, imsi.c_str(), "rejected_too_recent");
                 packet->data = create_response("rejected, the last update was too recent");
             }
 
             return packet;
         }
 
-        auto current_time = std::chrono::steady_clock::now();
+        auto current_time = IO_Utils::Coarse_Clock::steady_now();
         session.last_activity = current_time;
         if (!session_storage->_create(imsi, session))
         {
+            Metrics::add(udp_rejected_create);
+            IO_UTILS_PROBE(udp_result, imsi.c_str(), "rejected_create");
             packet->data = create_response("rejected, IMSI blacklisted or error creating session");
         }
         else
         {
+            Metrics::add(udp_created);
+            IO_UTILS_PROBE(udp_result, imsi.c_str(), "created");
             packet->data = create_response("created");
         }
 
@@ -80,104 +203,734 @@ namespace PGW
         return packet;
     }
 
-    std::vector<uint8_t> HTTP_Handler::create_error_response(int status_code, const std::string &message)
+    void HTTP_Handler::render_response(const Response &response, std::vector<uint8_t> &out)
     {
-        std::string response = "HTTP/1.1 " + std::to_string(status_code) + " " + message + "\r\n";
-        response += "Content-Length: " + std::to_string(message.size()) + "\r\n\r\n";
-        response += message;
+        char status_class = response.status.empty() ? '0' : response.status[0];
+        Metrics::add(http_responses[status_class >= '1' && status_class <= '5' ? status_class - '0' : 0]);
+
+        size_t body_length = response.file_body != nullptr ? response.file_body->length : response.content.size();
+
+        char length_str[24];
+        size_t length_size = std::to_chars(length_str, length_str + sizeof(length_str), body_length).ptr - length_str;
+
+        constexpr std::string_view version = "HTTP/1.1 ";
+        constexpr std::string_view content_type = "\r\nContent-Type: ";
+        constexpr std::string_view content_length = "\r\nContent-Length: ";
+        constexpr std::string_view end_of_headers = "\r\n\r\n";
+
+        // Память пакета (запроса) переиспользуется, новое выделение только если ответ в нее не влезает
+        out.clear();
+        out.reserve(version.size() + response.status.size() + content_type.size() + response.content_type.size() +
+                    response.extra_headers.size() + content_length.size() + length_size + end_of_headers.size() +
+                    response.content.size());
 
-        return {response.begin(), response.end()};
+        auto append = [&out](std::string_view str)
+        {
+            out.insert(out.end(), str.begin(), str.end());
+        };
+
+        append(version);
+        append(response.status);
+        append(content_type);
+        append(response.content_type);
+        // Каждый заголовок в extra_headers заканчивается на \r\n, последний перевод строки дает content_length
+        if (!response.extra_headers.empty())
+        {
+            append("\r\n");
+            append(response.extra_headers.substr(0, response.extra_headers.size() - 2));
+        }
+        append(content_length);
+        append({length_str, length_size});
+        append(end_of_headers);
+        append(response.content);
     }
 
-    std::vector<uint8_t> HTTP_Handler::process_request(
-        std::string method,
-        std::string path,
+    void HTTP_Handler::process_request(
+        std::string_view method,
+        std::string_view path,
         int http_version,
         phr_header *headers,
         size_t num_headers,
-        const char *body,
-        size_t body_size)
+        std::string_view body,
+        Response &response)
     {
-        std::string content = "";
-        std::string response = "HTTP/1.1 200 OK\r\n";
-
-        LOG_DEBUG(logger, "Method = {}\nPath = {}\nHttp version = {}", method, path, http_version);
+        LOG_DEBUG(logger, "Method = {}\nPath = {}\nHttp version = {}\nBody size = {}", method, path, http_version, body.size());
 
         if (path == "/check_subscriber")
         {
-            response = "HTTP/1.1 400 Bad Request\r\n";
-            std::string header_with_IMSI = "";
-            if(num_headers > 0){
-                LOG_DEBUG(logger, "Headers:");
+            process_check_subscriber(headers, num_headers, response);
+        }
+        else if (path == "/check_subscribers")
+        {
+            process_check_subscribers(method, body, response);
+        }
+        else if (path == "/cdr/files" || path.starts_with("/cdr/files/"))
+        {
+            process_cdr_files_request(path.size() > 11 ? path.substr(11) : std::string_view{}, headers, num_headers, response);
+        }
+        else if (path == "/cdr" || path.starts_with("/cdr?"))
+        {
+            process_cdr_request(method, path.size() > 4 ? path.substr(5) : std::string_view{}, response);
+        }
+        else if (path == "/profile/start" || path == "/profile/stop")
+        {
+            process_profile_request(path.substr(9), response);
+        }
+        else if (path == "/trace/start" || path.starts_with("/trace/start?") || path == "/trace/stop")
+        {
+            process_trace_request(path.substr(7, 5), path.size() > 12 ? path.substr(13) : std::string_view{}, response);
+        }
+        else if (path == "/lock_stats")
+        {
+            process_lock_stats_request(response);
+        }
+        else if (path == "/metrics")
+        {
+            content_buffer.clear();
+            Metrics::render(content_buffer);
+
+            response.content_type = "text/plain; version=0.0.4";
+            response.content = content_buffer;
+        }
+        else if (path == "/stop")
+        {
+            // По факту тут происходит не столько gracefull_offload, сколько отключение всего вообще
+            stop.store(true);
+
+            LOG_DEBUG(logger, "Start offload");
+
+            response.content = "offload started";
+        }
+    }
+
+    void HTTP_Handler::unavailable(const Session_Storage_Unavailable &error, Response &response)
+    {
+        IO_UTILS_LOG_THROTTLED(unavailable_log, LOG_WARNING, logger, "Session lookup failed: {}", error.what());
+
+        // Клиент может повторить запрос, ответ "not active" был бы неправдой
+        response.status = "503 Service Unavailable";
+        response.extra_headers = "Retry-After: 1\r\n";
+        response.content = "Session storage unavailable";
+    }
+
+    void HTTP_Handler::process_check_subscriber(phr_header *headers, size_t num_headers, Response &response)
+    {
+        response.status = "400 Bad Request";
+
+        for (size_t i = 0; i < num_headers; ++i)
+        {
+            LOG_DEBUG(logger, "{}: {}", header_name(headers[i]), header_value(headers[i]));
+        }
+
+        std::string_view value = find_header(headers, num_headers, "IMSI");
+        value = value.substr(0, value.find('\\'));
+
+        // IMSI не длиннее 15 цифр и хранится без выделения памяти (SSO)
+        IMSI imsi;
+        Session session;
+        if (!value.empty() && imsi.set_IMSI_from_str(std::string{value}))
+        {
+            LOG_DEBUG(logger, "Check session existence for IMSI {}", imsi.get_IMSI_to_str());
+            bool active;
+            try
+            {
+                active = session_storage->_read(imsi, session);
+            }
+            catch (const Session_Storage_Unavailable &e)
+            {
+                unavailable(e, response);
+                return;
+            }
+
+            response.content = active ? "active" : "not active";
+            response.status = "200 OK";
+        }
+    }
+
+    // Значение в кавычках для CSV ответа, кавычки внутри удваиваются
+    static void append_csv_field(std::string &out, std::string_view value)
+    {
+        out += '"';
+        for (char c : value)
+        {
+            if (c == '"')
+                out += '"';
+            out += c;
+        }
+        out += '"';
+    }
+
+    void HTTP_Handler::process_check_subscribers(std::string_view method, std::string_view body, Response &response)
+    {
+        if (method != "POST")
+        {
+            response.status = "405 Method Not Allowed";
+            response.extra_headers = "Allow: POST\r\n";
+            response.content = "Method Not Allowed";
+            return;
+        }
+
+        batch_keys.clear();
+
+        size_t first = body.find_first_not_of(" \t\r\n");
+        bool json = first != std::string_view::npos && (body[first] == '[' || body[first] == '{');
+        if (json)
+        {
+            nlohmann::json request = nlohmann::json::parse(body.begin(), body.end(), nullptr, false);
+            const nlohmann::json *list = &request;
+            if (request.is_object() && request.contains("imsis"))
+                list = &request["imsis"];
+
+            if (!list->is_array())
+            {
+                response.status = "400 Bad Request";
+                response.content = "Expected JSON array of IMSI";
+                return;
             }
-            for (size_t i = 0; i < num_headers; ++i)
+
+            for (const auto &element : *list)
             {
-                static std::string imsi_header = "IMSI";
-                std::string header{headers[i].name, headers[i].name_len};
-                std::string value{headers[i].value, headers[i].value_len};
-
-                LOG_DEBUG(logger, "{}: {}", header, value);
-
-                if (std::equal(header.begin(), header.end(), imsi_header.begin(), imsi_header.end(),
-                               [](char a, char b)
-                               {
-                                   return std::tolower(a) == std::tolower(b);
-                               }))
-                {
-                    size_t index = value.find("\\");
-                    if (index == std::string::npos)
-                        index = headers[i].value_len;
-                    header_with_IMSI = value.substr(0, index);
-                }
+                // Число без ведущих нулей тоже принимается, но IMSI лучше передавать строкой
+                if (element.is_string())
+                    batch_keys.push_back(element.get<std::string>());
+                else if (element.is_number_unsigned())
+                    batch_keys.push_back(std::to_string(element.get<uint64_t>()));
+                else
+                    batch_keys.push_back(element.dump());
             }
+        }
+        else
+        {
+            while (!body.empty())
+            {
+                std::string_view line = body.substr(0, body.find('\n'));
+                body.remove_prefix(line.size() < body.size() ? line.size() + 1 : line.size());
+
+                size_t begin = line.find_first_not_of(" \t\r");
+                if (begin == std::string_view::npos)
+                    continue;
 
+                line = line.substr(begin, line.find_last_not_of(" \t\r") + 1 - begin);
+                batch_keys.emplace_back(line);
+            }
+        }
+
+        // Неправильные IMSI в хранилище не ищутся, в ответе для них invalid
+        batch_imsis.clear();
+        std::vector<bool> valid(batch_keys.size());
+        for (size_t i = 0; i < batch_keys.size(); ++i)
+        {
             IMSI imsi;
-            Session session;
-            if (header_with_IMSI != "" && imsi.set_IMSI_from_str(header_with_IMSI))
+            valid[i] = imsi.set_IMSI_from_str(batch_keys[i]);
+            if (valid[i])
+                batch_imsis.push_back(imsi);
+        }
+
+        size_t found;
+        try
+        {
+            found = session_storage->_read_batch(batch_imsis, batch_active);
+        }
+        catch (const Session_Storage_Unavailable &e)
+        {
+            unavailable(e, response);
+            return;
+        }
+
+        LOG_DEBUG(logger, "Batch check of {} IMSI: {} valid, {} active", batch_keys.size(), batch_imsis.size(), found);
+
+        content_buffer.clear();
+        content_buffer.reserve(batch_keys.size() * 40);
+        if (json)
+            content_buffer += '[';
+
+        for (size_t i = 0, checked = 0; i < batch_keys.size(); ++i)
+        {
+            std::string_view status = !valid[i] ? "invalid" : batch_active[checked++] ? "active"
+                                                                                      : "not active";
+            if (json)
             {
-                LOG_DEBUG(logger, "Check session existence for IMSI {}", imsi.get_IMSI_to_str());
-                if (session_storage->_read(imsi, session))
-                {
-                    content = "active";
-                }
+                content_buffer += i == 0 ? "{\"imsi\":" : ",{\"imsi\":";
+                // Правильный IMSI - только цифры, экранировать нужно лишь остальные строки
+                if (valid[i])
+                    content_buffer.append("\"").append(batch_keys[i]).append("\"");
                 else
-                {
-                    content = "not active";
-                }
+                    content_buffer += nlohmann::json(batch_keys[i]).dump();
+                content_buffer += ",\"status\":\"";
+                content_buffer += status;
+                content_buffer += "\"}";
+            }
+            else
+            {
+                append_csv_field(content_buffer, batch_keys[i]);
+                content_buffer += ',';
+                append_csv_field(content_buffer, status);
+                content_buffer += "\r\n";
+            }
+        }
 
-                response = "HTTP/1.1 200 OK\r\n";
+        if (json)
+            content_buffer += ']';
+
+        response.content_type = json ? "application/json" : "text/csv";
+        response.content = content_buffer;
+    }
+
+    void HTTP_Handler::process_lock_stats_request(Response &response)
+    {
+        std::vector<IO_Utils::Lock_Stats> stats = session_storage->lock_stats();
+        if (stats.empty())
+        {
+            response.status = "404 Not Found";
+            response.content = "Lock statistics are not available";
+            return;
+        }
+
+        // Время в микросекундах, удержание замеряется выборочно, поэтому среднее считается по замеренным
+        content_buffer = "\"shard\",\"mode\",\"acquisitions\",\"contended\",\"wait_us\",\"max_wait_us\",\"sampled_holds\",\"avg_hold_us\",\"max_hold_us\"\r\n";
+        for (size_t i = 0; i < stats.size(); ++i)
+        {
+            for (bool exclusive : {true, false})
+            {
+                const IO_Utils::Lock_Stats::Mode &mode = exclusive ? stats[i].exclusive : stats[i].shared;
+
+                content_buffer += "\"" + std::to_string(i) + "\",\"" + (exclusive ? "exclusive" : "shared") + "\",\"" +
+                                  std::to_string(mode.acquisitions) + "\",\"" + std::to_string(mode.contended) + "\",\"" +
+                                  std::to_string(mode.wait_ns / 1000) + "\",\"" + std::to_string(mode.max_wait_ns / 1000) + "\",\"" +
+                                  std::to_string(mode.sampled_holds) + "\",\"" +
+                                  std::to_string(mode.sampled_holds == 0 ? 0 : mode.hold_ns / mode.sampled_holds / 1000) + "\",\"" +
+                                  std::to_string(mode.max_hold_ns / 1000) + "\"\r\n";
             }
         }
-        else if (path == "/stop")
+
+        std::vector<IO_Utils::Instrumented_Shared_Mutex::Call_Site> sites = IO_Utils::Instrumented_Shared_Mutex::top_call_sites(LOCK_CALL_SITES_LIMIT);
+        if (!sites.empty())
         {
-            // По факту тут происходит не столько gracefull_offload, сколько отключение всего вообще
-            stop.store(true);
+            content_buffer += "\r\n\"waits\",\"wait_us\",\"stack\"\r\n";
+            for (const auto &site : sites)
+            {
+                content_buffer += "\"" + std::to_string(site.waits) + "\",\"" + std::to_string(site.wait_ns / 1000) + "\",";
+                append_csv_field(content_buffer, site.frames);
+                content_buffer += "\r\n";
+            }
+        }
 
-            LOG_DEBUG(logger, "Start offload");
+        response.content_type = "text/csv";
+        response.content = content_buffer;
+    }
 
-            content = "offload started";
+    void HTTP_Handler::process_trace_request(std::string_view action, std::string_view query, Response &response)
+    {
+        if (trace_file.empty())
+        {
+            response.status = "403 Forbidden";
+            response.content = "Tracing is disabled (trace_file)";
+            return;
+        }
+
+        if (action == "stop")
+        {
+            if (!IO_Utils::Tracer::stop())
+            {
+                response.status = "409 Conflict";
+                response.content = "Tracing is not running";
+                return;
+            }
+
+            content_buffer = "tracing stopped, file ";
+            content_buffer += trace_file;
+            content_buffer += "\nwritten_events ";
+            content_buffer += std::to_string(IO_Utils::Tracer::written_events());
+            content_buffer += "\ndropped_events ";
+            content_buffer += std::to_string(IO_Utils::Tracer::dropped_events());
+            content_buffer += '\n';
+            response.content = content_buffer;
+            return;
+        }
+
+        size_t sample = DEFAULT_TRACE_SAMPLE;
+        size_t duration_ms = DEFAULT_TRACE_DURATION_MS;
+
+        std::string value;
+        while (!query.empty())
+        {
+            std::string_view parameter = query.substr(0, query.find('&'));
+            query.remove_prefix(parameter.size() < query.size() ? parameter.size() + 1 : parameter.size());
+
+            size_t equal = parameter.find('=');
+            std::string_view name = parameter.substr(0, equal);
+
+            bool valid = equal != std::string_view::npos && url_decode(parameter.substr(equal + 1), value);
+            if (valid && name == "sample")
+            {
+                auto [ptr, ec] = std::from_chars(value.data(), value.data() + value.size(), sample);
+                valid = ec == std::errc{} && ptr == value.data() + value.size() && sample > 0;
+            }
+            else if (valid && name == "duration_ms")
+            {
+                auto [ptr, ec] = std::from_chars(value.data(), value.data() + value.size(), duration_ms);
+                valid = ec == std::errc{} && ptr == value.data() + value.size() && duration_ms > 0 && duration_ms <= MAX_TRACE_DURATION_MS;
+            }
+            else
+            {
+                valid = false;
+            }
+
+            if (!valid)
+            {
+                content_buffer = "Invalid parameter ";
+                content_buffer += name;
+                response.status = "400 Bad Request";
+                response.content = content_buffer;
+                return;
+            }
+        }
+
+        int error = 0;
+        if (IO_Utils::Tracer::running())
+        {
+            response.status = "409 Conflict";
+            response.content = "Tracing is already running";
+        }
+        else if (!IO_Utils::Tracer::start(trace_file, sample, std::chrono::milliseconds(duration_ms), error))
+        {
+            LOG_WARNING(logger, "Can't start tracing to {}, errno = {}", trace_file, error);
+
+            response.status = "500 Internal Server Error";
+            content_buffer = "Can't open trace file: ";
+            content_buffer += std::strerror(error);
+            response.content = content_buffer;
+        }
+        else
+        {
+            LOG_INFO(logger, "Tracing 1 of {} requests for {} ms to {}", sample, duration_ms, trace_file);
+
+            content_buffer = "tracing started, file ";
+            content_buffer += trace_file;
+            response.content = content_buffer;
+        }
+    }
+
+    void HTTP_Handler::process_profile_request(std::string_view action, Response &response)
+    {
+        if (!profiling_enabled)
+        {
+            response.status = "403 Forbidden";
+            response.content = "Profiling is disabled (profiling_enabled)";
+            return;
+        }
+
+        if (action == "start")
+        {
+            int error = 0;
+            if (IO_Utils::Perf_Profiler::running())
+            {
+                response.status = "409 Conflict";
+                response.content = "Profiling is already running";
+            }
+            else if (!IO_Utils::Perf_Profiler::start(error))
+            {
+                LOG_WARNING(logger, "Can't open perf_event counters, errno = {}", error);
+
+                response.status = "503 Service Unavailable";
+                content_buffer = "Can't open perf_event counters: ";
+                content_buffer += std::strerror(error);
+                response.content = content_buffer;
+            }
+            else
+            {
+                profile_start_time = std::chrono::steady_clock::now();
+                profile_start_packets = Metrics::value(udp_packets_received) + Metrics::value(http_packets_received);
+
+                response.content = "profiling started";
+            }
+            return;
+        }
+
+        std::vector<IO_Utils::Perf_Profiler::Thread_Result> results;
+        if (!IO_Utils::Perf_Profiler::stop(results))
+        {
+            response.status = "409 Conflict";
+            response.content = "Profiling is not running";
+            return;
+        }
+
+        uint64_t packets = Metrics::value(udp_packets_received) + Metrics::value(http_packets_received) - profile_start_packets;
+        auto window = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - profile_start_time);
+
+        // Без аппаратных счетчиков (hardware = no) поля циклов, инструкций и кэша пустые, остается процессорное время
+        char line[512];
+        content_buffer = "\"window_ms\",\"packets\"\r\n\"" + std::to_string(window.count()) + "\",\"" + std::to_string(packets) + "\"\r\n\r\n";
+        content_buffer += "\"thread\",\"tid\",\"hardware\",\"cpu_ms\",\"context_switches\",\"cycles\",\"instructions\",\"ipc\","
+                          "\"cache_references\",\"cache_misses\",\"cache_miss_rate\",\"cycles_per_packet\",\"cpu_ns_per_packet\"\r\n";
+        for (const auto &result : results)
+        {
+            double per_packet = packets == 0 ? 0 : 1.0 / packets;
+
+            std::snprintf(line, sizeof(line), "\"%s\",\"%d\",\"%s\",\"%.3f\",\"%llu\",", result.name.c_str(), (int)result.tid,
+                          result.hardware ? "yes" : "no", result.task_clock_ns / 1e6, (unsigned long long)result.context_switches);
+            content_buffer += line;
+
+            if (result.hardware)
+            {
+                std::snprintf(line, sizeof(line), "\"%llu\",\"%llu\",\"%.3f\",\"%llu\",\"%llu\",\"%.4f\",\"%.1f\",",
+                              (unsigned long long)result.cycles, (unsigned long long)result.instructions,
+                              result.cycles == 0 ? 0.0 : (double)result.instructions / result.cycles,
+                              (unsigned long long)result.cache_references, (unsigned long long)result.cache_misses,
+                              result.cache_references == 0 ? 0.0 : (double)result.cache_misses / result.cache_references,
+                              result.cycles * per_packet);
+                content_buffer += line;
+            }
+            else
+            {
+                content_buffer += "\"\",\"\",\"\",\"\",\"\",\"\",\"\",";
+            }
+
+            std::snprintf(line, sizeof(line), "\"%.1f\"\r\n", result.task_clock_ns * per_packet);
+            content_buffer += line;
+        }
+
+        response.content_type = "text/csv";
+        response.content = content_buffer;
+    }
+
+    void HTTP_Handler::process_cdr_request(std::string_view method, std::string_view query, Response &response)
+    {
+        if (method != "GET")
+        {
+            response.status = "405 Method Not Allowed";
+            response.extra_headers = "Allow: GET\r\n";
+            response.content = "Method Not Allowed";
+            return;
+        }
+
+        if (cdr_history == nullptr)
+        {
+            response.status = "404 Not Found";
+            response.content = "CDR history is not available";
+            return;
         }
 
-        response += "Content-Type: text/plain\r\n";
-        response += "Content-Length: " + std::to_string(content.size()) + "\r\n\r\n";
-        response += content;
+        std::string imsi_str;
+        int64_t since_ns = 0;
+        size_t limit = DEFAULT_CDR_LIMIT;
 
-        LOG_DEBUG(logger, "Response on that packet:\n{}", response);
+        // Параметры imsi (обязательный), since (секунды от эпохи или "YYYY-MM-DD HH:MM:SS" в местном времени) и limit
+        std::string value;
+        while (!query.empty())
+        {
+            std::string_view parameter = query.substr(0, query.find('&'));
+            query.remove_prefix(parameter.size() < query.size() ? parameter.size() + 1 : parameter.size());
+
+            size_t equal = parameter.find('=');
+            std::string_view name = parameter.substr(0, equal);
+
+            bool valid = equal != std::string_view::npos && url_decode(parameter.substr(equal + 1), value);
+            if (valid && name == "imsi")
+            {
+                imsi_str = value;
+            }
+            else if (valid && name == "since")
+            {
+                int64_t seconds = 0;
+                auto [ptr, ec] = std::from_chars(value.data(), value.data() + value.size(), seconds);
+                if (ec != std::errc{} || ptr != value.data() + value.size())
+                    valid = parse_cdr_date_time(value.data(), value.size(), seconds);
+                valid = valid && seconds >= -MAX_CDR_SINCE_SEC && seconds <= MAX_CDR_SINCE_SEC;
+                since_ns = valid ? seconds * 1'000'000'000 : 0;
+            }
+            else if (valid && name == "limit")
+            {
+                auto [ptr, ec] = std::from_chars(value.data(), value.data() + value.size(), limit);
+                valid = ec == std::errc{} && ptr == value.data() + value.size() && limit > 0 && limit <= MAX_CDR_LIMIT;
+            }
+
+            if (!valid)
+            {
+                content_buffer = "Invalid parameter ";
+                content_buffer += name;
+                response.status = "400 Bad Request";
+                response.content = content_buffer;
+                return;
+            }
+        }
+
+        IMSI imsi;
+        if (imsi_str.empty() || !imsi.set_IMSI_from_str(imsi_str))
+        {
+            response.status = "400 Bad Request";
+            response.content = "Invalid parameter imsi";
+            return;
+        }
+
+        CDR_Lookup_Stats stats;
+        std::vector<CDR_Record> records = cdr_history->lookup(imsi.get_IMSI_to_str(), since_ns, limit, &stats, true, MAX_CDR_SCAN_BYTES);
+
+        LOG_DEBUG(logger, "CDR lookup for IMSI {}: {} records, {} files ({} indexed, {} scanned), {} of {} blocks read{}",
+                  imsi.get_IMSI_to_str(), records.size(), stats.files, stats.indexed_files, stats.scanned_files,
+                  stats.blocks_read, stats.blocks, stats.truncated ? ", truncated" : "");
+        if (stats.truncated)
+            response.extra_headers = "X-CDR-Truncated: true\r\n";
 
-        return {response.begin(), response.end()};
+        // Колонки выбираются один раз на ответ, чтобы все строки имели одинаковое число полей
+        bool with_sequence = false, with_summary = false;
+        for (const auto &record : records)
+        {
+            with_sequence |= record.sequence != 0;
+            with_summary |= record.first_seen_ns != 0;
+        }
+
+        char line[CDR_CSV_LINE_SIZE];
+        content_buffer.clear();
+        content_buffer.reserve(records.size() * 64);
+        for (const auto &record : records)
+        {
+            size_t length = format_csv_line(record, time_formatter, line, with_sequence, with_summary);
+            content_buffer.append(line, length);
+        }
+
+        response.content_type = "text/csv";
+        response.content = content_buffer;
     }
 
-    HTTP_Handler::HTTP_Handler(std::shared_ptr<ISession_Storage> session_storage, std::atomic<bool> &stop, quill::Logger *logger) : session_storage(session_storage), stop(stop), logger(logger) {}
+    // Разбирает значение Range вида bytes=a-b, bytes=a- или bytes=-n для файла размера size.
+    // 0 - диапазон [begin, end] задан, 1 - заголовок не понят или диапазонов несколько (отдается весь файл),
+    // -1 - диапазон за пределами файла
+    static int parse_range(std::string_view value, size_t size, size_t &begin, size_t &end)
+    {
+        if (!value.starts_with("bytes=") || value.find(',') != std::string_view::npos)
+            return 1;
+
+        size_t dash = value.find('-', 6);
+        if (dash == std::string_view::npos)
+            return 1;
+
+        const char *first = value.data() + 6;
+        const char *middle = value.data() + dash;
+        const char *last = value.data() + value.size();
+
+        size_t from = 0, to = 0;
+        bool has_from = first != middle;
+        bool has_to = middle + 1 != last;
+        if ((has_from && std::from_chars(first, middle, from).ptr != middle) ||
+            (has_to && std::from_chars(middle + 1, last, to).ptr != last) ||
+            (!has_from && !has_to))
+            return 1;
+
+        if (!has_from)
+        {
+            // Последние to байт
+            if (to == 0 || size == 0)
+                return -1;
+            begin = to >= size ? 0 : size - to;
+            end = size - 1;
+            return 0;
+        }
+
+        if (from >= size || (has_to && to < from))
+            return -1;
+
+        begin = from;
+        end = has_to && to < size ? to : size - 1;
+        return 0;
+    }
+
+    void HTTP_Handler::process_cdr_files_request(std::string_view name, phr_header *headers, size_t num_headers, Response &response)
+    {
+        if (cdr_history == nullptr)
+        {
+            response.status = "404 Not Found";
+            response.content = "CDR history is not available";
+            return;
+        }
+
+        if (name.empty())
+        {
+            // "Имя","Размер","closed|open", последний файл - тот, в который сейчас пишет журнал
+            content_buffer.clear();
+            std::vector<std::string> files = cdr_history->list_files();
+            for (size_t i = 0; i < files.size(); ++i)
+            {
+                struct stat file_stat;
+                if (stat(files[i].c_str(), &file_stat) != 0)
+                    continue;
+
+                content_buffer += "\"" + std::filesystem::path(files[i]).filename().string() + "\",\"" +
+                                  std::to_string(file_stat.st_size) + "\",\"" + (i + 1 == files.size() ? "open" : "closed") + "\"\r\n";
+            }
+
+            response.content = content_buffer;
+            return;
+        }
+
+        std::string path = cdr_history->find_file(std::string{name});
+        int fd = path.empty() ? -1 : open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        struct stat file_stat;
+        if (fd < 0 || fstat(fd, &file_stat) != 0)
+        {
+            if (fd >= 0)
+                close(fd);
+
+            response.status = "404 Not Found";
+            response.content = "CDR file not found";
+            return;
+        }
+
+        // Размер фиксируется здесь: в открытый файл журнал может дописывать, клиент получит снимок на момент запроса
+        size_t size = file_stat.st_size;
+        size_t begin = 0;
+        size_t end = size == 0 ? 0 : size - 1;
+        int range = 1;
+
+        std::string_view range_value = find_header(headers, num_headers, "Range");
+        if (!range_value.empty())
+            range = parse_range(range_value, size, begin, end);
+
+        if (range < 0)
+        {
+            close(fd);
+            headers_buffer = "Content-Range: bytes */" + std::to_string(size) + "\r\n";
+            response.status = "416 Range Not Satisfiable";
+            response.extra_headers = headers_buffer;
+            response.content = "Range Not Satisfiable";
+            return;
+        }
+
+        LOG_DEBUG(logger, "Sending CDR file {} bytes {}-{} of {}", path, begin, end, size);
+
+        response.file_body = std::make_shared<IO_Utils::File_Body>(fd, begin, size == 0 ? 0 : end - begin + 1);
+        response.content_type = "application/octet-stream";
+        headers_buffer = "Accept-Ranges: bytes\r\n";
+
+        if (range == 0)
+        {
+            headers_buffer += "Content-Range: bytes " + std::to_string(begin) + "-" + std::to_string(end) + "/" + std::to_string(size) + "\r\n";
+            response.status = "206 Partial Content";
+        }
+
+        response.extra_headers = headers_buffer;
+    }
+
+    HTTP_Handler::HTTP_Handler(std::shared_ptr<ISession_Storage> session_storage, std::atomic<bool> &stop, quill::Logger *logger,
+                               std::shared_ptr<CDR_History> cdr_history, bool profiling_enabled,
+                               std::string trace_file) : session_storage(session_storage), stop(stop), logger(logger), cdr_history(cdr_history),
+                                                         profiling_enabled(profiling_enabled), trace_file(std::move(trace_file)) {}
 
     std::unique_ptr<IO_Utils::Packet> HTTP_Handler::handle_packet(std::unique_ptr<IO_Utils::Packet> packet)
     {
+        IO_Utils::Tracer::Span trace_span{"HTTP_Handler::handle_packet"};
+
         LOG_DEBUG(logger, "Received HTTP packet from {}", packet->get_socket()->socket_to_str());
 
+        Response response;
+
         // Слишком длинное сообщение
-        if (packet->data.size() > MAX_HTTP_SIZE)
+        if (packet->data.size() > MAX_HTTP_SIZE + MAX_HTTP_BODY_SIZE)
         {
             LOG_WARNING(logger, "The received HTTP packet was too long");
-            packet->data = create_error_response(400, "Bad Request");
+            response.status = "400 Bad Request";
+            response.content = "Bad Request";
+            render_response(response, packet->data);
             return packet;
         }
 
@@ -189,7 +942,7 @@ namespace PGW
         phr_header headers[16];
         size_t num_headers = 16;
 
-        // Парсинг HTTP-запроса
+        // Парсинг HTTP-запроса, все строки дальше указывают в буфер пакета
         int parsed = phr_parse_request(
             (char *)packet->data.data(),
             packet->data.size(),
@@ -199,60 +952,40 @@ namespace PGW
             headers, &num_headers,
             0);
 
-        // Ответ на запрос который не получилось распарсить
-        if (parsed <= 0)
-        {
-            LOG_WARNING(logger, "The received http packet could not be processed");
-
-            packet->data = create_error_response(400, "Bad Request");
-            return packet;
-        }
-
-        // Извлечение информации о запросе
-        std::string method_str(method, method_len);
-        std::string path_str(path, path_len);
-
-        // Проверка наличия тела запроса
-        // Но на данный момент это вообше не нужно
-        bool has_body = false;
-        size_t content_length = 0;
-        for (size_t i = 0; i < num_headers; i++)
+        // Тело запроса, если оно указано в Content-Length, должно прийти целиком вместе с заголовками
+        std::string_view body;
+        bool valid = parsed > 0;
+        if (valid)
         {
-            static std::string content_length_header = "Content-Length";
-            std::string header(headers[i].name, headers[i].name_len);
-            header += std::string(headers[i].value, headers[i].value_len);
-
-            if (std::equal(header.begin(), header.end(), content_length_header.begin(), content_length_header.end(),
-                           [](char a, char b)
-                           {
-                               return std::tolower(a) == std::tolower(b);
-                           }))
+            std::string_view content_length = find_header(headers, num_headers, "Content-Length");
+            size_t body_size = 0;
+            if (!content_length.empty())
             {
-                content_length = std::strtoul(headers[i].value, nullptr, 10);
-                has_body = true;
-
-                break;
+                auto [ptr, ec] = std::from_chars(content_length.data(), content_length.data() + content_length.size(), body_size);
+                valid = ec == std::errc{} && ptr == content_length.data() + content_length.size() &&
+                        body_size <= packet->data.size() - parsed;
             }
+            body = {(const char *)packet->data.data() + parsed, body_size};
         }
 
-        if (has_body)
+        // Ответ на запрос который не получилось распарсить
+        if (!valid)
         {
-            size_t body_start = parsed;
-            size_t body_size = packet->data.size() - body_start;
+            LOG_WARNING(logger, "The received http packet could not be processed");
 
-            // Обработка тела сообщения если потребуется
+            response.status = "400 Bad Request";
+            response.content = "Bad Request";
+            render_response(response, packet->data);
+            return packet;
         }
 
-        // Обработка запроса и формирование ответа
-        packet->data = process_request(
-            method_str,
-            path_str,
-            minor_version,
-            headers,
-            num_headers,
-            has_body ? (char *)packet->data.data() + parsed : nullptr,
-            has_body ? content_length : 0);
+        // Обработка запроса и формирование ответа. Ответ не ссылается на буфер пакета, поэтому пишется поверх запроса
+        process_request({method, method_len}, {path, path_len}, minor_version, headers, num_headers, body, response);
+        render_response(response, packet->data);
+        packet->file_body = std::move(response.file_body);
+
+        LOG_DEBUG(logger, "Response on that packet:\n{}", std::string_view{(const char *)packet->data.data(), packet->data.size()});
 
         return packet;
     }
-}
\ No newline at end of file
+}
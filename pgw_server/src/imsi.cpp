@@ -75,6 +75,187 @@ namespace PGW
         return set_IMSI_from_str(imsi_str);
     }
 
+    namespace
+    {
+        // Программа классического BPF с переходами вперед на метки, смещения проставляются в finish
+        class BPF_Program
+        {
+            std::vector<sock_filter> program;
+            // Цели переходов: 0 и больше - сколько инструкций пропустить, меньше 0 - метка
+            std::vector<std::pair<int, int>> targets;
+            std::vector<size_t> labels;
+
+        public:
+            int label()
+            {
+                labels.push_back(0);
+                return -(int)labels.size();
+            }
+            // Метка указывает на следующую добавленную инструкцию
+            void place(int label)
+            {
+                labels[-label - 1] = program.size();
+            }
+
+            void stmt(uint16_t code, uint32_t k)
+            {
+                program.push_back(BPF_STMT(code, k));
+                targets.emplace_back(0, 0);
+            }
+            void jump(uint16_t code, uint32_t k, int jt, int jf)
+            {
+                program.push_back(BPF_JUMP(code, k, 0, 0));
+                targets.emplace_back(jt, jf);
+            }
+
+            std::vector<sock_filter> finish()
+            {
+                for (size_t i = 0; i < program.size(); ++i)
+                {
+                    auto offset = [&](int target) -> uint8_t
+                    {
+                        if (target >= 0)
+                            return (uint8_t)target;
+                        return (uint8_t)(labels[-target - 1] - i - 1);
+                    };
+                    program[i].jt = offset(targets[i].first);
+                    program[i].jf = offset(targets[i].second);
+                }
+                return program;
+            }
+        };
+
+        // Смещение цифр в IE и наибольшее число байт с цифрами (15 цифр и филлер)
+        constexpr uint32_t IE_DIGITS = 4;
+        constexpr uint32_t MAX_DIGIT_BYTES = 8;
+    }
+
+    std::vector<sock_filter> IMSI::socket_filter()
+    {
+        // Фильтр сокета видит датаграмму вместе с UDP заголовком
+        constexpr uint32_t UDP_HEADER = 8;
+        constexpr uint32_t DIGITS = UDP_HEADER + IE_DIGITS;
+
+        BPF_Program program;
+        int accept = program.label(), drop = program.label();
+
+        // От 1 до MAX_DIGIT_BYTES байт с цифрами, X - их число
+        program.stmt(BPF_LD | BPF_W | BPF_LEN, 0);
+        program.jump(BPF_JMP | BPF_JGE | BPF_K, DIGITS + 1, 0, drop);
+        program.jump(BPF_JMP | BPF_JGT | BPF_K, DIGITS + MAX_DIGIT_BYTES, drop, 0);
+        program.stmt(BPF_ALU | BPF_SUB | BPF_K, DIGITS);
+        program.stmt(BPF_MISC | BPF_TAX, 0);
+
+        // Type = 1 и Length равен размеру полезных данных
+        program.stmt(BPF_LD | BPF_B | BPF_ABS, UDP_HEADER);
+        program.jump(BPF_JMP | BPF_JEQ | BPF_K, 1, 0, drop);
+        program.stmt(BPF_LD | BPF_H | BPF_ABS, UDP_HEADER + 1);
+        program.jump(BPF_JMP | BPF_JEQ | BPF_X, 0, 0, drop);
+
+        // Циклов в классическом BPF нет, поэтому проверка полубайтов развернута по каждому возможному байту.
+        // Старший полубайт последнего байта может быть филлером 0xF, а в последнем возможном байте обязан им быть,
+        // иначе цифр 16
+        for (uint32_t i = 0; i < MAX_DIGIT_BYTES; ++i)
+        {
+            if (i != 0)
+            {
+                program.stmt(BPF_MISC | BPF_TXA, 0);
+                program.jump(BPF_JMP | BPF_JEQ | BPF_K, i, accept, 0);
+            }
+
+            program.stmt(BPF_LD | BPF_B | BPF_ABS, DIGITS + i);
+            program.stmt(BPF_ALU | BPF_AND | BPF_K, 0x0F);
+            program.jump(BPF_JMP | BPF_JGT | BPF_K, 9, drop, 0);
+
+            program.stmt(BPF_LD | BPF_B | BPF_ABS, DIGITS + i);
+            program.stmt(BPF_ALU | BPF_RSH | BPF_K, 4);
+            if (i + 1 == MAX_DIGIT_BYTES)
+            {
+                program.jump(BPF_JMP | BPF_JEQ | BPF_K, 0x0F, accept, drop);
+            }
+            else
+            {
+                // Цифра - к следующему байту, филлер допустим только в последнем байте
+                program.jump(BPF_JMP | BPF_JGT | BPF_K, 9, 0, 3);
+                program.jump(BPF_JMP | BPF_JEQ | BPF_K, 0x0F, 0, drop);
+                program.stmt(BPF_MISC | BPF_TXA, 0);
+                program.jump(BPF_JMP | BPF_JEQ | BPF_K, i + 1, accept, drop);
+            }
+        }
+
+        program.place(accept);
+        program.stmt(BPF_RET | BPF_K, 0xFFFFFFFF);
+        program.place(drop);
+        program.stmt(BPF_RET | BPF_K, 0);
+
+        return program.finish();
+    }
+
+    std::vector<sock_filter> IMSI::reuseport_filter(uint32_t sockets, uint32_t shards)
+    {
+        BPF_Program program;
+        int done = program.label(), fallback = program.label();
+
+        // Программе группы SO_REUSEPORT датаграмма видна уже без UDP заголовка.
+        // M[1] - число байт с цифрами, при неверной длине сокет выбирает ядро
+        program.stmt(BPF_LD | BPF_W | BPF_LEN, 0);
+        program.jump(BPF_JMP | BPF_JGE | BPF_K, IE_DIGITS + 1, 0, fallback);
+        program.jump(BPF_JMP | BPF_JGT | BPF_K, IE_DIGITS + MAX_DIGIT_BYTES, fallback, 0);
+        program.stmt(BPF_ALU | BPF_SUB | BPF_K, IE_DIGITS);
+        program.stmt(BPF_ST, 1);
+
+        // M[0] - shard_key: FNV-1a по всем байтам с цифрами, затем свертка старшей половины в младшую
+        program.stmt(BPF_LD | BPF_IMM, SHARD_KEY_BASIS);
+        program.stmt(BPF_ST, 0);
+        for (uint32_t i = 0; i < MAX_DIGIT_BYTES; ++i)
+        {
+            if (i != 0)
+            {
+                program.stmt(BPF_LD | BPF_MEM, 1);
+                program.jump(BPF_JMP | BPF_JEQ | BPF_K, i, done, 0);
+            }
+
+            program.stmt(BPF_LD | BPF_B | BPF_ABS, IE_DIGITS + i);
+            program.stmt(BPF_MISC | BPF_TAX, 0);
+            program.stmt(BPF_LD | BPF_MEM, 0);
+            program.stmt(BPF_ALU | BPF_XOR | BPF_X, 0);
+            program.stmt(BPF_ALU | BPF_MUL | BPF_K, SHARD_KEY_PRIME);
+            program.stmt(BPF_ST, 0);
+        }
+
+        // Номер сокета - владелец шарда этого IMSI
+        program.place(done);
+        program.stmt(BPF_LD | BPF_MEM, 0);
+        program.stmt(BPF_ALU | BPF_RSH | BPF_K, 16);
+        program.stmt(BPF_MISC | BPF_TAX, 0);
+        program.stmt(BPF_LD | BPF_MEM, 0);
+        program.stmt(BPF_ALU | BPF_XOR | BPF_X, 0);
+        program.stmt(BPF_ALU | BPF_MOD | BPF_K, shards);
+        program.stmt(BPF_ALU | BPF_MOD | BPF_K, sockets);
+        program.stmt(BPF_RET | BPF_A, 0);
+
+        // Номер вне группы: ядро выбирает сокет по хешу адресов
+        program.place(fallback);
+        program.stmt(BPF_RET | BPF_K, 0xFFFFFFFF);
+
+        return program.finish();
+    }
+
+    uint32_t IMSI::shard_key() const noexcept
+    {
+        // Байты BCD как в IE: младший полубайт - первая цифра пары, незанятый старший - филлер 0xF
+        uint32_t key = SHARD_KEY_BASIS;
+        for (size_t i = 0; i < imsi.size(); i += 2)
+        {
+            uint32_t low = imsi[i] - '0';
+            uint32_t high = i + 1 < imsi.size() ? imsi[i + 1] - '0' : 0xF;
+            key = (key ^ (high << 4 | low)) * SHARD_KEY_PRIME;
+        }
+
+        // Номер шарда - младшие биты ключа, в них подмешиваются старшие
+        return key ^ (key >> 16);
+    }
+
     std::string IMSI::get_IMSI_to_str() const
     {
         return imsi;
@@ -1,4 +1,6 @@
 #include <cctype>
+#include <functional>
+#include <optional>
 #include <thread>
 #include <mutex>
 #include <shared_mutex>
@@ -10,13 +12,24 @@
 #include <iomanip>
 
 #include "pgw_config.h"
+#include "cdr_history.h"
 #include "cdr_journal.h"
+#include "core_worker.h"
 #include "session_storage.h"
 #include "handler.h"
 
+#include <codel.h>
+#include <coarse_clock.h>
 #include <io_worker.h>
+#include <latency.h>
+#include <log_throttle.h>
+#include <metrics.h>
 #include <network_io.h>
+#include <perf_profiler.h>
+#include <probes.h>
 #include <queue.h>
+#include <thread_placement.h>
+#include <trace.h>
 
 #include <quill/Backend.h>
 #include <quill/Frontend.h>
@@ -26,6 +39,24 @@
 
 using namespace PGW;
 
+static const IO_Utils::Metrics::Id udp_out_drops = IO_Utils::Metrics::counter("pgw_queue_drops_total", "Packets dropped because the queue was full", "queue=\"udp_out\"");
+static const IO_Utils::Metrics::Id http_out_drops = IO_Utils::Metrics::counter("pgw_queue_drops_total", "Packets dropped because the queue was full", "queue=\"http_out\"");
+static const IO_Utils::Metrics::Id udp_shed_stale = IO_Utils::Metrics::counter("pgw_overload_shed_total", "UDP requests answered busy because of udp_in queue delay", "stage=\"stale\"");
+
+// Ожидание запроса из выборки трассировки во входной очереди
+static void trace_dequeued(const IO_Utils::Packet &packet, const char *queue, IO_Utils::Tracer::Track track)
+{
+    if (packet.trace.id != 0)
+        IO_Utils::Tracer::record(queue, packet.trace.id, packet.trace.handoff_ns, IO_Utils::Tracer::now_ns(), track);
+}
+
+// Начало ожидания ответа в выходной очереди
+static void trace_handoff(IO_Utils::Packet &packet)
+{
+    if (packet.trace.id != 0)
+        packet.trace.handoff_ns = IO_Utils::Tracer::now_ns();
+}
+
 void process(std::atomic<bool> &stop,
              IO_Utils::Queue<IO_Utils::Packet> &http_in_queue,
              IO_Utils::Queue<IO_Utils::Packet> &udp_in_queue,
@@ -33,41 +64,87 @@ void process(std::atomic<bool> &stop,
              IO_Utils::Queue<IO_Utils::Packet> &udp_out_queue,
              const std::unordered_set<IMSI> blacklist,
              std::shared_ptr<ISession_Storage> session_storage,
+             std::shared_ptr<CDR_History> cdr_history,
+             bool profiling_enabled,
+             std::string trace_file,
+             IO_Utils::Codel_Controller *overload_control,
              quill::Logger *logger)
 {
+    IO_Utils::Perf_Profiler::Thread_Registration profiler_registration{"processing"};
 
     Handler handler{};
     UDP_Handler udp_handler{blacklist, session_storage, logger};
-    HTTP_Handler http_handler{session_storage, stop, logger};
+    HTTP_Handler http_handler{session_storage, stop, logger, cdr_history, profiling_enabled, trace_file};
+    // При перегрузке сообщение о переполнении повторялось бы на каждый пакет
+    IO_Utils::Log_Throttle udp_out_full_log{"The UDP out_queue is FULL"};
+    IO_Utils::Log_Throttle http_out_full_log{"The HTTP out_queue is FULL"};
+    const std::vector<uint8_t> busy_response = UDP_Handler::busy_response();
 
     bool res = false;
     // А этот цикл остановим сразу, чтобы не порождал еще ответы на запросы после /stop
     while (!stop.load())
     {
         std::unique_ptr<IO_Utils::Packet> packet = udp_in_queue.pop();
+        if (packet == nullptr && overload_control != nullptr)
+            overload_control->queue_empty();
 
         if (packet != nullptr)
         {
+            // Запрос, слишком долго ждавший в очереди, получает отказ без обработки
+            bool shed = false;
+            if (overload_control != nullptr)
+            {
+                int64_t now = IO_Utils::Packet_Latency::now_ns();
+                packet->timestamps.dequeued_ns = now;
+                shed = !overload_control->admit(now - packet->timestamps.enqueued_ns, now);
+            }
+            else
+            {
+                IO_Utils::Packet_Latency::stamp(packet->timestamps.dequeued_ns);
+            }
+            trace_dequeued(*packet, "udp_in_queue", IO_Utils::Tracer::udp_in_queue);
+            // Участки обработчика, хранилища и журнала относятся к этому запросу
+            IO_Utils::Tracer::Scope trace_scope{packet->trace.id};
             LOG_DEBUG(logger, "Received UDP packet\n{}", vec_to_str(packet->data));
 
-            if (typeid(*packet.get()) == typeid(IO_Utils::UDP_Packet))
+            if (shed)
+            {
+                IO_Utils::Metrics::add(udp_shed_stale);
+                packet->data = busy_response;
+
+                res = udp_out_queue.push(std::move(packet));
+                if (!res)
+                {
+                    IO_Utils::Metrics::add(udp_out_drops);
+                    IO_UTILS_PROBE(queue_full, "udp_out", 0, 0);
+                }
+            }
+            else if (typeid(*packet.get()) == typeid(IO_Utils::UDP_Packet))
             {
                 packet = udp_handler.handle_packet(std::move(packet));
+                IO_Utils::Packet_Latency::stamp(packet->timestamps.handled_ns);
+                trace_handoff(*packet);
 
                 res = udp_out_queue.push(std::move(packet));
                 if (!res)
                 {
-                    LOG_WARNING(logger, "The UDP out_queue is FULL");
+                    IO_Utils::Metrics::add(udp_out_drops);
+                    IO_UTILS_PROBE(queue_full, "udp_out", 0, 0);
+                    IO_UTILS_LOG_THROTTLED(udp_out_full_log, LOG_WARNING, logger, "The UDP out_queue is FULL");
                 }
             }
             else
             {
                 packet = handler.handle_packet(std::move(packet));
+                IO_Utils::Packet_Latency::stamp(packet->timestamps.handled_ns);
+                trace_handoff(*packet);
 
                 res = udp_out_queue.push(std::move(packet));
                 if (!res)
                 {
-                    LOG_DEBUG(logger, "The UDP out_queue is FULL");
+                    IO_Utils::Metrics::add(udp_out_drops);
+                    IO_UTILS_PROBE(queue_full, "udp_out", 0, 0);
+                    IO_UTILS_LOG_THROTTLED(udp_out_full_log, LOG_DEBUG, logger, "The UDP out_queue is FULL");
                 }
             }
         }
@@ -76,30 +153,115 @@ void process(std::atomic<bool> &stop,
 
         if (packet != nullptr)
         {
+            IO_Utils::Packet_Latency::stamp(packet->timestamps.dequeued_ns);
+            trace_dequeued(*packet, "http_in_queue", IO_Utils::Tracer::http_in_queue);
+            IO_Utils::Tracer::Scope trace_scope{packet->trace.id};
             if (typeid(*packet.get()) == typeid(IO_Utils::HTTP_Packet))
             {
                 packet = http_handler.handle_packet(std::move(packet));
+                IO_Utils::Packet_Latency::stamp(packet->timestamps.handled_ns);
+                trace_handoff(*packet);
 
                 res = http_out_queue.push(std::move(packet));
                 if (!res)
                 {
-                    LOG_WARNING(logger, "The HTTP out_queue is FULL");
+                    IO_Utils::Metrics::add(http_out_drops);
+                    IO_UTILS_PROBE(queue_full, "http_out", 0, 0);
+                    IO_UTILS_LOG_THROTTLED(http_out_full_log, LOG_WARNING, logger, "The HTTP out_queue is FULL");
                 }
             }
             else
             {
                 packet = handler.handle_packet(std::move(packet));
+                IO_Utils::Packet_Latency::stamp(packet->timestamps.handled_ns);
+                trace_handoff(*packet);
 
                 res = http_out_queue.push(std::move(packet));
                 if (!res)
                 {
-                    LOG_DEBUG(logger, "The HTTP out_queue is FULL");
+                    IO_Utils::Metrics::add(http_out_drops);
+                    IO_UTILS_PROBE(queue_full, "http_out", 0, 0);
+                    IO_UTILS_LOG_THROTTLED(http_out_full_log, LOG_DEBUG, logger, "The HTTP out_queue is FULL");
                 }
             }
         }
     }
 }
 
+// Приемный буфер и фильтр UDP сокета, общие для конвейеров (IO_Worker) и ядер режима thread_per_core (Core_Worker)
+template <typename Worker>
+static void configure_udp_socket(Worker &worker, const Config &server_config, quill::Logger *logger)
+{
+    if (server_config.udp_receive_buffer_bytes != 0)
+    {
+        int receive_buffer = worker.set_udp_receive_buffer((int)server_config.udp_receive_buffer_bytes);
+        if (receive_buffer < 0)
+            LOG_WARNING(logger, "Can't set UDP receive buffer to {} bytes, errno = {}", server_config.udp_receive_buffer_bytes, errno);
+        else
+            LOG_INFO(logger, "UDP receive buffer is {} bytes (requested {})", receive_buffer, server_config.udp_receive_buffer_bytes);
+    }
+
+    // Некорректные датаграммы отбрасываются в ядре и не доходят до очередей, отказ им не отправляется
+    if (server_config.udp_socket_filter)
+    {
+        if (worker.set_udp_socket_filter(IMSI::socket_filter()) < 0)
+            LOG_WARNING(logger, "Can't attach UDP socket filter, errno = {}", errno);
+        else
+            LOG_INFO(logger, "UDP socket filter attached");
+    }
+}
+
+// Настройки UDP сокета и защиты очереди, общие для всех UDP конвейеров
+static void configure_udp(IO_Utils::IO_Worker &io_worker, const Config &server_config,
+                          IO_Utils::Codel_Controller *overload_control, quill::Logger *logger)
+{
+    // Всплеск сверх udp_high_watermark копится в приемном буфере ядра, а его переполнение видно в pgw_udp_kernel_drops_total
+    io_worker.set_udp_flow_control(server_config.udp_high_watermark, server_config.udp_low_watermark);
+    configure_udp_socket(io_worker, server_config, logger);
+
+    if (overload_control != nullptr)
+        io_worker.set_overload_control(overload_control, UDP_Handler::busy_response());
+}
+
+// Поток роли: имя видно в top -H, ps -L и perf, поток закрепляется за cpus (пустой список - не закрепляется)
+template <typename Function, typename... Args>
+static std::thread start_thread(const std::string &name, const std::vector<int> &cpus, quill::Logger *logger,
+                                Function function, Args &&...args)
+{
+    return std::thread(
+        [name, cpus, logger, function](auto &&...thread_args)
+        {
+            IO_Utils::Thread_Placement::set_name(name);
+            if (IO_Utils::Thread_Placement::pin(cpus) != 0)
+                LOG_WARNING(logger, "Can't pin thread {}, errno = {}", name, errno);
+            std::invoke(function, thread_args...);
+        },
+        std::forward<Args>(args)...);
+}
+
+// Входит в Scope размещения для создания объектов потока name и, как start_thread, сообщает о неудачном закреплении
+static void enter_placement(std::optional<IO_Utils::Thread_Placement::Scope> &scope, const std::vector<int> &cpus, bool numa_local,
+                            const std::string &name, quill::Logger *logger)
+{
+    scope.emplace(cpus, numa_local);
+    if (scope->pin_error() != 0)
+        LOG_WARNING(logger, "Can't pin to CPUs of thread {}, errno = {}", name, scope->pin_error());
+}
+
+// Дополнительный UDP конвейер (udp_workers > 1): свой сокет в группе SO_REUSEPORT, IO поток и поток обработки.
+// HTTP обслуживает только основной конвейер, очереди HTTP здесь остаются пустыми
+struct UDP_Pipeline
+{
+    IO_Utils::Queue<IO_Utils::Packet> http_in_queue{1};
+    IO_Utils::Queue<IO_Utils::Packet> udp_in_queue{10000};
+    IO_Utils::Queue<IO_Utils::Packet> http_out_queue{1};
+    IO_Utils::Queue<IO_Utils::Packet> udp_out_queue{10000};
+
+    std::unique_ptr<IO_Utils::IO_Worker> io_worker;
+    std::unique_ptr<IO_Utils::Codel_Controller> overload_control;
+    std::thread io_worker_thread, process_thread;
+};
+
 int main()
 {
     std::unique_ptr<Config> server_config;
@@ -123,7 +285,16 @@ int main()
     std::atomic<quill::LogLevel> log_level;
     log_level.store(server_config->log_level);
 
-    quill::Backend::start();
+    // Размещение читается только при запуске, try_reload его не меняет
+    const Thread_Placement_Config placement = server_config->thread_placement;
+    // Закрепление, с которым запущен процесс: его получает поток очистки без своего списка CPU
+    const std::vector<int> process_affinity = IO_Utils::Thread_Placement::affinity();
+
+    quill::BackendOptions backend_options;
+    backend_options.thread_name = "pgw-logger";
+    if (!placement.logger.empty())
+        backend_options.cpu_affinity = (uint16_t)placement.logger[0];
+    quill::Backend::start(backend_options);
 
     // Создается rotation file sink, чтобы создавать новые лог файлы при переполнении старых (8 МБ) или по истечении таймаута (1 час)
     auto rotating_file_sink = quill::Frontend::create_or_get_sink<quill::RotatingFileSink>(
@@ -178,21 +349,47 @@ int main()
         }
     }
 
+    // Очереди и таблицы создаются под Scope с CPU потока, который будет с ними работать,
+    // так при numa_local их память оказывается на его узле NUMA
+    using IO_Utils::Thread_Placement;
+    std::optional<Thread_Placement::Scope> placement_scope;
+    enter_placement(placement_scope, Thread_Placement::pick(placement.process, 0), placement.numa_local, "pgw-process", logger);
+
     // Кажется это называется Lock-Free SPSC Queue, момент в том, что пользоваться такой очередью должны только два потока, один читает, а второй - пишет
     IO_Utils::Queue<IO_Utils::Packet> http_in_queue{1000};
     IO_Utils::Queue<IO_Utils::Packet> udp_in_queue{10000};
     IO_Utils::Queue<IO_Utils::Packet> http_out_queue{1000};
     IO_Utils::Queue<IO_Utils::Packet> udp_out_queue{10000};
 
+    placement_scope.reset();
+
     std::atomic<bool> stop = false;
 
+    // Грубые часы для хранилища сессий и CDR журнала, дополнительно обновляются IO потоком раз в пачку событий
+    IO_Utils::Coarse_Clock::Ticker clock_ticker{std::chrono::milliseconds(server_config->clock_precision_ms)};
+
+    // Защита udp_in_queue от перегрузки: отказы по времени ожидания в очереди, у каждого конвейера своя
+    auto make_overload_control = [&server_config]() -> std::unique_ptr<IO_Utils::Codel_Controller>
+    {
+        if (!server_config->overload_control)
+            return nullptr;
+        return std::make_unique<IO_Utils::Codel_Controller>(IO_Utils::Codel_Controller::Options{
+            std::chrono::milliseconds(server_config->overload_target_ms),
+            std::chrono::milliseconds(server_config->overload_interval_ms)});
+    };
+
+    // В режиме thread_per_core UDP принимают ядра, а основной конвейер обслуживает только HTTP
+    bool thread_per_core = server_config->thread_per_core;
+    // Номер сокета в группе SO_REUSEPORT - порядок привязки, поэтому основной конвейер создается первым
+    bool udp_reuse_port = !thread_per_core && server_config->udp_workers > 1;
+
     IO_Utils::IO_Worker *io_worker;
     try
     {
         io_worker = new IO_Utils::IO_Worker(
-            server_config->udp_ip, server_config->udp_port,
+            thread_per_core ? "" : server_config->udp_ip, server_config->udp_port,
             server_config->http_ip, server_config->http_port,
-            logger);
+            logger, udp_reuse_port);
     }
     catch (const std::exception &e)
     {
@@ -200,30 +397,288 @@ int main()
         return -1;
     }
 
-    std::thread io_worker_thread(
-        &IO_Utils::IO_Worker::run, std::ref(io_worker),
+    std::unique_ptr<IO_Utils::Codel_Controller> overload_control;
+    if (!thread_per_core)
+    {
+        overload_control = make_overload_control();
+        configure_udp(*io_worker, *server_config, overload_control.get(), logger);
+    }
+
+    std::vector<std::unique_ptr<UDP_Pipeline>> udp_pipelines;
+    for (size_t i = 1; !thread_per_core && i < server_config->udp_workers; ++i)
+    {
+        enter_placement(placement_scope, Thread_Placement::pick(placement.process, i), placement.numa_local,
+                        "pgw-process-" + std::to_string(i), logger);
+        std::unique_ptr<UDP_Pipeline> pipeline = std::make_unique<UDP_Pipeline>();
+        placement_scope.reset();
+        try
+        {
+            pipeline->io_worker = std::make_unique<IO_Utils::IO_Worker>(
+                server_config->udp_ip, server_config->udp_port,
+                "", 0,
+                logger, true);
+        }
+        catch (const std::exception &e)
+        {
+            LOG_ERROR(logger, "Can't create UDP pipeline {}: {}", i, e.what());
+            stop.store(true);
+            return -1;
+        }
+
+        pipeline->overload_control = make_overload_control();
+        configure_udp(*pipeline->io_worker, *server_config, pipeline->overload_control.get(), logger);
+        udp_pipelines.push_back(std::move(pipeline));
+    }
+
+    // Программа группы выбирает конвейер-владелец шарда IMSI, тогда шард блокируют только его поток
+    // обработки, очистка и HTTP запросы. Без нее ядро распределяет датаграммы по хешу адресов
+    if (udp_reuse_port && server_config->udp_steering)
+    {
+        if (io_worker->set_udp_steering_filter(IMSI::reuseport_filter((uint32_t)server_config->udp_workers, Session_Storage::amount_of_shards)) < 0)
+            LOG_WARNING(logger, "Can't attach UDP steering filter, errno = {}", errno);
+        else
+            LOG_INFO(logger, "UDP packets are steered by IMSI across {} workers", server_config->udp_workers);
+    }
+
+    // Если журнал не создастся, выдаст запись в лог с уровнем INFO
+    CDR_Journal cdr_log{server_config->cdr_file, server_config->cdr_file_max_lines, logger, server_config->cdr_options};
+
+    // Устаревшие сессии в режиме thread_per_core удаляют ядра-владельцы шардов.
+    // Поток очистки запускается внутри Scope и без своего списка CPU возвращается к закреплению процесса.
+    // В режиме thread_per_core каждый шард создается под Scope CPU своего ядра-владельца, в режиме конвейеров
+    // с шардами работают все потоки обработки, и они остаются в размещении основного
+    std::vector<std::vector<int>> shard_cpus;
+    for (size_t i = 0; thread_per_core && i < Session_Storage::amount_of_shards; ++i)
+    {
+        shard_cpus.push_back(Thread_Placement::pick(placement.cores, Core_Worker::shard_owner(i, server_config->udp_workers)));
+    }
+    enter_placement(placement_scope, Thread_Placement::pick(thread_per_core ? placement.cores : placement.process, 0), placement.numa_local,
+                    thread_per_core ? "pgw-core-0" : "pgw-process", logger);
+    std::shared_ptr<Session_Storage> storage = std::make_shared<Session_Storage>(
+        session_timeout_sec, gracefull_shutdown_rate,
+        cdr_log, blacklist, logger, stop, !thread_per_core,
+        placement.cleanup.empty() ? process_affinity : placement.cleanup,
+        shard_cpus, placement.numa_local);
+    placement_scope.reset();
+    std::shared_ptr<ISession_Storage> session_storage = storage;
+
+    // Ядра создаются по порядку: номер сокета в группе SO_REUSEPORT совпадает с номером ядра
+    std::vector<std::unique_ptr<Core_Worker>> cores;
+    for (size_t i = 0; thread_per_core && i < server_config->udp_workers; ++i)
+    {
+        enter_placement(placement_scope, Thread_Placement::pick(placement.cores, i), placement.numa_local,
+                        "pgw-core-" + std::to_string(i), logger);
+        try
+        {
+            cores.push_back(std::make_unique<Core_Worker>(
+                server_config->udp_ip, server_config->udp_port,
+                i, server_config->udp_workers,
+                blacklist, storage, logger));
+        }
+        catch (const std::exception &e)
+        {
+            LOG_CRITICAL(logger, "Can't create core {}: {}", i, e.what());
+            stop.store(true);
+            return -1;
+        }
+        placement_scope.reset();
+
+        // Очереди нет, поэтому нет и приостановки чтения и отказов по задержке в ней: запросы ждут в приемном буфере
+        configure_udp_socket(*cores.back(), *server_config, logger);
+    }
+
+    if (cores.size() > 1)
+    {
+        if (cores[0]->set_udp_steering_filter(IMSI::reuseport_filter((uint32_t)cores.size(), Session_Storage::amount_of_shards)) < 0)
+            LOG_WARNING(logger, "Can't attach UDP steering filter, errno = {}", errno);
+        else
+            LOG_INFO(logger, "UDP packets are steered by IMSI across {} cores", cores.size());
+    }
+
+    // HTTP поиски сессий уходят ядрам-владельцам шардов через их каналы
+    if (thread_per_core)
+    {
+        std::vector<Core_Worker *> core_pointers;
+        for (auto &core : cores)
+        {
+            core_pointers.push_back(core.get());
+        }
+        session_storage = std::make_shared<Core_Session_Storage>(storage, std::move(core_pointers), logger);
+    }
+
+    // Поток k роли закрепляется за k-м CPU ее списка (по кругу)
+    std::thread io_worker_thread = start_thread(
+        "pgw-io", Thread_Placement::pick(placement.io, 0), logger,
+        &IO_Utils::IO_Worker::run, io_worker,
         std::ref(stop),
         std::ref(http_in_queue), std::ref(udp_in_queue),
         std::ref(http_out_queue), std::ref(udp_out_queue));
+    for (size_t i = 0; i < udp_pipelines.size(); ++i)
+    {
+        UDP_Pipeline *pipeline = udp_pipelines[i].get();
+        pipeline->io_worker_thread = start_thread(
+            "pgw-io-" + std::to_string(i + 1), Thread_Placement::pick(placement.io, i + 1), logger,
+            &IO_Utils::IO_Worker::run, pipeline->io_worker.get(),
+            std::ref(stop),
+            std::ref(pipeline->http_in_queue), std::ref(pipeline->udp_in_queue),
+            std::ref(pipeline->http_out_queue), std::ref(pipeline->udp_out_queue));
+    }
 
-    // Если журнал не создастся, выдаст запись в лог с уровнем INFO
-    CDR_Journal cdr_log{server_config->cdr_file, server_config->cdr_file_max_lines, logger};
-
-    std::shared_ptr<ISession_Storage> session_storage = std::make_shared<Session_Storage>(
-        session_timeout_sec, gracefull_shutdown_rate,
-        cdr_log, blacklist, logger, stop);
+    std::vector<std::thread> core_threads;
+    for (size_t i = 0; i < cores.size(); ++i)
+    {
+        core_threads.push_back(start_thread(
+            "pgw-core-" + std::to_string(i), Thread_Placement::pick(placement.cores, i), logger,
+            &Core_Worker::run, cores[i].get(), std::ref(stop)));
+    }
 
-    std::thread process_thread(
+    // Значения для /metrics, которые снимаются в момент запроса, счетчики горячего пути регистрируются в своих модулях
+    using IO_Utils::Metrics;
+    Metrics::Collector queue_depth_metric{"pgw_queue_depth", "Packets waiting in the queue", "gauge", [&](Metrics::Samples &samples)
+                                          {
+                                              samples.emplace_back("queue=\"udp_in\"", udp_in_queue.size());
+                                              samples.emplace_back("queue=\"http_in\"", http_in_queue.size());
+                                              samples.emplace_back("queue=\"udp_out\"", udp_out_queue.size());
+                                              samples.emplace_back("queue=\"http_out\"", http_out_queue.size());
+                                              // Очереди HTTP дополнительных конвейеров всегда пусты
+                                              for (size_t i = 0; i < udp_pipelines.size(); ++i)
+                                              {
+                                                  std::string worker = ",worker=\"" + std::to_string(i + 1) + "\"";
+                                                  samples.emplace_back("queue=\"udp_in\"" + worker, udp_pipelines[i]->udp_in_queue.size());
+                                                  samples.emplace_back("queue=\"udp_out\"" + worker, udp_pipelines[i]->udp_out_queue.size());
+                                              }
+                                          }};
+    Metrics::Collector sessions_metric{"pgw_sessions", "Active sessions per storage shard", "gauge", [&storage](Metrics::Samples &samples)
+                                       {
+                                           std::vector<size_t> sizes = storage->shard_sizes();
+                                           for (size_t i = 0; i < sizes.size(); ++i)
+                                           {
+                                               samples.emplace_back("shard=\"" + std::to_string(i) + "\"", sizes[i]);
+                                           }
+                                       }};
+    // Статистика блокировок шардов, подробности (удержание, места ожидания) - в /lock_stats
+    auto lock_metric = [&storage](Metrics::Samples &samples, auto value)
+    {
+        std::vector<IO_Utils::Lock_Stats> stats = storage->lock_stats();
+        for (size_t i = 0; i < stats.size(); ++i)
+        {
+            samples.emplace_back("shard=\"" + std::to_string(i) + "\",mode=\"exclusive\"", value(stats[i].exclusive));
+            samples.emplace_back("shard=\"" + std::to_string(i) + "\",mode=\"shared\"", value(stats[i].shared));
+        }
+    };
+    Metrics::Collector lock_acquisitions_metric{"pgw_shard_lock_acquisitions_total", "Session storage shard lock acquisitions", "counter", [&](Metrics::Samples &samples)
+                                                { lock_metric(samples, [](const IO_Utils::Lock_Stats::Mode &mode)
+                                                              { return (double)mode.acquisitions; }); }};
+    Metrics::Collector lock_contended_metric{"pgw_shard_lock_contended_total", "Session storage shard lock acquisitions that had to wait", "counter", [&](Metrics::Samples &samples)
+                                             { lock_metric(samples, [](const IO_Utils::Lock_Stats::Mode &mode)
+                                                           { return (double)mode.contended; }); }};
+    Metrics::Collector lock_wait_metric{"pgw_shard_lock_wait_seconds_total", "Time spent waiting for session storage shard locks", "counter", [&](Metrics::Samples &samples)
+                                        { lock_metric(samples, [](const IO_Utils::Lock_Stats::Mode &mode)
+                                                      { return mode.wait_ns / 1e9; }); }};
+    Metrics::Collector cdr_written_metric{"pgw_cdr_records_written_total", "CDR records written to the journal file", "counter", [&cdr_log](Metrics::Samples &samples)
+                                          { samples.emplace_back("", cdr_log.written_records()); }};
+    Metrics::Collector cdr_dropped_metric{"pgw_cdr_records_dropped_total", "CDR records dropped because the journal queue was full", "counter", [&cdr_log](Metrics::Samples &samples)
+                                          { samples.emplace_back("", cdr_log.dropped_records()); }};
+    Metrics::Collector cdr_lost_metric{"pgw_cdr_records_lost_total", "CDR records lost because the journal file could not be created or written", "counter", [&cdr_log](Metrics::Samples &samples)
+                                       { samples.emplace_back("", cdr_log.lost_records()); }};
+    Metrics::Collector cdr_durable_metric{"pgw_cdr_records_durable_total", "CDR records covered by fdatasync", "counter", [&cdr_log](Metrics::Samples &samples)
+                                          { samples.emplace_back("", cdr_log.durable_records()); }};
+    Metrics::Collector cdr_rotations_metric{"pgw_cdr_rotations_total", "CDR journal file rotations", "counter", [&cdr_log](Metrics::Samples &samples)
+                                            { samples.emplace_back("", cdr_log.rotation_count()); }};
+    Metrics::Collector latency_metric{"pgw_packet_latency_seconds", "Packet latency per processing stage, from receive to response sent", "summary", IO_Utils::Packet_Latency::collect};
+    // Состояние основного конвейера без метки, дополнительных - с меткой worker
+    auto udp_worker_metric = [&](Metrics::Samples &samples, auto value)
+    {
+        value(samples, std::string{}, *io_worker, overload_control.get());
+        for (size_t i = 0; i < udp_pipelines.size(); ++i)
+        {
+            value(samples, "worker=\"" + std::to_string(i + 1) + "\"", *udp_pipelines[i]->io_worker, udp_pipelines[i]->overload_control.get());
+        }
+    };
+    Metrics::Collector udp_paused_metric{"pgw_udp_receive_paused", "1 while UDP socket reading is paused because udp_in is above the high watermark", "gauge", [&](Metrics::Samples &samples)
+                                         { udp_worker_metric(samples, [](Metrics::Samples &samples, std::string labels, IO_Utils::IO_Worker &worker, IO_Utils::Codel_Controller *)
+                                                             { samples.emplace_back(std::move(labels), worker.udp_reading_paused() ? 1 : 0); }); }};
+    // Отказы по перегрузке считаются в pgw_overload_shed_total, здесь - состояние защиты
+    Metrics::Collector overload_delay_metric{"pgw_udp_in_queue_delay_seconds", "Time the last request taken from udp_in waited in the queue (with overload control)", "gauge", [&](Metrics::Samples &samples)
+                                             { udp_worker_metric(samples, [](Metrics::Samples &samples, std::string labels, IO_Utils::IO_Worker &, IO_Utils::Codel_Controller *control)
+                                                                 {
+                                                                     if (control != nullptr)
+                                                                         samples.emplace_back(std::move(labels), control->last_sojourn_ns() / 1e9);
+                                                                 }); }};
+    Metrics::Collector overload_state_metric{"pgw_overload_shedding", "1 while udp_in has not been empty for longer than the overload interval", "gauge", [&](Metrics::Samples &samples)
+                                             { udp_worker_metric(samples, [](Metrics::Samples &samples, std::string labels, IO_Utils::IO_Worker &, IO_Utils::Codel_Controller *control)
+                                                                 {
+                                                                     if (control != nullptr)
+                                                                         samples.emplace_back(std::move(labels), control->overloaded() ? 1 : 0);
+                                                                 }); }};
+    // Нагрузка на ядра режима thread_per_core: перекос виден как разница между ними
+    Metrics::Collector core_requests_metric{"pgw_core_udp_requests_total", "UDP requests handled by the core (thread_per_core)", "counter", [&cores](Metrics::Samples &samples)
+                                            {
+                                                for (size_t i = 0; i < cores.size(); ++i)
+                                                {
+                                                    samples.emplace_back("core=\"" + std::to_string(i) + "\"", cores[i]->requests());
+                                                }
+                                            }};
+    Metrics::Collector core_lookups_metric{"pgw_core_lookups_total", "HTTP session lookups served by the core (thread_per_core)", "counter", [&cores](Metrics::Samples &samples)
+                                           {
+                                               for (size_t i = 0; i < cores.size(); ++i)
+                                               {
+                                                   samples.emplace_back("core=\"" + std::to_string(i) + "\"", cores[i]->lookups_served());
+                                               }
+                                           }};
+
+    // Поиск по файлам журнала для /cdr, только читает их
+    std::shared_ptr<CDR_History> cdr_history = std::make_shared<CDR_History>(server_config->cdr_file, server_config->cdr_options.format);
+
+    std::thread process_thread = start_thread(
+        "pgw-process", Thread_Placement::pick(placement.process, 0), logger,
         process,
         std::ref(stop),
         std::ref(http_in_queue), std::ref(udp_in_queue),
         std::ref(http_out_queue), std::ref(udp_out_queue),
         blacklist,
         std::ref(session_storage),
+        cdr_history,
+        server_config->profiling_enabled,
+        server_config->trace_file,
+        overload_control.get(),
         logger);
+    for (size_t i = 0; i < udp_pipelines.size(); ++i)
+    {
+        UDP_Pipeline *pipeline = udp_pipelines[i].get();
+        pipeline->process_thread = start_thread(
+            "pgw-process-" + std::to_string(i + 1), Thread_Placement::pick(placement.process, i + 1), logger,
+            process,
+            std::ref(stop),
+            std::ref(pipeline->http_in_queue), std::ref(pipeline->udp_in_queue),
+            std::ref(pipeline->http_out_queue), std::ref(pipeline->udp_out_queue),
+            blacklist,
+            session_storage,
+            cdr_history,
+            server_config->profiling_enabled,
+            server_config->trace_file,
+            pipeline->overload_control.get(),
+            logger);
+    }
+
+    // Основной поток дальше только перечитывает конфигурацию и пишет сводки. Имя ему не меняется:
+    // имя главного потока - это имя процесса в ps и top
+    if (Thread_Placement::pin(placement.config_reload) != 0)
+        LOG_WARNING(logger, "Can't pin config reload thread, errno = {}", errno);
 
+    // Сводка по задержкам в лог раз в latency_log_interval_sec, основной цикл идет с шагом в секунду
+    size_t latency_log_ticks = 0;
     while (!stop.load())
     {
+        if (server_config->latency_log_interval_sec != 0 && ++latency_log_ticks >= server_config->latency_log_interval_sec)
+        {
+            latency_log_ticks = 0;
+
+            std::string latency_summary = IO_Utils::Packet_Latency::summary();
+            if (!latency_summary.empty())
+                LOG_INFO(logger, "Packet latency: {}", latency_summary);
+        }
+
         try
         {
             if (server_config->try_reload())
@@ -250,6 +705,15 @@ int main()
 
     process_thread.join();
     io_worker_thread.join();
+    for (auto &pipeline : udp_pipelines)
+    {
+        pipeline->process_thread.join();
+        pipeline->io_worker_thread.join();
+    }
+    for (auto &core_thread : core_threads)
+    {
+        core_thread.join();
+    }
 
     delete io_worker;
 
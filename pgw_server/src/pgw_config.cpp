@@ -57,10 +57,150 @@ namespace PGW
         if (temp_cdr_file_max_lines < 1000)
             throw std::invalid_argument("CDR journal too short (min 1000 lines)");
 
+        CDR_Journal_Options temp_cdr_options;
+
+        temp_cdr_options.queue_size = json_config->value("cdr_queue_size", temp_cdr_options.queue_size);
+        if (temp_cdr_options.queue_size < 1024)
+            throw std::invalid_argument("CDR queue too short (min 1024 records)");
+
+        temp_cdr_options.streams = json_config->value("cdr_streams", temp_cdr_options.streams);
+        if (temp_cdr_options.streams == 0 || temp_cdr_options.streams > 64)
+            throw std::invalid_argument("CDR streams out of range (1..64)");
+
+        std::string temp_cdr_overflow_policy = json_config->value("cdr_overflow_policy", "block");
+        static std::unordered_map<std::string, CDR_Overflow_Policy> cdr_overflow_policies{
+            {"block", CDR_Overflow_Policy::block},
+            {"drop", CDR_Overflow_Policy::drop}};
+
+        if (!cdr_overflow_policies.contains(temp_cdr_overflow_policy))
+            throw std::invalid_argument("Wrong CDR overflow policy");
+        temp_cdr_options.overflow_policy = cdr_overflow_policies.at(temp_cdr_overflow_policy);
+
+        size_t temp_cdr_flush_interval_ms = json_config->value("cdr_flush_interval_ms", 10);
+        if (temp_cdr_flush_interval_ms == 0 || temp_cdr_flush_interval_ms > 1000)
+            throw std::invalid_argument("CDR flush interval out of range (1..1000 ms)");
+        temp_cdr_options.flush_interval = std::chrono::milliseconds(temp_cdr_flush_interval_ms);
+
+        std::string temp_cdr_format = json_config->value("cdr_format", "csv");
+        static std::unordered_map<std::string, CDR_Format> cdr_formats{
+            {"csv", CDR_Format::csv},
+            {"binary", CDR_Format::binary}};
+
+        if (!cdr_formats.contains(temp_cdr_format))
+            throw std::invalid_argument("Wrong CDR format");
+        temp_cdr_options.format = cdr_formats.at(temp_cdr_format);
+
+        std::string temp_cdr_mode = json_config->value("cdr_mode", "per_event");
+        static std::unordered_map<std::string, CDR_Mode> cdr_modes{
+            {"per_event", CDR_Mode::per_event},
+            {"aggregated", CDR_Mode::aggregated}};
+
+        if (!cdr_modes.contains(temp_cdr_mode))
+            throw std::invalid_argument("Wrong CDR mode");
+        temp_cdr_options.mode = cdr_modes.at(temp_cdr_mode);
+
+        std::string temp_cdr_durability = json_config->value("cdr_durability", "none");
+        static std::unordered_map<std::string, CDR_Durability> cdr_durabilities{
+            {"none", CDR_Durability::none},
+            {"periodic", CDR_Durability::periodic},
+            {"group_commit", CDR_Durability::group_commit}};
+
+        if (!cdr_durabilities.contains(temp_cdr_durability))
+            throw std::invalid_argument("Wrong CDR durability mode");
+        temp_cdr_options.durability = cdr_durabilities.at(temp_cdr_durability);
+
+        size_t temp_cdr_sync_interval_ms = json_config->value("cdr_sync_interval_ms", 1000);
+        if (temp_cdr_sync_interval_ms == 0)
+            throw std::invalid_argument("Zero CDR sync interval");
+        temp_cdr_options.sync_interval = std::chrono::milliseconds(temp_cdr_sync_interval_ms);
+
+        size_t temp_cdr_max_commit_latency_ms = json_config->value("cdr_max_commit_latency_ms", 50);
+        if (temp_cdr_max_commit_latency_ms < 2)
+            throw std::invalid_argument("CDR commit latency too short (min 2 ms)");
+        temp_cdr_options.max_commit_latency = std::chrono::milliseconds(temp_cdr_max_commit_latency_ms);
+
+        temp_cdr_options.preallocate = json_config->value("cdr_preallocate", true);
+
+        temp_cdr_options.background_rotation = json_config->value("cdr_background_rotation", true);
+
+        std::string temp_cdr_post_process = json_config->value("cdr_post_process", "none");
+        static std::unordered_map<std::string, CDR_Post_Process> cdr_post_processes{
+            {"none", CDR_Post_Process::none},
+            {"checksum", CDR_Post_Process::checksum}};
+
+        if (!cdr_post_processes.contains(temp_cdr_post_process))
+            throw std::invalid_argument("Wrong CDR post processing");
+        temp_cdr_options.post_process = cdr_post_processes.at(temp_cdr_post_process);
+
+        temp_cdr_options.index = json_config->value("cdr_index", true);
+
         std::string temp_log_file = json_config->at("log_file");
 
         std::vector<std::string> temp_blacklist = json_config->at("blacklist").get<std::vector<std::string>>();
 
+        // Необязательный параметр, чтобы старые конфигурации продолжали работать
+        size_t temp_clock_precision_ms = json_config->value("clock_precision_ms", 10);
+        if (temp_clock_precision_ms == 0)
+            throw std::invalid_argument("Zero clock precision");
+        if (temp_clock_precision_ms > 100)
+            throw std::invalid_argument("Clock precision too coarse (max 100 ms)");
+
+        size_t temp_latency_log_interval_sec = json_config->value("latency_log_interval_sec", 60);
+        if (temp_latency_log_interval_sec > 24 * 60 * 60)
+            throw std::invalid_argument("Latency log interval too long (max 1 day)");
+
+        bool temp_profiling_enabled = json_config->value("profiling_enabled", false);
+
+        std::string temp_trace_file = json_config->value("trace_file", "");
+
+        bool temp_overload_control = json_config->value("overload_control", true);
+        size_t temp_overload_target_ms = json_config->value("overload_target_ms", 5);
+        size_t temp_overload_interval_ms = json_config->value("overload_interval_ms", 100);
+        if (temp_overload_target_ms == 0)
+            throw std::invalid_argument("Zero overload target");
+        if (temp_overload_interval_ms < temp_overload_target_ms)
+            throw std::invalid_argument("Overload interval shorter than target");
+        if (temp_overload_interval_ms > 10000)
+            throw std::invalid_argument("Overload interval too long (max 10 s)");
+
+        size_t temp_udp_receive_buffer_bytes = json_config->value("udp_receive_buffer_bytes", 4194304);
+        size_t temp_udp_high_watermark = json_config->value("udp_high_watermark", 8000);
+        size_t temp_udp_low_watermark = json_config->value("udp_low_watermark", 4000);
+        if (temp_udp_receive_buffer_bytes > 1073741824)
+            throw std::invalid_argument("UDP receive buffer too large (max 1 GiB)");
+        if (temp_udp_high_watermark > 10000)
+            throw std::invalid_argument("UDP high watermark above udp_in queue capacity (10000)");
+        if (temp_udp_high_watermark != 0 && temp_udp_low_watermark >= temp_udp_high_watermark)
+            throw std::invalid_argument("UDP low watermark not below high watermark");
+
+        bool temp_udp_socket_filter = json_config->value("udp_socket_filter", false);
+
+        // Конвейеры владеют непересекающимися шардами хранилища, поэтому их не больше числа шардов
+        size_t temp_udp_workers = json_config->value("udp_workers", 1);
+        bool temp_udp_steering = json_config->value("udp_steering", true);
+        if (temp_udp_workers == 0 || temp_udp_workers > 16)
+            throw std::invalid_argument("UDP workers out of range (1..16)");
+        bool temp_thread_per_core = json_config->value("thread_per_core", false);
+
+        Thread_Placement_Config temp_thread_placement;
+        nlohmann::json temp_placement_json = json_config->value("thread_placement", nlohmann::json::object());
+        for (auto [role, cpus] : {std::pair{"io", &temp_thread_placement.io},
+                                  std::pair{"process", &temp_thread_placement.process},
+                                  std::pair{"cleanup", &temp_thread_placement.cleanup},
+                                  std::pair{"logger", &temp_thread_placement.logger},
+                                  std::pair{"config_reload", &temp_thread_placement.config_reload},
+                                  std::pair{"cores", &temp_thread_placement.cores}})
+        {
+            *cpus = temp_placement_json.value(role, std::vector<int>{});
+            for (int cpu : *cpus)
+            {
+                // Предел cpu_set_t
+                if (cpu < 0 || cpu >= 1024)
+                    throw std::invalid_argument("Thread placement CPU out of range (0..1023)");
+            }
+        }
+        temp_thread_placement.numa_local = temp_placement_json.value("numa_local", true);
+
         // Это для того, чтобы в случае проблем при чтении конфигурации они не повлияли на существующую конфигурацию
         // Актуально для функции load_reloadable вызываемой try_reload
         udp_ip = temp_udp_ip;
@@ -69,8 +209,24 @@ namespace PGW
         http_port = temp_http_port;
         cdr_file = temp_cdr_file;
         cdr_file_max_lines = temp_cdr_file_max_lines;
+        cdr_options = temp_cdr_options;
         log_file = temp_log_file;
         blacklist = temp_blacklist;
+        clock_precision_ms = temp_clock_precision_ms;
+        latency_log_interval_sec = temp_latency_log_interval_sec;
+        profiling_enabled = temp_profiling_enabled;
+        trace_file = temp_trace_file;
+        overload_control = temp_overload_control;
+        overload_target_ms = temp_overload_target_ms;
+        overload_interval_ms = temp_overload_interval_ms;
+        udp_receive_buffer_bytes = temp_udp_receive_buffer_bytes;
+        udp_high_watermark = temp_udp_high_watermark;
+        udp_low_watermark = temp_udp_low_watermark;
+        udp_socket_filter = temp_udp_socket_filter;
+        udp_workers = temp_udp_workers;
+        udp_steering = temp_udp_steering;
+        thread_per_core = temp_thread_per_core;
+        thread_placement = temp_thread_placement;
     }
 
     void Config::load_reloadable()
@@ -2,43 +2,72 @@
 
 #include "cdr_journal.h"
 
+#include <coarse_clock.h>
+#include <perf_profiler.h>
+#include <probes.h>
+#include <thread_placement.h>
+#include <trace.h>
+
 #include <quill/LogMacros.h>
 
+#include <array>
+#include <cerrno>
+#include <optional>
+
 namespace PGW
 {
     size_t Session_Storage::get_shard_index(const IMSI &imsi) const
     {
-        return std::hash<IMSI>{}(imsi) % amount_of_shards;
+        return imsi.shard_key() % amount_of_shards;
+    }
+
+    void Session_Storage::write_delete_cdr(const IMSI &imsi, const Session &session, CDR_Action action)
+    {
+        if (aggregate_cdr)
+            cdr_log.write_summary(imsi, action, session.first_seen, session.last_seen, session.update_count);
+        else
+            cdr_log.write(imsi, action);
+    }
+
+    void Session_Storage::expire_shard(size_t shard_index)
+    {
+        std::chrono::seconds timeout{session_timeout_in_seconds.load()};
+        Shard &shard = *shards[shard_index];
+        std::unique_lock lock(shard.mutex);
+
+        auto current_time = IO_Utils::Coarse_Clock::steady_now();
+
+        auto it = shard.sessions.begin();
+        while (it != shard.sessions.end())
+        {
+            if (current_time - it->second.last_activity >= timeout)
+            {
+                IO_UTILS_PROBE(session_expire, it->first.c_str(), shard_index,
+                               std::chrono::duration_cast<std::chrono::milliseconds>(current_time - it->second.last_activity).count());
+                LOG_DEBUG(logger, "Session with IMSI {} deleted on timeout", it->first.get_IMSI_to_str());
+                write_delete_cdr(it->first, it->second, CDR_Action::delete_on_timeout);
+                it = shard.sessions.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
     }
 
     void Session_Storage::cleanup(std::atomic<bool> &stop)
     {
+        IO_Utils::Perf_Profiler::Thread_Registration profiler_registration{"cleanup"};
+        IO_Utils::Thread_Placement::set_name("pgw-cleanup");
+        if (IO_Utils::Thread_Placement::pin(cleanup_cpus) != 0)
+            LOG_WARNING(logger, "Can't pin session storage cleanup thread, errno = {}", errno);
         LOG_DEBUG(logger, "Session storage cleanup thread started");
 
         while (!stop.load())
         {
-            std::chrono::seconds timeout{session_timeout_in_seconds.load()};
-
-            for (auto &shard : shards)
-            {               
-                std::unique_lock lock(shard.mutex);
-
-                auto current_time = std::chrono::steady_clock::now();
-
-                auto it = shard.sessions.begin();
-                while (it != shard.sessions.end())
-                {
-                    if (current_time - it->second.last_activity >= timeout)
-                    {
-                        LOG_DEBUG(logger, "Session with IMSI {} deleted on timeout", it->first.get_IMSI_to_str());
-                        cdr_log.write(it->first, "delete_session_on_timeout");
-                        it = shard.sessions.erase(it);
-                    }
-                    else
-                    {
-                        ++it;
-                    }
-                }
+            for (size_t i = 0; i < amount_of_shards; ++i)
+            {
+                expire_shard(i);
             }
 
             std::this_thread::sleep_for(std::chrono::milliseconds(250));
@@ -53,16 +82,16 @@ namespace PGW
 
         for (size_t i = 0; i < amount_of_shards; ++i)
         {
-            Shard &shard = shards[i];
+            Shard &shard = *shards[i];
             std::unique_lock lock(shard.mutex);
 
-            auto current_time = std::chrono::steady_clock::now();
+            auto current_time = IO_Utils::Coarse_Clock::steady_now();
 
             auto it = shard.sessions.begin();
             while (it != shard.sessions.end())
             {
                 LOG_DEBUG(logger, "Session with IMSI {} deleted on offload", it->first.get_IMSI_to_str());
-                cdr_log.write(it->first, "delete_session_on_offload");
+                write_delete_cdr(it->first, it->second, CDR_Action::delete_on_offload);
                 it = shard.sessions.erase(it);
 
                 if (it != shard.sessions.end())
@@ -83,62 +112,93 @@ namespace PGW
         CDR_Journal &cdr_log,
         std::unordered_set<IMSI> blacklist,
         quill::Logger* logger,
-        std::atomic<bool> &stop) : session_timeout_in_seconds(session_timeout_in_seconds),
+        std::atomic<bool> &stop,
+        bool cleanup_thread_enabled,
+        std::vector<int> cleanup_cpus,
+        const std::vector<std::vector<int>> &shard_cpus,
+        bool numa_local) : session_timeout_in_seconds(session_timeout_in_seconds),
                                    graceful_shutdown_rate(graceful_shutdown_rate),
                                    cdr_log(cdr_log),
                                    blacklist(blacklist),
-                                   logger(logger)
+                                   logger(logger),
+                                   aggregate_cdr(cdr_log.get_mode() == CDR_Mode::aggregated),
+                                   cleanup_cpus(std::move(cleanup_cpus))
     {
+        shards.reserve(amount_of_shards);
+        for (size_t i = 0; i < amount_of_shards; ++i)
+        {
+            std::optional<IO_Utils::Thread_Placement::Scope> scope;
+            if (i < shard_cpus.size())
+            {
+                scope.emplace(shard_cpus[i], numa_local);
+                if (scope->pin_error() != 0)
+                    LOG_WARNING(logger, "Can't pin to CPUs of shard {} owner, errno = {}", i, scope->pin_error());
+            }
+            shards.push_back(std::make_unique<Shard>());
+        }
+
         LOG_DEBUG(logger, "Session storage created");
-        cleanup_thread = std::thread{&Session_Storage::cleanup, this, std::ref(stop)};
+        if (cleanup_thread_enabled)
+            cleanup_thread = std::thread{&Session_Storage::cleanup, this, std::ref(stop)};
     }
 
     bool Session_Storage::_create(IMSI imsi, Session session)
     {
+        IO_Utils::Tracer::Span trace_span{"Session_Storage::_create"};
+
         if (blacklist.contains(imsi))
         {
-            // Чтобы как-то ограничить число таких записей в CDR журнал
-            static IMSI last_received_imsi_from_blacklist;
-            if (last_received_imsi_from_blacklist != imsi)
-            {
-                cdr_log.write(imsi, "rejected, IMSI blacklisted");
+            // В CDR журнал попадает каждый отказ, ограничивается только лог
+            cdr_log.write(imsi, CDR_Action::rejected_blacklisted);
 
+            uint64_t suppressed = 0;
+            if (blacklisted_log.allow(std::hash<IMSI>{}(imsi), suppressed))
+            {
+                if (suppressed != 0)
+                    LOG_DEBUG(logger, "{} similar messages suppressed: {}", suppressed, blacklisted_log.site());
                 LOG_DEBUG(logger, "Create session rejected: IMSI {} blacklisted", imsi.get_IMSI_to_str());
-
-                last_received_imsi_from_blacklist = imsi;
             }
 
             return false;
         }
 
-        Shard &shard = shards[get_shard_index(imsi)];
+        Shard &shard = *shards[get_shard_index(imsi)];
 
         // На момент записи шард блокируется для остальных операций
         std::unique_lock lock(shard.mutex);
 
         if(shard.sessions.contains(imsi)){
+            // _update берет ту же блокировку, а сессию мог создать другой поток между _read и _create
+            lock.unlock();
             return _update(imsi, session);
         }
 
+        session.first_seen = IO_Utils::Coarse_Clock::system_now();
+        session.last_seen = session.first_seen;
+        session.update_count = 0;
         shard.sessions[imsi] = session;
 
         if (!shard.sessions.contains(imsi))
         {
             LOG_ERROR(logger, "Create session rejected on error in session_storage for IMSI {}", imsi.get_IMSI_to_str());
-            cdr_log.write(imsi, "rejected, error while session creating");
+            cdr_log.write(imsi, CDR_Action::rejected_error);
 
             return false;
         }
 
+        IO_UTILS_PROBE(session_create, imsi.c_str(), get_shard_index(imsi));
         LOG_DEBUG(logger, "Create session success for IMSI {}", imsi.get_IMSI_to_str());
-        cdr_log.write(imsi, "created");
+        if (!aggregate_cdr)
+            cdr_log.write(imsi, CDR_Action::created);
 
         return true;
     }
 
     bool Session_Storage::_read(IMSI imsi, Session &session)
     {
-        Shard &shard = shards[get_shard_index(imsi)];
+        IO_Utils::Tracer::Span trace_span{"Session_Storage::_read"};
+
+        Shard &shard = *shards[get_shard_index(imsi)];
 
         // Другим потокам позволяется читать паралельно с этим в этом же шарде
         std::shared_lock lock(shard.mutex);
@@ -152,33 +212,129 @@ namespace PGW
             return true;
         }
 
-        //Сомнительный механизм, чтобы не засорять логи уровня DEBUG повторяющимися сообщениями на поиск того-же IMSI
-        static IMSI last_received_not_founded_imsi;
-        if(last_received_not_founded_imsi != imsi){
-            LOG_DEBUG(logger, "Can't find session for IMSI {} ", imsi.get_IMSI_to_str());
-            last_received_not_founded_imsi = imsi;
-        }
+        IO_UTILS_LOG_THROTTLED(not_found_log, LOG_DEBUG, logger, "Can't find session for IMSI {} ", imsi.get_IMSI_to_str());
 
         return false;
     }
 
+    size_t ISession_Storage::_read_batch(const std::vector<IMSI> &imsis, std::vector<bool> &active)
+    {
+        active.assign(imsis.size(), false);
+
+        size_t found = 0;
+        Session session;
+        for (size_t i = 0; i < imsis.size(); ++i)
+        {
+            if (_read(imsis[i], session))
+            {
+                active[i] = true;
+                found++;
+            }
+        }
+
+        return found;
+    }
+
+    size_t Session_Storage::_read_batch(const std::vector<IMSI> &imsis, std::vector<bool> &active)
+    {
+        IO_Utils::Tracer::Span trace_span{"Session_Storage::_read_batch"};
+
+        active.assign(imsis.size(), false);
+
+        // Сортировка подсчетом: order содержит индексы IMSI, идущие подряд для каждого шарда,
+        // IMSI шарда s лежат в order[bounds[s]] ... order[bounds[s + 1] - 1]
+        std::vector<uint8_t> shard_of(imsis.size());
+        std::array<size_t, amount_of_shards + 1> bounds{};
+        for (size_t i = 0; i < imsis.size(); ++i)
+        {
+            shard_of[i] = get_shard_index(imsis[i]);
+            bounds[shard_of[i] + 1]++;
+        }
+        for (size_t s = 0; s < amount_of_shards; ++s)
+        {
+            bounds[s + 1] += bounds[s];
+        }
+
+        std::vector<size_t> order(imsis.size());
+        std::array<size_t, amount_of_shards> next{};
+        for (size_t i = 0; i < imsis.size(); ++i)
+        {
+            order[bounds[shard_of[i]] + next[shard_of[i]]++] = i;
+        }
+
+        size_t found = 0;
+        for (size_t s = 0; s < amount_of_shards; ++s)
+        {
+            if (bounds[s] == bounds[s + 1])
+                continue;
+
+            std::shared_lock lock(shards[s]->mutex);
+            for (size_t j = bounds[s]; j < bounds[s + 1]; ++j)
+            {
+                if (shards[s]->sessions.contains(imsis[order[j]]))
+                {
+                    active[order[j]] = true;
+                    found++;
+                }
+            }
+        }
+
+        LOG_DEBUG(logger, "Batch session check: {} of {} IMSI found", found, imsis.size());
+
+        return found;
+    }
+
+    std::vector<size_t> Session_Storage::shard_sizes()
+    {
+        std::vector<size_t> sizes(amount_of_shards);
+        for (size_t i = 0; i < amount_of_shards; ++i)
+        {
+            std::shared_lock lock(shards[i]->mutex);
+            sizes[i] = shards[i]->sessions.size();
+        }
+
+        return sizes;
+    }
+
+    std::vector<IO_Utils::Lock_Stats> ISession_Storage::lock_stats()
+    {
+        return {};
+    }
+
+    std::vector<IO_Utils::Lock_Stats> Session_Storage::lock_stats()
+    {
+        std::vector<IO_Utils::Lock_Stats> stats(amount_of_shards);
+        for (size_t i = 0; i < amount_of_shards; ++i)
+        {
+            stats[i] = shards[i]->mutex.stats();
+        }
+
+        return stats;
+    }
+
     bool Session_Storage::_update(IMSI imsi, Session session)
     {
-        Shard &shard = shards[get_shard_index(imsi)];
+        IO_Utils::Tracer::Span trace_span{"Session_Storage::_update"};
+
+        Shard &shard = *shards[get_shard_index(imsi)];
 
         // На момент записи шард блокируется для остальных операций
         std::unique_lock lock(shard.mutex);
 
         if (shard.sessions.contains(imsi))
         {
-            auto current_time = std::chrono::steady_clock::now();
+            auto current_time = IO_Utils::Coarse_Clock::steady_now();
             std::chrono::duration<double> duration = current_time - shard.sessions.at(imsi).last_activity;
 
             // Сессию нельзя обновлять чаще чем раз в 0.5 секунды
             if (duration.count() >= 0.5)
             {
-                shard.sessions[imsi].last_activity = current_time;
-                cdr_log.write(imsi, "updated");
+                Session &stored = shard.sessions[imsi];
+                stored.last_activity = current_time;
+                stored.last_seen = IO_Utils::Coarse_Clock::system_now();
+                stored.update_count++;
+                if (!aggregate_cdr)
+                    cdr_log.write(imsi, CDR_Action::updated);
 
                 LOG_DEBUG(logger, "Successfull update for IMSI {}", imsi.get_IMSI_to_str());
 
@@ -195,21 +351,34 @@ namespace PGW
 
     bool Session_Storage::_delete(IMSI imsi)
     {
-        Shard &shard = shards[get_shard_index(imsi)];
+        IO_Utils::Tracer::Span trace_span{"Session_Storage::_delete"};
+
+        Shard &shard = *shards[get_shard_index(imsi)];
 
         // На момент удаления шард блокируется для остальных операций
         std::unique_lock lock(shard.mutex);
 
         LOG_DEBUG(logger, "Attempt to delete session for IMSI {}", imsi.get_IMSI_to_str());
 
-        cdr_log.write(imsi, "delete_session_manually");
+        auto it = shard.sessions.find(imsi);
+
+        // Итоговая запись возможна только для существующей сессии
+        if (!aggregate_cdr)
+            cdr_log.write(imsi, CDR_Action::delete_manually);
+        else if (it != shard.sessions.end())
+            write_delete_cdr(imsi, it->second, CDR_Action::delete_manually);
 
-        return shard.sessions.erase(imsi) > 0;
+        if (it == shard.sessions.end())
+            return false;
+
+        shard.sessions.erase(it);
+        return true;
     }
 
     Session_Storage::~Session_Storage()
     {
-        cleanup_thread.join();
+        if (cleanup_thread.joinable())
+            cleanup_thread.join();
 
         delete_sessions_gracefully();
     }
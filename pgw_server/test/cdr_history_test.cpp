@@ -0,0 +1,163 @@
+#include "cdr_history.h"
+
+#include "cdr_journal.h"
+#include "imsi.h"
+
+#include <gtest/gtest.h>
+#include <quill/Backend.h>
+#include <quill/Frontend.h>
+#include <quill/LogMacros.h>
+#include <quill/Logger.h>
+#include <quill/sinks/FileSink.h>
+
+#include <filesystem>
+#include <string>
+
+static quill::Logger *main_logger;
+class CDRHistoryTest : public ::testing::Test
+{
+protected:
+    static void SetUpTestSuite()
+    {
+        quill::Backend::start();
+
+        auto file_sink = quill::Frontend::create_or_get_sink<quill::FileSink>(
+            "test_log/cdr_history_test.log",
+            []()
+            {
+                quill::FileSinkConfig cfg;
+                cfg.set_open_mode('w');
+                cfg.set_filename_append_option(quill::FilenameAppendOption::StartDateTime);
+                return cfg;
+            }(),
+            quill::FileEventNotifier{});
+
+        main_logger = quill::Frontend::create_or_get_logger("root", std::move(file_sink));
+        main_logger->set_log_level(quill::LogLevel::Debug);
+    }
+
+    static void TearDownTestSuite()
+    {
+        main_logger->flush_log();
+        main_logger = nullptr;
+    }
+
+    // Пишет records записей по imsi_pool абонентам, target пишется только первые 5 раз
+    static void fill_journal(PGW::CDR_Journal &journal, size_t records, size_t imsi_pool)
+    {
+        PGW::IMSI target;
+        target.set_IMSI_from_str("999990000000001");
+        PGW::IMSI imsi;
+        for (size_t i = 0; i < records; ++i)
+        {
+            if (i < 5)
+            {
+                journal.write(target, PGW::CDR_Action::updated);
+                continue;
+            }
+
+            imsi.set_IMSI_from_str(std::to_string(250010000000000ul + i % imsi_pool));
+            journal.write(imsi, PGW::CDR_Action::updated);
+        }
+        journal.flush();
+    }
+
+    static std::string make_dir(const std::string &name)
+    {
+        std::string dir = "test_cdr/" + name;
+        std::filesystem::remove_all(dir);
+        std::filesystem::create_directories(dir);
+        return dir;
+    }
+};
+
+TEST_F(CDRHistoryTest, IndexedLookupMatchesFullScan)
+{
+    for (PGW::CDR_Format format : {PGW::CDR_Format::csv, PGW::CDR_Format::binary})
+    {
+        std::string dir = make_dir(format == PGW::CDR_Format::csv ? "history_csv" : "history_binary");
+
+        PGW::CDR_Journal_Options options;
+        options.format = format;
+        {
+            PGW::CDR_Journal journal{dir + "/cdr.csv", 2000, main_logger, options};
+            fill_journal(journal, 6000, 1000);
+        }
+
+        PGW::CDR_History history{dir + "/cdr.csv", format};
+        ASSERT_EQ(history.list_files().size(), 3u);
+
+        PGW::CDR_Lookup_Stats indexed_stats;
+        auto indexed = history.lookup("999990000000001", 0, 100, &indexed_stats);
+        PGW::CDR_Lookup_Stats scan_stats;
+        auto scanned = history.lookup("999990000000001", 0, 100, &scan_stats, false);
+
+        ASSERT_EQ(indexed.size(), 5u);
+        ASSERT_EQ(scanned.size(), 5u);
+        for (size_t i = 0; i < indexed.size(); ++i)
+        {
+            EXPECT_EQ(std::string(indexed[i].imsi, indexed[i].imsi_length), "999990000000001");
+            EXPECT_EQ(indexed[i].timestamp_ns, scanned[i].timestamp_ns);
+        }
+
+        EXPECT_EQ(indexed_stats.indexed_files, 3u);
+        EXPECT_EQ(indexed_stats.scanned_files, 0u);
+        EXPECT_LT(indexed_stats.blocks_read, indexed_stats.blocks);
+        EXPECT_LT(indexed_stats.bytes_read, scan_stats.bytes_read);
+
+        auto other = history.lookup("250010000000007", 0, 2, nullptr);
+        EXPECT_EQ(other.size(), 2u);
+    }
+}
+
+TEST_F(CDRHistoryTest, ActiveFileIsScannedAndSinceSkipsOldFiles)
+{
+    std::string dir = make_dir("history_active");
+
+    PGW::CDR_Journal journal{dir + "/cdr.csv", 100000, main_logger};
+    fill_journal(journal, 100, 10);
+
+    PGW::CDR_History history{dir + "/cdr.csv", PGW::CDR_Format::csv};
+
+    PGW::CDR_Lookup_Stats stats;
+    auto records = history.lookup("999990000000001", 0, 100, &stats);
+    EXPECT_EQ(records.size(), 5u);
+    EXPECT_EQ(stats.scanned_files, 1u);
+
+    int64_t future_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                            (std::chrono::system_clock::now() + std::chrono::hours(1)).time_since_epoch())
+                            .count();
+    PGW::CDR_Lookup_Stats future_stats;
+    EXPECT_TRUE(history.lookup("999990000000001", future_ns, 100, &future_stats).empty());
+    EXPECT_EQ(future_stats.skipped_files, 1u);
+}
+
+TEST_F(CDRHistoryTest, LookupStopsAtByteLimit)
+{
+    for (PGW::CDR_Format format : {PGW::CDR_Format::csv, PGW::CDR_Format::binary})
+    {
+        std::string dir = make_dir(format == PGW::CDR_Format::csv ? "history_limit_csv" : "history_limit_binary");
+
+        PGW::CDR_Journal_Options options;
+        options.format = format;
+        {
+            PGW::CDR_Journal journal{dir + "/cdr.csv", 2000, main_logger, options};
+            fill_journal(journal, 6000, 1000);
+        }
+
+        PGW::CDR_History history{dir + "/cdr.csv", format};
+
+        PGW::CDR_Lookup_Stats full_stats;
+        auto full = history.lookup("999990000000001", 0, 100, &full_stats, false);
+        EXPECT_FALSE(full_stats.truncated);
+
+        // Предел меньше одного файла: дальше первого файла поиск не идет
+        PGW::CDR_Lookup_Stats limited_stats;
+        auto limited = history.lookup("999990000000001", 0, 100, &limited_stats, false, 1024);
+        EXPECT_TRUE(limited_stats.truncated);
+        EXPECT_EQ(limited_stats.files, 1u);
+        EXPECT_LT(limited_stats.bytes_read, full_stats.bytes_read);
+        // Записи абонента в начале первого файла найдены до остановки
+        EXPECT_EQ(limited.size(), full.size());
+    }
+}
@@ -0,0 +1,93 @@
+#include "cdr_index.h"
+
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <filesystem>
+#include <string>
+
+static PGW::CDR_Record make_record(const std::string &imsi, int64_t timestamp_ns)
+{
+    PGW::CDR_Record record{};
+    record.timestamp_ns = timestamp_ns;
+    record.imsi_length = imsi.size();
+    std::memcpy(record.imsi, imsi.data(), imsi.size());
+    record.action = PGW::CDR_Action::created;
+
+    return record;
+}
+
+TEST(CDRIndexTest, BlocksCoverRecordsAndTime)
+{
+    PGW::CDR_Index_Builder builder;
+    builder.reset(128);
+
+    size_t records = PGW::CDR_INDEX_BLOCK_RECORDS * 2 + 10;
+    for (size_t i = 0; i < records; ++i)
+    {
+        builder.add(make_record(std::to_string(100000000 + i), 1000 + i), 48);
+    }
+
+    auto blocks = builder.take_blocks();
+    ASSERT_EQ(blocks.size(), 3u);
+
+    EXPECT_EQ(blocks[0].offset, 128u);
+    EXPECT_EQ(blocks[0].records, PGW::CDR_INDEX_BLOCK_RECORDS);
+    EXPECT_EQ(blocks[0].size, PGW::CDR_INDEX_BLOCK_RECORDS * 48);
+    EXPECT_EQ(blocks[1].offset, 128 + PGW::CDR_INDEX_BLOCK_RECORDS * 48);
+    EXPECT_EQ(blocks[2].records, 10u);
+    EXPECT_EQ(blocks[0].min_timestamp_ns, 1000);
+    EXPECT_EQ(blocks[2].max_timestamp_ns, (int64_t)(1000 + records - 1));
+}
+
+TEST(CDRIndexTest, BloomHasNoFalseNegativesAndFewFalsePositives)
+{
+    PGW::CDR_Index_Builder builder;
+    builder.reset(0);
+
+    for (size_t i = 0; i < PGW::CDR_INDEX_BLOCK_RECORDS; ++i)
+    {
+        builder.add(make_record(std::to_string(250010000000000ul + i), 0), 56);
+    }
+    auto blocks = builder.take_blocks();
+    ASSERT_EQ(blocks.size(), 1u);
+
+    for (size_t i = 0; i < PGW::CDR_INDEX_BLOCK_RECORDS; ++i)
+    {
+        std::string imsi = std::to_string(250010000000000ul + i);
+        ASSERT_TRUE(PGW::cdr_index_may_contain(blocks[0], imsi.data(), imsi.size()));
+    }
+
+    size_t false_positives = 0;
+    for (size_t i = 0; i < 10000; ++i)
+    {
+        std::string imsi = std::to_string(310000000000000ul + i);
+        if (PGW::cdr_index_may_contain(blocks[0], imsi.data(), imsi.size()))
+            false_positives++;
+    }
+    EXPECT_LT(false_positives, 500u);
+}
+
+TEST(CDRIndexTest, WriteAndReadIndexFile)
+{
+    std::filesystem::create_directories("test_cdr");
+    std::string journal_path = "test_cdr/test_cdr_index_file.csv";
+
+    PGW::CDR_Index_Builder builder;
+    builder.reset(0);
+    for (size_t i = 0; i < PGW::CDR_INDEX_BLOCK_RECORDS + 1; ++i)
+    {
+        builder.add(make_record("123456789", i), 50);
+    }
+    auto blocks = builder.take_blocks();
+
+    ASSERT_TRUE(PGW::write_cdr_index(journal_path, blocks));
+    EXPECT_FALSE(std::filesystem::exists(PGW::cdr_index_path(journal_path) + ".tmp"));
+
+    std::vector<PGW::CDR_Index_Block> read_blocks;
+    ASSERT_TRUE(PGW::read_cdr_index(journal_path, read_blocks));
+    ASSERT_EQ(read_blocks.size(), blocks.size());
+    EXPECT_EQ(std::memcmp(read_blocks.data(), blocks.data(), blocks.size() * sizeof(PGW::CDR_Index_Block)), 0);
+
+    EXPECT_FALSE(PGW::read_cdr_index("test_cdr/missing.csv", read_blocks));
+}
@@ -10,6 +10,10 @@
 #include <quill/sinks/FileSink.h>
 
 #include <filesystem>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <vector>
 
 static quill::Logger *main_logger;
 class CDRJournalTest : public ::testing::Test
@@ -68,7 +72,7 @@ TEST_F(CDRJournalTest, WriteEntry)
 {
     PGW::IMSI imsi;
     imsi.set_IMSI_from_str("123456789");
-    journal->write(imsi, "created");
+    journal->write(imsi, PGW::CDR_Action::created);
 
     ASSERT_TRUE(journal->is_open());
 }
@@ -94,9 +98,12 @@ TEST_F(CDRJournalTest, FileRotation)
     // Записать больше лимита
     for (int i = 0; i < 15; i++)
     {
-        journal->write(imsi, "entry " + std::to_string(i));
+        journal->write(imsi, PGW::CDR_Action::updated);
     }
 
+    // Запись идет в отдельном потоке, ждем пока все строки окажутся в файлах
+    journal->flush();
+
     // Должен создаться новый файл
     for (const auto &entry : std::filesystem::recursive_directory_iterator("."))
     {
@@ -107,4 +114,396 @@ TEST_F(CDRJournalTest, FileRotation)
     }
 
     ASSERT_LT(ctr, 0);
-}
\ No newline at end of file
+}
+
+// Ищет файл журнала по префиксу имени и возвращает его содержимое
+static std::string read_journal(const std::string &prefix)
+{
+    for (const auto &entry : std::filesystem::directory_iterator("test_cdr"))
+    {
+        if (entry.path().filename().string().find(prefix) == 0 && entry.path().extension() == ".csv")
+        {
+            std::ifstream file(entry.path());
+            std::stringstream content;
+            content << file.rdbuf();
+            return content.str();
+        }
+    }
+
+    return "";
+}
+
+TEST_F(CDRJournalTest, EntryFormat)
+{
+    auto content_journal = std::make_unique<PGW::CDR_Journal>("test_cdr/test_cdr_format.csv", 10, logger);
+
+    PGW::IMSI imsi;
+    imsi.set_IMSI_from_str("123456789012345");
+    content_journal->write(imsi, PGW::CDR_Action::created);
+    content_journal->write(imsi, PGW::CDR_Action::delete_on_timeout);
+    content_journal->flush();
+
+    std::string content = read_journal("test_cdr_format_");
+    EXPECT_NE(content.find("\",\"123456789012345\",\"created\"\r\n"), std::string::npos);
+    EXPECT_NE(content.find("\",\"123456789012345\",\"delete_session_on_timeout\"\r\n"), std::string::npos);
+    EXPECT_LT(content.find("created"), content.find("delete_session_on_timeout"));
+
+    // Метка времени фиксированной ширины "YYYY-MM-DD HH:MM:SS"
+    ASSERT_GT(content.size(), 21);
+    EXPECT_EQ(content[0], '"');
+    EXPECT_EQ(content[5], '-');
+    EXPECT_EQ(content[8], '-');
+    EXPECT_EQ(content[11], ' ');
+    EXPECT_EQ(content[14], ':');
+    EXPECT_EQ(content[17], ':');
+    EXPECT_EQ(content[20], '"');
+}
+
+TEST_F(CDRJournalTest, DropPolicyCountsLostRecords)
+{
+    // Поток записи просыпается раз в секунду, поэтому маленькая очередь гарантированно переполнится
+    PGW::CDR_Journal_Options options;
+    options.queue_size = 4;
+    options.overflow_policy = PGW::CDR_Overflow_Policy::drop;
+    options.flush_interval = std::chrono::milliseconds(1000);
+
+    auto dropping_journal = std::make_unique<PGW::CDR_Journal>("test_cdr/test_cdr_drop.csv", 10000, logger, options);
+
+    PGW::IMSI imsi;
+    imsi.set_IMSI_from_str("123456789");
+    for (int i = 0; i < 1000; i++)
+    {
+        dropping_journal->write(imsi, PGW::CDR_Action::updated);
+    }
+
+    EXPECT_GT(dropping_journal->dropped_records(), 0);
+    EXPECT_EQ(dropping_journal->blocked_writes(), 0);
+}
+
+// Записи, для которых не создался файл, не считаются записанными, а flush их не ждет
+TEST_F(CDRJournalTest, FileErrorsCountLostRecords)
+{
+    auto lost_journal = std::make_unique<PGW::CDR_Journal>("test_cdr/missing_dir/test_cdr_lost.csv", 10, logger);
+    ASSERT_FALSE(lost_journal->is_open());
+
+    PGW::IMSI imsi;
+    imsi.set_IMSI_from_str("123456789");
+    for (int i = 0; i < 25; i++)
+    {
+        lost_journal->write(imsi, PGW::CDR_Action::updated);
+    }
+    lost_journal->flush();
+
+    EXPECT_EQ(lost_journal->written_records(), 0);
+    EXPECT_EQ(lost_journal->lost_records(), 25);
+    EXPECT_EQ(lost_journal->dropped_records(), 0);
+}
+
+TEST_F(CDRJournalTest, BlockPolicyKeepsAllRecords)
+{
+    PGW::CDR_Journal_Options options;
+    options.queue_size = 4;
+    options.overflow_policy = PGW::CDR_Overflow_Policy::block;
+    options.flush_interval = std::chrono::milliseconds(1);
+
+    auto blocking_journal = std::make_unique<PGW::CDR_Journal>("test_cdr/test_cdr_block.csv", 10000, logger, options);
+
+    PGW::IMSI imsi;
+    imsi.set_IMSI_from_str("123456789");
+    for (int i = 0; i < 100; i++)
+    {
+        blocking_journal->write(imsi, PGW::CDR_Action::updated);
+    }
+    blocking_journal->flush();
+
+    EXPECT_EQ(blocking_journal->dropped_records(), 0);
+
+    std::string content = read_journal("test_cdr_block_");
+    size_t lines = 0;
+    for (size_t pos = content.find("\r\n"); pos != std::string::npos; pos = content.find("\r\n", pos + 1))
+    {
+        lines++;
+    }
+    EXPECT_EQ(lines, 100);
+}
+
+TEST_F(CDRJournalTest, BinaryFormat)
+{
+    PGW::CDR_Journal_Options options;
+    options.format = PGW::CDR_Format::binary;
+
+    auto binary_journal = std::make_unique<PGW::CDR_Journal>("test_cdr/test_cdr_binary.csv", 100, logger, options);
+
+    PGW::IMSI imsi;
+    imsi.set_IMSI_from_str("123456789012345");
+    binary_journal->write(imsi, PGW::CDR_Action::created);
+    binary_journal->write(imsi, PGW::CDR_Action::delete_manually);
+    binary_journal->flush();
+
+    std::string path;
+    for (const auto &entry : std::filesystem::directory_iterator("test_cdr"))
+    {
+        if (entry.path().filename().string().find("test_cdr_binary_") == 0)
+            path = entry.path().string();
+    }
+
+    // Расширение из конфигурации заменяется на .cdr
+    ASSERT_EQ(std::filesystem::path(path).extension(), ".cdr");
+    ASSERT_EQ(std::filesystem::file_size(path), sizeof(PGW::CDR_File_Header) + 2 * sizeof(PGW::CDR_Binary_Record));
+
+    PGW::CDR_Binary_Reader reader{path};
+    ASSERT_TRUE(reader.is_valid());
+
+    PGW::CDR_Record record;
+    ASSERT_TRUE(reader.next(record));
+    EXPECT_EQ(std::string(record.imsi, record.imsi_length), "123456789012345");
+    EXPECT_EQ(record.action, PGW::CDR_Action::created);
+
+    ASSERT_TRUE(reader.next(record));
+    EXPECT_EQ(record.action, PGW::CDR_Action::delete_manually);
+
+    EXPECT_FALSE(reader.next(record));
+}
+
+TEST_F(CDRJournalTest, DurabilityNoneNeverSyncs)
+{
+    auto journal_none = std::make_unique<PGW::CDR_Journal>("test_cdr/test_cdr_sync_none.csv", 1000, logger);
+
+    PGW::IMSI imsi;
+    imsi.set_IMSI_from_str("123456789");
+    journal_none->write(imsi, PGW::CDR_Action::created);
+    journal_none->flush();
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    EXPECT_EQ(journal_none->durable_records(), 0);
+    EXPECT_EQ(journal_none->sync_count(), 0);
+}
+
+TEST_F(CDRJournalTest, DurabilityPeriodicSyncs)
+{
+    PGW::CDR_Journal_Options options;
+    options.durability = PGW::CDR_Durability::periodic;
+    options.sync_interval = std::chrono::milliseconds(20);
+    options.flush_interval = std::chrono::milliseconds(5);
+
+    auto periodic_journal = std::make_unique<PGW::CDR_Journal>("test_cdr/test_cdr_sync_periodic.csv", 1000, logger, options);
+
+    PGW::IMSI imsi;
+    imsi.set_IMSI_from_str("123456789");
+    for (int i = 0; i < 10; i++)
+    {
+        periodic_journal->write(imsi, PGW::CDR_Action::updated);
+    }
+    periodic_journal->flush();
+
+    for (int i = 0; i < 100 && periodic_journal->durable_records() < 10; i++)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    EXPECT_EQ(periodic_journal->durable_records(), 10);
+    EXPECT_GE(periodic_journal->sync_count(), 1);
+}
+
+TEST_F(CDRJournalTest, DurabilityGroupCommitBoundsLossWindow)
+{
+    PGW::CDR_Journal_Options options;
+    options.durability = PGW::CDR_Durability::group_commit;
+    options.max_commit_latency = std::chrono::milliseconds(20);
+    options.flush_interval = std::chrono::milliseconds(100);
+
+    auto group_journal = std::make_unique<PGW::CDR_Journal>("test_cdr/test_cdr_sync_group.csv", 1000, logger, options);
+
+    PGW::IMSI imsi;
+    imsi.set_IMSI_from_str("123456789");
+    for (int i = 0; i < 100; i++)
+    {
+        group_journal->write(imsi, PGW::CDR_Action::updated);
+    }
+    group_journal->flush();
+
+    for (int i = 0; i < 100 && group_journal->durable_records() < 100; i++)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    EXPECT_EQ(group_journal->durable_records(), 100);
+    // Одна группа на все записи, а не fdatasync на каждую
+    EXPECT_LT(group_journal->sync_count(), 10);
+    // Запас на планировщик и медленный диск в тестовом окружении
+    EXPECT_LT(group_journal->max_loss_window(), std::chrono::milliseconds(500));
+}
+
+TEST_F(CDRJournalTest, BackgroundRotationUsesPreparedFile)
+{
+    auto rotating_journal = std::make_unique<PGW::CDR_Journal>("test_cdr/test_cdr_prepared.csv", 10, logger);
+
+    PGW::IMSI imsi;
+    imsi.set_IMSI_from_str("123456789");
+    for (int round = 0; round < 3; round++)
+    {
+        // Пауза дает фоновому потоку время открыть следующий файл
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        for (int i = 0; i < 10; i++)
+        {
+            rotating_journal->write(imsi, PGW::CDR_Action::updated);
+        }
+        rotating_journal->flush();
+    }
+
+    EXPECT_EQ(rotating_journal->rotation_count(), 2);
+    EXPECT_EQ(rotating_journal->inline_rotation_count(), 0);
+
+    rotating_journal.reset();
+
+    // Ротации в одну секунду не перезаписывают друг друга, временный файл удален
+    size_t files = 0;
+    size_t lines = 0;
+    for (const auto &entry : std::filesystem::directory_iterator("test_cdr"))
+    {
+        std::string name = entry.path().filename().string();
+        EXPECT_EQ(name.find("test_cdr_prepared.next"), std::string::npos);
+
+        // Рядом с закрытыми файлами лежат их индексы .idx
+        if (name.find("test_cdr_prepared_") == 0 && entry.path().extension() == ".csv")
+        {
+            files++;
+            std::ifstream file(entry.path());
+            std::string line;
+            while (std::getline(file, line))
+            {
+                lines++;
+            }
+        }
+    }
+    EXPECT_EQ(files, 3);
+    EXPECT_EQ(lines, 30);
+}
+
+TEST_F(CDRJournalTest, InlineRotationWithoutBackgroundThread)
+{
+    PGW::CDR_Journal_Options options;
+    options.background_rotation = false;
+
+    auto inline_journal = std::make_unique<PGW::CDR_Journal>("test_cdr/test_cdr_inline.csv", 10, logger, options);
+
+    PGW::IMSI imsi;
+    imsi.set_IMSI_from_str("123456789");
+    for (int i = 0; i < 25; i++)
+    {
+        inline_journal->write(imsi, PGW::CDR_Action::updated);
+    }
+    inline_journal->flush();
+
+    EXPECT_EQ(inline_journal->rotation_count(), 2);
+    EXPECT_EQ(inline_journal->inline_rotation_count(), 2);
+}
+
+TEST_F(CDRJournalTest, ChecksumPostProcess)
+{
+    PGW::CDR_Journal_Options options;
+    options.post_process = PGW::CDR_Post_Process::checksum;
+
+    auto checksum_journal = std::make_unique<PGW::CDR_Journal>("test_cdr/test_cdr_crc.csv", 5, logger, options);
+
+    PGW::IMSI imsi;
+    imsi.set_IMSI_from_str("123456789");
+    for (int i = 0; i < 7; i++)
+    {
+        checksum_journal->write(imsi, PGW::CDR_Action::updated);
+    }
+    checksum_journal->flush();
+
+    // Деструктор дожидается обработки всех закрытых файлов, включая последний
+    checksum_journal.reset();
+
+    size_t checked = 0;
+    for (const auto &entry : std::filesystem::directory_iterator("test_cdr"))
+    {
+        std::string name = entry.path().filename().string();
+        if (name.find("test_cdr_crc_") != 0 || entry.path().extension() != ".csv")
+            continue;
+
+        std::ifstream file(entry.path(), std::ios::binary);
+        std::stringstream content;
+        content << file.rdbuf();
+        std::string data = content.str();
+
+        char expected[128];
+        std::snprintf(expected, sizeof(expected), "%08x  %s\n", PGW::cdr_crc32(data.data(), data.size()), name.c_str());
+
+        std::ifstream checksum_file(entry.path().string() + ".crc32");
+        std::stringstream checksum;
+        checksum << checksum_file.rdbuf();
+        EXPECT_EQ(checksum.str(), expected);
+
+        checked++;
+    }
+    EXPECT_EQ(checked, 2);
+}
+
+TEST_F(CDRJournalTest, StreamsKeepGlobalSequence)
+{
+    PGW::CDR_Journal_Options options;
+    options.streams = 4;
+    options.format = PGW::CDR_Format::binary;
+
+    auto stream_journal = std::make_unique<PGW::CDR_Journal>("test_cdr/test_cdr_streams.csv", 1000, logger, options);
+
+    // Разные IMSI попадают в разные очереди, записи одного IMSI всегда в одну
+    std::vector<std::string> imsis{"100000000000001", "100000000000002", "100000000000003", "100000000000004", "100000000000005"};
+    for (int i = 0; i < 100; i++)
+    {
+        PGW::IMSI imsi;
+        imsi.set_IMSI_from_str(imsis[i % imsis.size()]);
+        stream_journal->write(imsi, PGW::CDR_Action::updated);
+    }
+    stream_journal->flush();
+    stream_journal.reset();
+
+    std::string path;
+    for (const auto &entry : std::filesystem::directory_iterator("test_cdr"))
+    {
+        if (entry.path().filename().string().find("test_cdr_streams_") == 0 && entry.path().extension() == ".cdr")
+            path = entry.path().string();
+    }
+
+    PGW::CDR_Binary_Reader reader{path};
+    ASSERT_TRUE(reader.is_valid());
+
+    std::vector<bool> seen(101, false);
+    std::map<std::string, uint64_t> last_sequence;
+    PGW::CDR_Record record;
+    size_t records = 0;
+    while (reader.next(record))
+    {
+        ASSERT_GE(record.sequence, 1);
+        ASSERT_LE(record.sequence, 100);
+        EXPECT_FALSE(seen[record.sequence]);
+        seen[record.sequence] = true;
+
+        // В пределах одного IMSI порядок в файле совпадает с порядком вызовов
+        std::string imsi(record.imsi, record.imsi_length);
+        EXPECT_GT(record.sequence, last_sequence[imsi]);
+        last_sequence[imsi] = record.sequence;
+
+        records++;
+    }
+    EXPECT_EQ(records, 100);
+}
+
+TEST_F(CDRJournalTest, StreamsAddSequenceToCSV)
+{
+    PGW::CDR_Journal_Options options;
+    options.streams = 2;
+
+    auto stream_journal = std::make_unique<PGW::CDR_Journal>("test_cdr/test_cdr_streams_csv.csv", 1000, logger, options);
+
+    PGW::IMSI imsi;
+    imsi.set_IMSI_from_str("123456789");
+    stream_journal->write(imsi, PGW::CDR_Action::created);
+    stream_journal->flush();
+
+    std::string content = read_journal("test_cdr_streams_csv_");
+    EXPECT_NE(content.find("\",\"123456789\",\"created\",\"1\"\r\n"), std::string::npos);
+}
@@ -0,0 +1,253 @@
+#include "cdr_record.h"
+
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <filesystem>
+#include <string>
+
+static PGW::CDR_Record make_record(const std::string &imsi, PGW::CDR_Action action, int64_t timestamp_ns)
+{
+    PGW::CDR_Record record;
+    record.timestamp_ns = timestamp_ns;
+    record.sequence = 0;
+    record.first_seen_ns = 0;
+    record.last_seen_ns = 0;
+    record.update_count = 0;
+    record.imsi_length = imsi.size();
+    std::memcpy(record.imsi, imsi.data(), imsi.size());
+    record.action = action;
+
+    return record;
+}
+
+TEST(CDRRecordTest, ActionNamesRoundTrip)
+{
+    for (size_t i = 0; i < PGW::CDR_ACTIONS_COUNT; ++i)
+    {
+        const char *name = PGW::cdr_action_to_str((PGW::CDR_Action)i);
+
+        PGW::CDR_Action action;
+        ASSERT_TRUE(PGW::cdr_action_from_str(name, std::strlen(name), action));
+        EXPECT_EQ(action, (PGW::CDR_Action)i);
+    }
+
+    PGW::CDR_Action action;
+    EXPECT_FALSE(PGW::cdr_action_from_str("unknown", 7, action));
+}
+
+TEST(CDRRecordTest, BinaryRoundTripOddAndEvenLength)
+{
+    for (const std::string imsi : {"123456789012345", "12345678901234", "1"})
+    {
+        PGW::CDR_Record record = make_record(imsi, PGW::CDR_Action::delete_on_timeout, 1704423845123456789);
+
+        PGW::CDR_Binary_Record binary;
+        PGW::encode_binary_record(record, binary);
+
+        PGW::CDR_Record decoded;
+        ASSERT_TRUE(PGW::decode_binary_record(binary, decoded));
+        EXPECT_EQ(decoded.timestamp_ns, record.timestamp_ns);
+        EXPECT_EQ(decoded.action, record.action);
+        EXPECT_EQ(std::string(decoded.imsi, decoded.imsi_length), imsi);
+    }
+}
+
+TEST(CDRRecordTest, BinarySequenceRoundTrip)
+{
+    PGW::CDR_Record record = make_record("123456789", PGW::CDR_Action::updated, 1);
+    record.sequence = 0x0123456789ABCDEF;
+
+    PGW::CDR_Binary_Record binary;
+    PGW::encode_binary_record(record, binary);
+
+    PGW::CDR_Record decoded;
+    ASSERT_TRUE(PGW::decode_binary_record(binary, decoded));
+    EXPECT_EQ(decoded.sequence, record.sequence);
+}
+
+TEST(CDRRecordTest, SessionSummaryRoundTripAndCSV)
+{
+    setenv("TZ", "UTC", 1);
+    tzset();
+
+    PGW::CDR_Record record = make_record("123456789", PGW::CDR_Action::delete_on_timeout, 1704423845000000000);
+    record.first_seen_ns = 1704423000000000000;
+    record.last_seen_ns = 1704423815000000000;
+    record.update_count = 42;
+
+    PGW::CDR_Binary_Record binary;
+    PGW::encode_binary_record(record, binary);
+
+    PGW::CDR_Record decoded;
+    ASSERT_TRUE(PGW::decode_binary_record(binary, decoded));
+    EXPECT_EQ(decoded.first_seen_ns, record.first_seen_ns);
+    EXPECT_EQ(decoded.last_seen_ns, record.last_seen_ns);
+    EXPECT_EQ(decoded.update_count, 42);
+
+    PGW::CDR_Time_Formatter formatter;
+    char line[PGW::CDR_CSV_LINE_SIZE];
+    size_t length = PGW::format_csv_line(record, formatter, line, false, true);
+    EXPECT_EQ(std::string(line, length),
+              "\"2024-01-05 03:04:05\",\"123456789\",\"delete_session_on_timeout\",\"2024-01-05 02:50:00\",\"2024-01-05 03:03:35\",\"42\"\r\n");
+
+    // Запись без итога сессии (например отказ) в том же формате
+    PGW::CDR_Record rejected = make_record("123456789", PGW::CDR_Action::rejected_blacklisted, 1704423845000000000);
+    length = PGW::format_csv_line(rejected, formatter, line, false, true);
+    EXPECT_EQ(std::string(line, length), "\"2024-01-05 03:04:05\",\"123456789\",\"rejected, IMSI blacklisted\",\"\",\"\",\"0\"\r\n");
+
+    unsetenv("TZ");
+    tzset();
+}
+
+TEST(CDRRecordTest, ReadsVersion1Files)
+{
+    // Файл старого формата: записи по 24 байта без номера последовательности
+    std::string path = (std::filesystem::temp_directory_path() / "cdr_record_test_v1.cdr").string();
+
+    PGW::CDR_File_Header header = PGW::make_cdr_file_header();
+    header.version = 1;
+    header.record_size = sizeof(PGW::CDR_Binary_Record_V1);
+
+    PGW::CDR_Binary_Record_V1 binary{};
+    binary.timestamp_ns = 42;
+    std::memset(binary.imsi_bcd, 0xFF, sizeof(binary.imsi_bcd));
+    binary.imsi_bcd[0] = 0x21;
+    binary.imsi_length = 2;
+    binary.action = (uint8_t)PGW::CDR_Action::created;
+
+    std::FILE *file = std::fopen(path.c_str(), "wb");
+    ASSERT_NE(file, nullptr);
+    std::fwrite(&header, sizeof(header), 1, file);
+    std::fwrite(&binary, sizeof(binary), 1, file);
+    std::fclose(file);
+
+    {
+        PGW::CDR_Binary_Reader reader{path};
+        ASSERT_TRUE(reader.is_valid());
+
+        PGW::CDR_Record record;
+        ASSERT_TRUE(reader.next(record));
+        EXPECT_EQ(record.timestamp_ns, 42);
+        EXPECT_EQ(record.sequence, 0);
+        EXPECT_EQ(std::string(record.imsi, record.imsi_length), "12");
+        EXPECT_EQ(record.action, PGW::CDR_Action::created);
+        EXPECT_FALSE(reader.next(record));
+    }
+
+    std::filesystem::remove(path);
+}
+
+TEST(CDRRecordTest, BinaryIMSIPackedAsBCD)
+{
+    PGW::CDR_Record record = make_record("123", PGW::CDR_Action::created, 0);
+
+    PGW::CDR_Binary_Record binary;
+    PGW::encode_binary_record(record, binary);
+
+    // Как в IE: первая цифра в младшем полубайте, незанятые полубайты заполнены 0xF
+    EXPECT_EQ(binary.imsi_bcd[0], 0x21);
+    EXPECT_EQ(binary.imsi_bcd[1], 0xF3);
+    EXPECT_EQ(binary.imsi_bcd[2], 0xFF);
+}
+
+TEST(CDRRecordTest, CorruptedBinaryRecordRejected)
+{
+    PGW::CDR_Record record = make_record("123456789", PGW::CDR_Action::created, 0);
+
+    PGW::CDR_Binary_Record binary;
+    PGW::encode_binary_record(record, binary);
+
+    PGW::CDR_Record decoded;
+    PGW::CDR_Binary_Record bad_action = binary;
+    bad_action.action = 200;
+    EXPECT_FALSE(PGW::decode_binary_record(bad_action, decoded));
+
+    PGW::CDR_Binary_Record bad_digit = binary;
+    bad_digit.imsi_bcd[0] = 0xAA;
+    EXPECT_FALSE(PGW::decode_binary_record(bad_digit, decoded));
+}
+
+TEST(CDRRecordTest, FileHeaderCheck)
+{
+    PGW::CDR_File_Header header = PGW::make_cdr_file_header();
+    EXPECT_TRUE(PGW::check_cdr_file_header(header));
+    EXPECT_EQ(std::string(header.schema), PGW::CDR_BINARY_SCHEMA);
+
+    PGW::CDR_File_Header other_version = header;
+    other_version.version = PGW::CDR_BINARY_VERSION + 1;
+    EXPECT_FALSE(PGW::check_cdr_file_header(other_version));
+
+    PGW::CDR_File_Header bad_magic = header;
+    bad_magic.magic[0] = 'X';
+    EXPECT_FALSE(PGW::check_cdr_file_header(bad_magic));
+}
+
+TEST(CDRRecordTest, CSVLine)
+{
+    setenv("TZ", "UTC", 1);
+    tzset();
+
+    PGW::CDR_Time_Formatter formatter;
+    PGW::CDR_Record record = make_record("123456789", PGW::CDR_Action::updated, 1704423845000000000);
+
+    char line[PGW::CDR_CSV_LINE_SIZE];
+    size_t length = PGW::format_csv_line(record, formatter, line);
+
+    EXPECT_EQ(std::string(line, length), "\"2024-01-05 03:04:05\",\"123456789\",\"updated\"\r\n");
+
+    record.sequence = 18446744073709551615ull;
+    length = PGW::format_csv_line(record, formatter, line, true);
+    EXPECT_EQ(std::string(line, length), "\"2024-01-05 03:04:05\",\"123456789\",\"updated\",\"18446744073709551615\"\r\n");
+
+    unsetenv("TZ");
+    tzset();
+}
+
+TEST(CDRRecordTest, CRC32)
+{
+    // Контрольное значение CRC-32 для строки "123456789"
+    EXPECT_EQ(PGW::cdr_crc32("123456789", 9), 0xCBF43926u);
+
+    // Подсчет по частям дает тот же результат
+    uint32_t crc = PGW::cdr_crc32("1234", 4);
+    EXPECT_EQ(PGW::cdr_crc32("56789", 5, crc), 0xCBF43926u);
+}
+
+TEST(CDRRecordTest, ParseCSVLineRoundTrip)
+{
+    PGW::CDR_Time_Formatter formatter;
+    char line[PGW::CDR_CSV_LINE_SIZE];
+
+    PGW::CDR_Record record = make_record("250010123456789", PGW::CDR_Action::rejected_blacklisted, 1'700'000'000'000'000'000);
+    record.sequence = 42;
+
+    for (bool with_sequence : {false, true})
+    {
+        size_t length = PGW::format_csv_line(record, formatter, line, with_sequence);
+
+        PGW::CDR_Record parsed;
+        ASSERT_TRUE(PGW::parse_csv_line(line, length, parsed));
+        EXPECT_EQ(parsed.timestamp_ns, record.timestamp_ns);
+        EXPECT_EQ(std::string(parsed.imsi, parsed.imsi_length), "250010123456789");
+        EXPECT_EQ(parsed.action, PGW::CDR_Action::rejected_blacklisted);
+        EXPECT_EQ(parsed.sequence, with_sequence ? 42u : 0u);
+    }
+
+    PGW::CDR_Record summary = make_record("1234567", PGW::CDR_Action::delete_on_timeout, 1'700'000'100'000'000'000);
+    summary.first_seen_ns = 1'700'000'000'000'000'000;
+    summary.last_seen_ns = 1'700'000'050'000'000'000;
+    summary.update_count = 7;
+    size_t length = PGW::format_csv_line(summary, formatter, line, true, true);
+
+    PGW::CDR_Record parsed;
+    ASSERT_TRUE(PGW::parse_csv_line(line, length, parsed));
+    EXPECT_EQ(parsed.first_seen_ns, summary.first_seen_ns);
+    EXPECT_EQ(parsed.last_seen_ns, summary.last_seen_ns);
+    EXPECT_EQ(parsed.update_count, 7u);
+
+    const std::string broken = "\"2024-01-01 00:00:00\",\"12a\",\"created\"\r\n";
+    EXPECT_FALSE(PGW::parse_csv_line(broken.data(), broken.size(), parsed));
+    const std::string unknown_action = "\"2024-01-01 00:00:00\",\"123\",\"moved\"\r\n";
+    EXPECT_FALSE(PGW::parse_csv_line(unknown_action.data(), unknown_action.size(), parsed));
+}
@@ -0,0 +1,84 @@
+#include "cdr_time_formatter.h"
+
+#include <gtest/gtest.h>
+
+#include <cstdlib>
+#include <string>
+
+class CDRTimeFormatterTest : public ::testing::Test
+{
+protected:
+    void SetUp() override
+    {
+        // Метки форматируются в локальном времени, для предсказуемости тестов фиксируем UTC
+        const char *tz = std::getenv("TZ");
+        if (tz != nullptr)
+            saved_tz = tz;
+        had_tz = tz != nullptr;
+
+        setenv("TZ", "UTC", 1);
+        tzset();
+    }
+
+    void TearDown() override
+    {
+        if (had_tz)
+            setenv("TZ", saved_tz.c_str(), 1);
+        else
+            unsetenv("TZ");
+        tzset();
+    }
+
+    bool had_tz = false;
+    std::string saved_tz;
+    PGW::CDR_Time_Formatter formatter;
+};
+
+TEST_F(CDRTimeFormatterTest, ZeroPaddedFixedWidth)
+{
+    // 2024-01-05 03:04:05 UTC
+    std::string result{formatter.format(1704423845), PGW::CDR_Time_Formatter::DATE_TIME_SIZE};
+    ASSERT_EQ(result, "2024-01-05 03:04:05");
+}
+
+TEST_F(CDRTimeFormatterTest, MonthIsOneBased)
+{
+    // 2024-12-31 23:59:59 UTC
+    std::string result{formatter.format(1735689599), PGW::CDR_Time_Formatter::DATE_TIME_SIZE};
+    ASSERT_EQ(result, "2024-12-31 23:59:59");
+}
+
+TEST_F(CDRTimeFormatterTest, CacheUpdatesOnNextSecond)
+{
+    const char *first = formatter.format(1704423845);
+    ASSERT_EQ(std::string(first, PGW::CDR_Time_Formatter::DATE_TIME_SIZE), "2024-01-05 03:04:05");
+
+    // Буфер тот же, меняется содержимое
+    const char *second = formatter.format(1704423846);
+    ASSERT_EQ(first, second);
+    ASSERT_EQ(std::string(second, PGW::CDR_Time_Formatter::DATE_TIME_SIZE), "2024-01-05 03:04:06");
+
+    ASSERT_EQ(std::string(formatter.format(1704423845), PGW::CDR_Time_Formatter::DATE_TIME_SIZE), "2024-01-05 03:04:05");
+}
+
+TEST_F(CDRTimeFormatterTest, SlotsAreCachedIndependently)
+{
+    const char *record = formatter.format(1704423845);
+    const char *first_seen = formatter.format(1704423000, 1);
+
+    // Разные кеши - разные буферы, форматирование одного не меняет другой
+    ASSERT_NE(record, first_seen);
+    ASSERT_EQ(std::string(record, PGW::CDR_Time_Formatter::DATE_TIME_SIZE), "2024-01-05 03:04:05");
+    ASSERT_EQ(std::string(first_seen, PGW::CDR_Time_Formatter::DATE_TIME_SIZE), "2024-01-05 02:50:00");
+    ASSERT_EQ(formatter.format(1704423845), record);
+}
+
+TEST_F(CDRTimeFormatterTest, FilenameFormat)
+{
+    char out[PGW::CDR_Time_Formatter::DATE_TIME_SIZE];
+    formatter.format_for_filename(1704423845, out);
+    ASSERT_EQ(std::string(out, sizeof(out)), "2024-01-05_03:04:05");
+
+    // Кеш для строк журнала при этом не портится
+    ASSERT_EQ(std::string(formatter.format(1704423845), PGW::CDR_Time_Formatter::DATE_TIME_SIZE), "2024-01-05 03:04:05");
+}
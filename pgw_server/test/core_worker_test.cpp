@@ -0,0 +1,245 @@
+#include "core_worker.h"
+
+#include "cdr_journal.h"
+
+#include <gtest/gtest.h>
+#include <quill/Backend.h>
+#include <quill/Frontend.h>
+#include <quill/LogMacros.h>
+#include <quill/Logger.h>
+#include <quill/sinks/FileSink.h>
+
+#include <netinet/in.h>
+#include <poll.h>
+#include <unistd.h>
+
+class CoreWorkerTest : public ::testing::Test
+{
+protected:
+    static quill::Logger *main_logger;
+    static PGW::CDR_Journal *main_cdr;
+    static std::atomic<size_t> timeout;
+    static std::atomic<size_t> rate;
+
+    static constexpr uint16_t port = 65510;
+
+    static void SetUpTestSuite()
+    {
+        quill::Backend::start();
+
+        auto file_sink = quill::Frontend::create_or_get_sink<quill::FileSink>(
+            "test_log/core_worker_test.log",
+            []()
+            {
+                quill::FileSinkConfig cfg;
+                cfg.set_open_mode('w');
+                cfg.set_filename_append_option(quill::FilenameAppendOption::StartDateTime);
+                return cfg;
+            }(),
+            quill::FileEventNotifier{});
+
+        main_logger = quill::Frontend::create_or_get_logger("root", std::move(file_sink));
+        main_logger->set_log_level(quill::LogLevel::Debug);
+        main_cdr = new PGW::CDR_Journal("test_cdr/test_core_cdr.csv", 1000, main_logger);
+
+        timeout.store(30);
+        // Выгрузка сессий при удалении хранилища без долгих пауз
+        rate.store(10000);
+    }
+
+    void SetUp() override
+    {
+        stop.store(false);
+        storage = std::make_shared<PGW::Session_Storage>(timeout, rate, *main_cdr, std::unordered_set<PGW::IMSI>{}, main_logger, stop, false);
+
+        for (size_t i = 0; i < 2; ++i)
+        {
+            cores.push_back(std::make_unique<PGW::Core_Worker>("127.0.0.1", port, i, 2, std::unordered_set<PGW::IMSI>{}, storage, main_logger));
+        }
+        ASSERT_EQ(cores[0]->set_udp_steering_filter(PGW::IMSI::reuseport_filter(2, PGW::Session_Storage::amount_of_shards)), 0);
+    }
+
+    void TearDown() override
+    {
+        stop.store(true);
+        for (auto &thread : threads)
+        {
+            thread.join();
+        }
+        cores.clear();
+        storage.reset();
+    }
+
+    static void TearDownTestSuite()
+    {
+        CoreWorkerTest::main_logger->flush_log();
+        CoreWorkerTest::main_logger = nullptr;
+
+        delete CoreWorkerTest::main_cdr;
+    }
+
+    void start(size_t core)
+    {
+        threads.emplace_back(&PGW::Core_Worker::run, cores[core].get(), std::ref(stop));
+    }
+
+    std::vector<PGW::Core_Worker *> core_pointers()
+    {
+        return {cores[0].get(), cores[1].get()};
+    }
+
+    std::atomic<bool> stop{false};
+    std::shared_ptr<PGW::Session_Storage> storage;
+    std::vector<std::unique_ptr<PGW::Core_Worker>> cores;
+    std::vector<std::thread> threads;
+};
+
+quill::Logger *CoreWorkerTest::main_logger = nullptr;
+PGW::CDR_Journal *CoreWorkerTest::main_cdr = nullptr;
+std::atomic<size_t> CoreWorkerTest::timeout(0);
+std::atomic<size_t> CoreWorkerTest::rate(0);
+
+// Каждое ядро получает и обрабатывает только IMSI своих шардов, HTTP поиски отвечают ядра-владельцы
+TEST_F(CoreWorkerTest, SteersRequestsAndForwardsLookups)
+{
+    start(0);
+    start(1);
+
+    IO_Utils::UDP_Socket sender_socket(0x100007F, 0);
+    int sender_fd = sender_socket.listen_or_bind();
+    ASSERT_GT(sender_fd, 0);
+    IO_Utils::UDP_Connection sender(sender_fd);
+    IO_Utils::Packet packet(std::make_shared<IO_Utils::UDP_Socket>(0x100007F, port));
+
+    std::vector<PGW::IMSI> imsis(40);
+    std::vector<uint64_t> owned(2);
+    for (size_t i = 0; i < imsis.size(); ++i)
+    {
+        ASSERT_TRUE(imsis[i].set_IMSI_from_str(std::to_string(250010000000000ul + i * 7919)));
+        owned[PGW::Core_Worker::owner(imsis[i], 2)]++;
+
+        packet.data = imsis[i].get_IMSI_to_IE();
+        ASSERT_EQ(sender.send_packet(packet), 0);
+
+        pollfd descriptor{sender_fd, POLLIN, 0};
+        ASSERT_EQ(poll(&descriptor, 1, 1000), 1);
+        IO_Utils::Packet reply(nullptr);
+        ASSERT_EQ(sender.recv_packet(reply), 0);
+        EXPECT_EQ(std::string(reply.data.begin(), reply.data.end()), "created");
+    }
+    EXPECT_EQ(cores[0]->requests(), owned[0]);
+    EXPECT_EQ(cores[1]->requests(), owned[1]);
+
+    PGW::Core_Session_Storage router{storage, core_pointers(), main_logger};
+
+    PGW::Session session;
+    EXPECT_TRUE(router._read(imsis[0], session));
+    EXPECT_EQ(session.imsi, imsis[0]);
+
+    PGW::IMSI unknown;
+    ASSERT_TRUE(unknown.set_IMSI_from_str("001010000000001"));
+    EXPECT_FALSE(router._read(unknown, session));
+
+    std::vector<PGW::IMSI> batch = imsis;
+    batch.insert(batch.begin() + 5, unknown);
+    std::vector<bool> active;
+    EXPECT_EQ(router._read_batch(batch, active), imsis.size());
+    ASSERT_EQ(active.size(), batch.size());
+    for (size_t i = 0; i < batch.size(); ++i)
+    {
+        EXPECT_EQ(active[i], i != 5) << i;
+    }
+    EXPECT_GE(cores[0]->lookups_served(), 1u);
+    EXPECT_GE(cores[1]->lookups_served(), 1u);
+
+    close(sender_fd);
+}
+
+// Пустая датаграмма остается без ответа и не доходит до обработчика, как в IO_Worker
+TEST_F(CoreWorkerTest, IgnoresEmptyDatagram)
+{
+    start(0);
+    start(1);
+
+    IO_Utils::UDP_Socket sender_socket(0x100007F, 0);
+    int sender_fd = sender_socket.listen_or_bind();
+    ASSERT_GT(sender_fd, 0);
+
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = 0x100007F;
+    address.sin_port = htons(port);
+    ASSERT_EQ(sendto(sender_fd, "", 0, 0, (sockaddr *)&address, sizeof(address)), 0);
+
+    // Ответ приходит только на следующий за пустой запрос с IMSI
+    PGW::IMSI imsi;
+    ASSERT_TRUE(imsi.set_IMSI_from_str("250010000000001"));
+    std::vector<uint8_t> ie = imsi.get_IMSI_to_IE();
+    ASSERT_EQ(sendto(sender_fd, ie.data(), ie.size(), 0, (sockaddr *)&address, sizeof(address)), (ssize_t)ie.size());
+
+    IO_Utils::UDP_Connection sender(sender_fd);
+    pollfd descriptor{sender_fd, POLLIN, 0};
+    ASSERT_EQ(poll(&descriptor, 1, 1000), 1);
+    IO_Utils::Packet reply(nullptr);
+    ASSERT_EQ(sender.recv_packet(reply), 0);
+    EXPECT_EQ(std::string(reply.data.begin(), reply.data.end()), "created");
+
+    EXPECT_EQ(poll(&descriptor, 1, 200), 0);
+    EXPECT_EQ(cores[0]->requests() + cores[1]->requests(), 1u);
+
+    close(sender_fd);
+}
+
+// Незапущенное ядро не отвечает на поиск: по таймауту это ошибка, а не "сессии нет"
+TEST_F(CoreWorkerTest, UnansweredLookupTimesOut)
+{
+    PGW::IMSI imsi;
+    ASSERT_TRUE(imsi.set_IMSI_from_str("250010000000001"));
+    ASSERT_TRUE(storage->_create(imsi, PGW::Session{imsi, std::chrono::steady_clock::now()}));
+
+    PGW::Core_Session_Storage router{storage, core_pointers(), main_logger};
+    PGW::Session session;
+    EXPECT_THROW(router._read(imsi, session), PGW::Session_Storage_Unavailable);
+
+    // Срок ответа общий для всех ядер: два молчащих ядра задерживают пакетный поиск один раз
+    std::vector<PGW::IMSI> batch(40);
+    for (size_t i = 0; i < batch.size(); ++i)
+    {
+        ASSERT_TRUE(batch[i].set_IMSI_from_str(std::to_string(250010000000000ul + i * 7919)));
+    }
+    std::vector<bool> active;
+    auto begin = std::chrono::steady_clock::now();
+    EXPECT_THROW(router._read_batch(batch, active), PGW::Session_Storage_Unavailable);
+    EXPECT_LT(std::chrono::steady_clock::now() - begin, std::chrono::milliseconds(1500));
+}
+
+// Без потока очистки хранилища устаревшие сессии удаляет ядро-владелец, и только в своих шардах
+TEST_F(CoreWorkerTest, ExpiresOwnShardsOnly)
+{
+    for (uint64_t i = 0; i < 200; ++i)
+    {
+        PGW::IMSI imsi;
+        ASSERT_TRUE(imsi.set_IMSI_from_str(std::to_string(250010000000000ul + i)));
+        ASSERT_TRUE(storage->_create(imsi, PGW::Session{imsi, std::chrono::steady_clock::now()}));
+    }
+    std::vector<size_t> created = storage->shard_sizes();
+    ASSERT_GT(created[0] + created[2] + created[4], 0u);
+
+    timeout.store(0);
+    start(0);
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    timeout.store(30);
+
+    std::vector<size_t> sizes = storage->shard_sizes();
+    for (size_t shard = 0; shard < sizes.size(); ++shard)
+    {
+        if (shard % 2 == 0)
+        {
+            EXPECT_EQ(sizes[shard], 0u) << shard;
+        }
+        else
+        {
+            EXPECT_EQ(sizes[shard], created[shard]) << shard;
+        }
+    }
+}
@@ -1,8 +1,11 @@
 #include "handler.h"
 
+#include "cdr_journal.h"
 #include "session_storage.h"
 
 #include <network_io.h>
+#include <perf_profiler.h>
+#include <trace.h>
 
 #include <gtest/gtest.h>
 
@@ -12,11 +15,17 @@
 #include <quill/Logger.h>
 #include <quill/sinks/FileSink.h>
 
+#include <filesystem>
+#include <fstream>
+
 class MockSessionStorage : public PGW::ISession_Storage
 {
     std::unordered_map<PGW::IMSI, PGW::Session> sessions;
 
 public:
+    // Поиски завершаются ошибкой, как у ядра, которое не ответило
+    bool unavailable = false;
+
     bool _create(PGW::IMSI imsi, PGW::Session session) override
     {
         if (sessions.contains(imsi))
@@ -30,6 +39,7 @@ public:
         }
     }
     bool _read(PGW::IMSI imsi, PGW::Session &session) override {
+        if (unavailable) throw PGW::Session_Storage_Unavailable("unavailable");
         if(sessions.contains(imsi)) return true;
 
         return false;
@@ -152,4 +162,373 @@ TEST_F(HandlerTest, HTTPHandlerStop)
     auto response = handler.handle_packet(std::move(packet));
     std::string res_str(response->data.begin(), response->data.end());
     ASSERT_NE(res_str.find("offload started"), std::string::npos);
-}
\ No newline at end of file
+}
+TEST_F(HandlerTest, HTTPHandlerMetrics)
+{
+    std::atomic<bool> stop(false);
+    PGW::HTTP_Handler handler(storage, stop, logger);
+    PGW::UDP_Handler udp_handler({}, storage, logger);
+
+    auto udp_packet = std::make_unique<IO_Utils::UDP_Packet>(udp_socket);
+    PGW::IMSI imsi;
+    imsi.set_IMSI_from_str("555666777");
+    udp_packet->data = imsi.get_IMSI_to_IE();
+    udp_handler.handle_packet(std::move(udp_packet));
+
+    auto packet = std::make_unique<IO_Utils::HTTP_Packet>(http_socket);
+    std::string request =
+        "GET /metrics HTTP/1.1\r\n"
+        "\r\n";
+    packet->data.assign(request.begin(), request.end());
+
+    auto response = handler.handle_packet(std::move(packet));
+    std::string res_str(response->data.begin(), response->data.end());
+    ASSERT_EQ(res_str.rfind("HTTP/1.1 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\n", 0), 0u);
+    ASSERT_NE(res_str.find("# TYPE pgw_udp_requests_total counter\n"), std::string::npos);
+    ASSERT_NE(res_str.find("pgw_udp_requests_total{result=\"created\"} "), std::string::npos);
+    ASSERT_EQ(res_str.find("pgw_udp_requests_total{result=\"created\"} 0\n"), std::string::npos);
+}
+
+TEST_F(HandlerTest, HTTPHandlerLockStatsUnavailable)
+{
+    // Хранилище без статистики блокировок
+    std::atomic<bool> stop(false);
+    PGW::HTTP_Handler handler(storage, stop, logger);
+
+    auto packet = std::make_unique<IO_Utils::HTTP_Packet>(http_socket);
+    std::string request =
+        "GET /lock_stats HTTP/1.1\r\n"
+        "\r\n";
+    packet->data.assign(request.begin(), request.end());
+
+    auto response = handler.handle_packet(std::move(packet));
+    std::string res_str(response->data.begin(), response->data.end());
+    ASSERT_EQ(res_str.rfind("HTTP/1.1 404 Not Found\r\n", 0), 0u);
+}
+
+TEST_F(HandlerTest, HTTPHandlerProfile)
+{
+    std::atomic<bool> stop(false);
+    auto request = [&](PGW::HTTP_Handler &handler, const std::string &path)
+    {
+        auto packet = std::make_unique<IO_Utils::HTTP_Packet>(http_socket);
+        std::string text = "GET " + path + " HTTP/1.1\r\n\r\n";
+        packet->data.assign(text.begin(), text.end());
+
+        auto response = handler.handle_packet(std::move(packet));
+        return std::string(response->data.begin(), response->data.end());
+    };
+
+    // По умолчанию выключено
+    PGW::HTTP_Handler disabled(storage, stop, logger);
+    ASSERT_EQ(request(disabled, "/profile/start").rfind("HTTP/1.1 403 Forbidden\r\n", 0), 0u);
+
+    PGW::HTTP_Handler handler(storage, stop, logger, nullptr, true);
+    ASSERT_EQ(request(handler, "/profile/stop").rfind("HTTP/1.1 409 Conflict\r\n", 0), 0u);
+
+    IO_Utils::Perf_Profiler::Thread_Registration registration{"handler_test"};
+    std::string started = request(handler, "/profile/start");
+    if (started.rfind("HTTP/1.1 503", 0) == 0)
+        GTEST_SKIP() << "perf_event_open is not available";
+    ASSERT_EQ(started.rfind("HTTP/1.1 200 OK\r\n", 0), 0u);
+
+    std::string stopped = request(handler, "/profile/stop");
+    ASSERT_EQ(stopped.rfind("HTTP/1.1 200 OK\r\nContent-Type: text/csv\r\n", 0), 0u);
+    ASSERT_NE(stopped.find("\"window_ms\",\"packets\"\r\n"), std::string::npos);
+    ASSERT_NE(stopped.find("\"handler_test\","), std::string::npos);
+}
+
+TEST_F(HandlerTest, HTTPHandlerTrace)
+{
+    std::atomic<bool> stop(false);
+    auto request = [&](PGW::HTTP_Handler &handler, const std::string &path)
+    {
+        auto packet = std::make_unique<IO_Utils::HTTP_Packet>(http_socket);
+        std::string text = "GET " + path + " HTTP/1.1\r\n\r\n";
+        packet->data.assign(text.begin(), text.end());
+
+        auto response = handler.handle_packet(std::move(packet));
+        return std::string(response->data.begin(), response->data.end());
+    };
+
+    PGW::HTTP_Handler disabled(storage, stop, logger);
+    ASSERT_EQ(request(disabled, "/trace/start").rfind("HTTP/1.1 403 Forbidden\r\n", 0), 0u);
+
+    std::string path = (std::filesystem::temp_directory_path() / "handler_test_trace.json").string();
+    PGW::HTTP_Handler handler(storage, stop, logger, nullptr, false, path);
+    ASSERT_EQ(request(handler, "/trace/stop").rfind("HTTP/1.1 409 Conflict\r\n", 0), 0u);
+    ASSERT_EQ(request(handler, "/trace/start?sample=0").rfind("HTTP/1.1 400 Bad Request\r\n", 0), 0u);
+    ASSERT_EQ(request(handler, "/trace/start?duration_ms=600001").rfind("HTTP/1.1 400 Bad Request\r\n", 0), 0u);
+    ASSERT_EQ(request(handler, "/trace/start?rate=1").rfind("HTTP/1.1 400 Bad Request\r\n", 0), 0u);
+
+    ASSERT_EQ(request(handler, "/trace/start?sample=1&duration_ms=10000").rfind("HTTP/1.1 200 OK\r\n", 0), 0u);
+    ASSERT_EQ(request(handler, "/trace/start").rfind("HTTP/1.1 409 Conflict\r\n", 0), 0u);
+
+    // Запрос из выборки: участок обработчика попадает в файл
+    {
+        IO_Utils::Tracer::Scope scope{IO_Utils::Tracer::sample()};
+        auto packet = std::make_unique<IO_Utils::UDP_Packet>(udp_socket);
+        PGW::IMSI imsi;
+        imsi.set_IMSI_from_str("123456789");
+        packet->data = imsi.get_IMSI_to_IE();
+        PGW::UDP_Handler udp_handler({}, storage, logger);
+        udp_handler.handle_packet(std::move(packet));
+    }
+
+    std::string stopped = request(handler, "/trace/stop");
+    ASSERT_EQ(stopped.rfind("HTTP/1.1 200 OK\r\n", 0), 0u);
+    ASSERT_NE(stopped.find("dropped_events 0\n"), std::string::npos);
+
+    std::ifstream file(path);
+    std::string content((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    ASSERT_NE(content.find("\"name\":\"UDP_Handler::handle_packet\""), std::string::npos);
+    std::filesystem::remove(path);
+}
+
+TEST(EqualsIgnoreCase, ASCIILetters)
+{
+    ASSERT_TRUE(PGW::equals_ignore_case("Content-Length", "content-length"));
+    ASSERT_TRUE(PGW::equals_ignore_case("IMSI", "imsi"));
+    ASSERT_TRUE(PGW::equals_ignore_case("", ""));
+    ASSERT_FALSE(PGW::equals_ignore_case("IMSI", "IMSI2"));
+    ASSERT_FALSE(PGW::equals_ignore_case("Range", "Rangf"));
+    // '@' и '`' отличаются от 'A' и 'a' на ту же величину, но буквами не являются
+    ASSERT_FALSE(PGW::equals_ignore_case("@", "`"));
+}
+
+TEST_F(HandlerTest, HTTPHandlerHeadersAreCaseInsensitive)
+{
+    std::atomic<bool> stop(false);
+    PGW::HTTP_Handler handler(storage, stop, logger);
+
+    PGW::IMSI imsi;
+    imsi.set_IMSI_from_str("123456789");
+    storage->_create(imsi, PGW::Session{});
+
+    for (std::string name : {"IMSI", "imsi", "Imsi"})
+    {
+        auto packet = std::make_unique<IO_Utils::HTTP_Packet>(http_socket);
+        std::string request =
+            "GET /check_subscriber HTTP/1.1\r\n" +
+            name + ": 123456789\r\n"
+                   "\r\n";
+        packet->data.assign(request.begin(), request.end());
+
+        auto response = handler.handle_packet(std::move(packet));
+        std::string res_str(response->data.begin(), response->data.end());
+        ASSERT_EQ(res_str, "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\nContent-Length: 6\r\n\r\nactive") << name;
+    }
+
+    auto packet = std::make_unique<IO_Utils::HTTP_Packet>(http_socket);
+    std::string request =
+        "GET /check_subscriber HTTP/1.1\r\n"
+        "\r\n";
+    packet->data.assign(request.begin(), request.end());
+
+    auto response = handler.handle_packet(std::move(packet));
+    std::string res_str(response->data.begin(), response->data.end());
+    ASSERT_EQ(res_str.rfind("HTTP/1.1 400 Bad Request\r\n", 0), 0u);
+}
+
+TEST_F(HandlerTest, HTTPHandlerContentLength)
+{
+    std::atomic<bool> stop(false);
+    PGW::HTTP_Handler handler(storage, stop, logger);
+
+    auto send = [&](const std::string &request)
+    {
+        auto packet = std::make_unique<IO_Utils::HTTP_Packet>(http_socket);
+        packet->data.assign(request.begin(), request.end());
+
+        auto response = handler.handle_packet(std::move(packet));
+        return std::string(response->data.begin(), response->data.end());
+    };
+
+    // Тело пришло целиком
+    std::string res_str = send("POST /check_subscriber HTTP/1.1\r\ncontent-length: 4\r\nIMSI: 1234\r\n\r\nbody");
+    ASSERT_EQ(res_str.rfind("HTTP/1.1 200 OK\r\n", 0), 0u);
+    ASSERT_NE(res_str.find("not active"), std::string::npos);
+
+    // Тело короче Content-Length или длина не число
+    res_str = send("POST /check_subscriber HTTP/1.1\r\nContent-Length: 10\r\nIMSI: 1234\r\n\r\nbody");
+    ASSERT_EQ(res_str.rfind("HTTP/1.1 400 Bad Request\r\n", 0), 0u);
+
+    res_str = send("POST /check_subscriber HTTP/1.1\r\nContent-Length: 4x\r\nIMSI: 1234\r\n\r\nbody");
+    ASSERT_EQ(res_str.rfind("HTTP/1.1 400 Bad Request\r\n", 0), 0u);
+}
+
+TEST_F(HandlerTest, HTTPHandlerCheckSubscribers)
+{
+    std::atomic<bool> stop(false);
+    PGW::HTTP_Handler handler(storage, stop, logger);
+
+    PGW::IMSI imsi;
+    imsi.set_IMSI_from_str("123456789");
+    storage->_create(imsi, PGW::Session{});
+
+    auto send = [&](const std::string &method, const std::string &body)
+    {
+        auto packet = std::make_unique<IO_Utils::HTTP_Packet>(http_socket);
+        std::string request = method + " /check_subscribers HTTP/1.1\r\nContent-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+        packet->data.assign(request.begin(), request.end());
+
+        auto response = handler.handle_packet(std::move(packet));
+        std::string res_str(response->data.begin(), response->data.end());
+        return res_str.substr(res_str.find("\r\n\r\n") + 4);
+    };
+
+    ASSERT_EQ(send("POST", "123456789\r\n987654321\n\nabc\n"),
+              "\"123456789\",\"active\"\r\n"
+              "\"987654321\",\"not active\"\r\n"
+              "\"abc\",\"invalid\"\r\n");
+
+    ASSERT_EQ(send("POST", "[\"123456789\", 987654321, \"a\\\"b\"]"),
+              "[{\"imsi\":\"123456789\",\"status\":\"active\"},"
+              "{\"imsi\":\"987654321\",\"status\":\"not active\"},"
+              "{\"imsi\":\"a\\\"b\",\"status\":\"invalid\"}]");
+
+    ASSERT_EQ(send("POST", "{\"imsis\": [\"123456789\"]}"), "[{\"imsi\":\"123456789\",\"status\":\"active\"}]");
+    ASSERT_EQ(send("POST", ""), "");
+    ASSERT_EQ(send("POST", "{\"imsis\": 1}"), "Expected JSON array of IMSI");
+    ASSERT_EQ(send("GET", ""), "Method Not Allowed");
+
+    // Хранилище не ответило: 503, а не "not active"
+    storage->unavailable = true;
+    ASSERT_EQ(send("POST", "123456789\n"), "Session storage unavailable");
+
+    auto packet = std::make_unique<IO_Utils::HTTP_Packet>(http_socket);
+    std::string request = "GET /check_subscriber HTTP/1.1\r\nIMSI: 123456789\r\n\r\n";
+    packet->data.assign(request.begin(), request.end());
+    auto response = handler.handle_packet(std::move(packet));
+    std::string res_str(response->data.begin(), response->data.end());
+    EXPECT_EQ(res_str.rfind("HTTP/1.1 503 Service Unavailable\r\n", 0), 0u);
+    EXPECT_NE(res_str.find("Retry-After: 1"), std::string::npos);
+}
+
+TEST_F(HandlerTest, HTTPHandlerCDRHistory)
+{
+    std::atomic<bool> stop(false);
+
+    std::string request =
+        "GET /cdr?imsi=123456789&since=2000-01-01+00%3A00%3A00 HTTP/1.1\r\n"
+        "\r\n";
+
+    {
+        PGW::HTTP_Handler handler(storage, stop, logger);
+        auto packet = std::make_unique<IO_Utils::HTTP_Packet>(http_socket);
+        packet->data.assign(request.begin(), request.end());
+
+        auto response = handler.handle_packet(std::move(packet));
+        std::string res_str(response->data.begin(), response->data.end());
+        ASSERT_EQ(res_str.find("HTTP/1.1 404"), 0u);
+    }
+
+    std::filesystem::remove_all("test_cdr/handler_history");
+    std::filesystem::create_directories("test_cdr/handler_history");
+    {
+        PGW::CDR_Journal journal{"test_cdr/handler_history/cdr.csv", 100, logger};
+        PGW::IMSI imsi;
+        imsi.set_IMSI_from_str("123456789");
+        journal.write(imsi, PGW::CDR_Action::created);
+        imsi.set_IMSI_from_str("987654321");
+        journal.write(imsi, PGW::CDR_Action::created);
+        journal.flush();
+    }
+
+    auto history = std::make_shared<PGW::CDR_History>("test_cdr/handler_history/cdr.csv", PGW::CDR_Format::csv);
+    PGW::HTTP_Handler handler(storage, stop, logger, history);
+
+    auto packet = std::make_unique<IO_Utils::HTTP_Packet>(http_socket);
+    packet->data.assign(request.begin(), request.end());
+    auto response = handler.handle_packet(std::move(packet));
+    std::string res_str(response->data.begin(), response->data.end());
+    ASSERT_EQ(res_str.find("HTTP/1.1 200"), 0u);
+    EXPECT_NE(res_str.find("text/csv"), std::string::npos);
+    EXPECT_NE(res_str.find("\"123456789\",\"created\""), std::string::npos);
+    EXPECT_EQ(res_str.find("987654321"), std::string::npos);
+
+    EXPECT_EQ(res_str.find("X-CDR-Truncated"), std::string::npos);
+
+    auto send = [&](const std::string &text)
+    {
+        auto packet = std::make_unique<IO_Utils::HTTP_Packet>(http_socket);
+        packet->data.assign(text.begin(), text.end());
+        auto response = handler.handle_packet(std::move(packet));
+        return std::string(response->data.begin(), response->data.end());
+    };
+
+    EXPECT_EQ(send("GET /cdr?imsi=12ab HTTP/1.1\r\n\r\n").find("HTTP/1.1 400"), 0u);
+    // since в наносекундах не поместился бы в int64_t
+    EXPECT_EQ(send("GET /cdr?imsi=123456789&since=9300000000000000000 HTTP/1.1\r\n\r\n").find("HTTP/1.1 400"), 0u);
+    EXPECT_EQ(send("GET /cdr?imsi=123456789&since=9223372037 HTTP/1.1\r\n\r\n").find("HTTP/1.1 400"), 0u);
+    EXPECT_EQ(send("GET /cdr?imsi=123456789&since=9223372036 HTTP/1.1\r\n\r\n").find("HTTP/1.1 200"), 0u);
+
+    res_str = send("POST /cdr?imsi=123456789 HTTP/1.1\r\nContent-Length: 0\r\n\r\n");
+    EXPECT_EQ(res_str.find("HTTP/1.1 405"), 0u);
+    EXPECT_NE(res_str.find("Allow: GET"), std::string::npos);
+}
+
+TEST_F(HandlerTest, HTTPHandlerCDRFileDownload)
+{
+    std::atomic<bool> stop(false);
+
+    std::filesystem::remove_all("test_cdr/handler_files");
+    std::filesystem::create_directories("test_cdr/handler_files");
+    {
+        PGW::CDR_Journal journal{"test_cdr/handler_files/cdr.csv", 100, logger};
+        PGW::IMSI imsi;
+        imsi.set_IMSI_from_str("123456789");
+        journal.write(imsi, PGW::CDR_Action::created);
+        journal.flush();
+    }
+
+    auto history = std::make_shared<PGW::CDR_History>("test_cdr/handler_files/cdr.csv", PGW::CDR_Format::csv);
+    ASSERT_EQ(history->list_files().size(), 1u);
+    std::string path = history->list_files()[0];
+    std::string name = std::filesystem::path(path).filename().string();
+    size_t size = std::filesystem::file_size(path);
+
+    PGW::HTTP_Handler handler(storage, stop, logger, history);
+
+    auto request = [&](const std::string &text)
+    {
+        auto packet = std::make_unique<IO_Utils::HTTP_Packet>(http_socket);
+        packet->data.assign(text.begin(), text.end());
+        return handler.handle_packet(std::move(packet));
+    };
+
+    auto response = request("GET /cdr/files HTTP/1.1\r\n\r\n");
+    std::string res_str(response->data.begin(), response->data.end());
+    EXPECT_NE(res_str.find("\"" + name + "\",\"" + std::to_string(size) + "\",\"open\""), std::string::npos);
+
+    // Тело не копируется в ответ, пакет несет дескриптор файла
+    response = request("GET /cdr/files/" + name + " HTTP/1.1\r\n\r\n");
+    res_str.assign(response->data.begin(), response->data.end());
+    ASSERT_EQ(res_str.find("HTTP/1.1 200"), 0u);
+    EXPECT_NE(res_str.find("Content-Length: " + std::to_string(size) + "\r\n"), std::string::npos);
+    ASSERT_NE(response->file_body, nullptr);
+    EXPECT_EQ(response->file_body->offset, 0);
+    EXPECT_EQ(response->file_body->length, size);
+
+    response = request("GET /cdr/files/" + name + " HTTP/1.1\r\nrange: bytes=5-9\r\n\r\n");
+    res_str.assign(response->data.begin(), response->data.end());
+    ASSERT_EQ(res_str.find("HTTP/1.1 206"), 0u);
+    EXPECT_NE(res_str.find("Content-Range: bytes 5-9/" + std::to_string(size)), std::string::npos);
+    ASSERT_NE(response->file_body, nullptr);
+    EXPECT_EQ(response->file_body->offset, 5);
+    EXPECT_EQ(response->file_body->length, 5u);
+
+    response = request("GET /cdr/files/" + name + " HTTP/1.1\r\nRange: bytes=-4\r\n\r\n");
+    ASSERT_NE(response->file_body, nullptr);
+    EXPECT_EQ(response->file_body->offset, (off_t)(size - 4));
+    EXPECT_EQ(response->file_body->length, 4u);
+
+    response = request("GET /cdr/files/" + name + " HTTP/1.1\r\nRange: bytes=100000-\r\n\r\n");
+    res_str.assign(response->data.begin(), response->data.end());
+    EXPECT_EQ(res_str.find("HTTP/1.1 416"), 0u);
+    EXPECT_EQ(response->file_body, nullptr);
+
+    response = request("GET /cdr/files/..%2Fpgw_server_config.json HTTP/1.1\r\n\r\n");
+    res_str.assign(response->data.begin(), response->data.end());
+    EXPECT_EQ(res_str.find("HTTP/1.1 404"), 0u);
+}
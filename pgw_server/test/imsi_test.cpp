@@ -1,13 +1,23 @@
 #include "imsi.h"
 
+#include <network_io.h>
+
 #include <gtest/gtest.h>
 
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <random>
+
 class IMSITest : public ::testing::Test {};
 
 TEST_F(IMSITest, StringConversion) {
     PGW::IMSI imsi;
     ASSERT_TRUE(imsi.set_IMSI_from_str("123456789012345"));
     ASSERT_EQ(imsi.get_IMSI_to_str(), "123456789012345");
+    ASSERT_STREQ(imsi.c_str(), "123456789012345");
 }
 
 TEST_F(IMSITest, IEConversion) {
@@ -33,4 +43,242 @@ TEST_F(IMSITest, InvalidInput) {
     PGW::IMSI imsi;
     ASSERT_FALSE(imsi.set_IMSI_from_str("invalid_imsi"));
     ASSERT_FALSE(imsi.set_IMSI_from_IE({0x00, 0x00, 0x00})); // Невалидный IE
-}
\ No newline at end of file
+}
+
+// Датаграммы проходят через фильтр в ядре, за каждой идет заведомо верный маркер:
+// если проверяемая датаграмма пришла раньше маркера, фильтр ее пропустил
+class IMSISocketFilterTest : public ::testing::Test {
+protected:
+    int receiver_fd = -1, sender_fd = -1;
+    std::unique_ptr<IO_Utils::UDP_Connection> receiver, sender;
+    std::shared_ptr<IO_Utils::UDP_Socket> receiver_address;
+    std::vector<uint8_t> marker;
+
+    void SetUp() override {
+        IO_Utils::UDP_Socket receiver_socket(0x100007F, 0);
+        receiver_fd = receiver_socket.listen_or_bind();
+        ASSERT_GT(receiver_fd, 0);
+        ASSERT_EQ(IO_Utils::Socket::attach_filter(receiver_fd, PGW::IMSI::socket_filter()), 0);
+
+        IO_Utils::UDP_Socket sender_socket(0x100007F, 0);
+        sender_fd = sender_socket.listen_or_bind();
+        ASSERT_GT(sender_fd, 0);
+
+        sockaddr_in address;
+        socklen_t length = sizeof(address);
+        getsockname(receiver_fd, (sockaddr *)&address, &length);
+        receiver_address = std::make_shared<IO_Utils::UDP_Socket>(address.sin_addr.s_addr, ntohs(address.sin_port));
+
+        receiver = std::make_unique<IO_Utils::UDP_Connection>(receiver_fd);
+        sender = std::make_unique<IO_Utils::UDP_Connection>(sender_fd);
+
+        PGW::IMSI imsi;
+        imsi.set_IMSI_from_str("999999999999999");
+        marker = imsi.get_IMSI_to_IE();
+    }
+
+    void TearDown() override {
+        close(receiver_fd);
+        close(sender_fd);
+    }
+
+    void send(const std::vector<uint8_t> &data) {
+        IO_Utils::Packet packet(receiver_address);
+        packet.data = data;
+        // Пустая датаграмма тоже уходит, хотя send_packet считает это ошибкой
+        sender->send_packet(packet);
+    }
+
+    IO_Utils::Packet receive() {
+        pollfd descriptor{receiver_fd, POLLIN, 0};
+        poll(&descriptor, 1, 1000);
+
+        IO_Utils::Packet packet(nullptr);
+        receiver->recv_packet(packet);
+        return packet;
+    }
+
+    bool passes(const std::vector<uint8_t> &data) {
+        send(data);
+        send(marker);
+
+        IO_Utils::Packet first = receive();
+        if (first.data == marker)
+            return false;
+
+        EXPECT_EQ(first.data, data);
+        EXPECT_EQ(receive().data, marker);
+        return true;
+    }
+};
+
+TEST_F(IMSISocketFilterTest, AcceptsIMSIIE) {
+    PGW::IMSI imsi;
+    ASSERT_TRUE(imsi.set_IMSI_from_str("1"));
+    EXPECT_TRUE(passes(imsi.get_IMSI_to_IE()));
+    ASSERT_TRUE(imsi.set_IMSI_from_str("1234567890"));
+    EXPECT_TRUE(passes(imsi.get_IMSI_to_IE()));
+    ASSERT_TRUE(imsi.set_IMSI_from_str("001010123456789"));
+    EXPECT_TRUE(passes(imsi.get_IMSI_to_IE()));
+}
+
+TEST_F(IMSISocketFilterTest, DropsMalformedDatagrams) {
+    EXPECT_FALSE(passes({}));
+    EXPECT_FALSE(passes({0x01, 0x00, 0x00, 0x00}));
+    // Другой тип IE
+    EXPECT_FALSE(passes({0x02, 0x00, 0x01, 0x00, 0x21}));
+    // Length не совпадает с размером
+    EXPECT_FALSE(passes({0x01, 0x00, 0x02, 0x00, 0x21}));
+    EXPECT_FALSE(passes({0x01, 0x01, 0x01, 0x00, 0x21}));
+    // Не цифра и филлер не в последнем байте
+    EXPECT_FALSE(passes({0x01, 0x00, 0x01, 0x00, 0x2A}));
+    EXPECT_FALSE(passes({0x01, 0x00, 0x02, 0x00, 0xF1, 0x21}));
+    // 16 цифр
+    EXPECT_FALSE(passes({0x01, 0x00, 0x08, 0x00, 0x21, 0x43, 0x65, 0x87, 0x09, 0x21, 0x43, 0x65}));
+    EXPECT_FALSE(passes(std::vector<uint8_t>(512, 0x01)));
+}
+
+TEST_F(IMSISocketFilterTest, MatchesIEParser) {
+    std::mt19937 random(2024);
+    size_t accepted = 0;
+
+    for (int i = 0; i < 3000; ++i) {
+        // Почти правильные IE, чтобы проверки доходили до полубайтов, и произвольный мусор
+        std::vector<uint8_t> data;
+        if (i % 2 == 0) {
+            size_t digits = random() % 10;
+            data = {(uint8_t)(random() % 8 == 0 ? 2 : 1), 0x00, (uint8_t)(digits + (random() % 8 == 0 ? 1 : 0)), (uint8_t)random()};
+            for (size_t j = 0; j < digits; ++j) {
+                uint8_t low = random() % 12, high = random() % 12;
+                data.push_back((uint8_t)((random() % 4 == 0 ? 0xF : high) << 4 | (random() % 16 == 0 ? 0xF : low)));
+            }
+        } else {
+            data.resize(random() % 24);
+            for (uint8_t &byte : data)
+                byte = (uint8_t)random();
+        }
+        if (data == marker)
+            continue;
+
+        PGW::IMSI imsi;
+        bool expected = imsi.set_IMSI_from_IE(data);
+        accepted += expected;
+        ASSERT_EQ(passes(data), expected) << "packet " << i;
+    }
+
+    EXPECT_GT(accepted, 100u);
+}
+
+TEST_F(IMSITest, ShardKeyFollowsIEBytes) {
+    PGW::IMSI imsi;
+    auto expected = [](std::vector<uint32_t> bytes) {
+        uint32_t key = PGW::IMSI::SHARD_KEY_BASIS;
+        for (uint32_t byte : bytes)
+            key = (key ^ byte) * PGW::IMSI::SHARD_KEY_PRIME;
+        return key ^ (key >> 16);
+    };
+    ASSERT_TRUE(imsi.set_IMSI_from_str("12"));
+    EXPECT_EQ(imsi.shard_key(), expected({0x21}));
+    ASSERT_TRUE(imsi.set_IMSI_from_str("123"));
+    EXPECT_EQ(imsi.shard_key(), expected({0x21, 0xF3}));
+}
+
+// Последовательные IMSI ложатся по шардам равномерно
+TEST_F(IMSITest, ShardKeyBalancesSequentialIMSIs) {
+    constexpr size_t shards = 16, count = 100'000;
+
+    std::vector<size_t> sizes(shards);
+    for (uint64_t i = 0; i < count; ++i) {
+        PGW::IMSI imsi;
+        ASSERT_TRUE(imsi.set_IMSI_from_str(std::to_string(250010000000000ul + i)));
+        sizes[imsi.shard_key() % shards]++;
+    }
+    for (size_t size : sizes) {
+        EXPECT_GT(size, count / shards * 95 / 100);
+        EXPECT_LT(size, count / shards * 105 / 100);
+    }
+}
+
+// Замена любой одной цифры может перенести IMSI в другой шард
+TEST_F(IMSITest, ShardKeyDependsOnEveryDigit) {
+    const std::string base = "250010000012345";
+    PGW::IMSI imsi;
+    ASSERT_TRUE(imsi.set_IMSI_from_str(base));
+    uint32_t shard = imsi.shard_key() % 16;
+
+    for (size_t position = 0; position < base.size(); ++position) {
+        bool moved = false;
+        for (char digit = '0'; digit <= '9' && !moved; ++digit) {
+            std::string changed = base;
+            changed[position] = digit;
+            PGW::IMSI other;
+            ASSERT_TRUE(other.set_IMSI_from_str(changed));
+            moved = other.shard_key() % 16 != shard;
+        }
+        EXPECT_TRUE(moved) << "digit " << position;
+    }
+}
+
+// Датаграммы с IMSI уходят сокету группы SO_REUSEPORT, который владеет шардом IMSI
+TEST(IMSIReuseportFilterTest, SteersByShardOwner) {
+    constexpr uint32_t sockets = 3, shards = 16;
+
+    std::vector<int> fds;
+    uint16_t port = 0;
+    for (uint32_t i = 0; i < sockets; ++i) {
+        IO_Utils::UDP_Socket socket(0x100007F, port, true);
+        int fd = socket.listen_or_bind();
+        ASSERT_GT(fd, 0);
+        fds.push_back(fd);
+
+        sockaddr_in address;
+        socklen_t length = sizeof(address);
+        getsockname(fd, (sockaddr *)&address, &length);
+        port = ntohs(address.sin_port);
+    }
+    ASSERT_EQ(IO_Utils::Socket::attach_reuseport_filter(fds[0], PGW::IMSI::reuseport_filter(sockets, shards)), 0);
+
+    IO_Utils::UDP_Socket sender_socket(0x100007F, 0);
+    int sender_fd = sender_socket.listen_or_bind();
+    ASSERT_GT(sender_fd, 0);
+    IO_Utils::UDP_Connection sender(sender_fd);
+    IO_Utils::Packet packet(std::make_shared<IO_Utils::UDP_Socket>(0x100007F, port));
+
+    auto received_by = [&fds]() {
+        std::vector<pollfd> descriptors;
+        for (int fd : fds)
+            descriptors.push_back({fd, POLLIN, 0});
+        poll(descriptors.data(), descriptors.size(), 1000);
+
+        for (size_t i = 0; i < fds.size(); ++i) {
+            IO_Utils::UDP_Connection connection(fds[i]);
+            IO_Utils::Packet incoming(nullptr);
+            if (connection.recv_packet(incoming) == 0)
+                return (int)i;
+        }
+        return -1;
+    };
+
+    std::vector<size_t> per_socket(sockets);
+    for (uint64_t i = 0; i < 300; ++i) {
+        PGW::IMSI imsi;
+        ASSERT_TRUE(imsi.set_IMSI_from_str(std::to_string(250010000000000ul + i * 7919)));
+        packet.data = imsi.get_IMSI_to_IE();
+        sender.send_packet(packet);
+
+        int expected = (int)(imsi.shard_key() % shards % sockets);
+        ASSERT_EQ(received_by(), expected) << imsi.get_IMSI_to_str();
+        per_socket[expected]++;
+    }
+    for (size_t count : per_socket)
+        EXPECT_GT(count, 50u);
+
+    // Не IMSI - сокет выбирает ядро, датаграмма не теряется
+    packet.data = {0x02, 0x00};
+    sender.send_packet(packet);
+    EXPECT_GE(received_by(), 0);
+
+    close(sender_fd);
+    for (int fd : fds)
+        close(fd);
+}
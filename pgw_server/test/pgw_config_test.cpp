@@ -36,6 +36,99 @@ TEST_F(ConfigTest, LoadConfig) {
     ASSERT_EQ(config.http_port, 8080);
     ASSERT_EQ(config.session_timeout_sec, 30);
     ASSERT_EQ(config.blacklist.size(), 2);
+    // Необязательные параметры получают значения по умолчанию
+    ASSERT_EQ(config.clock_precision_ms, 10);
+    ASSERT_EQ(config.latency_log_interval_sec, 60);
+    ASSERT_FALSE(config.profiling_enabled);
+    ASSERT_EQ(config.trace_file, "");
+    ASSERT_TRUE(config.overload_control);
+    ASSERT_EQ(config.overload_target_ms, 5);
+    ASSERT_EQ(config.overload_interval_ms, 100);
+    ASSERT_EQ(config.udp_receive_buffer_bytes, 4194304);
+    ASSERT_EQ(config.udp_high_watermark, 8000);
+    ASSERT_EQ(config.udp_low_watermark, 4000);
+    ASSERT_FALSE(config.udp_socket_filter);
+    ASSERT_EQ(config.udp_workers, 1);
+    ASSERT_TRUE(config.udp_steering);
+    ASSERT_FALSE(config.thread_per_core);
+    ASSERT_TRUE(config.thread_placement.io.empty());
+    ASSERT_TRUE(config.thread_placement.cores.empty());
+    ASSERT_TRUE(config.thread_placement.numa_local);
+    ASSERT_EQ(config.cdr_options.streams, 1u);
+    ASSERT_EQ(config.cdr_options.format, PGW::CDR_Format::csv);
+    ASSERT_EQ(config.cdr_options.overflow_policy, PGW::CDR_Overflow_Policy::block);
+    ASSERT_TRUE(config.cdr_options.background_rotation);
+    ASSERT_EQ(config.cdr_options.post_process, PGW::CDR_Post_Process::none);
+    ASSERT_TRUE(config.cdr_options.index);
+}
+
+TEST_F(ConfigTest, InvalidCDRFormat) {
+    std::ofstream config("invalid_config.json");
+    config << R"({
+            "udp_ip": "127.0.0.1",
+            "udp_port": 65000,
+            "http_ip": "192.168.1.1",
+            "http_port": 8080,
+            "session_timeout_sec": 30,
+            "gracefull_shutdown_rate": 1000,
+            "cdr_file": "cdr.csv",
+            "cdr_file_max_lines": 1000,
+            "cdr_format": "xml",
+            "log_file": "log.txt",
+            "log_level": "DEBUG",
+            "blacklist": []
+        })";
+    config.close();
+
+    EXPECT_THROW(PGW::Config config("invalid_config.json"), std::invalid_argument);
+
+    std::remove("invalid_config.json");
+}
+
+TEST_F(ConfigTest, ThreadPlacement) {
+    std::ofstream config("placement_config.json");
+    config << R"({
+            "udp_ip": "127.0.0.1",
+            "udp_port": 65000,
+            "http_ip": "192.168.1.1",
+            "http_port": 8080,
+            "session_timeout_sec": 30,
+            "gracefull_shutdown_rate": 1000,
+            "cdr_file": "cdr.csv",
+            "cdr_file_max_lines": 1000,
+            "log_file": "log.txt",
+            "log_level": "DEBUG",
+            "blacklist": [],
+            "thread_placement": {"io": [0, 2], "process": [1, 3], "numa_local": false}
+        })";
+    config.close();
+
+    PGW::Config placement("placement_config.json");
+    EXPECT_EQ(placement.thread_placement.io, (std::vector<int>{0, 2}));
+    EXPECT_EQ(placement.thread_placement.process, (std::vector<int>{1, 3}));
+    EXPECT_TRUE(placement.thread_placement.cleanup.empty());
+    EXPECT_FALSE(placement.thread_placement.numa_local);
+
+    config.open("placement_config.json");
+    config << R"({
+            "udp_ip": "127.0.0.1",
+            "udp_port": 65000,
+            "http_ip": "192.168.1.1",
+            "http_port": 8080,
+            "session_timeout_sec": 30,
+            "gracefull_shutdown_rate": 1000,
+            "cdr_file": "cdr.csv",
+            "cdr_file_max_lines": 1000,
+            "log_file": "log.txt",
+            "log_level": "DEBUG",
+            "blacklist": [],
+            "thread_placement": {"cores": [4096]}
+        })";
+    config.close();
+
+    EXPECT_THROW(PGW::Config config("placement_config.json"), std::invalid_argument);
+
+    std::remove("placement_config.json");
 }
 
 TEST_F(ConfigTest, InvalidIPAddress) {
@@ -8,7 +8,11 @@
 #include <quill/LogMacros.h>
 #include <quill/Logger.h>
 #include <quill/sinks/FileSink.h>
+#include <thread_placement.h>
 
+#include <filesystem>
+#include <fstream>
+#include <sstream>
 #include <unordered_set>
 
 class SessionStorageTest : public ::testing::Test
@@ -96,6 +100,73 @@ TEST_F(SessionStorageTest, CreateSession)
     ASSERT_FALSE(storage->_create(imsi, session));
 }
 
+TEST_F(SessionStorageTest, CreateExistingSession)
+{
+    PGW::IMSI imsi;
+    imsi.set_IMSI_from_str("250010000000555");
+    PGW::Session session{imsi, std::chrono::steady_clock::now()};
+
+    // Сессию мог создать другой UDP конвейер между _read и _create: повторное создание - это обновление
+    ASSERT_TRUE(storage->_create(imsi, session));
+    storage->_create(imsi, session);
+
+    // Шард определяется тем же ключом, по которому распределяются UDP пакеты
+    std::vector<size_t> sizes = storage->shard_sizes();
+    ASSERT_EQ(sizes.size(), PGW::Session_Storage::amount_of_shards);
+    EXPECT_EQ(sizes[imsi.shard_key() % PGW::Session_Storage::amount_of_shards], 1u);
+}
+
+TEST_F(SessionStorageTest, ReadBatch)
+{
+    // IMSI из разных шардов, сессии есть у каждого второго
+    std::vector<PGW::IMSI> imsis(100);
+    for (size_t i = 0; i < imsis.size(); ++i)
+    {
+        imsis[i].set_IMSI_from_str(std::to_string(250010000000000ul + i));
+        if (i % 2 == 0)
+            storage->_create(imsis[i], PGW::Session{imsis[i], std::chrono::steady_clock::now()});
+    }
+
+    std::vector<bool> active;
+    ASSERT_EQ(storage->_read_batch(imsis, active), 50u);
+    ASSERT_EQ(active.size(), imsis.size());
+    for (size_t i = 0; i < imsis.size(); ++i)
+    {
+        EXPECT_EQ(active[i], i % 2 == 0) << i;
+    }
+
+    ASSERT_EQ(storage->_read_batch({}, active), 0u);
+    ASSERT_TRUE(active.empty());
+}
+
+TEST_F(SessionStorageTest, LockStats)
+{
+    PGW::IMSI imsi;
+    imsi.set_IMSI_from_str("250010000000777");
+    storage->_create(imsi, PGW::Session{imsi, std::chrono::steady_clock::now()});
+
+    std::vector<IO_Utils::Lock_Stats> before = storage->lock_stats();
+    ASSERT_EQ(before.size(), 16u);
+
+    PGW::Session session;
+    for (size_t i = 0; i < 10; ++i)
+    {
+        ASSERT_TRUE(storage->_read(imsi, session));
+    }
+    storage->_delete(imsi);
+
+    // Поток очистки тоже берет монопольные блокировки, поэтому проверяется только нижняя граница
+    std::vector<IO_Utils::Lock_Stats> after = storage->lock_stats();
+    uint64_t shared = 0, exclusive = 0;
+    for (size_t i = 0; i < after.size(); ++i)
+    {
+        shared += after[i].shared.acquisitions - before[i].shared.acquisitions;
+        exclusive += after[i].exclusive.acquisitions - before[i].exclusive.acquisitions;
+    }
+    ASSERT_EQ(shared, 10u);
+    ASSERT_GE(exclusive, 1u);
+}
+
 TEST_F(SessionStorageTest, UpdateSession)
 {
     PGW::IMSI imsi;
@@ -141,3 +212,119 @@ TEST_F(SessionStorageTest, SessionCleanup)
     }
     ASSERT_TRUE(session_removed);
 }
+
+TEST_F(SessionStorageTest, AggregatedCDRModeWritesOneSummary)
+{
+    PGW::CDR_Journal_Options options;
+    options.mode = PGW::CDR_Mode::aggregated;
+    auto aggregated_cdr = std::make_unique<PGW::CDR_Journal>("test_cdr/test_storage_aggregated.csv", 100, main_logger, options);
+
+    std::atomic<bool> aggregated_stop{false};
+    auto aggregated_storage = std::make_unique<PGW::Session_Storage>(
+        timeout, rate, *aggregated_cdr, std::unordered_set<PGW::IMSI>{}, main_logger, aggregated_stop);
+
+    PGW::IMSI imsi;
+    imsi.set_IMSI_from_str("123456789");
+    PGW::Session session{imsi, std::chrono::steady_clock::now() - std::chrono::seconds(1)};
+    ASSERT_TRUE(aggregated_storage->_create(imsi, session));
+    ASSERT_TRUE(aggregated_storage->_update(imsi, session));
+    ASSERT_TRUE(aggregated_storage->_delete(imsi));
+
+    // Удаление несуществующей сессии итоговой записи не дает
+    ASSERT_FALSE(aggregated_storage->_delete(imsi));
+
+    aggregated_stop.store(true);
+    aggregated_storage.reset();
+    aggregated_cdr->flush();
+
+    std::string content;
+    for (const auto &entry : std::filesystem::directory_iterator("test_cdr"))
+    {
+        if (entry.path().filename().string().find("test_storage_aggregated_") == 0)
+        {
+            std::ifstream file(entry.path());
+            std::stringstream stream;
+            stream << file.rdbuf();
+            content = stream.str();
+        }
+    }
+
+    // Одна строка: причина удаления, время появления и последней активности, одно обновление
+    EXPECT_EQ(content.find("created"), std::string::npos);
+    EXPECT_EQ(content.find("\"updated\""), std::string::npos);
+    ASSERT_EQ(content.find("\r\n"), content.size() - 2);
+    EXPECT_NE(content.find("\",\"123456789\",\"delete_session_manually\",\""), std::string::npos);
+    EXPECT_EQ(content.substr(content.size() - 6), ",\"1\"\r\n");
+}
+
+// Ограничение лога не теряет записи CDR: пишется каждый отказ, в том числе повторы того же IMSI
+TEST_F(SessionStorageTest, BlacklistRejectionsAlwaysReachCDR)
+{
+    auto blacklist_cdr = std::make_unique<PGW::CDR_Journal>("test_cdr/test_storage_blacklist.csv", 1000, main_logger);
+
+    std::unordered_set<PGW::IMSI> blacklist;
+    for (uint64_t i = 0; i < 30; ++i)
+    {
+        PGW::IMSI imsi;
+        imsi.set_IMSI_from_str(std::to_string(250019000000000ul + i));
+        blacklist.insert(imsi);
+    }
+
+    std::atomic<bool> blacklist_stop{false};
+    auto blacklist_storage = std::make_unique<PGW::Session_Storage>(
+        timeout, rate, *blacklist_cdr, blacklist, main_logger, blacklist_stop);
+
+    for (const PGW::IMSI &imsi : blacklist)
+    {
+        ASSERT_FALSE(blacklist_storage->_create(imsi, PGW::Session{imsi, std::chrono::steady_clock::now()}));
+    }
+    const PGW::IMSI &first = *blacklist.begin();
+    ASSERT_FALSE(blacklist_storage->_create(first, PGW::Session{first, std::chrono::steady_clock::now()}));
+    ASSERT_FALSE(blacklist_storage->_create(first, PGW::Session{first, std::chrono::steady_clock::now()}));
+
+    blacklist_stop.store(true);
+    blacklist_storage.reset();
+    blacklist_cdr->flush();
+
+    size_t rejected = 0;
+    for (const auto &entry : std::filesystem::directory_iterator("test_cdr"))
+    {
+        if (entry.path().filename().string().find("test_storage_blacklist_") != 0)
+            continue;
+
+        std::ifstream file(entry.path());
+        std::string line;
+        while (std::getline(file, line))
+        {
+            if (line.find("rejected, IMSI blacklisted") != std::string::npos)
+                rejected++;
+        }
+    }
+
+    // 30 разных IMSI и два повтора первого из них подряд
+    EXPECT_EQ(rejected, 32u);
+}
+
+// Шарды создаются под Scope CPU своих владельцев, после конструктора закрепление потока прежнее
+TEST_F(SessionStorageTest, ShardPlacementRestoresAffinity)
+{
+    std::vector<int> before = IO_Utils::Thread_Placement::affinity();
+    std::vector<std::vector<int>> shard_cpus;
+    for (size_t i = 0; i < PGW::Session_Storage::amount_of_shards; ++i)
+    {
+        shard_cpus.push_back(IO_Utils::Thread_Placement::pick(before, i));
+    }
+
+    std::atomic<bool> placed_stop{false};
+    auto placed_storage = std::make_unique<PGW::Session_Storage>(
+        timeout, rate, *main_cdr, std::unordered_set<PGW::IMSI>{}, main_logger, placed_stop, false,
+        std::vector<int>{}, shard_cpus, true);
+    EXPECT_EQ(IO_Utils::Thread_Placement::affinity(), before);
+
+    PGW::IMSI imsi;
+    imsi.set_IMSI_from_str("123456789");
+    ASSERT_TRUE(placed_storage->_create(imsi, PGW::Session{imsi, std::chrono::steady_clock::now()}));
+    EXPECT_EQ(placed_storage->shard_sizes()[imsi.shard_key() % PGW::Session_Storage::amount_of_shards], 1u);
+
+    placed_stop.store(true);
+}
@@ -0,0 +1,301 @@
+#include "cdr_record.h"
+#include "cdr_time_formatter.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <map>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+// Утилита для разбора двоичных CDR журналов (cdr_format = "binary") без запуска сервера
+
+using namespace PGW;
+
+static void print_usage()
+{
+    std::fprintf(stderr,
+                 "Usage:\n"
+                 "  cdr_tool csv [-S] <file.cdr>...\n"
+                 "      convert records to CSV in the same format as the server writes,\n"
+                 "      -S adds session summary columns (first seen, last seen, updates) to every line\n"
+                 "  cdr_tool filter [-S] [-i IMSI] [-a ACTION] [-s SINCE] [-u UNTIL] <file.cdr>...\n"
+                 "      print matching records as CSV, SINCE/UNTIL as epoch seconds or \"YYYY-MM-DD HH:MM:SS\" (local time)\n"
+                 "  cdr_tool summary <file.cdr>...\n"
+                 "      print number of records per action, unique IMSI and time range\n"
+                 "  cdr_tool merge -o <out.cdr> <file.cdr>...\n"
+                 "      write all records into one binary journal in global order (by sequence number, then time)\n");
+}
+
+// Время из аргумента: секунды от начала эпохи или локальное время "YYYY-MM-DD HH:MM:SS"
+static bool parse_time(const char *str, int64_t &seconds)
+{
+    char *end = nullptr;
+    long long value = std::strtoll(str, &end, 10);
+    if (end != str && *end == '\0')
+    {
+        seconds = value;
+        return true;
+    }
+
+    std::tm time_info{};
+    const char *rest = strptime(str, "%Y-%m-%d %H:%M:%S", &time_info);
+    if (rest == nullptr || *rest != '\0')
+        return false;
+
+    time_info.tm_isdst = -1;
+    seconds = std::mktime(&time_info);
+    return true;
+}
+
+struct Filter
+{
+    std::string imsi;
+    bool has_action = false;
+    CDR_Action action = CDR_Action::created;
+    int64_t since = INT64_MIN;
+    int64_t until = INT64_MAX;
+
+    bool matches(const CDR_Record &record) const
+    {
+        if (!imsi.empty() && (imsi.size() != record.imsi_length || std::memcmp(imsi.data(), record.imsi, record.imsi_length) != 0))
+            return false;
+
+        if (has_action && record.action != action)
+            return false;
+
+        int64_t seconds = record.timestamp_ns / 1'000'000'000;
+        return seconds >= since && seconds <= until;
+    }
+};
+
+template <typename F>
+static bool for_each_record(const std::vector<std::string> &files, F &&fn)
+{
+    bool ok = true;
+
+    for (const auto &path : files)
+    {
+        CDR_Binary_Reader reader{path};
+        if (!reader.is_valid())
+        {
+            std::fprintf(stderr, "%s: not a binary CDR journal or unsupported version\n", path.c_str());
+            ok = false;
+            continue;
+        }
+
+        CDR_Record record;
+        while (reader.next(record))
+        {
+            fn(record);
+        }
+
+        if (reader.skipped_records() > 0)
+        {
+            std::fprintf(stderr, "%s: %zu corrupted records skipped\n", path.c_str(), reader.skipped_records());
+        }
+    }
+
+    return ok;
+}
+
+// Набор колонок один на весь вывод: без with_summary итоги сессий не печатаются, с ним обычные записи
+// получают пустые колонки итога, как в журнале режима aggregated
+static bool print_csv(const std::vector<std::string> &files, const Filter &filter, bool with_summary)
+{
+    CDR_Time_Formatter formatter;
+    char line[CDR_CSV_LINE_SIZE];
+
+    return for_each_record(files, [&](const CDR_Record &record)
+                           {
+                               if (!filter.matches(record))
+                                   return;
+
+                               size_t length = format_csv_line(record, formatter, line, false, with_summary);
+                               std::fwrite(line, 1, length, stdout); });
+}
+
+static bool print_summary(const std::vector<std::string> &files)
+{
+    size_t total = 0;
+    size_t per_action[CDR_ACTIONS_COUNT] = {};
+    std::unordered_set<std::string> imsis;
+    int64_t first = INT64_MAX;
+    int64_t last = INT64_MIN;
+
+    bool ok = for_each_record(files, [&](const CDR_Record &record)
+                              {
+                                  total++;
+                                  per_action[(size_t)record.action]++;
+                                  imsis.emplace(record.imsi, record.imsi_length);
+
+                                  if (record.timestamp_ns < first)
+                                      first = record.timestamp_ns;
+                                  if (record.timestamp_ns > last)
+                                      last = record.timestamp_ns; });
+
+    std::printf("records: %zu\n", total);
+    std::printf("unique IMSI: %zu\n", imsis.size());
+
+    if (total > 0)
+    {
+        CDR_Time_Formatter formatter;
+        std::printf("first: %.*s\n", (int)CDR_Time_Formatter::DATE_TIME_SIZE, formatter.format(first / 1'000'000'000));
+        std::printf("last: %.*s\n", (int)CDR_Time_Formatter::DATE_TIME_SIZE, formatter.format(last / 1'000'000'000));
+    }
+
+    for (size_t i = 0; i < CDR_ACTIONS_COUNT; ++i)
+    {
+        std::printf("%s: %zu\n", cdr_action_to_str((CDR_Action)i), per_action[i]);
+    }
+
+    return ok;
+}
+
+static bool merge(const std::vector<std::string> &files, const std::string &output)
+{
+    // Записи разных потоков перемешаны в пределах файла, поэтому все они сортируются в памяти
+    // У файлов версии 1 номера нет (0): они упорядочиваются по времени, записи с номером - по номеру,
+    // а затем обе последовательности сливаются по времени
+    std::vector<CDR_Record> numbered, unnumbered;
+    bool ok = for_each_record(files, [&](const CDR_Record &record)
+                              { (record.sequence != 0 ? numbered : unnumbered).push_back(record); });
+
+    std::stable_sort(numbered.begin(), numbered.end(), [](const CDR_Record &a, const CDR_Record &b)
+                     { return a.sequence < b.sequence; });
+    std::stable_sort(unnumbered.begin(), unnumbered.end(), [](const CDR_Record &a, const CDR_Record &b)
+                     { return a.timestamp_ns < b.timestamp_ns; });
+
+    // Пропуски в номерах означают, что часть записей потеряна (политика drop) или не все файлы переданы
+    size_t gaps = 0;
+    for (size_t i = 1; i < numbered.size(); ++i)
+    {
+        if (numbered[i].sequence > numbered[i - 1].sequence + 1)
+            gaps++;
+    }
+
+    // Записи с номером идут по номеру и при слиянии не переставляются между собой, даже если время у соседних
+    // немного расходится с номером (грубые часы разных потоков)
+    std::vector<CDR_Record> records;
+    records.reserve(numbered.size() + unnumbered.size());
+    size_t n = 0, u = 0;
+    while (n < numbered.size() || u < unnumbered.size())
+    {
+        if (u == unnumbered.size() || (n < numbered.size() && numbered[n].timestamp_ns <= unnumbered[u].timestamp_ns))
+            records.push_back(numbered[n++]);
+        else
+            records.push_back(unnumbered[u++]);
+    }
+
+    std::FILE *out = std::fopen(output.c_str(), "wb");
+    if (out == nullptr)
+    {
+        std::fprintf(stderr, "%s: can't create output file\n", output.c_str());
+        return false;
+    }
+
+    CDR_File_Header header = make_cdr_file_header();
+    bool written = std::fwrite(&header, sizeof(header), 1, out) == 1;
+
+    for (const auto &record : records)
+    {
+        CDR_Binary_Record binary;
+        encode_binary_record(record, binary);
+        written = written && std::fwrite(&binary, sizeof(binary), 1, out) == 1;
+    }
+
+    written = std::fclose(out) == 0 && written;
+    if (!written)
+    {
+        std::fprintf(stderr, "%s: write error\n", output.c_str());
+        return false;
+    }
+
+    std::fprintf(stderr, "%zu records merged, %zu gaps in sequence\n", records.size(), gaps);
+
+    return ok;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 3)
+    {
+        print_usage();
+        return -1;
+    }
+
+    std::string command = argv[1];
+    Filter filter;
+    std::string output;
+    bool with_summary = false;
+    std::vector<std::string> files;
+
+    for (int i = 2; i < argc; ++i)
+    {
+        if ((command == "csv" || command == "filter") && !std::strcmp(argv[i], "-S"))
+        {
+            with_summary = true;
+        }
+        else if (command == "filter" && !std::strcmp(argv[i], "-i") && argc > i + 1)
+        {
+            filter.imsi = argv[++i];
+        }
+        else if (command == "filter" && !std::strcmp(argv[i], "-a") && argc > i + 1)
+        {
+            i++;
+            if (!cdr_action_from_str(argv[i], std::strlen(argv[i]), filter.action))
+            {
+                std::fprintf(stderr, "Unknown action %s\n", argv[i]);
+                return -1;
+            }
+            filter.has_action = true;
+        }
+        else if (command == "filter" && (!std::strcmp(argv[i], "-s") || !std::strcmp(argv[i], "-u")) && argc > i + 1)
+        {
+            bool since = !std::strcmp(argv[i], "-s");
+            i++;
+            if (!parse_time(argv[i], since ? filter.since : filter.until))
+            {
+                std::fprintf(stderr, "Wrong time %s\n", argv[i]);
+                return -1;
+            }
+        }
+        else if (command == "merge" && !std::strcmp(argv[i], "-o") && argc > i + 1)
+        {
+            output = argv[++i];
+        }
+        else
+        {
+            files.push_back(argv[i]);
+        }
+    }
+
+    if (files.empty())
+    {
+        print_usage();
+        return -1;
+    }
+
+    bool ok;
+    if (command == "csv" || command == "filter")
+    {
+        ok = print_csv(files, filter, with_summary);
+    }
+    else if (command == "summary")
+    {
+        ok = print_summary(files);
+    }
+    else if (command == "merge" && !output.empty())
+    {
+        ok = merge(files, output);
+    }
+    else
+    {
+        print_usage();
+        return -1;
+    }
+
+    return ok ? 0 : 1;
+}